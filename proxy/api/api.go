@@ -24,7 +24,10 @@ import (
 //
 // List of changes:
 // • version 1: initial version released with Clear Containers 2.1
-const Version = 1
+// • version 2: request IDs (see Hello) and the batch payload
+// • version 3: the register payload
+// • version 4: the console payload
+const Version = 4
 
 // The Hello payload is issued first after connecting to the proxy socket.
 // It is used to let the proxy know about a new container on the system along
@@ -33,6 +36,19 @@ const Version = 1
 // Console can be used to indicate the path of a socket linked to the VM
 // console. The proxy can output this data when asked for verbose output.
 //
+// Restore indicates the VM has been restored from a checkpoint (or cloned
+// from a VM template) rather than booted: hyperstart is already running and will not send its READY message
+// again, so the proxy must not wait for it.
+//
+// RequestIDs asks the proxy to accept request IDs on this connection. Once
+// the proxy has acknowledged it in HelloResult, requests can be tagged with an
+// ID (see WriteMessageWithID) and several of them can be in flight at the same
+// time. The response to a tagged request is tagged with the same ID and
+// responses can come back in a different order than the requests were sent.
+// hello, attach, bye and batch requests are still handled one at a time, in
+// the order they were received. Requests without an ID are always answered in
+// order.
+//
 //  {
 //    "id": "hello",
 //    "data": {
@@ -46,6 +62,8 @@ type Hello struct {
 	CtlSerial   string `json:"ctlSerial"`
 	IoSerial    string `json:"ioSerial"`
 	Console     string `json:"console,omitempty"`
+	Restore     bool   `json:"restore,omitempty"`
+	RequestIDs  bool   `json:"requestIds,omitempty"`
 }
 
 // HelloResult is the result from a successful Hello.
@@ -53,18 +71,57 @@ type Hello struct {
 //  {
 //    "success": true,
 //    "data": {
-//      "version": 1
+//      "version": 4,
+//      "requestIds": true
 //    }
 //  }
 type HelloResult struct {
 	// The version of the proxy protocol
 	Version int `json:"version"`
+	// Request IDs can be used on this connection
+	RequestIDs bool `json:"requestIds,omitempty"`
+}
+
+// The Register payload lets the runtime hand over the hyperstart channels of a
+// VM as soon as the hypervisor has been started, before the VM has booted.
+// The proxy connects to the channels and waits for hyperstart to be ready in
+// the background, while the runtime carries on setting up the container. The
+// hello for the same container, sent later, then binds to the VM without
+// having to wait for the boot to complete, or waits for what's left of it.
+//
+// ContainerID, CtlSerial, IoSerial, Console and Restore have the same meaning
+// as in Hello, and the hello binding to the registered VM must give the same
+// ContainerID, CtlSerial and IoSerial. Timeout is the time, in milliseconds,
+// the proxy waits for the hypervisor to create the sockets and for hyperstart
+// to be ready. It defaults to 30s.
+//
+// register doesn't associate the client with the VM and returns straight
+// away: errors connecting to the VM are reported to the hello.
+//
+//  {
+//    "id": "register",
+//    "data": {
+//      "containerId": "756535dc6e9ab9b560f84c8...",
+//      "ctlSerial": "/tmp/sh.hyper.channel.0.sock",
+//      "ioSerial": "/tmp/sh.hyper.channel.1.sock",
+//      "timeout": 30000
+//    }
+//  }
+type Register struct {
+	ContainerID string `json:"containerId"`
+	CtlSerial   string `json:"ctlSerial"`
+	IoSerial    string `json:"ioSerial"`
+	Console     string `json:"console,omitempty"`
+	Restore     bool   `json:"restore,omitempty"`
+	Timeout     int    `json:"timeout,omitempty"`
 }
 
 // The Attach payload can be used to associate clients to an already known VM.
 // attach cannot be issued if a hello for this container hasn't been issued
 // beforehand.
 //
+// RequestIDs has the same meaning as in Hello.
+//
 //  {
 //    "id": "attach",
 //    "data": {
@@ -73,6 +130,7 @@ type HelloResult struct {
 //  }
 type Attach struct {
 	ContainerID string `json:"containerId"`
+	RequestIDs  bool   `json:"requestIds,omitempty"`
 }
 
 // AttachResult is the result from a successful Attach.
@@ -80,12 +138,14 @@ type Attach struct {
 //  {
 //    "success": true,
 //    "data": {
-//      "version": 1
+//      "version": 4
 //    }
 //  }
 type AttachResult struct {
 	// The version of the proxy protocol
 	Version int `json:"version"`
+	// Request IDs can be used on this connection
+	RequestIDs bool `json:"requestIds,omitempty"`
 }
 
 // The Bye payload does the opposite of what hello does, indicating to the
@@ -170,3 +230,137 @@ type Hyper struct {
 	HyperName string          `json:"hyperName"`
 	Data      json.RawMessage `json:"data,omitempty"`
 }
+
+// The Stats payload asks the proxy for statistics about the VMs and I/O
+// sessions it handles and the commands it has served. It doesn't need to be
+// preceded by a hello or an attach.
+//
+//  {
+//    "id": "stats"
+//  }
+type Stats struct {
+}
+
+// StatsResult is the result from a successful Stats.
+//
+// Metrics holds the statistics in the Prometheus text exposition format
+// (https://prometheus.io/docs/instrumenting/exposition_formats/), one sample
+// per line. Samples are labelled with the VM containerId ("vm"), the ioBase
+// of the I/O session ("session") and the direction of the data ("direction",
+// "to_client" or "to_vm") where relevant.
+//
+//  {
+//    "success": true,
+//    "data": {
+//      "metrics": "# HELP cc_proxy_goroutines Number of goroutines...\n..."
+//    }
+//  }
+type StatsResult struct {
+	Metrics string `json:"metrics"`
+}
+
+// The Console payload gives the last lines written on the console of a VM.
+// The proxy keeps them, in a buffer of limited size, for every VM it's been
+// given the console socket of (see Hello). It doesn't need to be preceded by a
+// hello or an attach.
+//
+// Timestamps prefixes each line with the time it was read by the proxy, in
+// the RFC 3339 format.
+//
+// When Follow is set, the response is followed by a file descriptor, as for
+// allocateIO. The proxy writes the lines it has kept to this file descriptor,
+// then the console output as it comes, until the VM goes away or the client
+// closes its end.
+//
+//  {
+//    "id": "console",
+//    "data": {
+//      "containerId": "756535dc6e9ab9b560f84c8...",
+//      "timestamps": true
+//    }
+//  }
+type Console struct {
+	ContainerID string `json:"containerId"`
+	Timestamps  bool   `json:"timestamps,omitempty"`
+	Follow      bool   `json:"follow,omitempty"`
+}
+
+// ConsoleResult is the result from a successful Console without Follow.
+//
+// Output holds the console lines, each terminated by '\n'. Dropped is the
+// number of lines discarded so far to make room for newer ones.
+//
+//  {
+//    "success": true,
+//    "data": {
+//      "output": "2017-03-08T10:32:05.123456789Z [    0.000000] Linux...\n...",
+//      "dropped": 0
+//    }
+//  }
+type ConsoleResult struct {
+	Output  string `json:"output"`
+	Dropped uint64 `json:"dropped"`
+}
+
+// The Batch payload runs a list of requests, in order, in a single round trip
+// to the proxy. It doesn't need to be preceded by a hello or an attach, so a
+// client can, for instance, register a VM, start its pod and allocate I/O
+// streams with one batch. Batches cannot be nested.
+//
+// Running the batch stops at the first request that fails, in which case the
+// batch fails as well. The result of a batch is encoded as a BatchResult.
+//
+// The file descriptors returned by the requests of the batch (see
+// AllocateIoResult) follow the batch response, in the order of the requests.
+//
+//  {
+//    "id": "batch",
+//    "data": {
+//      "requests": [
+//        {
+//          "id": "hello",
+//          "data": {
+//            "containerId": "756535dc6e9ab9b560f84c8...",
+//            "ctlSerial": "/tmp/sh.hyper.channel.0.sock",
+//            "ioSerial": "/tmp/sh.hyper.channel.1.sock"
+//          }
+//        },
+//        {
+//          "id": "allocateIO",
+//          "data": {
+//            "nStreams": 2
+//          }
+//        }
+//      ]
+//    }
+//  }
+type Batch struct {
+	Requests []Request `json:"requests"`
+}
+
+// BatchResult is the result of a Batch. It holds the responses of the
+// requests that have been run, including the one that failed if the batch
+// has failed.
+//
+//  {
+//    "success": true,
+//    "data": {
+//      "results": [
+//        {
+//          "success": true,
+//          "data": {
+//            "version": 4
+//          }
+//        },
+//        {
+//          "success": true,
+//          "data": {
+//            "ioBase": 1234
+//          }
+//        }
+//      ]
+//    }
+//  }
+type BatchResult struct {
+	Results []Response `json:"results"`
+}
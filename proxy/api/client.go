@@ -19,6 +19,7 @@ import (
 	"errors"
 	"net"
 	"os"
+	"time"
 )
 
 // The Client struct can be used to issue proxy API calls with a convenient
@@ -41,10 +42,12 @@ func (client *Client) Close() {
 	client.conn.Close()
 }
 
-func (client *Client) sendPayload(id string, payload interface{}) (*Response, error) {
+// NewRequest creates a Request for the payload id, payload being its data (see
+// the payload descriptions). payload can be nil.
+func NewRequest(id string, payload interface{}) (*Request, error) {
 	var err error
 
-	req := Request{}
+	req := &Request{}
 	req.ID = id
 	if payload != nil {
 		if req.Data, err = json.Marshal(payload); err != nil {
@@ -52,10 +55,21 @@ func (client *Client) sendPayload(id string, payload interface{}) (*Response, er
 		}
 	}
 
-	if err := WriteMessage(client.conn, &req); err != nil {
+	return req, nil
+}
+
+func (client *Client) sendPayload(id string, payload interface{}) (*Response, error) {
+	req, err := NewRequest(id, payload)
+	if err != nil {
+		return nil, err
+	}
+
+	if err := WriteMessage(client.conn, req); err != nil {
 		return nil, err
 	}
 
+	// The connection isn't buffered as a fd can follow the response (see
+	// ReadFd).
 	resp := Response{}
 	if err := ReadMessage(client.conn, &resp); err != nil {
 		return nil, err
@@ -82,6 +96,7 @@ func errorFromResponse(resp *Response) error {
 // the Hello payload for more details.
 type HelloOptions struct {
 	Console string
+	Restore bool
 }
 
 // HelloReturn contains the return values from Hello. See the Hello and
@@ -101,6 +116,7 @@ func (client *Client) Hello(containerID, ctlSerial, ioSerial string,
 
 	if options != nil {
 		hello.Console = options.Console
+		hello.Restore = options.Restore
 	}
 
 	resp, err := client.sendPayload("hello", &hello)
@@ -119,6 +135,37 @@ func (client *Client) Hello(containerID, ctlSerial, ioSerial string,
 	return ret, errorFromResponse(resp)
 }
 
+// RegisterOptions holds extra arguments one can pass to the Register
+// function. See the Register payload for more details.
+type RegisterOptions struct {
+	Console string
+	Restore bool
+	Timeout time.Duration
+}
+
+// Register wraps the Register payload (see payload description for more details)
+func (client *Client) Register(containerID, ctlSerial, ioSerial string,
+	options *RegisterOptions) error {
+	register := Register{
+		ContainerID: containerID,
+		CtlSerial:   ctlSerial,
+		IoSerial:    ioSerial,
+	}
+
+	if options != nil {
+		register.Console = options.Console
+		register.Restore = options.Restore
+		register.Timeout = int(options.Timeout / time.Millisecond)
+	}
+
+	resp, err := client.sendPayload("register", &register)
+	if err != nil {
+		return err
+	}
+
+	return errorFromResponse(resp)
+}
+
 // AttachOptions holds extra arguments one can pass to the Attach function. See
 // the Attach payload for more details.
 type AttachOptions struct {
@@ -225,3 +272,144 @@ func (client *Client) Bye(containerID string) error {
 
 	return errorFromResponse(resp)
 }
+
+// Stats wraps the Stats payload (see payload description for more details).
+// It returns the statistics in the Prometheus text exposition format.
+func (client *Client) Stats() (string, error) {
+	resp, err := client.sendPayload("stats", nil)
+	if err != nil {
+		return "", err
+	}
+
+	if err := errorFromResponse(resp); err != nil {
+		return "", err
+	}
+
+	val, ok := resp.Data["metrics"]
+	if !ok {
+		return "", errors.New("stats: no metrics in response")
+	}
+	metrics, ok := val.(string)
+	if !ok {
+		return "", errors.New("stats: malformed metrics in response")
+	}
+
+	return metrics, nil
+}
+
+// ConsoleOptions holds extra arguments one can pass to the Console and
+// FollowConsole functions. See the Console payload for more details.
+type ConsoleOptions struct {
+	Timestamps bool
+}
+
+// Console wraps the Console payload (see payload description for more
+// details). It returns the console output kept by the proxy and the number of
+// lines that had to be discarded.
+func (client *Client) Console(containerID string, options *ConsoleOptions) (string, uint64, error) {
+	console := Console{
+		ContainerID: containerID,
+	}
+	if options != nil {
+		console.Timestamps = options.Timestamps
+	}
+
+	resp, err := client.sendPayload("console", &console)
+	if err != nil {
+		return "", 0, err
+	}
+
+	if err := errorFromResponse(resp); err != nil {
+		return "", 0, err
+	}
+
+	output, ok := resp.Data["output"].(string)
+	if !ok {
+		return "", 0, errors.New("console: no output in response")
+	}
+	dropped, ok := resp.Data["dropped"].(float64)
+	if !ok {
+		return "", 0, errors.New("console: no dropped in response")
+	}
+
+	return output, uint64(dropped), nil
+}
+
+// FollowConsole wraps the Console payload with Follow set (see payload
+// description for more details). The console output can be read from the
+// returned file, which the caller has to close.
+func (client *Client) FollowConsole(containerID string, options *ConsoleOptions) (*os.File, error) {
+	console := Console{
+		ContainerID: containerID,
+		Follow:      true,
+	}
+	if options != nil {
+		console.Timestamps = options.Timestamps
+	}
+
+	resp, err := client.sendPayload("console", &console)
+	if err != nil {
+		return nil, err
+	}
+
+	if err := errorFromResponse(resp); err != nil {
+		return nil, err
+	}
+
+	fd, err := ReadFd(client.conn)
+	if err != nil {
+		return nil, errors.New("console: couldn't read fd")
+	}
+
+	return os.NewFile(uintptr(fd), ""), nil
+}
+
+// Batch wraps the Batch payload (see payload description for more details).
+//
+// It returns the responses of the requests that have been run and the files
+// passed along with them, one per successful allocateIO request. Those are
+// returned even when the batch fails.
+func (client *Client) Batch(requests []Request) ([]Response, []*os.File, error) {
+	batch := Batch{
+		Requests: requests,
+	}
+
+	resp, err := client.sendPayload("batch", &batch)
+	if err != nil {
+		return nil, nil, err
+	}
+
+	result := BatchResult{}
+	if resp.Data != nil {
+		// Going through JSON again is the simplest way to get a typed
+		// result out of Response.Data
+		data, err := json.Marshal(resp.Data)
+		if err != nil {
+			return nil, nil, err
+		}
+		if err := json.Unmarshal(data, &result); err != nil {
+			return nil, nil, err
+		}
+	}
+
+	var files []*os.File
+	for i := range result.Results {
+		if i >= len(requests) {
+			break
+		}
+		if requests[i].ID != "allocateIO" || !result.Results[i].Success {
+			continue
+		}
+
+		newFd, err := ReadFd(client.conn)
+		if err != nil {
+			for _, f := range files {
+				f.Close()
+			}
+			return nil, nil, errors.New("batch: couldn't read fd")
+		}
+		files = append(files, os.NewFile(uintptr(newFd), ""))
+	}
+
+	return result.Results, files, errorFromResponse(resp)
+}
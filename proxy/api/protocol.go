@@ -15,18 +15,30 @@
 package api
 
 import (
+	"bytes"
 	"encoding/binary"
 	"encoding/json"
 	"errors"
 	"fmt"
 	"io"
+	"sync"
 )
 
-const headerLength = 8 // in bytes
+const (
+	headerLength    = 8 // in bytes
+	requestIDLength = 4 // in bytes
+)
+
+// Header flags
+const (
+	// The header is followed by a 32 bits request ID
+	flagRequestID = 1 << 0
+)
 
 type header struct {
 	length uint32
 	flags  uint32
+	id     uint32
 }
 
 const maxPayloadLength = 1 * 1024 * 1024
@@ -35,12 +47,16 @@ func (hdr *header) validate() error {
 	if hdr.length > maxPayloadLength {
 		return fmt.Errorf("payload size too big: %d (max: %d)", hdr.length, maxPayloadLength)
 	}
-	if hdr.flags != 0 {
+	if hdr.flags&^flagRequestID != 0 {
 		return fmt.Errorf("unexpected flags: 0x%x", hdr.flags)
 	}
 	return nil
 }
 
+func (hdr *header) hasID() bool {
+	return hdr.flags&flagRequestID != 0
+}
+
 // A Request is a JSON message sent from a client to the proxy. This message
 // embed a payload identified by "id". A payload can have data associated with
 // it. It's useful to think of Request as an RPC call with "id" as function
@@ -65,79 +81,160 @@ type Response struct {
 	Data    map[string]interface{} `json:"data,omitempty"`
 }
 
+// Buffers holding messages are recycled through bufferPool to not allocate
+// memory for each message. Buffers that have grown bigger than
+// maxPooledBufferSize to hold an unusually large message aren't kept around.
+const maxPooledBufferSize = 64 * 1024
+
+var bufferPool = sync.Pool{
+	New: func() interface{} {
+		return new(bytes.Buffer)
+	},
+}
+
+func getBuffer() *bytes.Buffer {
+	buf := bufferPool.Get().(*bytes.Buffer)
+	buf.Reset()
+	return buf
+}
+
+func putBuffer(buf *bytes.Buffer) {
+	if buf.Cap() > maxPooledBufferSize {
+		return
+	}
+	bufferPool.Put(buf)
+}
+
 // ReadMessage reads a message from reader. A message is either a Request or a
 // Response
+//
+// The header and payload of a message are read separately, so reader is
+// better buffered (see bufio.Reader). Buffering must not be used when file
+// descriptors can be passed along with the messages (see ReadFd), which is the
+// case for the client side of the protocol.
 func ReadMessage(reader io.Reader, msg interface{}) error {
-	buf := make([]byte, headerLength)
-	n, err := reader.Read(buf)
+	_, err := readMessage(reader, msg)
+	return err
+}
+
+// ReadMessageWithID reads a message from reader like ReadMessage does, also
+// returning the request ID carried by the message header. hasID is false when
+// the message doesn't have a request ID.
+func ReadMessageWithID(reader io.Reader, msg interface{}) (id uint32, hasID bool, err error) {
+	hdr, err := readMessage(reader, msg)
 	if err != nil {
-		return err
+		return 0, false, err
+	}
+	return hdr.id, hdr.hasID(), nil
+}
+
+func readMessage(reader io.Reader, msg interface{}) (header, error) {
+	buf := getBuffer()
+	defer putBuffer(buf)
+
+	buf.Grow(headerLength + requestIDLength)
+	hdrBuf := buf.Bytes()[:headerLength]
+	n, err := io.ReadFull(reader, hdrBuf)
+	if err != nil {
+		if err == io.ErrUnexpectedEOF {
+			return header{}, errors.New("couldn't read the full header")
+		}
+		return header{}, err
 	}
 	if n != headerLength {
-		return errors.New("couldn't read the full header")
+		return header{}, errors.New("couldn't read the full header")
 	}
 
 	hdr := header{
-		length: binary.BigEndian.Uint32(buf[0:4]),
-		flags:  binary.BigEndian.Uint32(buf[4:8]),
+		length: binary.BigEndian.Uint32(hdrBuf[0:4]),
+		flags:  binary.BigEndian.Uint32(hdrBuf[4:8]),
 	}
 
 	if err := hdr.validate(); err != nil {
-		return err
+		return header{}, err
 	}
 
-	received := 0
-	need := int(hdr.length)
-	data := make([]byte, need)
-	for received < need {
-		n, err := reader.Read(data[received:need])
-		if err != nil {
-			return err
+	if hdr.hasID() {
+		idBuf := buf.Bytes()[:requestIDLength]
+		if _, err := io.ReadFull(reader, idBuf); err != nil {
+			return header{}, errors.New("couldn't read the request ID")
 		}
+		hdr.id = binary.BigEndian.Uint32(idBuf)
+	}
 
-		received += n
+	need := int(hdr.length)
+	buf.Grow(need)
+	data := buf.Bytes()[:need]
+	if _, err := io.ReadFull(reader, data); err != nil {
+		return header{}, err
 	}
 
+	// The payload buffer can be reused once unmarshalled, json.RawMessage
+	// fields get a copy of the data.
 	err = json.Unmarshal(data, msg)
 	if err != nil {
-		return err
+		return header{}, err
 	}
 
-	return nil
+	return hdr, nil
 }
 
 // WriteMessage writes a message into writer. A message is either a Request for
 // a Response
+//
+// The header and payload are written with a single Write() call.
 func WriteMessage(writer io.Writer, msg interface{}) error {
-	data, err := json.Marshal(msg)
-	if err != nil {
-		return err
-	}
+	return writeMessage(writer, msg, &header{})
+}
 
-	hdr := header{
-		length: uint32(len(data)),
+// WriteMessageWithID writes a message into writer like WriteMessage does,
+// tagging it with the request ID id.
+//
+// Request IDs have to be negotiated with the proxy first (see Hello). The
+// proxy tags the response to a request with the ID of that request.
+func WriteMessageWithID(writer io.Writer, msg interface{}, id uint32) error {
+	return writeMessage(writer, msg, &header{
+		flags: flagRequestID,
+		id:    id,
+	})
+}
+
+func writeMessage(writer io.Writer, msg interface{}, hdr *header) error {
+	buf := getBuffer()
+	defer putBuffer(buf)
+
+	// Make room for the header, filled once we know the payload length
+	var hdrBuf [headerLength + requestIDLength]byte
+	hdrLen := headerLength
+	if hdr.hasID() {
+		hdrLen += requestIDLength
 	}
-	if err := hdr.validate(); err != nil {
+	buf.Write(hdrBuf[:hdrLen])
+
+	if err := json.NewEncoder(buf).Encode(msg); err != nil {
 		return err
 	}
+	// Encode() terminates the JSON value with a new line
+	buf.Truncate(buf.Len() - 1)
 
-	buf := make([]byte, headerLength)
-	binary.BigEndian.PutUint32(buf[0:4], hdr.length)
-
-	n, err := writer.Write(buf)
-	if err != nil {
+	hdr.length = uint32(buf.Len() - hdrLen)
+	if err := hdr.validate(); err != nil {
 		return err
 	}
-	if n != headerLength {
-		return errors.New("couldn't write the full header")
+
+	data := buf.Bytes()
+	binary.BigEndian.PutUint32(data[0:4], hdr.length)
+	binary.BigEndian.PutUint32(data[4:8], hdr.flags)
+	if hdr.hasID() {
+		binary.BigEndian.PutUint32(data[8:12], hdr.id)
 	}
 
-	n, err = writer.Write(data)
+	n, err := writer.Write(data)
 	if err != nil {
 		return err
 	}
 	if n != len(data) {
-		return errors.New("couldn't write the full data")
+		return errors.New("couldn't write the full message")
 	}
 
 	return nil
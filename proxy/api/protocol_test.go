@@ -15,6 +15,8 @@
 package api
 
 import (
+	"bytes"
+	"encoding/json"
 	"testing"
 
 	"github.com/stretchr/testify/assert"
@@ -34,7 +36,11 @@ func TestHeaderValidate(t *testing.T) {
 			valid: false,
 		},
 		{
-			hdr:   header{length: 64, flags: 0x1},
+			hdr:   header{length: 64, flags: flagRequestID},
+			valid: true,
+		},
+		{
+			hdr:   header{length: 64, flags: 0x2},
 			valid: false,
 		},
 	}
@@ -45,3 +51,71 @@ func TestHeaderValidate(t *testing.T) {
 		assert.Equal(t, test.valid, err == nil)
 	}
 }
+
+func TestMessageWithID(t *testing.T) {
+	var buf bytes.Buffer
+
+	// A message written with an ID is 4 bytes longer than one without
+	err := WriteMessage(&buf, &benchRequest)
+	assert.Nil(t, err)
+	noIDLength := buf.Len()
+
+	buf.Reset()
+	err = WriteMessageWithID(&buf, &benchRequest, 0xdeadbeef)
+	assert.Nil(t, err)
+	assert.Equal(t, noIDLength+requestIDLength, buf.Len())
+
+	req := Request{}
+	id, hasID, err := ReadMessageWithID(&buf, &req)
+	assert.Nil(t, err)
+	assert.True(t, hasID)
+	assert.Equal(t, uint32(0xdeadbeef), id)
+	assert.Equal(t, benchRequest.ID, req.ID)
+	assert.Equal(t, benchRequest.Data, req.Data)
+
+	// Messages without an ID can still be read
+	buf.Reset()
+	err = WriteMessage(&buf, &benchRequest)
+	assert.Nil(t, err)
+	_, hasID, err = ReadMessageWithID(&buf, &req)
+	assert.Nil(t, err)
+	assert.False(t, hasID)
+}
+
+var benchRequest = Request{
+	ID:   "hyper",
+	Data: json.RawMessage(`{"hyperName":"startpod","data":{"hostname":"testhostname","shareDir":"rootfs"}}`),
+}
+
+func BenchmarkWriteMessage(b *testing.B) {
+	var buf bytes.Buffer
+
+	b.ReportAllocs()
+	for i := 0; i < b.N; i++ {
+		buf.Reset()
+		if err := WriteMessage(&buf, &benchRequest); err != nil {
+			b.Fatal(err)
+		}
+	}
+	b.SetBytes(int64(buf.Len()))
+}
+
+func BenchmarkReadMessage(b *testing.B) {
+	var buf bytes.Buffer
+
+	if err := WriteMessage(&buf, &benchRequest); err != nil {
+		b.Fatal(err)
+	}
+	msg := buf.Bytes()
+	reader := bytes.NewReader(msg)
+
+	b.SetBytes(int64(len(msg)))
+	b.ReportAllocs()
+	for i := 0; i < b.N; i++ {
+		reader.Reset(msg)
+		req := Request{}
+		if err := ReadMessage(reader, &req); err != nil {
+			b.Fatal(err)
+		}
+	}
+}
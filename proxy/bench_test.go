@@ -0,0 +1,406 @@
+// Copyright (c) 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package main
+
+import (
+	"bufio"
+	"encoding/binary"
+	"fmt"
+	"io"
+	"net"
+	"os"
+	"path/filepath"
+	"sync"
+	"testing"
+	"time"
+
+	"github.com/01org/cc-oci-runtime/proxy/api"
+
+	hyper "github.com/hyperhq/runv/hyperstart/api/json"
+)
+
+// The hyperstart mock logs every single operation and asserts through a
+// *testing.T, which makes it unsuitable for benchmarks. benchHyperstart is a
+// bare-bones replacement: it sends READY on the ctl channel and exposes the
+// I/O channel connection.
+type benchHyperstart struct {
+	ctlPath, ioPath         string
+	ctlListener, ioListener *net.UnixListener
+	ctl, io                 net.Conn
+	connected               sync.WaitGroup
+}
+
+var benchHyperstartID = 0
+
+func newBenchHyperstart(b *testing.B) *benchHyperstart {
+	benchHyperstartID++
+	prefix := filepath.Join(os.TempDir(),
+		fmt.Sprintf("bench.hyper.%d.%d", os.Getpid(), benchHyperstartID))
+
+	h := &benchHyperstart{
+		ctlPath: prefix + ".0.sock",
+		ioPath:  prefix + ".1.sock",
+	}
+
+	listen := func(path string) *net.UnixListener {
+		l, err := net.ListenUnix("unix", &net.UnixAddr{Name: path, Net: "unix"})
+		if err != nil {
+			b.Fatal(err)
+		}
+		return l
+	}
+	h.ctlListener = listen(h.ctlPath)
+	h.ioListener = listen(h.ioPath)
+
+	h.connected.Add(2)
+	go func() {
+		defer h.connected.Done()
+
+		c, err := h.ctlListener.Accept()
+		if err != nil {
+			return
+		}
+		h.ctl = c
+
+		ready := make([]byte, 8)
+		binary.BigEndian.PutUint32(ready[:], uint32(hyper.INIT_READY))
+		binary.BigEndian.PutUint32(ready[4:], uint32(len(ready)))
+		c.Write(ready)
+	}()
+	go func() {
+		defer h.connected.Done()
+
+		c, err := h.ioListener.Accept()
+		if err != nil {
+			return
+		}
+		h.io = c
+	}()
+
+	return h
+}
+
+func (h *benchHyperstart) Stop() {
+	h.ctlListener.Close()
+	h.ioListener.Close()
+	h.connected.Wait()
+	if h.ctl != nil {
+		h.ctl.Close()
+	}
+	if h.io != nil {
+		h.io.Close()
+	}
+	os.Remove(h.ctlPath)
+	os.Remove(h.ioPath)
+}
+
+// benchProxy is an in-process proxy serving a single client connection.
+type benchProxy struct {
+	proxy  *proxy
+	client *api.Client
+	conn   net.Conn
+	wg     sync.WaitGroup
+}
+
+func newBenchProxy(b *testing.B) *benchProxy {
+	proto := newProtocol()
+	proto.Handle("hello", helloHandler)
+	proto.Handle("attach", attachHandler)
+	proto.Handle("bye", byeHandler)
+	proto.Handle("allocateIO", allocateIoHandler)
+	proto.Handle("hyper", hyperHandler)
+
+	clientConn, proxyConn, err := Socketpair()
+	if err != nil {
+		b.Fatal(err)
+	}
+
+	bp := &benchProxy{
+		proxy:  newProxy(),
+		client: api.NewClient(clientConn),
+		conn:   proxyConn,
+	}
+
+	bp.wg.Add(1)
+	go func() {
+		bp.proxy.serveNewClient(proto, proxyConn)
+		bp.wg.Done()
+	}()
+
+	return bp
+}
+
+// Register n VMs that are never connected to anything, so the lookups done
+// by the benchmarked operations happen in a populated registry.
+func (bp *benchProxy) populate(n int) {
+	for i := 0; i < n; i++ {
+		id := fmt.Sprintf("idle-%d", i)
+		bp.proxy.vms.Add(newVM(id, "", ""))
+	}
+}
+
+func (bp *benchProxy) Stop() {
+	bp.client.Close()
+	bp.conn.Close()
+	bp.wg.Wait()
+	bp.proxy.wg.Wait()
+}
+
+var benchRegisteredVMs = []int{1, 100, 1000}
+
+func BenchmarkHello(b *testing.B) {
+	for _, nVMs := range benchRegisteredVMs {
+		b.Run(fmt.Sprintf("vms=%d", nVMs), func(b *testing.B) {
+			bp := newBenchProxy(b)
+			bp.populate(nVMs - 1)
+
+			b.ResetTimer()
+			for i := 0; i < b.N; i++ {
+				b.StopTimer()
+				h := newBenchHyperstart(b)
+				id := fmt.Sprintf("bench-%d", i)
+				b.StartTimer()
+
+				if _, err := bp.client.Hello(id, h.ctlPath, h.ioPath, nil); err != nil {
+					b.Fatal(err)
+				}
+
+				b.StopTimer()
+				if err := bp.client.Bye(id); err != nil {
+					b.Fatal(err)
+				}
+				// Closing the hyperstart side makes the proxy
+				// tear the VM down
+				h.Stop()
+				b.StartTimer()
+			}
+			b.StopTimer()
+
+			bp.Stop()
+		})
+	}
+}
+
+// Size of the I/O payloads relayed by BenchmarkRelay
+const benchRelayPayload = 1024
+
+func BenchmarkRelay(b *testing.B) {
+	for _, nVMs := range benchRegisteredVMs {
+		b.Run(fmt.Sprintf("vms=%d", nVMs), func(b *testing.B) {
+			bp := newBenchProxy(b)
+			bp.populate(nVMs - 1)
+
+			h := newBenchHyperstart(b)
+			if _, err := bp.client.Hello("bench", h.ctlPath, h.ioPath, nil); err != nil {
+				b.Fatal(err)
+			}
+			h.connected.Wait()
+
+			ioBase, ioFile, err := bp.client.AllocateIo(2)
+			if err != nil {
+				b.Fatal(err)
+			}
+
+			frame := make([]byte, ioHeaderLength+benchRelayPayload)
+			binary.BigEndian.PutUint64(frame[:], ioBase)
+			binary.BigEndian.PutUint32(frame[8:], uint32(len(frame)))
+
+			b.SetBytes(benchRelayPayload)
+			b.ReportAllocs()
+			b.ResetTimer()
+
+			go func() {
+				for i := 0; i < b.N; i++ {
+					if _, err := h.io.Write(frame); err != nil {
+						return
+					}
+				}
+			}()
+
+			buf := make([]byte, len(frame))
+			for i := 0; i < b.N; i++ {
+				if _, err := io.ReadFull(ioFile, buf); err != nil {
+					b.Fatal(err)
+				}
+			}
+
+			b.StopTimer()
+
+			ioFile.Close()
+			h.Stop()
+			bp.Stop()
+		})
+	}
+}
+
+// Relay of client data (stdin) to hyperstart
+func BenchmarkRelayStdin(b *testing.B) {
+	bp := newBenchProxy(b)
+
+	h := newBenchHyperstart(b)
+	if _, err := bp.client.Hello("bench", h.ctlPath, h.ioPath, nil); err != nil {
+		b.Fatal(err)
+	}
+	h.connected.Wait()
+
+	ioBase, ioFile, err := bp.client.AllocateIo(1)
+	if err != nil {
+		b.Fatal(err)
+	}
+
+	frame := make([]byte, ioHeaderLength+benchRelayPayload)
+	binary.BigEndian.PutUint64(frame[:], ioBase)
+	binary.BigEndian.PutUint32(frame[8:], uint32(len(frame)))
+
+	b.SetBytes(benchRelayPayload)
+	b.ReportAllocs()
+	b.ResetTimer()
+
+	go func() {
+		for i := 0; i < b.N; i++ {
+			if _, err := ioFile.Write(frame); err != nil {
+				return
+			}
+		}
+	}()
+
+	buf := make([]byte, len(frame))
+	for i := 0; i < b.N; i++ {
+		if _, err := io.ReadFull(h.io, buf); err != nil {
+			b.Fatal(err)
+		}
+	}
+
+	b.StopTimer()
+
+	ioFile.Close()
+	h.Stop()
+	bp.Stop()
+}
+
+// Small I/O packets, as written by a program printing lines of text
+const benchCoalescePayload = 64
+
+func benchmarkCoalesceThroughput(b *testing.B, coalesceBytes int) {
+	bp := newBenchProxy(b)
+	bp.proxy.ioQueue.coalesceBytes = coalesceBytes
+	bp.proxy.ioQueue.coalesceDelay = 200 * time.Microsecond
+
+	h := newBenchHyperstart(b)
+	if _, err := bp.client.Hello("bench", h.ctlPath, h.ioPath, nil); err != nil {
+		b.Fatal(err)
+	}
+	h.connected.Wait()
+
+	ioBase, ioFile, err := bp.client.AllocateIo(2)
+	if err != nil {
+		b.Fatal(err)
+	}
+
+	frame := make([]byte, ioHeaderLength+benchCoalescePayload)
+	binary.BigEndian.PutUint64(frame[:], ioBase)
+	binary.BigEndian.PutUint32(frame[8:], uint32(len(frame)))
+
+	b.SetBytes(benchCoalescePayload)
+	b.ResetTimer()
+
+	go func() {
+		for i := 0; i < b.N; i++ {
+			if _, err := h.io.Write(frame); err != nil {
+				return
+			}
+		}
+	}()
+
+	// Each packet received by the client is one write() from the proxy
+	reader := bufio.NewReader(ioFile)
+	received, writes := 0, 0
+	for received < b.N*benchCoalescePayload {
+		f, err := readIoFrame(reader)
+		if err != nil {
+			b.Fatal(err)
+		}
+		received += len(f.Payload())
+		writes++
+		f.Free()
+	}
+
+	b.StopTimer()
+	b.ReportMetric(float64(writes)/(float64(received)/(1024*1024)), "writes/MB")
+
+	ioFile.Close()
+	h.Stop()
+	bp.Stop()
+}
+
+// Time for a single small packet to go through the proxy when there's nothing
+// else to merge it with
+func benchmarkCoalesceLatency(b *testing.B, coalesceBytes int) {
+	bp := newBenchProxy(b)
+	bp.proxy.ioQueue.coalesceBytes = coalesceBytes
+	bp.proxy.ioQueue.coalesceDelay = 200 * time.Microsecond
+
+	h := newBenchHyperstart(b)
+	if _, err := bp.client.Hello("bench", h.ctlPath, h.ioPath, nil); err != nil {
+		b.Fatal(err)
+	}
+	h.connected.Wait()
+
+	ioBase, ioFile, err := bp.client.AllocateIo(2)
+	if err != nil {
+		b.Fatal(err)
+	}
+
+	frame := make([]byte, ioHeaderLength+benchCoalescePayload)
+	binary.BigEndian.PutUint64(frame[:], ioBase)
+	binary.BigEndian.PutUint32(frame[8:], uint32(len(frame)))
+	buf := make([]byte, len(frame))
+
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		if _, err := h.io.Write(frame); err != nil {
+			b.Fatal(err)
+		}
+		if _, err := io.ReadFull(ioFile, buf); err != nil {
+			b.Fatal(err)
+		}
+	}
+	b.StopTimer()
+
+	ioFile.Close()
+	h.Stop()
+	bp.Stop()
+}
+
+func BenchmarkCoalesce(b *testing.B) {
+	modes := []struct {
+		name          string
+		coalesceBytes int
+	}{
+		{"off", 0},
+		{"4KB", 4096},
+	}
+
+	for _, mode := range modes {
+		b.Run("throughput/"+mode.name, func(b *testing.B) {
+			benchmarkCoalesceThroughput(b, mode.coalesceBytes)
+		})
+	}
+	for _, mode := range modes {
+		b.Run("latency/"+mode.name, func(b *testing.B) {
+			benchmarkCoalesceLatency(b, mode.coalesceBytes)
+		})
+	}
+}
@@ -0,0 +1,246 @@
+// Copyright (c) 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package main
+
+import (
+	"bytes"
+	"encoding/binary"
+	"net"
+	"sync"
+	"time"
+)
+
+// Default size, in bytes, of the per-VM console buffer
+const defaultConsoleBufferSize = 32 * 1024
+
+// Longer console lines are split
+const consoleMaxLineLength = 1024
+
+// Each line is stored in the ring as a header, the capture time in ns since
+// the epoch (8 bytes) and the length of the text (2 bytes), followed by the
+// line text without the '\n'
+const consoleRecordHeaderLength = 10
+
+// consoleRing keeps the last lines written on the console of a VM in a buffer
+// of fixed size, evicting the oldest lines to make room for new ones.
+//
+// Positions in the ring are byte offsets counted from the first line ever
+// written: they only ever grow and are taken modulo the buffer size to index
+// it. The ring holds the lines between head and tail.
+type consoleRing struct {
+	sync.Mutex
+
+	// Allocated on the first write
+	buf  []byte
+	size int
+
+	head, tail uint64
+
+	// Number of lines evicted from the ring
+	dropped uint64
+
+	// Closed, and replaced, when lines are written to wake up followers
+	changed chan struct{}
+	closed  bool
+
+	// Connections streaming the console, closed with the ring
+	followers map[net.Conn]struct{}
+}
+
+func newConsoleRing(size int) *consoleRing {
+	return &consoleRing{
+		size:      size,
+		changed:   make(chan struct{}),
+		followers: make(map[net.Conn]struct{}),
+	}
+}
+
+// Copy data to the ring at pos, wrapping around the end of the buffer
+func (r *consoleRing) put(pos uint64, data []byte) {
+	i := int(pos % uint64(len(r.buf)))
+	n := copy(r.buf[i:], data)
+	copy(r.buf, data[n:])
+}
+
+// Copy len(data) bytes from the ring at pos
+func (r *consoleRing) get(pos uint64, data []byte) {
+	i := int(pos % uint64(len(r.buf)))
+	n := copy(data, r.buf[i:])
+	copy(data[n:], r.buf)
+}
+
+// Length of the record at pos
+func (r *consoleRing) recordLength(pos uint64) uint64 {
+	var header [consoleRecordHeaderLength]byte
+	r.get(pos, header[:])
+	return consoleRecordHeaderLength + uint64(binary.BigEndian.Uint16(header[8:]))
+}
+
+// Write adds a line, captured at t, to the ring.
+func (r *consoleRing) Write(t time.Time, line []byte) {
+	if len(line) > consoleMaxLineLength {
+		line = line[:consoleMaxLineLength]
+	}
+
+	var header [consoleRecordHeaderLength]byte
+	binary.BigEndian.PutUint64(header[:], uint64(t.UnixNano()))
+	binary.BigEndian.PutUint16(header[8:], uint16(len(line)))
+	n := uint64(len(header) + len(line))
+
+	r.Lock()
+	defer r.Unlock()
+
+	if r.closed || n > uint64(r.size) {
+		return
+	}
+
+	if r.buf == nil {
+		r.buf = make([]byte, r.size)
+	}
+
+	for r.tail+n-r.head > uint64(len(r.buf)) {
+		r.head += r.recordLength(r.head)
+		r.dropped++
+	}
+
+	r.put(r.tail, header[:])
+	r.put(r.tail+uint64(len(header)), line)
+	r.tail += n
+
+	close(r.changed)
+	r.changed = make(chan struct{})
+}
+
+// Format the lines from pos onwards in w. It returns the position following
+// the last line and a channel closed when more lines are written, nil once
+// the ring is closed. Lines evicted before they could be read are skipped.
+func (r *consoleRing) read(w *bytes.Buffer, pos uint64, timestamps bool) (uint64, <-chan struct{}) {
+	var header [consoleRecordHeaderLength]byte
+	var text [consoleMaxLineLength]byte
+
+	r.Lock()
+	defer r.Unlock()
+
+	if pos < r.head {
+		pos = r.head
+	}
+
+	for pos < r.tail {
+		r.get(pos, header[:])
+		length := int(binary.BigEndian.Uint16(header[8:]))
+		r.get(pos+consoleRecordHeaderLength, text[:length])
+		pos += consoleRecordHeaderLength + uint64(length)
+
+		if timestamps {
+			ns := int64(binary.BigEndian.Uint64(header[:]))
+			w.WriteString(time.Unix(0, ns).UTC().Format(time.RFC3339Nano))
+			w.WriteByte(' ')
+		}
+		w.Write(text[:length])
+		w.WriteByte('\n')
+	}
+
+	if r.closed {
+		return pos, nil
+	}
+
+	return pos, r.changed
+}
+
+// Fetch returns the lines held in the ring and the number of lines that have
+// been evicted from it.
+func (r *consoleRing) Fetch(timestamps bool) ([]byte, uint64) {
+	var w bytes.Buffer
+
+	r.read(&w, 0, timestamps)
+
+	r.Lock()
+	dropped := r.dropped
+	r.Unlock()
+
+	return w.Bytes(), dropped
+}
+
+// Follow writes the lines held in the ring to conn and then the lines written
+// after that, until the ring is closed or the other end of conn is closed.
+// conn is closed before returning.
+func (r *consoleRing) Follow(conn net.Conn, timestamps bool) {
+	r.Lock()
+	if r.closed {
+		r.Unlock()
+		conn.Close()
+		return
+	}
+	r.followers[conn] = struct{}{}
+	pos := r.head
+	r.Unlock()
+
+	defer func() {
+		r.Lock()
+		delete(r.followers, conn)
+		r.Unlock()
+		conn.Close()
+	}()
+
+	// The client isn't expected to send anything: a read only returns
+	// once it closes its end.
+	peerGone := make(chan struct{})
+	go func() {
+		var b [1]byte
+		conn.Read(b[:])
+		close(peerGone)
+	}()
+
+	var w bytes.Buffer
+	for {
+		var changed <-chan struct{}
+
+		w.Reset()
+		pos, changed = r.read(&w, pos, timestamps)
+
+		if w.Len() > 0 {
+			if _, err := conn.Write(w.Bytes()); err != nil {
+				return
+			}
+		}
+
+		if changed == nil {
+			return
+		}
+
+		select {
+		case <-changed:
+		case <-peerGone:
+			return
+		}
+	}
+}
+
+// Close stops the followers of the ring. The lines written so far can still
+// be fetched.
+func (r *consoleRing) Close() {
+	r.Lock()
+	defer r.Unlock()
+
+	if r.closed {
+		return
+	}
+	r.closed = true
+	close(r.changed)
+
+	for conn := range r.followers {
+		conn.Close()
+	}
+}
@@ -0,0 +1,236 @@
+// Copyright (c) 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package main
+
+import (
+	"bufio"
+	"fmt"
+	"io/ioutil"
+	"net"
+	"strings"
+	"testing"
+	"time"
+
+	"github.com/01org/cc-oci-runtime/proxy/api"
+	"github.com/containers/virtcontainers/hyperstart/mock"
+	"github.com/stretchr/testify/assert"
+)
+
+func TestConsoleRing(t *testing.T) {
+	// Room for 4 lines of 6 characters
+	r := newConsoleRing(4 * (consoleRecordHeaderLength + 6))
+	now := time.Date(2017, 3, 8, 10, 32, 5, 123, time.UTC)
+
+	output, dropped := r.Fetch(false)
+	assert.Equal(t, "", string(output))
+	assert.Equal(t, uint64(0), dropped)
+
+	for i := 0; i < 3; i++ {
+		r.Write(now, []byte(fmt.Sprintf("line %d", i)))
+	}
+	output, dropped = r.Fetch(false)
+	assert.Equal(t, "line 0\nline 1\nline 2\n", string(output))
+	assert.Equal(t, uint64(0), dropped)
+
+	// The oldest lines make room for the new ones, the ring wrapping
+	// around several times
+	for i := 3; i < 10; i++ {
+		r.Write(now, []byte(fmt.Sprintf("line %d", i)))
+	}
+	output, dropped = r.Fetch(false)
+	assert.Equal(t, "line 6\nline 7\nline 8\nline 9\n", string(output))
+	assert.Equal(t, uint64(6), dropped)
+
+	// A longer line can evict several lines
+	r.Write(now, []byte("a longer line"))
+	output, dropped = r.Fetch(true)
+	assert.Equal(t, "2017-03-08T10:32:05.000000123Z line 8\n"+
+		"2017-03-08T10:32:05.000000123Z line 9\n"+
+		"2017-03-08T10:32:05.000000123Z a longer line\n", string(output))
+	assert.Equal(t, uint64(8), dropped)
+
+	// Lines that don't fit in the ring are ignored
+	r.Write(now, []byte(strings.Repeat("x", r.size)))
+	output, _ = r.Fetch(false)
+	assert.Equal(t, "line 8\nline 9\na longer line\n", string(output))
+
+	// Once closed, no more lines are kept, but they can still be fetched
+	r.Close()
+	r.Write(now, []byte("closed"))
+	output, _ = r.Fetch(false)
+	assert.Equal(t, "line 8\nline 9\na longer line\n", string(output))
+}
+
+func TestConsoleRingFollow(t *testing.T) {
+	r := newConsoleRing(defaultConsoleBufferSize)
+	r.Write(time.Now(), []byte("before"))
+
+	client, proxyConn, err := Socketpair()
+	assert.Nil(t, err)
+
+	done := make(chan struct{})
+	go func() {
+		r.Follow(proxyConn, false)
+		close(done)
+	}()
+
+	reader := bufio.NewReader(client)
+
+	// Lines already in the ring come first
+	line, err := reader.ReadString('\n')
+	assert.Nil(t, err)
+	assert.Equal(t, "before\n", line)
+
+	r.Write(time.Now(), []byte("after"))
+	line, err = reader.ReadString('\n')
+	assert.Nil(t, err)
+	assert.Equal(t, "after\n", line)
+
+	// Closing the ring ends the stream
+	r.Close()
+	<-done
+	rest, err := ioutil.ReadAll(reader)
+	assert.Nil(t, err)
+	assert.Equal(t, "", string(rest))
+
+	client.Close()
+}
+
+func TestConsoleRingFollowClientGone(t *testing.T) {
+	r := newConsoleRing(defaultConsoleBufferSize)
+
+	client, proxyConn, err := Socketpair()
+	assert.Nil(t, err)
+
+	done := make(chan struct{})
+	go func() {
+		r.Follow(proxyConn, false)
+		close(done)
+	}()
+
+	// The follower goes away when the client closes its end, without
+	// waiting for more console output
+	client.Close()
+	<-done
+
+	r.Lock()
+	assert.Equal(t, 0, len(r.followers))
+	r.Unlock()
+}
+
+// Serve a fake VM console on path, returning the accepted connection
+func serveConsole(t *testing.T, path string) <-chan net.Conn {
+	l, err := net.ListenUnix("unix", &net.UnixAddr{Name: path, Net: "unix"})
+	assert.Nil(t, err)
+
+	accepted := make(chan net.Conn, 1)
+	go func() {
+		c, err := l.Accept()
+		assert.Nil(t, err)
+		l.Close()
+		accepted <- c
+	}()
+
+	return accepted
+}
+
+func TestConsole(t *testing.T) {
+	proto := newProtocol()
+	proto.Handle("hello", helloHandler)
+	proto.Handle("console", consoleHandler)
+
+	rig := newTestRig(t, proto)
+	rig.Start()
+
+	consolePath := mock.GetTmpPath("test-console.%s.sock")
+	accepted := serveConsole(t, consolePath)
+
+	// Unknown VM
+	_, _, err := rig.Client.Console(testContainerID, nil)
+	assert.NotNil(t, err)
+
+	ctlSocketPath, ioSocketPath := rig.Hyperstart.GetSocketPaths()
+	_, err = rig.Client.Hello(testContainerID, ctlSocketPath, ioSocketPath,
+		&api.HelloOptions{Console: consolePath})
+	assert.Nil(t, err)
+
+	console := <-accepted
+
+	follow, err := rig.Client.FollowConsole(testContainerID, nil)
+	assert.Nil(t, err)
+	reader := bufio.NewReader(follow)
+
+	_, err = console.Write([]byte("booting\r\nhyperstart started\n"))
+	assert.Nil(t, err)
+
+	// Wait for both lines to be captured
+	for _, expected := range []string{"booting\n", "hyperstart started\n"} {
+		line, err := reader.ReadString('\n')
+		assert.Nil(t, err)
+		assert.Equal(t, expected, line)
+	}
+
+	output, dropped, err := rig.Client.Console(testContainerID, nil)
+	assert.Nil(t, err)
+	assert.Equal(t, "booting\nhyperstart started\n", output)
+	assert.Equal(t, uint64(0), dropped)
+
+	output, _, err = rig.Client.Console(testContainerID,
+		&api.ConsoleOptions{Timestamps: true})
+	assert.Nil(t, err)
+	lines := strings.Split(strings.TrimSuffix(output, "\n"), "\n")
+	assert.Equal(t, 2, len(lines))
+	for _, line := range lines {
+		fields := strings.SplitN(line, " ", 2)
+		assert.Equal(t, 2, len(fields))
+		_, err := time.Parse(time.RFC3339Nano, fields[0])
+		assert.Nil(t, err)
+	}
+
+	follow.Close()
+	console.Close()
+	rig.Stop()
+}
+
+func TestRegisterConsoleStats(t *testing.T) {
+	proto := newProtocol()
+	proto.Handle("register", registerHandler)
+	proto.Handle("hello", helloHandler)
+	proto.Handle("stats", statsHandler)
+
+	rig := newTestRig(t, proto)
+	rig.Start()
+
+	consolePath := mock.GetTmpPath("test-console.%s.sock")
+	accepted := serveConsole(t, consolePath)
+
+	ctlSocketPath, ioSocketPath := rig.Hyperstart.GetSocketPaths()
+	err := rig.Client.Register(testContainerID, ctlSocketPath, ioSocketPath,
+		&api.RegisterOptions{Console: consolePath})
+	assert.Nil(t, err)
+
+	console := <-accepted
+
+	// The console is connected in the background, while stats look at it
+	waitForStats(t, rig.Client, []string{
+		`cc_proxy_vm_goroutines{vm="0987654321"} 2`,
+	})
+
+	_, err = rig.Client.Hello(testContainerID, ctlSocketPath, ioSocketPath, nil)
+	assert.Nil(t, err)
+
+	console.Close()
+	rig.Stop()
+}
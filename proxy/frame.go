@@ -0,0 +1,116 @@
+// Copyright (c) 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package main
+
+import (
+	"encoding/binary"
+	"errors"
+	"fmt"
+	"io"
+	"sync"
+)
+
+// header for hyperstart's I/O channel packets is 12 bytes: the 8 bytes
+// sequence number followed by the 4 bytes length of the whole packet
+const ioHeaderLength = 12
+
+// Maximum length of an I/O packet, header included. That limit comes from
+// hyperstart src/init.c, hyper_channel_ops, rbuf_size.
+const ioFrameMaxLength = 10240
+
+// An ioFrame is a packet of the I/O channel, header included.
+//
+// The frame read from the hyperstart I/O channel is exactly what needs to be
+// written to the client socket (and vice versa), so frames are relayed
+// untouched. Their buffers are recycled through ioFramePool to not allocate
+// memory for each packet.
+type ioFrame struct {
+	buf []byte
+}
+
+var ioFramePool = sync.Pool{
+	New: func() interface{} {
+		return &ioFrame{
+			buf: make([]byte, ioFrameMaxLength),
+		}
+	},
+}
+
+func newIoFrame() *ioFrame {
+	frame := ioFramePool.Get().(*ioFrame)
+	frame.buf = frame.buf[:cap(frame.buf)]
+	return frame
+}
+
+// Free gives the frame back to the pool. The frame must not be used after
+// that.
+func (frame *ioFrame) Free() {
+	ioFramePool.Put(frame)
+}
+
+// Session returns the sequence number of the stream the frame belongs to.
+func (frame *ioFrame) Session() uint64 {
+	return binary.BigEndian.Uint64(frame.buf[:8])
+}
+
+// Payload returns the data carried by the frame.
+func (frame *ioFrame) Payload() []byte {
+	return frame.buf[ioHeaderLength:]
+}
+
+// appendPayload appends data to the payload of the frame, updating the frame
+// length. The caller must make sure the frame stays under ioFrameMaxLength.
+func (frame *ioFrame) appendPayload(data []byte) {
+	frame.buf = append(frame.buf, data...)
+	binary.BigEndian.PutUint32(frame.buf[8:ioHeaderLength], uint32(len(frame.buf)))
+}
+
+// readIoFrame reads a full I/O packet from reader. reader is usually buffered
+// as packets are read in two steps, the header then the payload.
+func readIoFrame(reader io.Reader) (*ioFrame, error) {
+	frame := newIoFrame()
+
+	if _, err := io.ReadFull(reader, frame.buf[:ioHeaderLength]); err != nil {
+		frame.Free()
+		return nil, err
+	}
+
+	length := int(binary.BigEndian.Uint32(frame.buf[8:ioHeaderLength]))
+	if length < ioHeaderLength || length > ioFrameMaxLength {
+		frame.Free()
+		return nil, fmt.Errorf("invalid I/O packet length: %d", length)
+	}
+
+	if _, err := io.ReadFull(reader, frame.buf[ioHeaderLength:length]); err != nil {
+		frame.Free()
+		return nil, err
+	}
+	frame.buf = frame.buf[:length]
+
+	return frame, nil
+}
+
+// writeTo writes the frame with a single write to not interleave with frames
+// written to w concurrently by other goroutines.
+func (frame *ioFrame) writeTo(w io.Writer) error {
+	n, err := w.Write(frame.buf)
+	if err != nil {
+		return err
+	}
+	if n != len(frame.buf) {
+		return errors.New("couldn't write the full I/O packet")
+	}
+	return nil
+}
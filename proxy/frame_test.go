@@ -0,0 +1,66 @@
+// Copyright (c) 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package main
+
+import (
+	"bytes"
+	"encoding/binary"
+	"io"
+	"testing"
+
+	"github.com/stretchr/testify/assert"
+)
+
+func TestReadIoFrame(t *testing.T) {
+	var stream bytes.Buffer
+
+	// Two frames back to back, the second one without payload (stream
+	// closed)
+	writeIo(t, &stream, 1, []byte("stdout\n"))
+	writeIo(t, &stream, 2, nil)
+
+	frame, err := readIoFrame(&stream)
+	assert.Nil(t, err)
+	assert.Equal(t, uint64(1), frame.Session())
+	assert.Equal(t, "stdout\n", string(frame.Payload()))
+
+	// Frames are relayed untouched
+	var out bytes.Buffer
+	assert.Nil(t, frame.writeTo(&out))
+	seq, data := readIo(t, &out)
+	assert.Equal(t, uint64(1), seq)
+	assert.Equal(t, "stdout\n", string(data))
+	frame.Free()
+
+	frame, err = readIoFrame(&stream)
+	assert.Nil(t, err)
+	assert.Equal(t, uint64(2), frame.Session())
+	assert.Equal(t, 0, len(frame.Payload()))
+	frame.Free()
+
+	_, err = readIoFrame(&stream)
+	assert.Equal(t, io.EOF, err)
+}
+
+func TestReadIoFrameInvalidLength(t *testing.T) {
+	for _, length := range []uint32{ioHeaderLength - 1, ioFrameMaxLength + 1} {
+		header := make([]byte, ioHeaderLength)
+		binary.BigEndian.PutUint64(header[:], 1)
+		binary.BigEndian.PutUint32(header[8:], length)
+
+		_, err := readIoFrame(bytes.NewReader(header))
+		assert.NotNil(t, err)
+	}
+}
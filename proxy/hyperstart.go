@@ -0,0 +1,223 @@
+// Copyright (c) 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package main
+
+import (
+	"encoding/binary"
+	"errors"
+	"fmt"
+	"io"
+	"net"
+	"sync"
+	"time"
+
+	"github.com/containers/virtcontainers/hyperstart"
+	hyper "github.com/hyperhq/runv/hyperstart/api/json"
+)
+
+// Codes of the hyperstart control commands, by name
+var hyperCmdCodes = map[string]uint32{
+	hyperstart.Version:        hyper.INIT_VERSION,
+	hyperstart.StartPod:       hyper.INIT_STARTPOD,
+	hyperstart.DestroyPod:     hyper.INIT_DESTROYPOD,
+	hyperstart.ExecCmd:        hyper.INIT_EXECCMD,
+	hyperstart.Ready:          hyper.INIT_READY,
+	hyperstart.Ack:            hyper.INIT_ACK,
+	hyperstart.Error:          hyper.INIT_ERROR,
+	hyperstart.WinSize:        hyper.INIT_WINSIZE,
+	hyperstart.Ping:           hyper.INIT_PING,
+	hyperstart.Next:           hyper.INIT_NEXT,
+	hyperstart.WriteFile:      hyper.INIT_WRITEFILE,
+	hyperstart.ReadFile:       hyper.INIT_READFILE,
+	hyperstart.NewContainer:   hyper.INIT_NEWCONTAINER,
+	hyperstart.KillContainer:  hyper.INIT_KILLCONTAINER,
+	hyperstart.OnlineCPUMem:   hyper.INIT_ONLINECPUMEM,
+	hyperstart.SetupInterface: hyper.INIT_SETUPINTERFACE,
+	hyperstart.SetupRoute:     hyper.INIT_SETUPROUTE,
+}
+
+const (
+	ctlHeaderLength = 8
+	// hyperstart can't receive bigger messages (see hyperstart src/init.c,
+	// hyper_channel_ops, rbuf_size)
+	ctlMaxMessageLength = 10240
+)
+
+// The control and I/O channels of a hyperstart instance.
+//
+// virtcontainers' hyperstart.Hyperstart keeps its I/O connection to itself.
+// The proxy reads and writes the I/O frames with its own buffering (see
+// ioHyperToClients()), so it connects the channels itself.
+type hyperstartChannels struct {
+	ctlSerial, ioSerial string
+	ctl, io             net.Conn
+
+	// A single "transaction" (write command + read answer) at a time on
+	// the control channel
+	ctlMutex sync.Mutex
+
+	// Protects ctl and io against a Close() racing with Open(), closed
+	// tells Open() the channels are no longer wanted
+	sync.Mutex
+	closed bool
+}
+
+func newHyperstartChannels(ctlSerial, ioSerial string) *hyperstartChannels {
+	return &hyperstartChannels{
+		ctlSerial: ctlSerial,
+		ioSerial:  ioSerial,
+	}
+}
+
+// Open connects both channels. It fails if Close() has been called.
+func (h *hyperstartChannels) Open() error {
+	ctl, err := net.Dial("unix", h.ctlSerial)
+	if err != nil {
+		return err
+	}
+
+	ioConn, err := net.Dial("unix", h.ioSerial)
+	if err != nil {
+		ctl.Close()
+		return err
+	}
+
+	h.Lock()
+	defer h.Unlock()
+
+	if h.closed {
+		ctl.Close()
+		ioConn.Close()
+		return errors.New("hyperstart channels closed")
+	}
+	h.ctl, h.io = ctl, ioConn
+
+	return nil
+}
+
+// Close closes both channels, unblocking their readers. It can be called
+// concurrently with Open(), and more than once.
+func (h *hyperstartChannels) Close() {
+	h.Lock()
+	defer h.Unlock()
+
+	if h.closed {
+		return
+	}
+	h.closed = true
+
+	if h.ctl != nil {
+		h.ctl.Close()
+	}
+	if h.io != nil {
+		h.io.Close()
+	}
+}
+
+// IoConn returns the connection to the I/O channel.
+func (h *hyperstartChannels) IoConn() net.Conn {
+	return h.io
+}
+
+// SetDeadline sets a deadline for the control channel.
+func (h *hyperstartChannels) SetDeadline(t time.Time) error {
+	return h.ctl.SetDeadline(t)
+}
+
+func (h *hyperstartChannels) readCtlMessage() (*hyper.DecodedMessage, error) {
+	var header [ctlHeaderLength]byte
+
+	if _, err := io.ReadFull(h.ctl, header[:]); err != nil {
+		return nil, err
+	}
+
+	length := binary.BigEndian.Uint32(header[4:])
+	if length < ctlHeaderLength || length > ctlMaxMessageLength {
+		return nil, fmt.Errorf("invalid hyperstart message length %d", length)
+	}
+
+	msg := &hyper.DecodedMessage{
+		Code:    binary.BigEndian.Uint32(header[:4]),
+		Message: make([]byte, length-ctlHeaderLength),
+	}
+	if _, err := io.ReadFull(h.ctl, msg.Message); err != nil {
+		return nil, err
+	}
+
+	return msg, nil
+}
+
+func (h *hyperstartChannels) writeCtlMessage(code uint32, data []byte) error {
+	length := ctlHeaderLength + len(data)
+	if length > ctlMaxMessageLength {
+		return fmt.Errorf("message too long %d", length)
+	}
+
+	msg := make([]byte, length)
+	binary.BigEndian.PutUint32(msg, code)
+	binary.BigEndian.PutUint32(msg[4:], uint32(length))
+	copy(msg[ctlHeaderLength:], data)
+
+	_, err := h.ctl.Write(msg)
+	return err
+}
+
+// Read control messages until one with code, skipping NEXT and READY
+func (h *hyperstartChannels) expectCtlMessage(code uint32) (*hyper.DecodedMessage, error) {
+	for {
+		msg, err := h.readCtlMessage()
+		if err != nil {
+			return nil, err
+		}
+
+		switch msg.Code {
+		case code:
+			return msg, nil
+		case hyper.INIT_NEXT, hyper.INIT_READY:
+			continue
+		case hyper.INIT_ERROR:
+			return nil, fmt.Errorf("ERROR received from hyperstart")
+		}
+
+		return nil, fmt.Errorf("CMD ID received %d not matching expected %d",
+			msg.Code, code)
+	}
+}
+
+// WaitForReady waits for the READY message hyperstart sends once booted.
+func (h *hyperstartChannels) WaitForReady() error {
+	h.ctlMutex.Lock()
+	defer h.ctlMutex.Unlock()
+
+	_, err := h.expectCtlMessage(hyper.INIT_READY)
+	return err
+}
+
+// SendCtlMessage sends the command cmd to hyperstart and waits for its ACK.
+func (h *hyperstartChannels) SendCtlMessage(cmd string, data []byte) (*hyper.DecodedMessage, error) {
+	code, ok := hyperCmdCodes[cmd]
+	if !ok {
+		return nil, fmt.Errorf("unknown command '%s'", cmd)
+	}
+
+	h.ctlMutex.Lock()
+	defer h.ctlMutex.Unlock()
+
+	if err := h.writeCtlMessage(code, data); err != nil {
+		return nil, err
+	}
+
+	return h.expectCtlMessage(hyper.INIT_ACK)
+}
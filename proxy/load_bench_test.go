@@ -0,0 +1,348 @@
+// Copyright (c) 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package main
+
+import (
+	"bufio"
+	"encoding/binary"
+	"flag"
+	"fmt"
+	"io"
+	"os"
+	"runtime"
+	"sort"
+	"strconv"
+	"strings"
+	"sync"
+	"testing"
+	"time"
+)
+
+// BenchmarkLoad relays I/O through an in-process proxy serving K simulated
+// VMs running M sessions each. The VMs are benchHyperstart instances, so no
+// hypervisor is needed. The shape of the load is given on the command line:
+//
+//   go test -run XXX -bench Load -benchmem ./proxy -args \
+//       -load.vms 1,16 -load.sessions 1,8 -load.frames 64,1024 -load.rate 0
+//
+// Each frame carries the time it was sent, which gives the relay latency.
+// On top of the usual benchmark results, each run reports the 50th and 99th
+// percentiles of that latency and the number of goroutines and heap bytes
+// each session added once set up. Without -load.rate, the proxy is saturated
+// and the latency is mostly the time frames spend queued.
+var (
+	loadVMs = flag.String("load.vms", "1,16",
+		"BenchmarkLoad: comma-separated numbers of VMs")
+	loadSessions = flag.String("load.sessions", "1,8",
+		"BenchmarkLoad: comma-separated numbers of sessions per VM")
+	loadFrames = flag.String("load.frames", "64,1024,8192",
+		"BenchmarkLoad: comma-separated I/O payload sizes, in bytes")
+	loadRate = flag.Int("load.rate", 0,
+		"BenchmarkLoad: frames per second sent on each session and direction (0 for as fast as possible)")
+	loadDirections = flag.String("load.directions", "out,in,both",
+		"BenchmarkLoad: comma-separated directions, out (hyperstart to client), in or both")
+)
+
+// The send time, in ns since loadEpoch, is at the start of the payload
+const loadTimestampLength = 8
+
+var loadEpoch = time.Now()
+
+func parseLoadList(b *testing.B, name, list string) []int {
+	var values []int
+	for _, s := range strings.Split(list, ",") {
+		v, err := strconv.Atoi(strings.TrimSpace(s))
+		if err != nil || v < 1 {
+			b.Fatalf("invalid -%s: %s", name, list)
+		}
+		values = append(values, v)
+	}
+	return values
+}
+
+type loadConfig struct {
+	vms, sessions int
+	payload       int
+	rate          int
+	out, in       bool
+}
+
+// A session of a simulated VM, with both ends of its I/O stream
+type loadSession struct {
+	ioBase uint64
+	client *os.File
+	// Latencies of the frames received on either end
+	latencies []time.Duration
+}
+
+type loadVM struct {
+	hyperstart *benchHyperstart
+	sessions   []*loadSession
+	// Latencies of the frames received by hyperstart
+	latencies []time.Duration
+}
+
+// Build a frame for ioBase with a zeroed payload
+func newLoadFrame(ioBase uint64, payload int) []byte {
+	frame := make([]byte, ioHeaderLength+payload)
+	binary.BigEndian.PutUint64(frame[:], ioBase)
+	binary.BigEndian.PutUint32(frame[8:], uint32(len(frame)))
+	return frame
+}
+
+func stampLoadFrame(frame []byte) {
+	binary.BigEndian.PutUint64(frame[ioHeaderLength:], uint64(time.Since(loadEpoch)))
+}
+
+func loadFrameLatency(frame []byte) time.Duration {
+	sent := time.Duration(binary.BigEndian.Uint64(frame[ioHeaderLength:]))
+	return time.Since(loadEpoch) - sent
+}
+
+// Send n frames on w, paced at rate frames per second if rate isn't 0
+func sendLoadFrames(w io.Writer, frame []byte, n, rate int) error {
+	start := time.Now()
+	for i := 0; i < n; i++ {
+		if rate > 0 {
+			next := start.Add(time.Duration(i) * time.Second / time.Duration(rate))
+			if d := time.Until(next); d > 0 {
+				time.Sleep(d)
+			}
+		}
+
+		stampLoadFrame(frame)
+		if _, err := w.Write(frame); err != nil {
+			return err
+		}
+	}
+	return nil
+}
+
+// Receive n frames from r
+func receiveLoadFrames(r io.Reader, frameLength, n int, latencies []time.Duration) ([]time.Duration, error) {
+	reader := bufio.NewReaderSize(r, 64*1024)
+	frame := make([]byte, frameLength)
+	for i := 0; i < n; i++ {
+		if _, err := io.ReadFull(reader, frame); err != nil {
+			return latencies, err
+		}
+		latencies = append(latencies, loadFrameLatency(frame))
+	}
+	return latencies, nil
+}
+
+// Heap and goroutines in use, once the garbage has been collected
+func loadFootprint() (int, uint64) {
+	var stats runtime.MemStats
+
+	runtime.GC()
+	runtime.ReadMemStats(&stats)
+
+	return runtime.NumGoroutine(), stats.HeapInuse
+}
+
+func percentile(sorted []time.Duration, p float64) time.Duration {
+	if len(sorted) == 0 {
+		return 0
+	}
+	i := int(float64(len(sorted)-1) * p)
+	return sorted[i]
+}
+
+func runLoad(b *testing.B, config *loadConfig) {
+	bp := newBenchProxy(b)
+
+	goroutinesBefore, heapBefore := loadFootprint()
+
+	vms := make([]*loadVM, config.vms)
+	for i := range vms {
+		vm := &loadVM{
+			hyperstart: newBenchHyperstart(b),
+		}
+		vms[i] = vm
+
+		id := fmt.Sprintf("load-%d", i)
+		h := vm.hyperstart
+		if _, err := bp.client.Hello(id, h.ctlPath, h.ioPath, nil); err != nil {
+			b.Fatal(err)
+		}
+		h.connected.Wait()
+
+		// allocateIO applies to the last VM the client said hello to
+		for j := 0; j < config.sessions; j++ {
+			ioBase, ioFile, err := bp.client.AllocateIo(1)
+			if err != nil {
+				b.Fatal(err)
+			}
+			vm.sessions = append(vm.sessions, &loadSession{
+				ioBase: ioBase,
+				client: ioFile,
+			})
+		}
+	}
+
+	goroutinesAfter, heapAfter := loadFootprint()
+
+	// Spread b.N frames per direction over the sessions
+	nSessions := config.vms * config.sessions
+	perSession := (b.N + nSessions - 1) / nSessions
+	frameLength := ioHeaderLength + config.payload
+
+	for _, vm := range vms {
+		if config.in {
+			vm.latencies = make([]time.Duration, 0, perSession*config.sessions)
+		}
+		for _, s := range vm.sessions {
+			if config.out {
+				s.latencies = make([]time.Duration, 0, perSession)
+			}
+		}
+	}
+
+	directions := 0
+	if config.out {
+		directions++
+	}
+	if config.in {
+		directions++
+	}
+	b.SetBytes(int64(directions * config.payload))
+	b.ReportAllocs()
+	b.ResetTimer()
+
+	var wg sync.WaitGroup
+	errors := make(chan error, 4*nSessions)
+	run := func(fn func() error) {
+		wg.Add(1)
+		go func() {
+			if err := fn(); err != nil {
+				errors <- err
+			}
+			wg.Done()
+		}()
+	}
+
+	for _, vm := range vms {
+		vm := vm
+
+		if config.in {
+			// hyperstart receives the frames of all the sessions
+			// on the I/O channel of the VM
+			run(func() (err error) {
+				vm.latencies, err = receiveLoadFrames(vm.hyperstart.io,
+					frameLength, perSession*config.sessions, vm.latencies)
+				return
+			})
+		}
+
+		for _, s := range vm.sessions {
+			s := s
+
+			if config.out {
+				run(func() error {
+					frame := newLoadFrame(s.ioBase, config.payload)
+					return sendLoadFrames(vm.hyperstart.io, frame, perSession, config.rate)
+				})
+				run(func() (err error) {
+					s.latencies, err = receiveLoadFrames(s.client, frameLength,
+						perSession, s.latencies)
+					return
+				})
+			}
+
+			if config.in {
+				run(func() error {
+					frame := newLoadFrame(s.ioBase, config.payload)
+					return sendLoadFrames(s.client, frame, perSession, config.rate)
+				})
+			}
+		}
+	}
+
+	wg.Wait()
+	b.StopTimer()
+
+	select {
+	case err := <-errors:
+		b.Fatal(err)
+	default:
+	}
+
+	var latencies []time.Duration
+	for _, vm := range vms {
+		latencies = append(latencies, vm.latencies...)
+		for _, s := range vm.sessions {
+			latencies = append(latencies, s.latencies...)
+		}
+	}
+	sort.Slice(latencies, func(i, j int) bool { return latencies[i] < latencies[j] })
+
+	b.ReportMetric(float64(percentile(latencies, 0.50).Nanoseconds())/1000, "p50-µs")
+	b.ReportMetric(float64(percentile(latencies, 0.99).Nanoseconds())/1000, "p99-µs")
+	b.ReportMetric(float64(goroutinesAfter-goroutinesBefore)/float64(nSessions),
+		"goroutines/session")
+	b.ReportMetric(float64(int64(heapAfter)-int64(heapBefore))/float64(nSessions),
+		"heap-B/session")
+
+	for _, vm := range vms {
+		for _, s := range vm.sessions {
+			s.client.Close()
+		}
+		vm.hyperstart.Stop()
+	}
+	bp.Stop()
+}
+
+func BenchmarkLoad(b *testing.B) {
+	vms := parseLoadList(b, "load.vms", *loadVMs)
+	sessions := parseLoadList(b, "load.sessions", *loadSessions)
+	frames := parseLoadList(b, "load.frames", *loadFrames)
+
+	for _, payload := range frames {
+		if payload < loadTimestampLength || payload > ioFrameMaxLength-ioHeaderLength {
+			b.Fatalf("payload size must be between %d and %d bytes",
+				loadTimestampLength, ioFrameMaxLength-ioHeaderLength)
+		}
+	}
+
+	for _, direction := range strings.Split(*loadDirections, ",") {
+		config := loadConfig{rate: *loadRate}
+
+		switch direction {
+		case "out":
+			config.out = true
+		case "in":
+			config.in = true
+		case "both":
+			config.out, config.in = true, true
+		default:
+			b.Fatalf("invalid -load.directions: %s", *loadDirections)
+		}
+
+		for _, config.vms = range vms {
+			for _, config.sessions = range sessions {
+				for _, config.payload = range frames {
+					name := fmt.Sprintf("%s/vms=%d/sessions=%d/payload=%d",
+						direction, config.vms, config.sessions,
+						config.payload)
+					c := config
+					b.Run(name, func(b *testing.B) {
+						runLoad(b, &c)
+					})
+				}
+			}
+		}
+	}
+}
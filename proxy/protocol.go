@@ -15,10 +15,14 @@
 package main
 
 import (
+	"bufio"
+	"encoding/json"
 	"errors"
 	"fmt"
 	"net"
 	"os"
+	"sync"
+	"time"
 
 	"github.com/01org/cc-oci-runtime/proxy/api"
 )
@@ -30,7 +34,10 @@ type protocolHandler func([]byte, interface{}, *handlerResponse)
 type handlerResponse struct {
 	err     error
 	results map[string]interface{}
-	file    *os.File
+	// sent after the response, in order
+	files []*os.File
+	// the client can now tag its requests with IDs
+	requestIDs bool
 }
 
 func (r *handlerResponse) SetError(err error) {
@@ -53,30 +60,79 @@ func (r *handlerResponse) AddResult(key string, value interface{}) {
 }
 
 func (r *handlerResponse) SetFile(f *os.File) {
-	r.file = f
+	r.files = append(r.files, f)
+}
+
+// EnableRequestIDs lets the client use request IDs for the subsequent
+// requests on its connection.
+func (r *handlerResponse) EnableRequestIDs() {
+	r.requestIDs = true
+	r.AddResult("requestIds", true)
+}
+
+func (r *handlerResponse) closeFiles() {
+	for _, f := range r.files {
+		f.Close()
+	}
+	r.files = nil
 }
 
 type protocol struct {
 	handlers map[string]protocolHandler
+
+	// Commands that can be handled while other requests are in flight (see
+	// HandleConcurrent).
+	concurrent map[string]bool
+
+	// Time taken by the handlers, indexed by command. Like handlers, only
+	// modified by Handle() before serving clients.
+	latencies map[string]*latencyHistogram
 }
 
 func newProtocol() *protocol {
-	return &protocol{
-		handlers: make(map[string]protocolHandler),
+	proto := &protocol{
+		handlers:   make(map[string]protocolHandler),
+		concurrent: make(map[string]bool),
+		latencies:  make(map[string]*latencyHistogram),
 	}
+	proto.Handle("batch", proto.batchHandler)
+	return proto
 }
 
+// Handle registers the handler of cmd. Requests for cmd are handled one at a
+// time, in the order they are received, which lets handlers change the client
+// state.
 func (proto *protocol) Handle(cmd string, handler protocolHandler) {
 	proto.handlers[cmd] = handler
+	proto.latencies[cmd] = &latencyHistogram{}
+}
+
+// HandleConcurrent registers the handler of cmd. Requests for cmd carrying a
+// request ID are handled in their own goroutine, concurrently with the other
+// requests of the client, and can be answered out of order. Such handlers may
+// read the client state but must not modify it.
+func (proto *protocol) HandleConcurrent(cmd string, handler protocolHandler) {
+	proto.Handle(cmd, handler)
+	proto.concurrent[cmd] = true
 }
 
 type clientCtx struct {
 	conn net.Conn
 
 	userData interface{}
+
+	// Set once the client has negotiated request IDs
+	requestIDs bool
+
+	// Responses, and the fds following them, are written under writeLock
+	// as concurrent handlers can complete at the same time.
+	writeLock sync.Mutex
+
+	// Requests handled in their own goroutine
+	inflight sync.WaitGroup
 }
 
-func (proto *protocol) handleRequest(ctx *clientCtx, req *api.Request, hr *handlerResponse) *api.Response {
+func (proto *protocol) handleRequest(userData interface{}, req *api.Request, hr *handlerResponse) *api.Response {
 	if req.ID == "" {
 		return &api.Response{
 			Success: false,
@@ -92,7 +148,9 @@ func (proto *protocol) handleRequest(ctx *clientCtx, req *api.Request, hr *handl
 		}
 	}
 
-	handler(req.Data, ctx.userData, hr)
+	start := time.Now()
+	handler(req.Data, userData, hr)
+	proto.latencies[req.ID].Observe(time.Since(start))
 	if hr.err != nil {
 		return &api.Response{
 			Success: false,
@@ -107,42 +165,133 @@ func (proto *protocol) handleRequest(ctx *clientCtx, req *api.Request, hr *handl
 	}
 }
 
+// "batch"
+func (proto *protocol) batchHandler(data []byte, userData interface{}, response *handlerResponse) {
+	batch := api.Batch{}
+	if err := json.Unmarshal(data, &batch); err != nil {
+		response.SetError(err)
+		return
+	}
+
+	results := make([]*api.Response, 0, len(batch.Requests))
+	defer func() {
+		response.AddResult("results", results)
+	}()
+
+	for i := range batch.Requests {
+		req := &batch.Requests[i]
+
+		if req.ID == "batch" {
+			results = append(results, &api.Response{
+				Success: false,
+				Error:   "batches cannot be nested",
+			})
+			response.SetErrorf("request %d (%s) failed: batches cannot be nested", i, req.ID)
+			return
+		}
+
+		hr := handlerResponse{}
+		resp := proto.handleRequest(userData, req, &hr)
+		results = append(results, resp)
+
+		response.files = append(response.files, hr.files...)
+		if hr.requestIDs {
+			response.requestIDs = true
+		}
+
+		if !resp.Success {
+			response.SetErrorf("request %d (%s) failed: %s", i, req.ID, resp.Error)
+			return
+		}
+	}
+}
+
+// Handle req and write the response back, along with the fds the handler
+// wants to pass to the client.
+func (proto *protocol) serveRequest(ctx *clientCtx, req *api.Request, id uint32, hasID bool) error {
+	hr := handlerResponse{}
+
+	// Execute the corresponding handler
+	resp := proto.handleRequest(ctx.userData, req, &hr)
+	defer hr.closeFiles()
+
+	if hr.requestIDs {
+		// Only set by handlers that don't run concurrently
+		ctx.requestIDs = true
+	}
+
+	ctx.writeLock.Lock()
+	defer ctx.writeLock.Unlock()
+
+	// Send the response back to the client.
+	var err error
+	if hasID {
+		err = api.WriteMessageWithID(ctx.conn, resp, id)
+	} else {
+		err = api.WriteMessage(ctx.conn, resp)
+	}
+	if err != nil {
+		// Something made us unable to write the response back
+		// to the client (could be a disconnection, ...).
+		return err
+	}
+
+	// And send the fds if the handler associated files with the response
+	for _, f := range hr.files {
+		if err = api.WriteFd(ctx.conn.(*net.UnixConn), int(f.Fd())); err != nil {
+			return err
+		}
+	}
+
+	return nil
+}
+
 func (proto *protocol) Serve(conn net.Conn, userData interface{}) error {
 	ctx := &clientCtx{
 		conn:     conn,
 		userData: userData,
 	}
 
+	// Don't return while handlers are still using the connection
+	defer ctx.inflight.Wait()
+
+	// Clients don't pass fds to the proxy so the requests can be read
+	// through a buffer.
+	reader := bufio.NewReader(conn)
+
 	for {
 		// Parse a request.
-		req := api.Request{}
-		hr := handlerResponse{}
+		req := &api.Request{}
 
-		err := api.ReadMessage(conn, &req)
+		id, hasID, err := api.ReadMessageWithID(reader, req)
 		if err != nil {
 			// EOF or the client isn't even sending proper JSON,
 			// just kill the connection
 			return err
 		}
 
-		// Execute the corresponding handler
-		resp := proto.handleRequest(ctx, &req, &hr)
-
-		// Send the response back to the client.
-		if err = api.WriteMessage(conn, resp); err != nil {
-			// Something made us unable to write the response back
-			// to the client (could be a disconnection, ...).
-			return err
+		if hasID && !ctx.requestIDs {
+			return errors.New("request ID used before being negotiated")
 		}
 
-		// And send a fd if the handler associated a file with the response
-		if hr.file != nil {
-			if err = api.WriteFd(conn.(*net.UnixConn), int(hr.file.Fd())); err != nil {
-				hr.file.Close()
-				return err
-			}
-			hr.file.Close()
+		if hasID && proto.concurrent[req.ID] {
+			ctx.inflight.Add(1)
+			go func() {
+				defer ctx.inflight.Done()
+				if err := proto.serveRequest(ctx, req, id, hasID); err != nil {
+					// Unblock the reading side
+					conn.Close()
+				}
+			}()
+			continue
 		}
 
+		// Requests that aren't run concurrently see the effects of
+		// all the requests received before them.
+		ctx.inflight.Wait()
+
+		if err := proto.serveRequest(ctx, req, id, hasID); err != nil {
+			return err
+		}
 	}
 }
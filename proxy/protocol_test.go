@@ -25,6 +25,8 @@ import (
 	"sync"
 	"testing"
 
+	"github.com/01org/cc-oci-runtime/proxy/api"
+
 	"github.com/stretchr/testify/assert"
 )
 
@@ -242,6 +244,115 @@ func TestCloseOnError(t *testing.T) {
 	assert.Equal(t, err, io.EOF)
 }
 
+func TestBatch(t *testing.T) {
+	tests := []struct {
+		input, output string
+	}{
+		{`{"id":"batch","data":{"requests":[{"id":"simple"},{"id":"echo","data":{"arg":"ping"}}]}}`,
+			`{"success":true,"data":{"results":[{"success":true},{"success":true,"data":{"result":"ping"}}]}}`},
+		{`{"id":"batch","data":{"requests":[{"id":"simple"},{"id":"returnError"},{"id":"simple"}]}}`,
+			`{"success":false,"error":"request 1 (returnError) failed: This is an error","data":{"results":[{"success":true},{"success":false,"error":"This is an error"}]}}`},
+		{`{"id":"batch","data":{"requests":[{"id":"batch"}]}}`,
+			`{"success":false,"error":"request 0 (batch) failed: batches cannot be nested","data":{"results":[{"success":false,"error":"batches cannot be nested"}]}}`},
+		{`{"id":"batch","data":{"requests":[]}}`,
+			`{"success":true,"data":{"results":[]}}`},
+	}
+
+	proto := newProtocol()
+	proto.Handle("simple", simpleHandler)
+	proto.Handle("returnError", returnErrorHandler)
+	proto.Handle("echo", echoHandler)
+
+	client, _ := setupMockServer(t, proto)
+
+	for _, test := range tests {
+		err := writeMessage(client, []byte(test.input))
+		assert.Nil(t, err)
+
+		buf, err := readMessage(client)
+		assert.Nil(t, err)
+		assert.Equal(t, test.output, string(buf))
+	}
+}
+
+func requestIDsHandler(data []byte, userData interface{}, response *handlerResponse) {
+	response.EnableRequestIDs()
+}
+
+var blockHandlerRelease = make(chan struct{})
+
+func blockHandler(data []byte, userData interface{}, response *handlerResponse) {
+	<-blockHandlerRelease
+}
+
+// Once negotiated, requests can be tagged with IDs and answered out of order
+func TestRequestIDs(t *testing.T) {
+	proto := newProtocol()
+	proto.Handle("requestIDs", requestIDsHandler)
+	proto.HandleConcurrent("block", blockHandler)
+	proto.HandleConcurrent("echo", echoHandler)
+
+	client, _ := setupMockServer(t, proto)
+
+	err := api.WriteMessage(client, &api.Request{ID: "requestIDs"})
+	assert.Nil(t, err)
+	resp := api.Response{}
+	err = api.ReadMessage(client, &resp)
+	assert.Nil(t, err)
+	assert.True(t, resp.Success)
+	assert.Equal(t, true, resp.Data["requestIds"])
+
+	// The first request blocks until the second one has been answered
+	err = api.WriteMessageWithID(client, &api.Request{ID: "block"}, 1)
+	assert.Nil(t, err)
+	echo, err := api.NewRequest("echo", &Echo{Arg: "ping"})
+	assert.Nil(t, err)
+	err = api.WriteMessageWithID(client, echo, 2)
+	assert.Nil(t, err)
+
+	resp = api.Response{}
+	id, hasID, err := api.ReadMessageWithID(client, &resp)
+	assert.Nil(t, err)
+	assert.True(t, hasID)
+	assert.Equal(t, uint32(2), id)
+	assert.Equal(t, "ping", resp.Data["result"])
+
+	blockHandlerRelease <- struct{}{}
+
+	resp = api.Response{}
+	id, hasID, err = api.ReadMessageWithID(client, &resp)
+	assert.Nil(t, err)
+	assert.True(t, hasID)
+	assert.Equal(t, uint32(1), id)
+	assert.True(t, resp.Success)
+
+	// Untagged requests are still answered without a request ID
+	err = api.WriteMessage(client, echo)
+	assert.Nil(t, err)
+	resp = api.Response{}
+	_, hasID, err = api.ReadMessageWithID(client, &resp)
+	assert.Nil(t, err)
+	assert.False(t, hasID)
+	assert.Equal(t, "ping", resp.Data["result"])
+
+	client.Close()
+}
+
+// Request IDs can't be used by clients that haven't asked for them
+func TestRequestIDsNotNegotiated(t *testing.T) {
+	proto := newProtocol()
+	proto.HandleConcurrent("simple", simpleHandler)
+
+	client, _ := setupMockServer(t, proto)
+
+	err := api.WriteMessageWithID(client, &api.Request{ID: "simple"}, 1)
+	assert.Nil(t, err)
+
+	buf := make([]byte, 512)
+	_, err = client.Read(buf)
+	assert.Equal(t, err, io.EOF)
+}
+
 func TestMain(m *testing.M) {
 	flag.Parse()
 	os.Exit(m.Run())
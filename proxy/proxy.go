@@ -26,6 +26,7 @@ import (
 	"path/filepath"
 	"sync"
 	"sync/atomic"
+	"time"
 
 	"github.com/01org/cc-oci-runtime/proxy/api"
 
@@ -38,19 +39,22 @@ const socketPathMaxLength = 107
 
 // Main struct holding the proxy state
 type proxy struct {
-	// Protect concurrent accesses from separate client goroutines to this
-	// structure fields
-	sync.Mutex
-
 	// proxy socket
 	listener net.Listener
 
 	// vms are hashed by their containerID
-	vms map[string]*vm
+	vms *vmRegistry
 
 	// Output the VM console on stderr
 	enableVMConsole bool
 
+	// Size of the buffer keeping the last lines of each VM console, 0 to
+	// not keep them
+	consoleBufferSize int
+
+	// Output queue configuration given to each new VM
+	ioQueue ioQueueConfig
+
 	wg sync.WaitGroup
 }
 
@@ -59,6 +63,7 @@ type proxy struct {
 type client struct {
 	id    uint64
 	proxy *proxy
+	proto *protocol
 	vm    *vm
 
 	conn net.Conn
@@ -81,60 +86,167 @@ func (c *client) infof(lvl glog.Level, fmt string, a ...interface{}) {
 	glog.Infof("[client #%d] "+fmt, a...)
 }
 
-// "hello"
-func helloHandler(data []byte, userData interface{}, response *handlerResponse) {
+// Capture the console of vm, if we've been given its path and there's
+// something to do with the output
+func (proxy *proxy) setVMConsole(vm *vm, path string) {
+	if path == "" || (proxy.consoleBufferSize == 0 && !proxy.enableVMConsole) {
+		return
+	}
+
+	vm.setConsole(path, proxy.consoleBufferSize)
+}
+
+// We start one goroutine per-VM to monitor the qemu process
+func (proxy *proxy) monitorVM(vm *vm) {
+	proxy.wg.Add(1)
+	go func() {
+		<-vm.OnVMLost()
+		// Nobody is left to send the bye of a registered VM that went
+		// away before a hello claimed it. Claiming it here keeps a late
+		// hello from binding to the dead VM.
+		if vm.registered() && vm.claim() {
+			glog.Infof("registered VM %s lost before hello", vm.containerID)
+			proxy.vms.RemoveVM(vm)
+		}
+		vm.Close()
+		proxy.wg.Done()
+	}()
+}
+
+// Default time given to a registered VM to be ready
+const defaultRegisterTimeout = 30 * time.Second
+
+// "register"
+func registerHandler(data []byte, userData interface{}, response *handlerResponse) {
 	client := userData.(*client)
-	hello := api.Hello{}
+	register := api.Register{}
 
-	if err := json.Unmarshal(data, &hello); err != nil {
+	if err := json.Unmarshal(data, &register); err != nil {
 		response.SetError(err)
 		return
 	}
 
-	if hello.ContainerID == "" || hello.CtlSerial == "" || hello.IoSerial == "" {
-		response.SetErrorMsg("malformed hello command")
+	if register.ContainerID == "" || register.CtlSerial == "" ||
+		register.IoSerial == "" || register.Timeout < 0 {
+		response.SetErrorMsg("malformed register command")
+		return
 	}
 
 	proxy := client.proxy
-	proxy.Lock()
-	if _, ok := proxy.vms[hello.ContainerID]; ok {
+	vm := newVM(register.ContainerID, register.CtlSerial, register.IoSerial)
+	vm.connected = make(chan struct{})
+	proxy.setVMConsole(vm, register.Console)
+	vm.setIoQueue(proxy.ioQueue)
 
-		proxy.Unlock()
+	if !proxy.vms.Add(vm) {
 		response.SetErrorf("%s: container already registered",
-			hello.ContainerID)
+			register.ContainerID)
 		return
 	}
 
-	client.infof(1, "hello(containerId=%s,ctlSerial=%s,ioSerial=%s,console=%s)", hello.ContainerID,
-		hello.CtlSerial, hello.IoSerial, hello.Console)
+	client.infof(1, "register(containerId=%s,ctlSerial=%s,ioSerial=%s,console=%s,restore=%v,timeout=%d)",
+		register.ContainerID, register.CtlSerial, register.IoSerial,
+		register.Console, register.Restore, register.Timeout)
+
+	timeout := defaultRegisterTimeout
+	if register.Timeout > 0 {
+		timeout = time.Duration(register.Timeout) * time.Millisecond
+	}
 
-	vm := newVM(hello.ContainerID, hello.CtlSerial, hello.IoSerial)
-	proxy.vms[hello.ContainerID] = vm
-	proxy.Unlock()
+	proxy.wg.Add(1)
+	go func() {
+		defer proxy.wg.Done()
+
+		vm.ConnectInBackground(register.Restore, timeout)
+		if err := vm.WaitConnected(); err != nil {
+			// The error is reported to the hello claiming the VM,
+			// if any. Don't keep a VM that will never be usable.
+			glog.Errorf("couldn't connect to VM %s: %v", vm.containerID, err)
+			proxy.vms.RemoveVM(vm)
+			vm.Close()
+			return
+		}
 
-	if hello.Console != "" && proxy.enableVMConsole {
-		vm.setConsole(hello.Console)
+		proxy.monitorVM(vm)
+	}()
+}
+
+// Bind the client to a VM given by an earlier register
+func helloRegistered(client *client, vm *vm, hello *api.Hello, response *handlerResponse) {
+	if hello.CtlSerial != vm.ctlSerial || hello.IoSerial != vm.ioSerial {
+		response.SetErrorf("%s: hello doesn't match the registered VM",
+			hello.ContainerID)
+		return
+	}
+
+	if !vm.claim() {
+		response.SetErrorf("%s: container already registered",
+			hello.ContainerID)
+		return
 	}
 
-	if err := vm.Connect(); err != nil {
-		proxy.Lock()
-		delete(proxy.vms, hello.ContainerID)
-		proxy.Unlock()
+	client.infof(1, "hello(containerId=%s): waiting for registered VM", hello.ContainerID)
+
+	if err := vm.WaitConnected(); err != nil {
 		response.SetError(err)
 		return
 	}
 
 	client.vm = vm
+}
 
-	response.AddResult("version", api.Version)
+// "hello"
+func helloHandler(data []byte, userData interface{}, response *handlerResponse) {
+	client := userData.(*client)
+	hello := api.Hello{}
 
-	// We start one goroutine per-VM to monitor the qemu process
-	proxy.wg.Add(1)
-	go func() {
-		<-vm.OnVMLost()
-		vm.Close()
-		proxy.wg.Done()
-	}()
+	if err := json.Unmarshal(data, &hello); err != nil {
+		response.SetError(err)
+		return
+	}
+
+	if hello.ContainerID == "" || hello.CtlSerial == "" || hello.IoSerial == "" {
+		response.SetErrorMsg("malformed hello command")
+	}
+
+	proxy := client.proxy
+
+	if vm := proxy.vms.Get(hello.ContainerID); vm != nil && vm.registered() {
+		helloRegistered(client, vm, &hello, response)
+		if client.vm == nil {
+			return
+		}
+	} else {
+		vm := newVM(hello.ContainerID, hello.CtlSerial, hello.IoSerial)
+		// Other clients can look the VM up once it's registered
+		proxy.setVMConsole(vm, hello.Console)
+		vm.setIoQueue(proxy.ioQueue)
+
+		if !proxy.vms.Add(vm) {
+			response.SetErrorf("%s: container already registered",
+				hello.ContainerID)
+			return
+		}
+
+		client.infof(1, "hello(containerId=%s,ctlSerial=%s,ioSerial=%s,console=%s,restore=%v)", hello.ContainerID,
+			hello.CtlSerial, hello.IoSerial, hello.Console, hello.Restore)
+
+		if err := vm.Connect(hello.Restore, time.Time{}); err != nil {
+			proxy.vms.RemoveVM(vm)
+			vm.Close()
+			response.SetError(err)
+			return
+		}
+
+		client.vm = vm
+
+		proxy.monitorVM(vm)
+	}
+
+	response.AddResult("version", api.Version)
+	if hello.RequestIDs {
+		response.EnableRequestIDs()
+	}
 }
 
 // "attach"
@@ -148,9 +260,7 @@ func attachHandler(data []byte, userData interface{}, response *handlerResponse)
 		return
 	}
 
-	proxy.Lock()
-	vm := proxy.vms[attach.ContainerID]
-	proxy.Unlock()
+	vm := proxy.vms.Get(attach.ContainerID)
 
 	if vm == nil {
 		response.SetErrorf("unknown containerID: %s", attach.ContainerID)
@@ -162,15 +272,20 @@ func attachHandler(data []byte, userData interface{}, response *handlerResponse)
 	client.vm = vm
 
 	response.AddResult("version", api.Version)
+	if attach.RequestIDs {
+		response.EnableRequestIDs()
+	}
 }
 
 // "bye"
 func byeHandler(data []byte, userData interface{}, response *handlerResponse) {
-	// Bye only affects the proxy.vms map and so removes the VM from the
+	// Bye only affects the proxy.vms registry and so removes the VM from the
 	// client visible API.
 	// vm.Close(), which tears down the VM object, is done at the end of
 	// the VM life cycle, when  we detect the qemu process is effectively
-	// gone (see helloHandler)
+	// gone (see monitorVM). A registered VM still being connected in the
+	// background never gets there: cancelling it makes the register
+	// goroutine close it.
 
 	client := userData.(*client)
 	proxy := client.proxy
@@ -181,9 +296,7 @@ func byeHandler(data []byte, userData interface{}, response *handlerResponse) {
 		return
 	}
 
-	proxy.Lock()
-	vm := proxy.vms[bye.ContainerID]
-	proxy.Unlock()
+	vm := proxy.vms.Get(bye.ContainerID)
 
 	if vm == nil {
 		response.SetErrorf("unknown containerID: %s", bye.ContainerID)
@@ -192,9 +305,8 @@ func byeHandler(data []byte, userData interface{}, response *handlerResponse) {
 
 	client.info(1, "bye()")
 
-	proxy.Lock()
-	delete(proxy.vms, vm.containerID)
-	proxy.Unlock()
+	proxy.vms.RemoveVM(vm)
+	vm.Cancel()
 
 	client.vm = nil
 }
@@ -247,6 +359,63 @@ func allocateIoHandler(data []byte, userData interface{}, response *handlerRespo
 	c0.Close()
 }
 
+// "console"
+func consoleHandler(data []byte, userData interface{}, response *handlerResponse) {
+	client := userData.(*client)
+	proxy := client.proxy
+
+	console := api.Console{}
+	if err := json.Unmarshal(data, &console); err != nil {
+		response.SetError(err)
+		return
+	}
+
+	vm := proxy.vms.Get(console.ContainerID)
+	if vm == nil {
+		response.SetErrorf("unknown containerID: %s", console.ContainerID)
+		return
+	}
+
+	ring := vm.console.ring
+	if ring == nil {
+		response.SetErrorf("%s: console not captured", console.ContainerID)
+		return
+	}
+
+	client.infof(1, "console(containerId=%s,timestamps=%v,follow=%v)",
+		console.ContainerID, console.Timestamps, console.Follow)
+
+	if !console.Follow {
+		output, dropped := ring.Fetch(console.Timestamps)
+		response.AddResult("output", string(output))
+		response.AddResult("dropped", dropped)
+		return
+	}
+
+	// We'll send c0 to the client and stream the console to c1
+	c0, c1, err := Socketpair()
+	if err != nil {
+		response.SetError(err)
+		return
+	}
+
+	f0, err := c0.File()
+	c0.Close()
+	if err != nil {
+		c1.Close()
+		response.SetError(err)
+		return
+	}
+
+	response.SetFile(f0)
+
+	proxy.wg.Add(1)
+	go func() {
+		ring.Follow(c1, console.Timestamps)
+		proxy.wg.Done()
+	}()
+}
+
 // "hyper"
 func hyperHandler(data []byte, userData interface{}, response *handlerResponse) {
 	client := userData.(*client)
@@ -271,7 +440,12 @@ func hyperHandler(data []byte, userData interface{}, response *handlerResponse)
 
 func newProxy() *proxy {
 	return &proxy{
-		vms: make(map[string]*vm),
+		vms:               newVMRegistry(),
+		consoleBufferSize: defaultConsoleBufferSize,
+		ioQueue: ioQueueConfig{
+			depth:  defaultIoQueueDepth,
+			policy: ioQueueBlock,
+		},
 	}
 }
 
@@ -282,6 +456,29 @@ var DefaultSocketPath string
 // ArgSocketPath is populated at runtime from the option -socket-path
 var ArgSocketPath = flag.String("socket-path", "", "specify path to socket file")
 
+// ArgConsoleBufferSize is populated at runtime from the option
+// -console-buffer-size
+var ArgConsoleBufferSize = flag.Int("console-buffer-size", defaultConsoleBufferSize,
+	"bytes of console output kept for each VM (0 to disable)")
+
+// ArgIoQueueDepth is populated at runtime from the option -io-queue-depth
+var ArgIoQueueDepth = flag.Int("io-queue-depth", defaultIoQueueDepth,
+	"number of I/O messages that can be queued for each client")
+
+// ArgIoQueuePolicy is populated at runtime from the option -io-queue-policy
+var ArgIoQueuePolicy = flag.String("io-queue-policy", "block",
+	"what to do with I/O messages when a client queue is full (block|drop)")
+
+// ArgIoCoalesceBytes is populated at runtime from the option
+// -io-coalesce-bytes
+var ArgIoCoalesceBytes = flag.Int("io-coalesce-bytes", 0,
+	"merge small I/O messages for a client up to that many bytes (0 to disable)")
+
+// ArgIoCoalesceDelay is populated at runtime from the option
+// -io-coalesce-delay
+var ArgIoCoalesceDelay = flag.Duration("io-coalesce-delay", 200*time.Microsecond,
+	"maximum time I/O data can be held back when merging messages")
+
 func (proxy *proxy) init() error {
 	var l net.Listener
 	var err error
@@ -290,6 +487,29 @@ func (proxy *proxy) init() error {
 	v := flag.Lookup("v").Value.(flag.Getter).Get().(glog.Level)
 	proxy.enableVMConsole = v >= 3
 
+	if *ArgConsoleBufferSize < 0 {
+		return fmt.Errorf("invalid console buffer size: %d", *ArgConsoleBufferSize)
+	}
+	proxy.consoleBufferSize = *ArgConsoleBufferSize
+
+	if *ArgIoQueueDepth < 1 {
+		return fmt.Errorf("invalid I/O queue depth: %d", *ArgIoQueueDepth)
+	}
+	proxy.ioQueue.depth = *ArgIoQueueDepth
+	if proxy.ioQueue.policy, err = parseIoQueuePolicy(*ArgIoQueuePolicy); err != nil {
+		return err
+	}
+	if *ArgIoCoalesceBytes < 0 || *ArgIoCoalesceDelay <= 0 {
+		return fmt.Errorf("invalid I/O coalescing parameters: %d bytes, %v",
+			*ArgIoCoalesceBytes, *ArgIoCoalesceDelay)
+	}
+	// Merged packets have to fit in a single I/O packet
+	proxy.ioQueue.coalesceBytes = *ArgIoCoalesceBytes
+	if proxy.ioQueue.coalesceBytes > ioFrameMaxLength-ioHeaderLength {
+		proxy.ioQueue.coalesceBytes = ioFrameMaxLength - ioHeaderLength
+	}
+	proxy.ioQueue.coalesceDelay = *ArgIoCoalesceDelay
+
 	// Open the proxy socket
 	fds := listenFds()
 
@@ -355,6 +575,7 @@ func (proxy *proxy) serveNewClient(proto *protocol, newConn net.Conn) {
 	newClient := &client{
 		id:    id,
 		proxy: proxy,
+		proto: proto,
 		conn:  newConn,
 	}
 
@@ -372,11 +593,14 @@ func (proxy *proxy) serve() {
 
 	// Define the client (runtime/shim) <-> proxy protocol
 	proto := newProtocol()
+	proto.Handle("register", registerHandler)
 	proto.Handle("hello", helloHandler)
 	proto.Handle("attach", attachHandler)
 	proto.Handle("bye", byeHandler)
-	proto.Handle("allocateIO", allocateIoHandler)
-	proto.Handle("hyper", hyperHandler)
+	proto.HandleConcurrent("allocateIO", allocateIoHandler)
+	proto.HandleConcurrent("hyper", hyperHandler)
+	proto.HandleConcurrent("stats", statsHandler)
+	proto.HandleConcurrent("console", consoleHandler)
 
 	glog.V(1).Info("proxy started")
 
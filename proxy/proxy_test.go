@@ -23,6 +23,8 @@ import (
 	"net"
 	"os"
 	"os/exec"
+	"runtime"
+	"strings"
 	"sync"
 	"syscall"
 	"testing"
@@ -47,6 +49,10 @@ type testRig struct {
 	// process
 	proxyFork bool
 
+	// Don't have the hyperstart mock send READY, as when the VM is
+	// restored rather than booted
+	skipReady bool
+
 	// proxy, in process
 	proxy     *proxy
 	protocol  *protocol
@@ -76,9 +82,17 @@ func (rig *testRig) SetFork(fork bool) {
 	rig.proxyFork = fork
 }
 
+func (rig *testRig) SetSkipReady(skip bool) {
+	rig.skipReady = skip
+}
+
 func (rig *testRig) Start() {
 	var err error
 
+	// Objects left behind by previous tests may hold fds closed by their
+	// finalizers. Collect them now rather than in the middle of this test.
+	runtime.GC()
+
 	rig.startFds, err = rig.detector.Snapshot()
 	assert.Nil(rig.t, err)
 
@@ -90,11 +104,13 @@ func (rig *testRig) Start() {
 	rig.Hyperstart.Start()
 
 	// Explicitly send READY message from hyperstart mock
-	rig.wg.Add(1)
-	go func() {
-		rig.Hyperstart.SendMessage(int(hyper.INIT_READY), []byte{})
-		rig.wg.Done()
-	}()
+	if !rig.skipReady {
+		rig.wg.Add(1)
+		go func() {
+			rig.Hyperstart.SendMessage(int(hyper.INIT_READY), []byte{})
+			rig.wg.Done()
+		}()
+	}
 
 	// we can either "start" the proxy in process or spawn a proxy process.
 	// Spawning the process (through TestLaunchProxy).
@@ -225,9 +241,7 @@ func TestHello(t *testing.T) {
 
 	// Hello should register a new vm object
 	proxy := rig.proxy
-	proxy.Lock()
-	vm := proxy.vms[testContainerID]
-	proxy.Unlock()
+	vm := proxy.vms.Get(testContainerID)
 
 	assert.NotNil(t, vm)
 	assert.Equal(t, testContainerID, vm.containerID)
@@ -239,6 +253,173 @@ func TestHello(t *testing.T) {
 	rig.Stop()
 }
 
+func TestHelloRestore(t *testing.T) {
+	proto := newProtocol()
+	proto.Handle("hello", helloHandler)
+
+	// A restored VM's hyperstart has sent READY before the checkpoint,
+	// it doesn't send it again
+	rig := newTestRig(t, proto)
+	rig.SetSkipReady(true)
+	rig.Start()
+
+	ctlSocketPath, ioSocketPath := rig.Hyperstart.GetSocketPaths()
+	ret, err := rig.Client.Hello(testContainerID, ctlSocketPath, ioSocketPath,
+		&api.HelloOptions{Restore: true})
+	assert.Nil(t, err)
+	assert.NotNil(t, ret)
+	assert.Equal(t, api.Version, ret.Version)
+
+	vm := rig.proxy.vms.Get(testContainerID)
+	assert.NotNil(t, vm)
+
+	rig.Stop()
+}
+
+func TestRegister(t *testing.T) {
+	proto := newProtocol()
+	proto.Handle("register", registerHandler)
+	proto.Handle("hello", helloHandler)
+	proto.Handle("hyper", hyperHandler)
+
+	rig := newTestRig(t, proto)
+	rig.Start()
+
+	// Malformed register
+	err := rig.Client.Register(testContainerID, "", "", nil)
+	assert.NotNil(t, err)
+
+	// register returns without waiting for hyperstart
+	ctlSocketPath, ioSocketPath := rig.Hyperstart.GetSocketPaths()
+	err = rig.Client.Register(testContainerID, ctlSocketPath, ioSocketPath, nil)
+	assert.Nil(t, err)
+	assert.NotNil(t, rig.proxy.vms.Get(testContainerID))
+
+	// Registering the same container twice is an error
+	err = rig.Client.Register(testContainerID, ctlSocketPath, ioSocketPath, nil)
+	assert.NotNil(t, err)
+
+	// A hello that doesn't match the registered VM is an error
+	_, err = rig.Client.Hello(testContainerID, "fooCtl", "fooIo", nil)
+	assert.NotNil(t, err)
+
+	// hello binds to the registered VM
+	ret, err := rig.Client.Hello(testContainerID, ctlSocketPath, ioSocketPath, nil)
+	assert.Nil(t, err)
+	assert.NotNil(t, ret)
+	assert.Equal(t, api.Version, ret.Version)
+
+	// And the client can use it
+	err = rig.Client.Hyper("ping", nil)
+	assert.Nil(t, err)
+
+	msgs := rig.Hyperstart.GetLastMessages()
+	assert.Equal(t, 1, len(msgs))
+	assert.Equal(t, hyper.INIT_PING, int(msgs[0].Code))
+
+	// Only one hello can bind to the registered VM
+	_, err = rig.Client.Hello(testContainerID, ctlSocketPath, ioSocketPath, nil)
+	assert.NotNil(t, err)
+
+	rig.Stop()
+}
+
+func TestRegisterTimeout(t *testing.T) {
+	proto := newProtocol()
+	proto.Handle("register", registerHandler)
+	proto.Handle("hello", helloHandler)
+
+	rig := newTestRig(t, proto)
+	rig.Start()
+
+	// The sockets never show up
+	err := rig.Client.Register(testContainerID, "/tmp/nonexistent.0.sock",
+		"/tmp/nonexistent.1.sock", &api.RegisterOptions{
+			Timeout: 20 * time.Millisecond,
+		})
+	assert.Nil(t, err)
+
+	// The error is reported to hello, if it gets to see the VM before
+	// the proxy forgets about it
+	_, err = rig.Client.Hello(testContainerID, "/tmp/nonexistent.0.sock",
+		"/tmp/nonexistent.1.sock", nil)
+	assert.NotNil(t, err)
+
+	rig.proxy.wg.Wait()
+	assert.Nil(t, rig.proxy.vms.Get(testContainerID))
+
+	// The mock hyperstart expects someone to connect to it
+	ctlSocketPath, ioSocketPath := rig.Hyperstart.GetSocketPaths()
+	_, err = rig.Client.Hello(testContainerID, ctlSocketPath, ioSocketPath, nil)
+	assert.Nil(t, err)
+
+	rig.Stop()
+}
+
+func TestRegisterBye(t *testing.T) {
+	proto := newProtocol()
+	proto.Handle("register", registerHandler)
+	proto.Handle("hello", helloHandler)
+	proto.Handle("bye", byeHandler)
+
+	rig := newTestRig(t, proto)
+	rig.Start()
+
+	// The sockets never show up, and the default timeout is long
+	err := rig.Client.Register(testContainerID, "/tmp/nonexistent.0.sock",
+		"/tmp/nonexistent.1.sock", nil)
+	assert.Nil(t, err)
+	stale := rig.proxy.vms.Get(testContainerID)
+	assert.NotNil(t, stale)
+
+	// bye stops waiting for the VM
+	start := time.Now()
+	err = rig.Client.Bye(testContainerID)
+	assert.Nil(t, err)
+	assert.Equal(t, errVMCancelled, stale.WaitConnected())
+	assert.True(t, time.Since(start) < time.Second)
+
+	// The container is created again with the same ID. Whatever is left
+	// of the first VM mustn't unregister the new one.
+	ctlSocketPath, ioSocketPath := rig.Hyperstart.GetSocketPaths()
+	err = rig.Client.Register(testContainerID, ctlSocketPath, ioSocketPath, nil)
+	assert.Nil(t, err)
+	vm := rig.proxy.vms.Get(testContainerID)
+	assert.True(t, vm != stale)
+
+	_, err = rig.Client.Hello(testContainerID, ctlSocketPath, ioSocketPath, nil)
+	assert.Nil(t, err)
+
+	rig.Stop()
+
+	assert.True(t, rig.proxy.vms.Get(testContainerID) == vm)
+}
+
+func TestRegisterLost(t *testing.T) {
+	proto := newProtocol()
+	proto.Handle("register", registerHandler)
+
+	rig := newTestRig(t, proto)
+	rig.Start()
+
+	ctlSocketPath, ioSocketPath := rig.Hyperstart.GetSocketPaths()
+	err := rig.Client.Register(testContainerID, ctlSocketPath, ioSocketPath, nil)
+	assert.Nil(t, err)
+
+	vm := rig.proxy.vms.Get(testContainerID)
+	assert.NotNil(t, vm)
+	assert.Nil(t, vm.WaitConnected())
+
+	// The VM goes away before any hello claims it: it shouldn't stay in
+	// the registry waiting for a bye that will never come
+	rig.Hyperstart.Stop()
+	<-vm.OnVMLost()
+	rig.proxy.wg.Wait()
+	assert.Nil(t, rig.proxy.vms.Get(testContainerID))
+
+	rig.Stop()
+}
+
 func TestBye(t *testing.T) {
 	proto := newProtocol()
 	proto.Handle("hello", helloHandler)
@@ -266,9 +447,7 @@ func TestBye(t *testing.T) {
 
 	// Bye should unregister the vm object
 	proxy := rig.proxy
-	proxy.Lock()
-	vm := proxy.vms[testContainerID]
-	proxy.Unlock()
+	vm := proxy.vms.Get(testContainerID)
 	assert.Nil(t, vm)
 
 	// This test shouldn't send anything to hyperstart
@@ -379,9 +558,6 @@ func TestHyperStartpod(t *testing.T) {
 	rig.Stop()
 }
 
-// header for hyperstart's I/O channel packets is 12 bytes
-const ioHeaderLength = 12
-
 // write a chunk of data to an I/O fd
 func writeIo(t *testing.T, writer io.Writer, seq uint64, data []byte) {
 	length := ioHeaderLength + len(data)
@@ -497,3 +673,459 @@ func TestAllocateIo(t *testing.T) {
 
 	rig.Stop()
 }
+
+// The runtime registers the VM, starts the pod and allocates the I/O streams of
+// the workload with a single batch
+func TestBatchCreate(t *testing.T) {
+	proto := newProtocol()
+	proto.Handle("hello", helloHandler)
+	proto.Handle("hyper", hyperHandler)
+	proto.Handle("allocateIO", allocateIoHandler)
+
+	rig := newTestRig(t, proto)
+	rig.Start()
+
+	ctlSocketPath, ioSocketPath := rig.Hyperstart.GetSocketPaths()
+	hello, err := api.NewRequest("hello", &api.Hello{
+		ContainerID: testContainerID,
+		CtlSerial:   ctlSocketPath,
+		IoSerial:    ioSocketPath,
+	})
+	assert.Nil(t, err)
+	startpod, err := api.NewRequest("hyper", &api.Hyper{
+		HyperName: "startpod",
+		Data:      []byte(`{"hostname":"testhostname","shareDir":"rootfs"}`),
+	})
+	assert.Nil(t, err)
+	allocateIo, err := api.NewRequest("allocateIO", &api.AllocateIo{NStreams: 2})
+	assert.Nil(t, err)
+
+	results, files, err := rig.Client.Batch([]api.Request{*hello, *startpod, *allocateIo})
+	assert.Nil(t, err)
+	assert.Equal(t, 3, len(results))
+	for _, result := range results {
+		assert.True(t, result.Success)
+	}
+	assert.Equal(t, float64(api.Version), results[0].Data["version"])
+	assert.Equal(t, float64(1), results[2].Data["ioBase"])
+	assert.Equal(t, 1, len(files))
+
+	assert.NotNil(t, rig.proxy.vms.Get(testContainerID))
+
+	msgs := rig.Hyperstart.GetLastMessages()
+	assert.Equal(t, 1, len(msgs))
+	assert.Equal(t, hyper.INIT_STARTPOD, int(msgs[0].Code))
+
+	// The fd is the one of the I/O session
+	rig.Hyperstart.SendIoString(1, "stdout\n")
+	seq, data := readIo(t, files[0])
+	assert.Equal(t, uint64(1), seq)
+	assert.Equal(t, "stdout\n", string(data))
+	files[0].Close()
+
+	// The batch stops at the first failing request
+	results, files, err = rig.Client.Batch([]api.Request{*hello, *allocateIo})
+	assert.NotNil(t, err)
+	assert.Equal(t, 1, len(results))
+	assert.False(t, results[0].Success)
+	assert.Equal(t, 0, len(files))
+
+	rig.Stop()
+}
+
+// Size of the I/O messages used to fill up a client socket and queue. The
+// proxy doesn't relay messages bigger than 10KB (hyperstart limit).
+const ioQueueTestPayload = 8 * 1024
+
+func TestIoQueueStalledClient(t *testing.T) {
+	proto := newProtocol()
+	proto.Handle("hello", helloHandler)
+	proto.Handle("allocateIO", allocateIoHandler)
+
+	rig := newTestRig(t, proto)
+	rig.Start()
+
+	rig.proxy.ioQueue = ioQueueConfig{
+		depth:  4,
+		policy: ioQueueDrop,
+	}
+
+	ctlSocketPath, ioSocketPath := rig.Hyperstart.GetSocketPaths()
+	_, err := rig.Client.Hello(testContainerID, ctlSocketPath, ioSocketPath, nil)
+	assert.Nil(t, err)
+
+	// Two processes, the client of the first one never reads its stdout
+	stalledBase, stalledFile, err := rig.Client.AllocateIo(1)
+	assert.Nil(t, err)
+	liveBase, liveFile, err := rig.Client.AllocateIo(1)
+	assert.Nil(t, err)
+
+	// Send way more than what the stalled client socket and queue can
+	// hold
+	const nMessages = 128
+	payload := make([]byte, ioQueueTestPayload)
+	for i := 0; i < nMessages; i++ {
+		rig.Hyperstart.SendIo(stalledBase, payload)
+	}
+
+	// The other process output should still go through
+	const stdoutData = "stdout\n"
+	rig.Hyperstart.SendIoString(liveBase, stdoutData)
+	seq, data := readIo(t, liveFile)
+	assert.Equal(t, liveBase, seq)
+	assert.Equal(t, stdoutData, string(data))
+
+	// The live session output has been relayed after all the messages
+	// destined to the stalled one, so its counters are final by now.
+	vm := rig.proxy.vms.Get(testContainerID)
+	assert.NotNil(t, vm)
+	stats := vm.findSession(stalledBase).queueStats()
+	assert.Equal(t, int64(4), stats.highWater)
+	assert.True(t, stats.dropped > 0)
+	assert.True(t, stats.dropped < nMessages)
+	assert.Equal(t, int64(0), stats.blocked)
+
+	stats = vm.findSession(liveBase).queueStats()
+	assert.Equal(t, uint64(0), stats.dropped)
+
+	stalledFile.Close()
+	liveFile.Close()
+
+	rig.Stop()
+}
+
+// A stalled client still gets the end of its stream and the exit status of the
+// process with the drop policy
+func TestIoQueueDropExitStatus(t *testing.T) {
+	proto := newProtocol()
+	proto.Handle("hello", helloHandler)
+	proto.Handle("allocateIO", allocateIoHandler)
+
+	rig := newTestRig(t, proto)
+	rig.Start()
+
+	rig.proxy.ioQueue = ioQueueConfig{
+		depth:  2,
+		policy: ioQueueDrop,
+	}
+
+	ctlSocketPath, ioSocketPath := rig.Hyperstart.GetSocketPaths()
+	_, err := rig.Client.Hello(testContainerID, ctlSocketPath, ioSocketPath, nil)
+	assert.Nil(t, err)
+
+	ioBase, ioFile, err := rig.Client.AllocateIo(1)
+	assert.Nil(t, err)
+
+	// Fill up the client socket and queue, then exit. The proxy waits for
+	// the client to have room for the end of the stream and exit status.
+	const nMessages = 128
+	var wg sync.WaitGroup
+	wg.Add(1)
+	go func() {
+		payload := make([]byte, ioQueueTestPayload)
+		for i := 0; i < nMessages; i++ {
+			rig.Hyperstart.SendIo(ioBase, payload)
+		}
+		rig.Hyperstart.CloseIo(ioBase)
+		rig.Hyperstart.SendExitStatus(ioBase, 17)
+		wg.Done()
+	}()
+
+	vm := rig.proxy.vms.Get(testContainerID)
+	assert.NotNil(t, vm)
+	session := vm.findSession(ioBase)
+	for i := 0; i < 1000 && session.queueStats().blocked == 0; i++ {
+		time.Sleep(1 * time.Millisecond)
+	}
+
+	received := 0
+	for {
+		seq, data := readIo(t, ioFile)
+		assert.Equal(t, ioBase, seq)
+		if len(data) == 0 {
+			break
+		}
+		assert.Equal(t, ioQueueTestPayload, len(data))
+		received++
+	}
+	assert.True(t, received < nMessages)
+
+	seq, data := readIo(t, ioFile)
+	assert.Equal(t, ioBase, seq)
+	assert.Equal(t, 1, len(data))
+	assert.Equal(t, uint8(17), data[0])
+	wg.Wait()
+
+	stats := session.queueStats()
+	assert.Equal(t, uint64(nMessages-received), stats.dropped)
+	assert.True(t, stats.blocked > 0)
+
+	ioFile.Close()
+
+	rig.Stop()
+}
+
+func TestIoQueueBlock(t *testing.T) {
+	proto := newProtocol()
+	proto.Handle("hello", helloHandler)
+	proto.Handle("allocateIO", allocateIoHandler)
+
+	rig := newTestRig(t, proto)
+	rig.Start()
+
+	rig.proxy.ioQueue = ioQueueConfig{
+		depth:  2,
+		policy: ioQueueBlock,
+	}
+
+	ctlSocketPath, ioSocketPath := rig.Hyperstart.GetSocketPaths()
+	_, err := rig.Client.Hello(testContainerID, ctlSocketPath, ioSocketPath, nil)
+	assert.Nil(t, err)
+
+	ioBase, ioFile, err := rig.Client.AllocateIo(1)
+	assert.Nil(t, err)
+
+	const nMessages = 64
+	var wg sync.WaitGroup
+	wg.Add(1)
+	go func() {
+		for i := 0; i < nMessages; i++ {
+			payload := make([]byte, ioQueueTestPayload)
+			payload[0] = byte(i)
+			rig.Hyperstart.SendIo(ioBase, payload)
+		}
+		wg.Done()
+	}()
+
+	// Wait for the queue to fill up while the client isn't reading
+	vm := rig.proxy.vms.Get(testContainerID)
+	assert.NotNil(t, vm)
+	session := vm.findSession(ioBase)
+	for i := 0; i < 1000 && session.queueStats().highWater < 2; i++ {
+		time.Sleep(1 * time.Millisecond)
+	}
+	assert.Equal(t, int64(2), session.queueStats().highWater)
+
+	// Nothing is lost with the block policy
+	for i := 0; i < nMessages; i++ {
+		seq, data := readIo(t, ioFile)
+		assert.Equal(t, ioBase, seq)
+		assert.Equal(t, ioQueueTestPayload, len(data))
+		assert.Equal(t, byte(i), data[0])
+	}
+	wg.Wait()
+
+	stats := session.queueStats()
+	assert.Equal(t, uint64(0), stats.dropped)
+	assert.True(t, stats.blocked > 0)
+
+	ioFile.Close()
+
+	rig.Stop()
+}
+
+func TestIoCoalesce(t *testing.T) {
+	proto := newProtocol()
+	proto.Handle("hello", helloHandler)
+	proto.Handle("allocateIO", allocateIoHandler)
+
+	rig := newTestRig(t, proto)
+	rig.Start()
+
+	// Long delay, the packets are written because of the other conditions
+	rig.proxy.ioQueue.coalesceBytes = 8
+	rig.proxy.ioQueue.coalesceDelay = 1 * time.Minute
+
+	ctlSocketPath, ioSocketPath := rig.Hyperstart.GetSocketPaths()
+	_, err := rig.Client.Hello(testContainerID, ctlSocketPath, ioSocketPath, nil)
+	assert.Nil(t, err)
+
+	ioBase, ioFile, err := rig.Client.AllocateIo(2)
+	assert.Nil(t, err)
+
+	// Reaching the byte budget
+	rig.Hyperstart.SendIoString(ioBase, "1234")
+	rig.Hyperstart.SendIoString(ioBase, "5678")
+	seq, data := readIo(t, ioFile)
+	assert.Equal(t, ioBase, seq)
+	assert.Equal(t, "12345678", string(data))
+
+	// Data for another stream, then the end of the streams
+	rig.Hyperstart.SendIoString(ioBase, "ab")
+	rig.Hyperstart.SendIoString(ioBase, "cd")
+	rig.Hyperstart.SendIoString(ioBase+1, "ef")
+	rig.Hyperstart.CloseIo(ioBase + 1)
+	rig.Hyperstart.CloseIo(ioBase)
+	rig.Hyperstart.SendExitStatus(ioBase, 17)
+
+	expected := []struct {
+		seq  uint64
+		data string
+	}{
+		{ioBase, "abcd"},
+		{ioBase + 1, "ef"},
+		{ioBase + 1, ""},
+		{ioBase, ""},
+		{ioBase, "\x11"},
+	}
+	for _, e := range expected {
+		seq, data = readIo(t, ioFile)
+		assert.Equal(t, e.seq, seq)
+		assert.Equal(t, e.data, string(data))
+	}
+
+	ioFile.Close()
+
+	rig.Stop()
+}
+
+func TestIoCoalesceDelay(t *testing.T) {
+	proto := newProtocol()
+	proto.Handle("hello", helloHandler)
+	proto.Handle("allocateIO", allocateIoHandler)
+
+	rig := newTestRig(t, proto)
+	rig.Start()
+
+	const delay = 10 * time.Millisecond
+	rig.proxy.ioQueue.coalesceBytes = 1024
+	rig.proxy.ioQueue.coalesceDelay = delay
+
+	ctlSocketPath, ioSocketPath := rig.Hyperstart.GetSocketPaths()
+	_, err := rig.Client.Hello(testContainerID, ctlSocketPath, ioSocketPath, nil)
+	assert.Nil(t, err)
+
+	// Data is held back for at most the coalescing delay
+	ioBase, ioFile, err := rig.Client.AllocateIo(2)
+	assert.Nil(t, err)
+
+	start := time.Now()
+	rig.Hyperstart.SendIoString(ioBase, "stdout\n")
+	seq, data := readIo(t, ioFile)
+	assert.Equal(t, ioBase, seq)
+	assert.Equal(t, "stdout\n", string(data))
+	assert.True(t, time.Since(start) >= delay)
+
+	// Terminal output isn't coalesced
+	ttyBase, ttyFile, err := rig.Client.AllocateIo(1)
+	assert.Nil(t, err)
+
+	rig.Hyperstart.SendIoString(ttyBase, "a")
+	rig.Hyperstart.SendIoString(ttyBase, "b")
+	for _, expected := range []string{"a", "b"} {
+		seq, data = readIo(t, ttyFile)
+		assert.Equal(t, ttyBase, seq)
+		assert.Equal(t, expected, string(data))
+	}
+
+	ioFile.Close()
+	ttyFile.Close()
+
+	rig.Stop()
+}
+
+// Fetch the proxy stats until they contain all the samples in expected. The
+// I/O counters are updated after the data has been written, so they can lag
+// behind what the test has just received.
+func waitForStats(t *testing.T, client *api.Client, expected []string) string {
+	var metrics string
+	var err error
+
+	for i := 0; i < 100; i++ {
+		metrics, err = client.Stats()
+		assert.Nil(t, err)
+
+		found := 0
+		for _, sample := range expected {
+			if strings.Contains(metrics, sample+"\n") {
+				found++
+			}
+		}
+		if found == len(expected) {
+			break
+		}
+
+		time.Sleep(1 * time.Millisecond)
+	}
+
+	for _, sample := range expected {
+		assert.Contains(t, metrics, sample+"\n")
+	}
+
+	return metrics
+}
+
+func TestStats(t *testing.T) {
+	proto := newProtocol()
+	proto.Handle("hello", helloHandler)
+	proto.Handle("allocateIO", allocateIoHandler)
+	proto.Handle("stats", statsHandler)
+
+	rig := newTestRig(t, proto)
+	rig.Start()
+
+	// Stats don't need a VM
+	waitForStats(t, rig.Client, []string{
+		"cc_proxy_vms 0",
+		`cc_proxy_command_duration_seconds_count{command="hello"} 0`,
+	})
+
+	ctlSocketPath, ioSocketPath := rig.Hyperstart.GetSocketPaths()
+	_, err := rig.Client.Hello(testContainerID, ctlSocketPath, ioSocketPath, nil)
+	assert.Nil(t, err)
+
+	ioBase, ioFile, err := rig.Client.AllocateIo(2)
+	assert.Nil(t, err)
+
+	// Relay some data in both directions
+	rig.Hyperstart.SendIoString(ioBase, "stdout\n")
+	seq, _ := readIo(t, ioFile)
+	assert.Equal(t, ioBase, seq)
+
+	writeIo(t, ioFile, ioBase, []byte("stdin\n"))
+	buf := make([]byte, 32)
+	_, seq = rig.Hyperstart.ReadIo(buf)
+	assert.Equal(t, ioBase, seq)
+
+	metrics := waitForStats(t, rig.Client, []string{
+		"cc_proxy_vms 1",
+		`cc_proxy_command_duration_seconds_count{command="hello"} 1`,
+		`cc_proxy_command_duration_seconds_count{command="allocateIO"} 1`,
+		`cc_proxy_command_duration_seconds_bucket{command="allocateIO",le="+Inf"} 1`,
+		`cc_proxy_vm_goroutines{vm="0987654321"} 3`,
+		`cc_proxy_vm_io_bytes_total{vm="0987654321",direction="to_client"} 7`,
+		`cc_proxy_vm_io_bytes_total{vm="0987654321",direction="to_vm"} 6`,
+		`cc_proxy_session_io_bytes_total{vm="0987654321",session="1",direction="to_client"} 7`,
+		`cc_proxy_session_io_bytes_total{vm="0987654321",session="1",direction="to_vm"} 6`,
+		`cc_proxy_session_io_frames_total{vm="0987654321",session="1",direction="to_client"} 1`,
+		`cc_proxy_session_io_frames_total{vm="0987654321",session="1",direction="to_vm"} 1`,
+		`cc_proxy_session_queue_size{vm="0987654321",session="1"} 128`,
+		`cc_proxy_session_queue_dropped_total{vm="0987654321",session="1"} 0`,
+	})
+
+	// Every sample belongs to a declared metric family
+	families := make(map[string]bool)
+	for _, line := range strings.Split(strings.TrimSpace(metrics), "\n") {
+		if strings.HasPrefix(line, "# TYPE ") {
+			families[strings.Fields(line)[2]] = true
+			continue
+		}
+		if strings.HasPrefix(line, "#") {
+			continue
+		}
+
+		name := strings.FieldsFunc(line, func(r rune) bool {
+			return r == '{' || r == ' '
+		})[0]
+		for _, suffix := range []string{"_bucket", "_sum", "_count"} {
+			if strings.HasSuffix(name, suffix) && !families[name] {
+				name = strings.TrimSuffix(name, suffix)
+			}
+		}
+		assert.True(t, families[name], "undeclared metric %s", name)
+	}
+
+	ioFile.Close()
+
+	rig.Stop()
+}
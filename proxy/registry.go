@@ -0,0 +1,125 @@
+// Copyright (c) 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package main
+
+import (
+	"sync"
+)
+
+// Number of shards the VM registry is split into. Needs to be a power of 2.
+const vmRegistryShards = 64
+
+type vmRegistryShard struct {
+	sync.RWMutex
+	vms map[string]*vm
+}
+
+// vmRegistry holds the VMs known to the proxy, hashed by their containerID.
+//
+// The registry is split into shards, each with its own lock, so that
+// hello/attach/bye commands issued by different clients for different VMs
+// don't all serialize on a single lock.
+type vmRegistry struct {
+	shards [vmRegistryShards]vmRegistryShard
+}
+
+func newVMRegistry() *vmRegistry {
+	r := &vmRegistry{}
+	for i := range r.shards {
+		r.shards[i].vms = make(map[string]*vm)
+	}
+	return r
+}
+
+// FNV-1a, inlined to not allocate a hash.Hash32 on every lookup
+func (r *vmRegistry) shard(containerID string) *vmRegistryShard {
+	const (
+		offset32 = 2166136261
+		prime32  = 16777619
+	)
+
+	h := uint32(offset32)
+	for i := 0; i < len(containerID); i++ {
+		h ^= uint32(containerID[i])
+		h *= prime32
+	}
+
+	return &r.shards[h&(vmRegistryShards-1)]
+}
+
+// Add registers vm. It returns false if a VM with the same containerID is
+// already registered.
+func (r *vmRegistry) Add(vm *vm) bool {
+	s := r.shard(vm.containerID)
+
+	s.Lock()
+	defer s.Unlock()
+
+	if _, ok := s.vms[vm.containerID]; ok {
+		return false
+	}
+	s.vms[vm.containerID] = vm
+
+	return true
+}
+
+// Get returns the VM registered with containerID or nil.
+func (r *vmRegistry) Get(containerID string) *vm {
+	s := r.shard(containerID)
+
+	s.RLock()
+	defer s.RUnlock()
+
+	return s.vms[containerID]
+}
+
+// RemoveVM unregisters vm, if it's still the VM registered under its
+// containerID. Goroutines outliving their VM use it so they don't remove a
+// new VM registered with the same containerID.
+func (r *vmRegistry) RemoveVM(vm *vm) {
+	s := r.shard(vm.containerID)
+
+	s.Lock()
+	if s.vms[vm.containerID] == vm {
+		delete(s.vms, vm.containerID)
+	}
+	s.Unlock()
+}
+
+// Len returns the number of registered VMs.
+func (r *vmRegistry) Len() int {
+	n := 0
+	for i := range r.shards {
+		s := &r.shards[i]
+		s.RLock()
+		n += len(s.vms)
+		s.RUnlock()
+	}
+	return n
+}
+
+// List returns the registered VMs.
+func (r *vmRegistry) List() []*vm {
+	var vms []*vm
+	for i := range r.shards {
+		s := &r.shards[i]
+		s.RLock()
+		for _, vm := range s.vms {
+			vms = append(vms, vm)
+		}
+		s.RUnlock()
+	}
+	return vms
+}
@@ -0,0 +1,58 @@
+// Copyright (c) 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package main
+
+import (
+	"fmt"
+	"testing"
+
+	"github.com/stretchr/testify/assert"
+)
+
+func TestVMRegistry(t *testing.T) {
+	r := newVMRegistry()
+
+	assert.Nil(t, r.Get(testContainerID))
+
+	vm := newVM(testContainerID, "", "")
+	assert.True(t, r.Add(vm))
+	assert.Equal(t, vm, r.Get(testContainerID))
+
+	// Registering the same containerID twice should fail and keep the
+	// first VM around
+	assert.False(t, r.Add(newVM(testContainerID, "", "")))
+	assert.Equal(t, vm, r.Get(testContainerID))
+
+	// Spread a few more VMs over the shards
+	for i := 0; i < 2*vmRegistryShards; i++ {
+		assert.True(t, r.Add(newVM(fmt.Sprintf("vm-%d", i), "", "")))
+	}
+	assert.Equal(t, 2*vmRegistryShards+1, r.Len())
+
+	r.RemoveVM(vm)
+	assert.Nil(t, r.Get(testContainerID))
+	assert.Equal(t, 2*vmRegistryShards, r.Len())
+
+	// Removing an unknown VM is a no-op
+	r.RemoveVM(newVM("foo", "", ""))
+	assert.Equal(t, 2*vmRegistryShards, r.Len())
+
+	// So is removing a VM that has been replaced by a new one with the
+	// same containerID
+	newer := newVM(testContainerID, "", "")
+	assert.True(t, r.Add(newer))
+	r.RemoveVM(vm)
+	assert.Equal(t, newer, r.Get(testContainerID))
+}
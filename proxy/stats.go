@@ -0,0 +1,301 @@
+// Copyright (c) 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package main
+
+import (
+	"bytes"
+	"fmt"
+	"runtime"
+	"sort"
+	"strconv"
+	"strings"
+	"sync/atomic"
+	"time"
+)
+
+// Upper bounds, in seconds, of the command latency histogram buckets. An
+// implicit +Inf bucket follows.
+var latencyBuckets = [...]float64{
+	0.0001, 0.00025, 0.0005,
+	0.001, 0.0025, 0.005,
+	0.01, 0.025, 0.05,
+	0.1, 0.25, 0.5,
+	1, 2.5, 5, 10,
+}
+
+// latencyHistogram counts the durations of a command, accessed atomically.
+type latencyHistogram struct {
+	count uint64
+	// in ns
+	sum    int64
+	counts [len(latencyBuckets) + 1]uint64
+}
+
+// Observe adds d to the histogram.
+func (h *latencyHistogram) Observe(d time.Duration) {
+	seconds := d.Seconds()
+	i := 0
+	for i < len(latencyBuckets) && seconds > latencyBuckets[i] {
+		i++
+	}
+
+	atomic.AddUint64(&h.counts[i], 1)
+	atomic.AddInt64(&h.sum, int64(d))
+	atomic.AddUint64(&h.count, 1)
+}
+
+// Stats are exposed in the Prometheus text exposition format, one sample per
+// line, which node agents can parse without a JSON decoder.
+//
+// See https://prometheus.io/docs/instrumenting/exposition_formats/
+type statsWriter struct {
+	bytes.Buffer
+}
+
+var labelEscaper = strings.NewReplacer(`\`, `\\`, `"`, `\"`, "\n", `\n`)
+
+func (w *statsWriter) family(name, kind, help string) {
+	fmt.Fprintf(w, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, kind)
+}
+
+// labels are given as name, value pairs
+func (w *statsWriter) sample(name string, value string, labels ...string) {
+	w.WriteString(name)
+	for i := 0; i+1 < len(labels); i += 2 {
+		if i == 0 {
+			w.WriteByte('{')
+		} else {
+			w.WriteByte(',')
+		}
+		fmt.Fprintf(w, `%s="%s"`, labels[i], labelEscaper.Replace(labels[i+1]))
+	}
+	if len(labels) > 1 {
+		w.WriteByte('}')
+	}
+	w.WriteByte(' ')
+	w.WriteString(value)
+	w.WriteByte('\n')
+}
+
+func formatUint(v uint64) string {
+	return strconv.FormatUint(v, 10)
+}
+
+func formatFloat(v float64) string {
+	return strconv.FormatFloat(v, 'g', -1, 64)
+}
+
+func formatSeconds(ns int64) string {
+	return formatFloat(time.Duration(ns).Seconds())
+}
+
+func (w *statsWriter) writeCommands(proto *protocol) {
+	commands := make([]string, 0, len(proto.latencies))
+	for cmd := range proto.latencies {
+		commands = append(commands, cmd)
+	}
+	sort.Strings(commands)
+
+	name := "cc_proxy_command_duration_seconds"
+	w.family(name, "histogram", "Time taken to handle proxy commands.")
+	for _, cmd := range commands {
+		h := proto.latencies[cmd]
+
+		cumulative := uint64(0)
+		for i := range h.counts {
+			le := "+Inf"
+			if i < len(latencyBuckets) {
+				le = formatFloat(latencyBuckets[i])
+			}
+			cumulative += atomic.LoadUint64(&h.counts[i])
+			w.sample(name+"_bucket", formatUint(cumulative),
+				"command", cmd, "le", le)
+		}
+		w.sample(name+"_sum", formatSeconds(atomic.LoadInt64(&h.sum)),
+			"command", cmd)
+		w.sample(name+"_count", formatUint(atomic.LoadUint64(&h.count)),
+			"command", cmd)
+	}
+}
+
+type sessionSnapshot struct {
+	vm      string
+	ioBase  string
+	relay   ioRelayStats
+	queue   ioQueueStats
+	depth   int
+	maxSize int
+}
+
+type vmSnapshot struct {
+	id         string
+	goroutines int
+	relay      ioRelayStats
+	sessions   []sessionSnapshot
+}
+
+func snapshotVMs(proxy *proxy) []vmSnapshot {
+	vms := proxy.vms.List()
+	sort.Slice(vms, func(i, j int) bool {
+		return vms[i].containerID < vms[j].containerID
+	})
+
+	snapshots := make([]vmSnapshot, 0, len(vms))
+	for _, vm := range vms {
+		snapshot := vmSnapshot{
+			id:         vm.containerID,
+			goroutines: vm.goroutines(),
+		}
+
+		for _, session := range vm.ioSessionList() {
+			s := sessionSnapshot{
+				vm:      vm.containerID,
+				ioBase:  formatUint(session.ioBase),
+				relay:   session.relayStats(),
+				queue:   session.queueStats(),
+				depth:   len(session.out),
+				maxSize: cap(session.out),
+			}
+
+			snapshot.relay.toClientBytes += s.relay.toClientBytes
+			snapshot.relay.toClientFrames += s.relay.toClientFrames
+			snapshot.relay.toVMBytes += s.relay.toVMBytes
+			snapshot.relay.toVMFrames += s.relay.toVMFrames
+
+			snapshot.sessions = append(snapshot.sessions, s)
+		}
+
+		snapshots = append(snapshots, snapshot)
+	}
+
+	return snapshots
+}
+
+func (w *statsWriter) writeVMs(vms []vmSnapshot) {
+	w.family("cc_proxy_vms", "gauge", "Number of VMs registered with the proxy.")
+	w.sample("cc_proxy_vms", strconv.Itoa(len(vms)))
+
+	w.family("cc_proxy_vm_goroutines", "gauge", "Number of goroutines serving a VM.")
+	for _, vm := range vms {
+		w.sample("cc_proxy_vm_goroutines", strconv.Itoa(vm.goroutines), "vm", vm.id)
+	}
+
+	counters := []struct {
+		name, help string
+		value      func(*ioRelayStats) (uint64, uint64)
+	}{
+		{
+			"cc_proxy_vm_io_bytes_total", "I/O payload bytes relayed for a VM.",
+			func(s *ioRelayStats) (uint64, uint64) { return s.toClientBytes, s.toVMBytes },
+		},
+		{
+			"cc_proxy_vm_io_frames_total", "I/O packets relayed for a VM.",
+			func(s *ioRelayStats) (uint64, uint64) { return s.toClientFrames, s.toVMFrames },
+		},
+	}
+	for _, c := range counters {
+		w.family(c.name, "counter", c.help)
+		for i := range vms {
+			toClient, toVM := c.value(&vms[i].relay)
+			w.sample(c.name, formatUint(toClient), "vm", vms[i].id, "direction", "to_client")
+			w.sample(c.name, formatUint(toVM), "vm", vms[i].id, "direction", "to_vm")
+		}
+	}
+}
+
+func (w *statsWriter) writeSessions(vms []vmSnapshot) {
+	forEach := func(fn func(s *sessionSnapshot)) {
+		for i := range vms {
+			for j := range vms[i].sessions {
+				fn(&vms[i].sessions[j])
+			}
+		}
+	}
+
+	name := "cc_proxy_session_io_bytes_total"
+	w.family(name, "counter", "I/O payload bytes relayed for a session.")
+	forEach(func(s *sessionSnapshot) {
+		w.sample(name, formatUint(s.relay.toClientBytes),
+			"vm", s.vm, "session", s.ioBase, "direction", "to_client")
+		w.sample(name, formatUint(s.relay.toVMBytes),
+			"vm", s.vm, "session", s.ioBase, "direction", "to_vm")
+	})
+
+	name = "cc_proxy_session_io_frames_total"
+	w.family(name, "counter", "I/O packets relayed for a session.")
+	forEach(func(s *sessionSnapshot) {
+		w.sample(name, formatUint(s.relay.toClientFrames),
+			"vm", s.vm, "session", s.ioBase, "direction", "to_client")
+		w.sample(name, formatUint(s.relay.toVMFrames),
+			"vm", s.vm, "session", s.ioBase, "direction", "to_vm")
+	})
+
+	gauges := []struct {
+		name, kind, help string
+		value            func(s *sessionSnapshot) string
+	}{
+		{
+			"cc_proxy_session_queue_depth", "gauge",
+			"I/O packets waiting to be written to the client.",
+			func(s *sessionSnapshot) string { return strconv.Itoa(s.depth) },
+		},
+		{
+			"cc_proxy_session_queue_size", "gauge",
+			"Maximum number of I/O packets the queue can hold.",
+			func(s *sessionSnapshot) string { return strconv.Itoa(s.maxSize) },
+		},
+		{
+			"cc_proxy_session_queue_high_water", "gauge",
+			"Largest number of I/O packets seen waiting in the queue.",
+			func(s *sessionSnapshot) string { return strconv.FormatInt(s.queue.highWater, 10) },
+		},
+		{
+			"cc_proxy_session_queue_blocked_seconds_total", "counter",
+			"Time the relay spent waiting for room in the queue.",
+			func(s *sessionSnapshot) string { return formatSeconds(s.queue.blocked) },
+		},
+		{
+			"cc_proxy_session_queue_dropped_total", "counter",
+			"I/O packets discarded because the queue was full.",
+			func(s *sessionSnapshot) string { return formatUint(s.queue.dropped) },
+		},
+	}
+	for _, g := range gauges {
+		w.family(g.name, g.kind, g.help)
+		forEach(func(s *sessionSnapshot) {
+			w.sample(g.name, g.value(s), "vm", s.vm, "session", s.ioBase)
+		})
+	}
+}
+
+// "stats"
+func statsHandler(data []byte, userData interface{}, response *handlerResponse) {
+	client := userData.(*client)
+
+	client.info(1, "stats()")
+
+	w := &statsWriter{}
+
+	w.family("cc_proxy_goroutines", "gauge", "Number of goroutines in the proxy.")
+	w.sample("cc_proxy_goroutines", strconv.Itoa(runtime.NumGoroutine()))
+
+	w.writeCommands(client.proto)
+
+	vms := snapshotVMs(client.proxy)
+	w.writeVMs(vms)
+	w.writeSessions(vms)
+
+	response.AddResult("metrics", w.String())
+}
@@ -16,37 +16,120 @@ package main
 
 import (
 	"bufio"
+	"bytes"
 	"encoding/hex"
+	"errors"
 	"fmt"
 	"net"
 	"os"
+	"sort"
 	"sync"
+	"sync/atomic"
+	"time"
 
-	"github.com/containers/virtcontainers/hyperstart"
 	"github.com/golang/glog"
 )
 
+// What to do with data coming from hyperstart when the output queue of the
+// ioSession it's destined to is full.
+type ioQueuePolicy int
+
+const (
+	// Wait for the session writer to make room in the queue. No data is
+	// lost but, once the queue is full, a slow client holds up the relay
+	// of all the I/O streams of the VM.
+	ioQueueBlock ioQueuePolicy = iota
+	// Discard the data. A slow client never holds up the other I/O
+	// streams of the VM, until the end of its streams, which is waited
+	// for like with ioQueueBlock.
+	ioQueueDrop
+)
+
+func parseIoQueuePolicy(s string) (ioQueuePolicy, error) {
+	switch s {
+	case "block":
+		return ioQueueBlock, nil
+	case "drop":
+		return ioQueueDrop, nil
+	}
+	return ioQueueBlock, fmt.Errorf("unknown I/O queue policy: %s", s)
+}
+
+func (p ioQueuePolicy) String() string {
+	if p == ioQueueDrop {
+		return "drop"
+	}
+	return "block"
+}
+
+// Default number of I/O messages that can be queued for a client
+const defaultIoQueueDepth = 128
+
+// Size of the buffer used to read the hyperstart I/O channel, big enough to
+// hold a few maximum sized packets
+const ioReadBufferSize = 4 * ioFrameMaxLength
+
+// Configuration of the per-ioSession output queues
+type ioQueueConfig struct {
+	depth  int
+	policy ioQueuePolicy
+
+	// When coalesceBytes isn't 0, consecutive small packets for the same
+	// stream are merged before being written to the client, up to
+	// coalesceBytes of data or until the first packet has been waiting
+	// for coalesceDelay (see ioSessionCoalescingWriter())
+	coalesceBytes int
+	coalesceDelay time.Duration
+}
+
 // Represents a single qemu/hyperstart instance on the system
 type vm struct {
+	// Serializes the updates of ioSessions and nextIoBase, protects
+	// console.conn
 	sync.Mutex
 
 	containerID string
 
-	hyperHandler *hyperstart.Hyperstart
+	// Paths of the hyperstart channels
+	ctlSerial, ioSerial string
+
+	hyperHandler *hyperstartChannels
+
+	// When the VM has been registered ahead of hello (see registerHandler),
+	// closed once the hyperstart channels are connected in the background
+	// or connectErr says why they couldn't be.
+	connected  chan struct{}
+	connectErr error
+
+	// Set by the hello claiming a registered VM
+	claimed int32
 
-	// Socket to the VM console
+	// Closed by Cancel() to abort the background connection of a
+	// registered VM
+	cancelled  chan struct{}
+	cancelOnce sync.Once
+
+	// Socket to the VM console and the last lines read from it
 	console struct {
 		socketPath string
 		conn       net.Conn
+		ring       *consoleRing
 	}
 
+	// Output queue configuration for the ioSessions of this VM
+	ioQueue ioQueueConfig
+
 	// Used to allocate globally unique IO sequence numbers
 	nextIoBase uint64
 
 	// ios are hashed by their sequence numbers. If 2 sequence numbers are
 	// allocated for one process (stdin/stdout and stderr) both sequence
 	// numbers appear in this map.
-	ioSessions map[uint64]*ioSession
+	//
+	// ioSessions holds a map[uint64]*ioSession that is never modified once
+	// stored: writers, holding the vm lock, store an updated copy so the
+	// I/O relay can look sessions up without taking any lock.
+	ioSessions atomic.Value
 
 	// Used to wait for all VM-global goroutines to finish on Close()
 	wg sync.WaitGroup
@@ -55,8 +138,32 @@ type vm struct {
 	vmLost chan interface{}
 }
 
+// Counters on the output queue of an ioSession, accessed atomically
+type ioQueueStats struct {
+	// Largest number of messages seen waiting in the queue
+	highWater int64
+	// Time the relay spent waiting for room in the queue, in ns
+	blocked int64
+	// Number of messages discarded because the queue was full
+	dropped uint64
+}
+
+// Counters on the data relayed for an ioSession, accessed atomically. Bytes
+// are payload bytes, not counting the packet headers.
+type ioRelayStats struct {
+	toClientBytes  uint64
+	toClientFrames uint64
+	toVMBytes      uint64
+	toVMFrames     uint64
+}
+
 // A set of I/O streams between a client and a process running inside the VM
 type ioSession struct {
+	// First fields to guarantee the 64-bit alignment atomic operations
+	// need on 32-bit platforms
+	stats ioQueueStats
+	relay ioRelayStats
+
 	nStreams int
 	ioBase   uint64
 
@@ -66,26 +173,59 @@ type ioSession struct {
 	// socket connected to the fd sent over to the client
 	client net.Conn
 
-	// Used to wait for per-ioSession goroutines. Currently there's only
-	// one such goroutine, the one reading stdin data from client socket.
+	// Messages from hyperstart waiting to be written to the client
+	out    chan *ioFrame
+	policy ioQueuePolicy
+
+	// Whether hyperstart has closed each stream, only accessed by
+	// ioHyperToClients
+	ended []bool
+
+	// Coalescing of the output, disabled when coalesceBytes is 0
+	coalesceBytes int
+	coalesceDelay time.Duration
+
+	// Closed to stop the per-ioSession goroutines
+	done chan struct{}
+
+	// Used to wait for per-ioSession goroutines: the one reading stdin
+	// data from the client socket and the one writing the output queue to
+	// it.
 	wg sync.WaitGroup
 }
 
 func newVM(id, ctlSerial, ioSerial string) *vm {
-	h := hyperstart.NewHyperstart(ctlSerial, ioSerial, "unix")
+	h := newHyperstartChannels(ctlSerial, ioSerial)
 
-	return &vm{
+	vm := &vm{
 		containerID:  id,
+		ctlSerial:    ctlSerial,
+		ioSerial:     ioSerial,
 		hyperHandler: h,
 		nextIoBase:   1,
-		ioSessions:   make(map[uint64]*ioSession),
-		vmLost:       make(chan interface{}),
+		ioQueue: ioQueueConfig{
+			depth:  defaultIoQueueDepth,
+			policy: ioQueueBlock,
+		},
+		cancelled: make(chan struct{}),
+		vmLost:    make(chan interface{}),
 	}
+	vm.ioSessions.Store(make(map[uint64]*ioSession))
+
+	return vm
 }
 
-// setConsole() will make the proxy output the console data on stderr
-func (vm *vm) setConsole(path string) {
+// setConsole() will make the proxy keep the last bufferSize bytes of console
+// output, and output it on stderr when asked for verbose output
+func (vm *vm) setConsole(path string, bufferSize int) {
 	vm.console.socketPath = path
+	vm.console.ring = newConsoleRing(bufferSize)
+}
+
+// setIoQueue() configures the output queues of the ioSessions allocated from
+// now on
+func (vm *vm) setIoQueue(config ioQueueConfig) {
+	vm.ioQueue = config
 }
 
 func (vm *vm) shortName() string {
@@ -121,40 +261,66 @@ func (vm *vm) dump(lvl glog.Level, data []byte) {
 	glog.Infof("\n%s", hex.Dump(data))
 }
 
-func (vm *vm) findSession(seq uint64) *ioSession {
+func (vm *vm) sessions() map[uint64]*ioSession {
+	return vm.ioSessions.Load().(map[uint64]*ioSession)
+}
+
+// ioSessionList() returns the I/O sessions of the VM, ordered by ioBase.
+func (vm *vm) ioSessionList() []*ioSession {
+	sessions := vm.sessions()
+	list := make([]*ioSession, 0, len(sessions))
+	for seq, session := range sessions {
+		if seq != session.ioBase {
+			continue
+		}
+		list = append(list, session)
+	}
+	sort.Slice(list, func(i, j int) bool {
+		return list[i].ioBase < list[j].ioBase
+	})
+	return list
+}
+
+// goroutines() returns the number of goroutines serving the VM.
+func (vm *vm) goroutines() int {
+	// ioHyperToClients() and, per session, ioClientToHyper() and
+	// ioSessionWriter()
+	n := 1 + 2*len(vm.ioSessionList())
 	vm.Lock()
-	defer vm.Unlock()
+	if vm.console.conn != nil {
+		// consoleCapture()
+		n++
+	}
+	vm.Unlock()
+	return n
+}
 
-	return vm.ioSessions[seq]
+func (vm *vm) findSession(seq uint64) *ioSession {
+	return vm.sessions()[seq]
 }
 
 // This function runs in a goroutine, reading data from the io channel and
-// dispatching it to the right client (the one with matching seq number)
+// dispatching it to the output queue of the right client (the one with
+// matching seq number)
 // There's only one instance of this goroutine per-VM
 func (vm *vm) ioHyperToClients() {
+	reader := bufio.NewReaderSize(vm.hyperHandler.IoConn(), ioReadBufferSize)
+
 	for {
-		msg, err := vm.hyperHandler.ReadIoMessage()
+		frame, err := readIoFrame(reader)
 		if err != nil {
 			break
 		}
 
-		session := vm.findSession(msg.Session)
+		session := vm.findSession(frame.Session())
 		if session == nil {
 			fmt.Fprintf(os.Stderr,
-				"couldn't find client with seq number %d\n", msg.Session)
+				"couldn't find client with seq number %d\n", frame.Session())
+			frame.Free()
 			continue
 		}
 
-		vm.infof(1, "io", "<- writing to client #%d", session.clientID)
-		vm.dump(2, msg.Message)
-
-		err = hyperstart.SendIoMessageWithConn(session.client, msg)
-		if err != nil {
-			// When the shim is forcefully killed, it's possible we
-			// still have data to write. Ignore errors for that case.
-			vm.infof(1, "io", "error writing I/O data to client:", err)
-			continue
-		}
+		session.enqueue(frame)
 	}
 
 	// Having an error on the IO channel read is interpreted as having lost
@@ -163,41 +329,66 @@ func (vm *vm) ioHyperToClients() {
 	vm.wg.Done()
 }
 
-// Stream the VM console to stderr
-func (vm *vm) consoleToLog() {
-	reader := bufio.NewReader(vm.console.conn)
+// Capture the VM console in its ring buffer, and stream it to stderr when
+// asked for verbose output
+func (vm *vm) consoleCapture(conn net.Conn) {
+	reader := bufio.NewReaderSize(conn, consoleMaxLineLength)
 	for {
-		line, err := reader.ReadString('\n')
-		if err != nil {
+		// A line too long for the reader buffer comes in several chunks
+		line, err := reader.ReadSlice('\n')
+		if err != nil && err != bufio.ErrBufferFull {
 			break
 		}
 
-		vm.infof(3, "hyperstart", line)
+		line = bytes.TrimRight(line, "\r\n")
+		vm.console.ring.Write(time.Now(), line)
+		if glog.V(3) {
+			vm.info(3, "hyperstart", string(line))
+		}
 	}
 
+	vm.console.ring.Close()
 	vm.wg.Done()
 }
 
-func (vm *vm) Connect() error {
+// Connect opens the hyperstart channels. A VM restored from a checkpoint
+// (restored is true) has a hyperstart that is already up, so there is no
+// READY message to wait for. A non-zero deadline bounds the wait for READY.
+func (vm *vm) Connect(restored bool, deadline time.Time) error {
 	if vm.console.socketPath != "" {
-		var err error
-
-		vm.console.conn, err = net.Dial("unix", vm.console.socketPath)
+		// The console is only there for diagnostics
+		conn, err := net.Dial("unix", vm.console.socketPath)
 		if err != nil {
-			return err
+			glog.Warningf("couldn't connect to the console of %s: %v",
+				vm.containerID, err)
+		} else {
+			// Stats and Close() can look at the console of a VM
+			// being connected in the background
+			vm.Lock()
+			vm.console.conn = conn
+			vm.Unlock()
+
+			vm.wg.Add(1)
+			go vm.consoleCapture(conn)
 		}
-
-		vm.wg.Add(1)
-		go vm.consoleToLog()
 	}
 
-	if err := vm.hyperHandler.OpenSockets(); err != nil {
+	if err := vm.hyperHandler.Open(); err != nil {
 		return err
 	}
 
-	if err := vm.hyperHandler.WaitForReady(); err != nil {
-		vm.hyperHandler.CloseSockets()
-		return err
+	if !restored {
+		err := vm.hyperHandler.SetDeadline(deadline)
+		if err == nil {
+			err = vm.hyperHandler.WaitForReady()
+		}
+		if err == nil {
+			err = vm.hyperHandler.SetDeadline(time.Time{})
+		}
+		if err != nil {
+			vm.hyperHandler.Close()
+			return err
+		}
 	}
 
 	vm.wg.Add(1)
@@ -206,6 +397,98 @@ func (vm *vm) Connect() error {
 	return nil
 }
 
+var errVMCancelled = errors.New("VM unregistered before being connected")
+
+// How often to look for the sockets of a registered VM
+const registerPollInterval = 5 * time.Millisecond
+
+// Wait for the hypervisor to create the sockets of the VM
+func (vm *vm) waitForSockets(deadline time.Time) error {
+	// The console socket is created along with the others, and is only
+	// used for diagnostics anyway
+	paths := []string{vm.ctlSerial, vm.ioSerial}
+
+	ticker := time.NewTicker(registerPollInterval)
+	defer ticker.Stop()
+
+	for _, path := range paths {
+		for {
+			if _, err := os.Stat(path); err == nil {
+				break
+			}
+			if time.Now().After(deadline) {
+				return fmt.Errorf("timed out waiting for %s", path)
+			}
+			select {
+			case <-ticker.C:
+			case <-vm.cancelled:
+				return errVMCancelled
+			}
+		}
+	}
+
+	return nil
+}
+
+// ConnectInBackground connects a registered VM, waiting up to timeout for its
+// sockets to be created and for hyperstart to be ready. WaitConnected gives
+// the outcome. Cancel() aborts the connection.
+func (vm *vm) ConnectInBackground(restored bool, timeout time.Duration) {
+	deadline := time.Now().Add(timeout)
+
+	// Unblock Connect() if the VM is cancelled while waiting for READY
+	done := make(chan struct{})
+	go func() {
+		select {
+		case <-vm.cancelled:
+			vm.hyperHandler.Close()
+		case <-done:
+		}
+	}()
+
+	err := vm.waitForSockets(deadline)
+	if err == nil {
+		err = vm.Connect(restored, deadline)
+	}
+	close(done)
+
+	// A Cancel() racing with a successful Connect() still wins: nobody
+	// wants that VM anymore
+	select {
+	case <-vm.cancelled:
+		err = errVMCancelled
+	default:
+	}
+
+	vm.connectErr = err
+	close(vm.connected)
+}
+
+// Cancel aborts the background connection of a registered VM, if still in
+// progress.
+func (vm *vm) Cancel() {
+	vm.cancelOnce.Do(func() {
+		close(vm.cancelled)
+	})
+}
+
+// registered returns true if the VM has been registered ahead of hello
+func (vm *vm) registered() bool {
+	return vm.connected != nil
+}
+
+// claim binds a registered VM to the first hello for it. It returns false if
+// the VM has already been claimed.
+func (vm *vm) claim() bool {
+	return atomic.CompareAndSwapInt32(&vm.claimed, 0, 1)
+}
+
+// WaitConnected waits for a registered VM to be connected.
+func (vm *vm) WaitConnected() error {
+	<-vm.connected
+	return vm.connectErr
+}
+
 func (vm *vm) SendMessage(cmd string, data []byte) error {
 	_, err := vm.hyperHandler.SendCtlMessage(cmd, data)
 	return err
@@ -215,33 +498,256 @@ func (vm *vm) SendMessage(cmd string, data []byte) error {
 // writing data to the hyperstart I/O chanel.
 // There's one instance of this goroutine per client having done an allocateIO.
 func (vm *vm) ioClientToHyper(session *ioSession) {
+	reader := bufio.NewReader(session.client)
+
 	for {
-		msg, err := hyperstart.ReadIoMessageWithConn(session.client)
+		frame, err := readIoFrame(reader)
 		if err != nil {
 			// client process is gone
 			break
 		}
 
-		if msg.Session != session.ioBase {
-			fmt.Fprintf(os.Stderr, "stdin seq %d not matching ioBase %d\n", msg.Session, session.ioBase)
+		if frame.Session() != session.ioBase {
+			fmt.Fprintf(os.Stderr, "stdin seq %d not matching ioBase %d\n", frame.Session(), session.ioBase)
+			frame.Free()
 			session.client.Close()
 			break
 		}
 
-		vm.infof(1, "io", "-> writing to hyper from #%d", session.clientID)
-		vm.dump(2, msg.Message)
+		// Check the level before calling infof() to not allocate the
+		// variadic arguments for each packet
+		if glog.V(1) {
+			vm.infof(1, "io", "-> writing to hyper from #%d", session.clientID)
+		}
+		vm.dump(2, frame.Payload())
 
-		err = vm.hyperHandler.SendIoMessage(msg)
+		n := len(frame.Payload())
+		err = frame.writeTo(vm.hyperHandler.IoConn())
+		frame.Free()
 		if err != nil {
 			fmt.Fprintf(os.Stderr,
 				"error writing I/O data to hyperstart: %v\n", err)
 			break
 		}
+
+		atomic.AddUint64(&session.relay.toVMBytes, uint64(n))
+		atomic.AddUint64(&session.relay.toVMFrames, 1)
 	}
 
 	session.wg.Done()
 }
 
+// This function runs in a goroutine, writing the messages queued by
+// ioHyperToClients to the client socket.
+// There's one instance of this goroutine per ioSession so a slow client only
+// holds up its own streams.
+func (vm *vm) ioSessionWriter(session *ioSession) {
+	defer session.wg.Done()
+
+	if session.coalesceBytes > 0 {
+		vm.ioSessionCoalescingWriter(session)
+		return
+	}
+
+	for {
+		var frame *ioFrame
+
+		select {
+		case frame = <-session.out:
+		case <-session.done:
+			return
+		}
+
+		vm.writeFrame(session, frame)
+	}
+}
+
+// writeFrame() writes frame to the session client and frees it.
+func (vm *vm) writeFrame(session *ioSession, frame *ioFrame) {
+	if glog.V(1) {
+		vm.infof(1, "io", "<- writing to client #%d", session.clientID)
+	}
+	vm.dump(2, frame.Payload())
+
+	n := len(frame.Payload())
+	err := frame.writeTo(session.client)
+	frame.Free()
+	if err != nil {
+		// When the shim is forcefully killed, it's possible we still
+		// have data to write. Ignore errors for that case.
+		vm.infof(1, "io", "error writing I/O data to client: %v", err)
+		return
+	}
+
+	atomic.AddUint64(&session.relay.toClientBytes, uint64(n))
+	atomic.AddUint64(&session.relay.toClientFrames, 1)
+}
+
+// ioSessionCoalescingWriter() is the session writer used when coalescing is
+// enabled. Packets for the same stream are merged into a pending packet which
+// is written to the client when:
+//   - it holds coalesceBytes of data,
+//   - its first data has been waiting for coalesceDelay,
+//   - a packet for another stream, or that can't be merged, comes in.
+//
+// Packets without data signal the end of a stream and the one following it
+// carries the exit status of the process. Those are never merged nor delayed.
+func (vm *vm) ioSessionCoalescingWriter(session *ioSession) {
+	var pending *ioFrame
+
+	closed := make([]bool, session.nStreams)
+
+	timer := time.NewTimer(session.coalesceDelay)
+	timer.Stop()
+	armed := false
+
+	stopTimer := func() {
+		if armed && !timer.Stop() {
+			<-timer.C
+		}
+		armed = false
+	}
+
+	flush := func() {
+		if pending == nil {
+			return
+		}
+		stopTimer()
+		vm.writeFrame(session, pending)
+		pending = nil
+	}
+
+	for {
+		var frame *ioFrame
+
+		if pending == nil {
+			select {
+			case frame = <-session.out:
+			case <-session.done:
+				return
+			}
+		} else {
+			select {
+			case frame = <-session.out:
+			case <-timer.C:
+				armed = false
+				flush()
+				continue
+			case <-session.done:
+				stopTimer()
+				pending.Free()
+				return
+			}
+		}
+
+		mergeable := false
+		if stream := frame.Session() - session.ioBase; stream < uint64(len(closed)) {
+			if len(frame.Payload()) == 0 {
+				closed[stream] = true
+			} else {
+				mergeable = !closed[stream]
+			}
+		}
+
+		if pending != nil && (!mergeable ||
+			pending.Session() != frame.Session() ||
+			len(pending.Payload())+len(frame.Payload()) > session.coalesceBytes) {
+			flush()
+		}
+
+		if !mergeable || len(frame.Payload()) >= session.coalesceBytes {
+			vm.writeFrame(session, frame)
+			continue
+		}
+
+		if pending == nil {
+			pending = frame
+			timer.Reset(session.coalesceDelay)
+			armed = true
+			continue
+		}
+
+		pending.appendPayload(frame.Payload())
+		frame.Free()
+
+		if len(pending.Payload()) >= session.coalesceBytes {
+			flush()
+		}
+	}
+}
+
+func (session *ioSession) updateHighWater() {
+	n := int64(len(session.out))
+	if n > atomic.LoadInt64(&session.stats.highWater) {
+		atomic.StoreInt64(&session.stats.highWater, n)
+	}
+}
+
+// mustDeliver() returns whether frame has to reach the client whatever the
+// queue policy: the end of a stream (an empty frame), and what follows it, the
+// exit status of the process, which the shim waits for to exit.
+func (session *ioSession) mustDeliver(frame *ioFrame) bool {
+	i := frame.Session() - session.ioBase
+	if i >= uint64(len(session.ended)) {
+		return false
+	}
+	if len(frame.Payload()) == 0 {
+		session.ended[i] = true
+		return true
+	}
+	return session.ended[i]
+}
+
+// enqueue() hands frame over to the session writer, applying the queue policy
+// when the queue is full. Only called from ioHyperToClients.
+func (session *ioSession) enqueue(frame *ioFrame) {
+	mustDeliver := session.mustDeliver(frame)
+
+	select {
+	case session.out <- frame:
+		session.updateHighWater()
+		return
+	case <-session.done:
+		frame.Free()
+		return
+	default:
+	}
+
+	if session.policy == ioQueueDrop && !mustDeliver {
+		atomic.AddUint64(&session.stats.dropped, 1)
+		frame.Free()
+		return
+	}
+
+	start := time.Now()
+	select {
+	case session.out <- frame:
+	case <-session.done:
+		frame.Free()
+	}
+	atomic.AddInt64(&session.stats.blocked, int64(time.Since(start)))
+	session.updateHighWater()
+}
+
+// relayStats() returns a snapshot of the relayed data counters.
+func (session *ioSession) relayStats() ioRelayStats {
+	return ioRelayStats{
+		toClientBytes:  atomic.LoadUint64(&session.relay.toClientBytes),
+		toClientFrames: atomic.LoadUint64(&session.relay.toClientFrames),
+		toVMBytes:      atomic.LoadUint64(&session.relay.toVMBytes),
+		toVMFrames:     atomic.LoadUint64(&session.relay.toVMFrames),
+	}
+}
+
+// queueStats() returns a snapshot of the output queue counters.
+func (session *ioSession) queueStats() ioQueueStats {
+	return ioQueueStats{
+		highWater: atomic.LoadInt64(&session.stats.highWater),
+		blocked:   atomic.LoadInt64(&session.stats.blocked),
+		dropped:   atomic.LoadUint64(&session.stats.dropped),
+	}
+}
+
 func (vm *vm) AllocateIo(n int, clientID uint64, c net.Conn) uint64 {
 	// Allocate ioBase
 	vm.Lock()
@@ -253,42 +759,64 @@ func (vm *vm) AllocateIo(n int, clientID uint64, c net.Conn) uint64 {
 		ioBase:   ioBase,
 		clientID: clientID,
 		client:   c,
+		out:      make(chan *ioFrame, vm.ioQueue.depth),
+		policy:   vm.ioQueue.policy,
+		ended:    make([]bool, n),
+		done:     make(chan struct{}),
 	}
 
+	// A single stream means the process has a terminal, whose output is
+	// better not delayed.
+	if n > 1 {
+		session.coalesceBytes = vm.ioQueue.coalesceBytes
+		session.coalesceDelay = vm.ioQueue.coalesceDelay
+	}
+
+	old := vm.sessions()
+	sessions := make(map[uint64]*ioSession, len(old)+n)
+	for seq, s := range old {
+		sessions[seq] = s
+	}
 	for i := 0; i < n; i++ {
-		vm.ioSessions[ioBase+uint64(i)] = session
+		sessions[ioBase+uint64(i)] = session
 	}
+	vm.ioSessions.Store(sessions)
 	vm.Unlock()
 
-	// Starts stdin forwarding between client and hyper
-	session.wg.Add(1)
+	// Starts stdin forwarding between client and hyper and the writer
+	// draining the output queue
+	session.wg.Add(2)
 	go vm.ioClientToHyper(session)
+	go vm.ioSessionWriter(session)
 
 	return ioBase
 }
 
 func (session *ioSession) Close() {
 	session.client.Close()
+	close(session.done)
 	session.wg.Wait()
 }
 
 func (vm *vm) Close() {
-	vm.hyperHandler.CloseSockets()
+	vm.hyperHandler.Close()
+
+	vm.Lock()
 	if vm.console.conn != nil {
 		vm.console.conn.Close()
 	}
-
 	// Wait for per-client goroutines
-	vm.Lock()
-	for seq, session := range vm.ioSessions {
-		delete(vm.ioSessions, seq)
+	sessions := vm.sessions()
+	vm.ioSessions.Store(make(map[uint64]*ioSession))
+	vm.Unlock()
+
+	for seq, session := range sessions {
 		if seq != session.ioBase {
 			continue
 		}
 
 		session.Close()
 	}
-	vm.Unlock()
 
 	// Wait for VM global goroutines
 	vm.wg.Wait()
@@ -0,0 +1,307 @@
+// Copyright (c) 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#include "ring_buffer.h"
+
+/*!
+ * Allocate the storage of a ring buffer
+ *
+ * \param rb \ref ring_buffer
+ * \param size Number of bytes the buffer can hold
+ *
+ * \return true on success, false otherwise
+ */
+bool
+ring_buffer_init(struct ring_buffer *rb, size_t size)
+{
+	if (! rb || size == 0) {
+		return false;
+	}
+
+	rb->data = malloc(size);
+	if (! rb->data) {
+		abort();
+	}
+	rb->size = size;
+	rb->head = 0;
+	rb->len = 0;
+
+	return true;
+}
+
+/*!
+ * Free the storage of a ring buffer
+ *
+ * \param rb \ref ring_buffer
+ */
+void
+ring_buffer_free(struct ring_buffer *rb)
+{
+	if (! rb) {
+		return;
+	}
+
+	free(rb->data);
+	rb->data = NULL;
+	rb->size = rb->head = rb->len = 0;
+}
+
+/*
+ * Describe, in at most 2 iovecs, the len bytes of the buffer starting
+ * offset bytes after the head (when data is true) or after the end of
+ * the data (when data is false, to describe free space).
+ *
+ * \return Number of iovecs used
+ */
+static int
+ring_buffer_iov(const struct ring_buffer *rb, bool data, size_t offset,
+		size_t len, struct iovec iov[2])
+{
+	size_t start;
+	size_t first;
+
+	if (len == 0) {
+		return 0;
+	}
+
+	start = (rb->head + offset + (data ? 0 : rb->len)) % rb->size;
+	first = rb->size - start;
+
+	iov[0].iov_base = rb->data + start;
+	if (len <= first) {
+		iov[0].iov_len = len;
+		return 1;
+	}
+
+	iov[0].iov_len = first;
+	iov[1].iov_base = rb->data;
+	iov[1].iov_len = len - first;
+	return 2;
+}
+
+/*!
+ * Append data to a ring buffer
+ *
+ * \param rb \ref ring_buffer
+ * \param buf Data to append
+ * \param len Length of the data
+ *
+ * \return true on success, false if there isn't enough space for all
+ * of the data, in which case nothing is appended
+ */
+bool
+ring_buffer_put(struct ring_buffer *rb, const void *buf, size_t len)
+{
+	struct iovec iov[2];
+	int          n;
+	size_t       copied = 0;
+
+	if (! (rb && buf) || len > ring_buffer_space(rb)) {
+		return false;
+	}
+
+	n = ring_buffer_iov(rb, false, 0, len, iov);
+	for (int i = 0; i < n; i++) {
+		memcpy(iov[i].iov_base, (const uint8_t *)buf + copied,
+				iov[i].iov_len);
+		copied += iov[i].iov_len;
+	}
+	rb->len += len;
+
+	return true;
+}
+
+/*!
+ * Copy data out of a ring buffer, without consuming it
+ *
+ * \param rb \ref ring_buffer
+ * \param offset Offset of the data to copy from the head of the buffer
+ * \param[out] buf Where to copy the data
+ * \param len Length of the data, offset + len must not be more than the
+ * length of the data held
+ */
+void
+ring_buffer_peek(const struct ring_buffer *rb, size_t offset,
+		void *buf, size_t len)
+{
+	struct iovec iov[2];
+	int          n;
+	size_t       copied = 0;
+
+	if (! (rb && buf) || offset + len > rb->len) {
+		return;
+	}
+
+	n = ring_buffer_iov(rb, true, offset, len, iov);
+	for (int i = 0; i < n; i++) {
+		memcpy((uint8_t *)buf + copied, iov[i].iov_base,
+				iov[i].iov_len);
+		copied += iov[i].iov_len;
+	}
+}
+
+/*!
+ * Describe data held in a ring buffer, to write it out without copying it
+ *
+ * \param rb \ref ring_buffer
+ * \param offset Offset of the data from the head of the buffer
+ * \param len Length of the data
+ * \param[out] iov Where to describe the data
+ *
+ * \return Number of iovecs used, at most 2
+ */
+int
+ring_buffer_data_iov(const struct ring_buffer *rb, size_t offset,
+		size_t len, struct iovec iov[2])
+{
+	if (! (rb && iov) || offset + len > rb->len) {
+		return 0;
+	}
+
+	return ring_buffer_iov(rb, true, offset, len, iov);
+}
+
+/*!
+ * Discard data from the head of a ring buffer
+ *
+ * \param rb \ref ring_buffer
+ * \param len Number of bytes to discard
+ */
+void
+ring_buffer_consume(struct ring_buffer *rb, size_t len)
+{
+	if (! rb) {
+		return;
+	}
+
+	if (len >= rb->len) {
+		/* Start over from the beginning to keep the data in one
+		 * piece as much as possible */
+		rb->head = rb->len = 0;
+		return;
+	}
+
+	rb->head = (rb->head + len) % rb->size;
+	rb->len -= len;
+}
+
+/*!
+ * Move data from the head of a ring buffer to the end of another
+ *
+ * \param dst \ref ring_buffer to move the data to
+ * \param src \ref ring_buffer to move the data from
+ * \param len Number of bytes to move
+ *
+ * \return true on success, false if src doesn't hold len bytes or dst
+ * doesn't have room for them, in which case nothing is moved
+ */
+bool
+ring_buffer_move(struct ring_buffer *dst, struct ring_buffer *src, size_t len)
+{
+	struct iovec iov[2];
+	int          n;
+
+	if (! (dst && src) || len > src->len || len > ring_buffer_space(dst)) {
+		return false;
+	}
+
+	n = ring_buffer_iov(src, true, 0, len, iov);
+	for (int i = 0; i < n; i++) {
+		ring_buffer_put(dst, iov[i].iov_base, iov[i].iov_len);
+	}
+	ring_buffer_consume(src, len);
+
+	return true;
+}
+
+/*!
+ * Read as much data as there is room for from a file descriptor
+ *
+ * \param rb \ref ring_buffer
+ * \param fd File descriptor to read from
+ *
+ * \return Number of bytes read, 0 on end of file, -1 on error with
+ * errno set (EAGAIN if the buffer is full)
+ */
+ssize_t
+ring_buffer_read_fd(struct ring_buffer *rb, int fd)
+{
+	struct iovec iov[2];
+	int          n;
+	ssize_t      ret;
+
+	if (! rb || fd < 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	n = ring_buffer_iov(rb, false, 0, ring_buffer_space(rb), iov);
+	if (n == 0) {
+		errno = EAGAIN;
+		return -1;
+	}
+
+	do {
+		ret = readv(fd, iov, n);
+	} while (ret == -1 && errno == EINTR);
+
+	if (ret > 0) {
+		rb->len += (size_t)ret;
+	}
+
+	return ret;
+}
+
+/*!
+ * Write as much data as possible to a file descriptor, consuming what
+ * has been written
+ *
+ * \param rb \ref ring_buffer
+ * \param fd File descriptor to write to
+ *
+ * \return Number of bytes written, -1 on error with errno set
+ */
+ssize_t
+ring_buffer_write_fd(struct ring_buffer *rb, int fd)
+{
+	struct iovec iov[2];
+	int          n;
+	ssize_t      ret;
+
+	if (! rb || fd < 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	n = ring_buffer_iov(rb, true, 0, rb->len, iov);
+	if (n == 0) {
+		return 0;
+	}
+
+	do {
+		ret = writev(fd, iov, n);
+	} while (ret == -1 && errno == EINTR);
+
+	if (ret > 0) {
+		ring_buffer_consume(rb, (size_t)ret);
+	}
+
+	return ret;
+}
@@ -0,0 +1,68 @@
+// Copyright (c) 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+/*
+ * Fixed size FIFO of bytes, used to hold the data read from one fd
+ * until the fd it is destined to can take it.
+ *
+ * | . . . . . . | d a t a . . . . . . . | . . . . . |
+ * 0             head                    head + len  size
+ *
+ * The data wraps around the end of the buffer.
+ */
+struct ring_buffer {
+	uint8_t    *data;
+	size_t      size;
+	size_t      head;
+	size_t      len;
+};
+
+bool ring_buffer_init(struct ring_buffer *rb, size_t size);
+void ring_buffer_free(struct ring_buffer *rb);
+bool ring_buffer_put(struct ring_buffer *rb, const void *buf, size_t len);
+void ring_buffer_peek(const struct ring_buffer *rb, size_t offset,
+		void *buf, size_t len);
+int ring_buffer_data_iov(const struct ring_buffer *rb, size_t offset,
+		size_t len, struct iovec iov[2]);
+void ring_buffer_consume(struct ring_buffer *rb, size_t len);
+bool ring_buffer_move(struct ring_buffer *dst, struct ring_buffer *src,
+		size_t len);
+ssize_t ring_buffer_read_fd(struct ring_buffer *rb, int fd);
+ssize_t ring_buffer_write_fd(struct ring_buffer *rb, int fd);
+
+static inline size_t
+ring_buffer_space(const struct ring_buffer *rb)
+{
+	return rb->size - rb->len;
+}
+
+static inline bool
+ring_buffer_empty(const struct ring_buffer *rb)
+{
+	return rb->len == 0;
+}
+
+static inline bool
+ring_buffer_full(const struct ring_buffer *rb)
+{
+	return rb->len == rb->size;
+}
@@ -18,6 +18,7 @@
 #include <errno.h>
 #include <string.h>
 #include <sys/un.h>
+#include <sys/epoll.h>
 #include <poll.h>
 #include <assert.h>
 #include <stdarg.h>
@@ -25,6 +26,7 @@
 #include <signal.h>
 #include <termios.h>
 #include <sys/ioctl.h>
+#include <sys/socket.h>
 #include <stdint.h>
 #include <inttypes.h>
 #include <getopt.h>
@@ -32,6 +34,7 @@
 #include <limits.h>
 #include <fcntl.h>
 #include <termios.h>
+#include <time.h>
 
 #include "config.h"
 #include "utils.h"
@@ -40,14 +43,6 @@
 
 /* globals */
 
-struct pollfd poll_fds[MAX_POLL_FDS] = {{-1}};
-
-// File descriptors are added at specific index in the poll_fds array
-#define SIGNAL_FD_INDEX 0
-#define PROXY_IO_INDEX 1
-#define PROXY_CTL_INDEX 2
-#define STDIN_INDEX 3
-
 /* Pipe used for capturing signal occurence */
 int signal_pipe_fd[2] = { -1, -1 };
 
@@ -55,26 +50,8 @@ static char *program_name;
 
 struct termios *saved_term_settings;
 
-/*!
- * Add file descriptor to the array of polled descriptors
- *
- * \param poll_fds Array of polled fds
- * \param index Index at which the fd is added
- * \param fd File descriptor to add
- * \param events Events for the fd that should be polled
- */
-void add_pollfd(struct pollfd *poll_fds, nfds_t index, int fd,  short events) {
-	struct pollfd pfd = { 0 };
-
-	if ( !poll_fds || fd < 0 || index >= MAX_POLL_FDS) {
-		shim_warning("Not able to add fd to poll_fds array\n");
-		return;
-	}
-
-	pfd.fd = fd;
-	pfd.events = events;
-	poll_fds[index] = pfd;
-}
+/* Shim whose stdio flags are restored on exit */
+static struct cc_shim *main_shim;
 
 /*!
  * Signal handler for the signals that should be caught and 
@@ -119,6 +96,33 @@ assign_all_signals(struct sigaction *sa)
         return true;
 }
 
+/*!
+ * Restore the file status flags stdin, stdout and stderr had
+ * before they were made non-blocking
+ *
+ * \param shim \ref cc_shim
+ */
+void
+restore_stdio_flags(struct cc_shim *shim)
+{
+	if (! shim) {
+		return;
+	}
+
+	for (int i = 0; i < 3; i++) {
+		if (shim->stdio_flags[i] != -1) {
+			fcntl(shim->stdio_fds[i], F_SETFL, shim->stdio_flags[i]);
+			shim->stdio_flags[i] = -1;
+		}
+	}
+}
+
+static void
+restore_main_stdio_flags(void)
+{
+	restore_stdio_flags(main_shim);
+}
+
 void restore_terminal(void) {
 	if ( isatty(STDIN_FILENO) && saved_term_settings) {
 		if (tcsetattr (STDIN_FILENO, TCSANOW, saved_term_settings)) {
@@ -152,6 +156,253 @@ err_exit(const char *format, ...)
 	exit(EXIT_FAILURE);
 }
 
+/*!
+ * Add file descriptor to the watched descriptors
+ *
+ * \param shim \ref cc_shim
+ * \param index Index at which the fd is watched
+ * \param fd File descriptor to watch
+ */
+void
+add_watch(struct cc_shim *shim, enum shim_watch_index index, int fd)
+{
+	if (! shim || index >= MAX_WATCHES) {
+		shim_warning("Not able to watch fd %d\n", fd);
+		return;
+	}
+
+	shim->watches[index].fd = fd;
+	shim->watches[index].events = 0;
+	shim->watches[index].pollable = true;
+}
+
+/*!
+ * Change the events a watched file descriptor is polled for
+ *
+ * The fd is only part of the epoll set while it is polled for some
+ * events, so that hang ups aren't reported for fds the shim is not
+ * interested in.
+ *
+ * \param shim \ref cc_shim
+ * \param index Index of the watched fd
+ * \param events epoll events to poll the fd for
+ */
+void
+update_watch(struct cc_shim *shim, enum shim_watch_index index, uint32_t events)
+{
+	struct shim_watch   *watch;
+	struct epoll_event   ev = { 0 };
+	int                  op;
+
+	if (! shim || index >= MAX_WATCHES) {
+		return;
+	}
+
+	watch = &shim->watches[index];
+	if (watch->fd < 0 || watch->events == events) {
+		return;
+	}
+
+	if (! watch->pollable) {
+		watch->events = events;
+		return;
+	}
+
+	if (watch->events == 0) {
+		op = EPOLL_CTL_ADD;
+	} else if (events == 0) {
+		op = EPOLL_CTL_DEL;
+	} else {
+		op = EPOLL_CTL_MOD;
+	}
+
+	ev.events = events;
+	ev.data.u32 = index;
+
+	if (epoll_ctl(shim->epoll_fd, op, watch->fd, &ev) == -1) {
+		if (op == EPOLL_CTL_ADD && errno == EPERM) {
+			/* Reads and writes never block on such fds */
+			watch->pollable = false;
+			watch->events = events;
+			return;
+		}
+		err_exit("Error watching fd %d: %s\n", watch->fd, strerror(errno));
+	}
+
+	watch->events = events;
+}
+
+/*!
+ * Stop watching a file descriptor
+ *
+ * \param shim \ref cc_shim
+ * \param index Index of the watched fd
+ */
+void
+remove_watch(struct cc_shim *shim, enum shim_watch_index index)
+{
+	if (! shim || index >= MAX_WATCHES) {
+		return;
+	}
+
+	update_watch(shim, index, 0);
+	shim->watches[index].fd = -1;
+}
+
+/*!
+ * Return the buffer holding the data to be written to a watched fd
+ *
+ * \param shim \ref cc_shim
+ * \param index Index of the watched fd
+ *
+ * \return \ref ring_buffer, \c NULL if nothing is written to the fd
+ */
+struct ring_buffer *
+watch_buffer(struct cc_shim *shim, enum shim_watch_index index)
+{
+	switch (index) {
+	case PROXY_IO_WATCH:
+		return &shim->to_proxy_io;
+	case PROXY_CTL_WATCH:
+		return &shim->to_proxy_ctl;
+	case STDOUT_WATCH:
+		return &shim->to_stdout;
+	case STDERR_WATCH:
+		return &shim->to_stderr;
+	default:
+		return NULL;
+	}
+}
+
+/*!
+ * Write as much buffered data as possible to a watched fd, without
+ * blocking. Data that can't be written because of an error is
+ * discarded.
+ *
+ * \param shim \ref cc_shim
+ * \param index Index of the watched fd
+ */
+void
+flush_watch(struct cc_shim *shim, enum shim_watch_index index)
+{
+	struct ring_buffer  *rb;
+	int                  fd;
+
+	if (! shim) {
+		return;
+	}
+
+	rb = watch_buffer(shim, index);
+	if (! rb || ring_buffer_empty(rb)) {
+		return;
+	}
+
+	fd = shim->watches[index].fd;
+	if (fd < 0) {
+		ring_buffer_consume(rb, rb->len);
+		return;
+	}
+
+	if (ring_buffer_write_fd(rb, fd) == -1 &&
+			errno != EAGAIN && errno != EWOULDBLOCK) {
+		shim_warning("Error writing to fd %d, discarding %zu bytes: %s\n",
+			fd, rb->len, strerror(errno));
+		ring_buffer_consume(rb, rb->len);
+	}
+}
+
+/*!
+ * Write all the buffered data to a watched fd, waiting for the fd to
+ * be writable as needed
+ *
+ * \param shim \ref cc_shim
+ * \param index Index of the watched fd
+ */
+void
+flush_watch_blocking(struct cc_shim *shim, enum shim_watch_index index)
+{
+	struct ring_buffer  *rb;
+	struct pollfd        pfd = { 0 };
+
+	if (! shim) {
+		return;
+	}
+
+	rb = watch_buffer(shim, index);
+	if (! rb) {
+		return;
+	}
+
+	pfd.fd = shim->watches[index].fd;
+	pfd.events = POLLOUT;
+
+	while (! ring_buffer_empty(rb)) {
+		flush_watch(shim, index);
+		if (! ring_buffer_empty(rb) &&
+				poll(&pfd, 1, -1) == -1 && errno != EINTR) {
+			shim_warning("Error polling fd %d: %s\n",
+				pfd.fd, strerror(errno));
+			return;
+		}
+	}
+}
+
+/*!
+ * Set the events each watched fd is polled for, from the state of the
+ * buffers: reading from an fd is only done while the buffer it is read
+ * to has room, and writing to an fd while there is data buffered for it.
+ *
+ * \param shim \ref cc_shim
+ */
+void
+update_watches(struct cc_shim *shim)
+{
+	uint32_t events;
+
+	if (! shim) {
+		return;
+	}
+
+	update_watch(shim, SIGNAL_WATCH,
+		ring_buffer_space(&shim->to_proxy_ctl) >= SHIM_MAX_CTL_MSG_SIZE ?
+		EPOLLIN : 0);
+
+	/* Once the exit code is received, only the pending output
+	 * is of interest */
+	events = 0;
+	if (shim->exit_code == -1) {
+		if (! ring_buffer_full(&shim->from_proxy_io)) {
+			events |= EPOLLIN;
+		}
+		if (! ring_buffer_empty(&shim->to_proxy_io)) {
+			events |= EPOLLOUT;
+		}
+	}
+	update_watch(shim, PROXY_IO_WATCH, events);
+
+	events = shim->exit_code == -1 ? EPOLLIN : 0;
+	if (! ring_buffer_empty(&shim->to_proxy_ctl)) {
+		events |= EPOLLOUT;
+	}
+	update_watch(shim, PROXY_CTL_WATCH, events);
+
+	/* While waiting for more of it, stdin is only checked as more
+	 * comes in */
+	if (shim->stdin_deadline) {
+		events = EPOLLIN | EPOLLET;
+	} else {
+		events = ring_buffer_space(&shim->to_proxy_io) > STREAM_HEADER_SIZE ?
+			EPOLLIN : 0;
+	}
+	update_watch(shim, STDIN_WATCH, events);
+
+	update_watch(shim, STDOUT_WATCH,
+		ring_buffer_empty(&shim->to_stdout) ? 0 : EPOLLOUT);
+
+	update_watch(shim, STDERR_WATCH,
+		ring_buffer_empty(&shim->to_stderr) ? 0 : EPOLLOUT);
+}
+
 /*!
  * Construct message in the proxy ctl rpc protocol format
  * Proxy control message format:
@@ -192,17 +443,20 @@ get_proxy_ctl_msg(const char *json, size_t *len) {
 /*!
  * Send "hyper" payload to cc-proxy. This will be forwarded to hyperstart.
  *
- * \param fd File descriptor to send the message to(should be proxy ctl socket fd)
+ * The message is buffered and written to the proxy ctl socket as soon as
+ * it is writable.
+ *
+ * \param shim \ref cc_shim
  * \param Hyperstart cmd id
  * \param json Json payload
  */
 void
-send_proxy_hyper_message(int fd, const char *hyper_cmd, const char *json) {
+send_proxy_hyper_message(struct cc_shim *shim, const char *hyper_cmd, const char *json) {
 	char      *proxy_payload = NULL;
 	char      *proxy_command_id = "hyper";
 	char      *proxy_ctl_msg = NULL;
-	size_t     len = 0, offset = 0;
-	ssize_t    ret;
+	size_t     len = 0;
+	int        ret;
 
 	/* cc-proxy has the following format for "hyper" payload:
 	 * {
@@ -214,7 +468,7 @@ send_proxy_hyper_message(int fd, const char *hyper_cmd, const char *json) {
 	 * }
 	*/
 
-	if ( !json || fd < 0) {
+	if ( !(shim && json) || shim->proxy_sock_fd < 0) {
 		return;
 	}
 
@@ -230,32 +484,30 @@ send_proxy_hyper_message(int fd, const char *hyper_cmd, const char *json) {
 	proxy_ctl_msg = get_proxy_ctl_msg(proxy_payload, &len);
 	free(proxy_payload);
 
-	while (offset < len) {
-		ret = write(fd, proxy_ctl_msg + offset, len-offset);
-		if (ret == -1 && errno == EINTR) {
-			continue;
-		}
-		if (ret <= 0 ) {
-			free(proxy_ctl_msg);
-			shim_error("Error writing to proxy: %s\n", strerror(errno));
-			return;
-		}
-		offset += (size_t)ret;
+	if (! ring_buffer_put(&shim->to_proxy_ctl, proxy_ctl_msg, len)) {
+		shim_warning("No room to send %s message to proxy, dropping it\n",
+			hyper_cmd);
 	}
 	free(proxy_ctl_msg);
+
+	flush_watch(shim, PROXY_CTL_WATCH);
 }
 
 /*!
  * Read signals received and send message in the hyperstart protocol
  * format to the proxy ctl socket.
  *
+ * Signals are left in the pipe while the proxy ctl buffer is full.
+ *
  * \param shim \ref cc_shim
  */
 void
 handle_signals(struct cc_shim *shim) {
 	int                sig;
+	int                fd;
 	char              *buf;
 	int                ret;
+	ssize_t            nread;
 	char              *cmd = NULL;
 	struct winsize     ws;
 	static char*       cmds[] = { "winsize", "killcontainer"};
@@ -264,11 +516,18 @@ handle_signals(struct cc_shim *shim) {
 		return;
 	}
 
-	while (read(signal_pipe_fd[0], &sig, sizeof(sig)) != -1) {
-		shim_debug("Handling signal : %d on fd %d\n", sig, signal_pipe_fd[0]);
+	fd = shim->watches[SIGNAL_WATCH].fd;
+
+	while (ring_buffer_space(&shim->to_proxy_ctl) >= SHIM_MAX_CTL_MSG_SIZE) {
+		nread = read(fd, &sig, sizeof(sig));
+		if (nread != sizeof(sig)) {
+			return;
+		}
+
+		shim_debug("Handling signal : %d on fd %d\n", sig, fd);
 		if (sig == SIGWINCH ) {
 			cmd = cmds[0];
-			if (ioctl(STDIN_FILENO, TIOCGWINSZ, &ws) == -1) {
+			if (ioctl(shim->watches[STDIN_WATCH].fd, TIOCGWINSZ, &ws) == -1) {
 				shim_warning("Error getting the current window size: %s\n",
 					strerror(errno));
 				continue;
@@ -287,130 +546,299 @@ handle_signals(struct cc_shim *shim) {
 			abort();
 		}
 
-		send_proxy_hyper_message(shim->proxy_sock_fd, cmd, buf);
+		send_proxy_hyper_message(shim, cmd, buf);
 		free(buf);
         }
 }
 
+/*!
+ * Current time in milliseconds, from the monotonic clock
+ */
+static uint64_t
+monotonic_ms(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) == -1) {
+		return 0;
+	}
+
+	return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+/*!
+ * Whether to leave a stdin that isn't a terminal unread, for more input
+ * to be sent in the same frame: for up to SHIM_STDIN_BATCH_MS, while less
+ * than want bytes are available.
+ *
+ * Regular files, which can't be polled, are read right away.
+ *
+ * \param shim \ref cc_shim
+ * \param want Number of bytes to read
+ *
+ * \return true if stdin should not be read yet, false otherwise
+ */
+static bool
+stdin_batch_wait(struct cc_shim *shim, size_t want)
+{
+	int       avail;
+	uint64_t  now;
+
+	if (shim->stdin_tty || ! shim->watches[STDIN_WATCH].pollable) {
+		return false;
+	}
+
+	/* Nothing available is the end of the stream */
+	if (ioctl(shim->watches[STDIN_WATCH].fd, FIONREAD, &avail) == -1 ||
+			avail <= 0 || (size_t)avail >= want) {
+		shim->stdin_deadline = 0;
+		return false;
+	}
+
+	now = monotonic_ms();
+	if (! shim->stdin_deadline) {
+		shim->stdin_deadline = now + SHIM_STDIN_BATCH_MS;
+		return true;
+	}
+	if (now < shim->stdin_deadline) {
+		return true;
+	}
+
+	shim->stdin_deadline = 0;
+	return false;
+}
+
 /*!
  * Read data from stdin(with tty set in raw mode)
  * and send it to proxy I/O channel
  * Reference : https://github.com/hyperhq/runv/blob/master/hypervisor/tty.go#L448
  *
+ * Only as much data as the proxy I/O buffer has room for is read. A
+ * terminal is read BUFSIZ bytes at a time, to forward keystrokes as they
+ * come, other stdin up to SHIM_STDIN_MAX_PAYLOAD bytes at a time (see
+ * stdin_batch_wait()).
+ *
  * \param shim \ref cc_shim
  */
 void
 handle_stdin(struct cc_shim *shim)
 {
 	ssize_t        nread;
-	int            ret;
-	ssize_t        len;
-	static uint8_t buf[BUFSIZ+STREAM_HEADER_SIZE];
+	size_t         want;
+	size_t         len;
+	static uint8_t buf[SHIM_STDIN_MAX_PAYLOAD+STREAM_HEADER_SIZE];
 
 	if (! shim || shim->proxy_io_fd < 0) {
 		return;
 	}
 
-	nread = read(STDIN_FILENO , buf+STREAM_HEADER_SIZE, BUFSIZ);
+	want = ring_buffer_space(&shim->to_proxy_io);
+	if (want <= STREAM_HEADER_SIZE) {
+		/* stdin is watched again once there is room */
+		shim->stdin_deadline = 0;
+		return;
+	}
+	want -= STREAM_HEADER_SIZE;
+	if (want > (shim->stdin_tty ? BUFSIZ : SHIM_STDIN_MAX_PAYLOAD)) {
+		want = shim->stdin_tty ? BUFSIZ : SHIM_STDIN_MAX_PAYLOAD;
+	}
+
+	if (stdin_batch_wait(shim, want)) {
+		return;
+	}
+
+	nread = read(shim->watches[STDIN_WATCH].fd, buf+STREAM_HEADER_SIZE, want);
 	if (nread < 0) {
-		shim_warning("Error while reading stdin char :%s\n", strerror(errno));
+		if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+			shim_warning("Error while reading stdin char :%s\n", strerror(errno));
+		}
 		return;
 	} else if (nread == 0) {
-		/* EOF received on stdin, send eof to hyperstart and remove stdin fd from
-		 * the polled descriptors to prevent further eof events
+		/* EOF received on stdin, send eof to hyperstart and stop watching
+		 * stdin to prevent further eof events
 		 */
-		poll_fds[STDIN_INDEX].fd = -1;
+		remove_watch(shim, STDIN_WATCH);
 	}
 
-	len = nread + STREAM_HEADER_SIZE;
+	len = (size_t)nread + STREAM_HEADER_SIZE;
 	set_big_endian_64 (buf, shim->io_seq_no);
 	set_big_endian_32 (buf + STREAM_HEADER_LENGTH_OFFSET, (uint32_t)len);
 
-	// TODO: handle write in the poll loop to account for write blocking
-	ret = (int)write(shim->proxy_io_fd, buf, (size_t)len);
-	if (ret == -1) {
-		shim_warning("Error writing from fd %d to fd %d: %s\n",
-			     STDIN_FILENO, shim->proxy_io_fd, strerror(errno));
-		return;
-	}
+	ring_buffer_put(&shim->to_proxy_io, buf, len);
+	flush_watch(shim, PROXY_IO_WATCH);
 }
 
 /*!
- * Read and parse I/O message on proxy I/O fd
+ * Write the payloads of the complete frames at the head of the proxy I/O
+ * buffer, for the stream with sequence number seq, straight from that
+ * buffer to stdout/stderr, with a single writev(). What can't be written
+ * out of the first frame not fully written is moved to the (empty)
+ * stdout/stderr buffer, the following frames stay in the proxy I/O buffer.
  *
  * \param shim \ref cc_shim
- * \param[out] seq Seqence number of the I/O stream
- * \param[out] stream_len Length of the data received
- *
- * \return newly allocated string on success, else \c NULL.
+ * \param index Index of the stdout or stderr watch
+ * \param seq Sequence number of the stream
  */
-char*
-read_IO_message(struct cc_shim *shim, uint64_t *seq, ssize_t *stream_len) {
-	char *buf = NULL;
-	ssize_t need_read = STREAM_HEADER_SIZE;
-	ssize_t bytes_read = 0, want, ret;
-	ssize_t max_bytes = HYPERSTART_MAX_RECV_BYTES;
+void
+write_proxy_output(struct cc_shim *shim, enum shim_watch_index index,
+		uint64_t seq)
+{
+	struct ring_buffer  *in;
+	struct ring_buffer  *out;
+	struct iovec         iov[2 * SHIM_MAX_OUTPUT_FRAMES];
+	uint32_t             frame_len[SHIM_MAX_OUTPUT_FRAMES];
+	uint8_t              header[STREAM_HEADER_SIZE];
+	int                  niov = 0;
+	int                  frames = 0;
+	size_t               offset = 0;
+	size_t               payload;
+	size_t               written;
+	ssize_t              ret;
 
-	if (! (shim && seq && stream_len)) {
-		return NULL;
+	if (! shim) {
+		return;
 	}
 
-	*stream_len = 0;
+	in = &shim->from_proxy_io;
+	out = watch_buffer(shim, index);
+
+	while (frames < SHIM_MAX_OUTPUT_FRAMES &&
+			in->len - offset >= STREAM_HEADER_SIZE) {
+		ring_buffer_peek(in, offset, header, STREAM_HEADER_SIZE);
+		frame_len[frames] = get_big_endian_32(header + STREAM_HEADER_LENGTH_OFFSET);
+
+		/* Stop at frames for another stream, incomplete frames and
+		 * frames with a special meaning (left to the caller) */
+		if (get_big_endian_64(header) != seq ||
+				frame_len[frames] <= STREAM_HEADER_SIZE ||
+				frame_len[frames] > HYPERSTART_MAX_RECV_BYTES ||
+				(shim->exiting && frame_len[frames] == STREAM_HEADER_SIZE+1) ||
+				in->len - offset < frame_len[frames]) {
+			break;
+		}
 
-	buf = calloc(STREAM_HEADER_SIZE, 1);
-	if (! buf ) {
-		abort();
+		niov += ring_buffer_data_iov(in, offset + STREAM_HEADER_SIZE,
+				frame_len[frames] - STREAM_HEADER_SIZE, iov + niov);
+		offset += frame_len[frames];
+		frames++;
 	}
 
-	while (bytes_read < need_read) {
-		want = need_read - bytes_read;
-		if (want > BUFSIZ)  {
-			want = BUFSIZ;
+	do {
+		ret = writev(shim->watches[index].fd, iov, niov);
+	} while (ret == -1 && errno == EINTR);
+
+	if (ret == -1) {
+		if (errno != EAGAIN && errno != EWOULDBLOCK) {
+			shim_warning("Error writing to fd %d, discarding output: %s\n",
+				shim->watches[index].fd, strerror(errno));
+			written = SIZE_MAX;
+		} else {
+			written = 0;
 		}
+	} else {
+		written = (size_t)ret;
+	}
 
-		ret = read(shim->proxy_io_fd, buf+bytes_read, (size_t)want);
-		if (ret == -1) {
-			free(buf);
-			err_exit("Error reading from proxy I/O fd: %s\n", strerror(errno));
-		} else if (ret == 0) {
-			/* EOF received on proxy I/O fd*/
-			free(buf);
-			err_exit("EOF received on proxy I/O fd\n");
+	for (int i = 0; i < frames; i++) {
+		payload = frame_len[i] - STREAM_HEADER_SIZE;
+		if (written >= payload) {
+			ring_buffer_consume(in, frame_len[i]);
+			written -= payload;
+			continue;
 		}
 
-		bytes_read += ret;
+		ring_buffer_consume(in, STREAM_HEADER_SIZE + written);
+		ring_buffer_move(out, in, payload - written);
+		break;
+	}
+}
+
+/*!
+ * Write the complete stream frames received from the proxy to
+ * stdout/stderr, as long as they have room in the stdout/stderr buffers
+ *
+ * \param shim \ref cc_shim
+ */
+void
+dispatch_proxy_output(struct cc_shim *shim)
+{
+	struct ring_buffer     *in;
+	struct ring_buffer     *out;
+	enum shim_watch_index   index;
+	uint8_t                 header[STREAM_HEADER_SIZE];
+	uint64_t                seq;
+	uint32_t                stream_len;
+	uint8_t                 code;
+
+	if (! shim) {
+		return;
+	}
 
-		if (*stream_len == 0 && bytes_read >= STREAM_HEADER_SIZE) {
-			*stream_len = get_big_endian_32((uint8_t*)(buf+STREAM_HEADER_LENGTH_OFFSET));
+	in = &shim->from_proxy_io;
 
-			// length is 12 when hyperstart sends eof before sending exit code
-			if (*stream_len == STREAM_HEADER_SIZE) {
-				break;
-			}
+	while (shim->exit_code == -1 && in->len >= STREAM_HEADER_SIZE) {
+		ring_buffer_peek(in, 0, header, STREAM_HEADER_SIZE);
+		seq = get_big_endian_64(header);
+		stream_len = get_big_endian_32(header + STREAM_HEADER_LENGTH_OFFSET);
 
-			/* Ensure amount of data is within expected bounds */
-			if (*stream_len > max_bytes) {
-				shim_error("message too big (limit is %lu, but proxy returned %lu)",
-						(unsigned long int)max_bytes,
-						(unsigned long int)stream_len);
-				goto err;
-			}
+		if (stream_len < STREAM_HEADER_SIZE ||
+				stream_len > HYPERSTART_MAX_RECV_BYTES) {
+			shim_error("Misbehaving proxy. Exiting");
+			exit(EXIT_FAILURE);
+		}
 
-			if (*stream_len > STREAM_HEADER_SIZE) {
-				need_read = *stream_len;
-				buf = realloc(buf, (size_t)*stream_len);
-				if (! buf) {
-					abort();
-				}
+		if (in->len < stream_len) {
+			/* Wait for the rest of the frame */
+			return;
+		}
+
+		if (seq == shim->io_seq_no) {
+			out = &shim->to_stdout;
+			index = STDOUT_WATCH;
+		} else if (seq == shim->io_seq_no + 1) {//proxy allocates errseq 1 higher
+			out = &shim->to_stderr;
+			index = STDERR_WATCH;
+		} else {
+			shim_warning("Seq no %"PRIu64 " received from proxy does not match with\
+					 shim seq %"PRIu64 "\n", seq, shim->io_seq_no);
+			ring_buffer_consume(in, stream_len);
+			continue;
+		}
+
+		if (!shim->exiting && stream_len == STREAM_HEADER_SIZE) {
+			shim->exiting = true;
+			ring_buffer_consume(in, stream_len);
+			continue;
+		} else if (shim->exiting && stream_len == (STREAM_HEADER_SIZE+1)) {
+			// hyperstart has sent the exit status
+			ring_buffer_peek(in, STREAM_HEADER_SIZE, &code, 1);
+			ring_buffer_consume(in, stream_len);
+			shim_debug("Exit status for container: %d\n", code);
+			shim->exit_code = code;
+			if (shim->initial_workload) {
+				send_proxy_hyper_message(shim, "destroypod", "\"\"");
 			}
+			return;
+		} else if (stream_len == STREAM_HEADER_SIZE) {
+			ring_buffer_consume(in, stream_len);
+			continue;
 		}
-	}
-	*seq = get_big_endian_64((uint8_t*)buf);
-	return buf;
 
-err:
-	free(buf);
-	return NULL;
+		if (ring_buffer_empty(out) && shim->watches[index].fd >= 0) {
+			write_proxy_output(shim, index, seq);
+			continue;
+		}
+
+		if (ring_buffer_space(out) < stream_len - STREAM_HEADER_SIZE) {
+			/* The frame stays in the proxy I/O buffer until
+			 * stdout/stderr catches up */
+			return;
+		}
+
+		ring_buffer_consume(in, STREAM_HEADER_SIZE);
+		ring_buffer_move(out, in, stream_len - STREAM_HEADER_SIZE);
+		flush_watch(shim, index);
+	}
 }
 
 /*!
@@ -421,64 +849,23 @@ err:
 void
 handle_proxy_output(struct cc_shim *shim)
 {
-	uint64_t  seq;
-	char     *buf = NULL;
-	int       outfd;
-	ssize_t   stream_len = 0;
-	ssize_t   ret;
-	ssize_t   offset;
-	int       code = 0;
+	ssize_t ret;
 
 	if (shim == NULL) {
 		return;
 	}
 
-	buf = read_IO_message(shim, &seq, &stream_len);
-	if ((! buf) || (stream_len <= 0) || (stream_len > HYPERSTART_MAX_RECV_BYTES)) {
-		shim_error("Misbehaving proxy. Exiting");
-		exit(EXIT_FAILURE);
-	}
-
-	if (seq == shim->io_seq_no) {
-		outfd = STDOUT_FILENO;
-	} else if (seq == shim->io_seq_no + 1) {//proxy allocates errseq 1 higher
-		outfd = STDERR_FILENO;
-	} else {
-		shim_warning("Seq no %"PRIu64 " received from proxy does not match with\
-				 shim seq %"PRIu64 "\n", seq, shim->io_seq_no);
-		goto out;
-	}
-
-	if (!shim->exiting && stream_len == STREAM_HEADER_SIZE) {
-		shim->exiting = true;
-		goto out;
-	} else if (shim->exiting && stream_len == (STREAM_HEADER_SIZE+1)) {
-		if (shim->initial_workload) {
-			send_proxy_hyper_message(shim->proxy_sock_fd, "destroypod", "\"\"");
-		}
-		code = *(buf + STREAM_HEADER_SIZE); 	// hyperstart has sent the exit status
-		shim_debug("Exit status for container: %d\n", code);
-		free(buf);
-		restore_terminal();
-		exit(code);
-	}
-
-	/* TODO: what if writing to stdout/err blocks? Add this to the poll loop
-	 * to watch out for EPOLLOUT
-	 */
-	offset = STREAM_HEADER_SIZE;
-	while (offset < stream_len) {
-		ret = write(outfd, buf+offset, (size_t)(stream_len-offset));
-		if (ret <= 0 ) {
-			goto out;
+	ret = ring_buffer_read_fd(&shim->from_proxy_io, shim->proxy_io_fd);
+	if (ret == -1) {
+		if (errno == EAGAIN || errno == EWOULDBLOCK) {
+			return;
 		}
-		offset += (ssize_t)ret;
+		err_exit("Error reading from proxy I/O fd: %s\n", strerror(errno));
+	} else if (ret == 0) {
+		err_exit("EOF received on proxy I/O fd\n");
 	}
 
-out:
-	if (buf) {
-		free (buf);
-	}
+	dispatch_proxy_output(shim);
 }
 
 /*!
@@ -498,6 +885,9 @@ handle_proxy_ctl(struct cc_shim *shim)
 
 	ret = read(shim->proxy_sock_fd, buf, LINE_MAX-1);
 	if (ret == -1) {
+		if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+			return;
+		}
 		err_exit("Error reading from the proxy ctl socket: %s\n", strerror(errno));
 	} else if (ret == 0) {
 		err_exit("EOF received on proxy ctl socket. Proxy has exited\n");
@@ -507,6 +897,204 @@ handle_proxy_ctl(struct cc_shim *shim)
 	shim_debug("Proxy response:%s\n", buf + PROXY_CTL_HEADER_SIZE);
 }
 
+/*!
+ * Receive the proxy fds and sequence numbers from the runtime
+ *
+ * The runtime spawns the shim before it has connected to the proxy,
+ * so these are sent once known (see struct cc_shim_args).
+ *
+ * \param shim \ref cc_shim
+ * \param fd Socket to read the arguments from (closed on return)
+ */
+void
+receive_shim_args(struct cc_shim *shim, int fd)
+{
+	struct cc_shim_args  args = { 0 };
+	struct iovec         iov = { &args, sizeof(args) };
+	struct msghdr        msg = { 0 };
+	struct cmsghdr      *cmsg;
+	int                  fds[SHIM_ARGS_FD_COUNT];
+	union {
+		char            buf[CMSG_SPACE(sizeof(fds))];
+		struct cmsghdr  align;
+	} control;
+	ssize_t              ret;
+
+	if (! shim) {
+		return;
+	}
+
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buf;
+	msg.msg_controllen = sizeof(control.buf);
+
+	do {
+		ret = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+	} while (ret == -1 && errno == EINTR);
+
+	if (ret != (ssize_t)sizeof(args)) {
+		err_exit("Error receiving arguments from runtime: %s\n",
+			 ret == -1 ? strerror(errno) : "short read");
+	}
+
+	cmsg = CMSG_FIRSTHDR(&msg);
+	if (! cmsg || cmsg->cmsg_level != SOL_SOCKET ||
+			cmsg->cmsg_type != SCM_RIGHTS ||
+			cmsg->cmsg_len != CMSG_LEN(sizeof(fds))) {
+		err_exit("Missing file descriptors in runtime arguments\n");
+	}
+
+	memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+
+	shim->proxy_sock_fd = fds[0];
+	shim->proxy_io_fd = fds[1];
+	shim->io_seq_no = args.io_seq_no;
+	shim->err_seq_no = args.err_seq_no;
+
+	close(fd);
+}
+
+/*!
+ * Watch stdin, stdout and stderr, made non-blocking so that a slow
+ * reader of stdout/stderr doesn't block the shim: output is buffered
+ * until they are writable. The flags are to be restored with
+ * restore_stdio_flags() as the file descriptions may be shared with
+ * other processes.
+ *
+ * \param shim \ref cc_shim
+ * \param fds stdin, stdout and stderr file descriptors, -1 for those
+ * not open
+ */
+void
+setup_stdio(struct cc_shim *shim, const int fds[3])
+{
+	if (! (shim && fds)) {
+		return;
+	}
+
+	for (int i = 0; i < 3; i++) {
+		shim->stdio_fds[i] = fds[i];
+		shim->stdio_flags[i] = fds[i] < 0 ? -1 : fcntl(fds[i], F_GETFL);
+		if (shim->stdio_flags[i] == -1) {
+			continue;
+		}
+
+		set_fd_nonblocking(fds[i]);
+		add_watch(shim, (enum shim_watch_index)(STDIN_WATCH + i), fds[i]);
+	}
+
+	shim->stdin_tty = fds[0] >= 0 && isatty(fds[0]);
+}
+
+/*!
+ * Mark the watched fds that can't be polled as ready for the events
+ * they are watched for, as they always are, and stdin as ready to be
+ * read once the wait for more of it is over
+ *
+ * \param shim \ref cc_shim
+ * \param[out] ready epoll events each watched fd is ready for
+ *
+ * \return Timeout for waiting for the other fds, in milliseconds: 0 if
+ * any fd was marked ready, -1 for no timeout
+ */
+int
+shim_poll_timeout(struct cc_shim *shim, uint32_t ready[MAX_WATCHES])
+{
+	int       timeout = -1;
+	uint64_t  now;
+
+	if (! (shim && ready)) {
+		return -1;
+	}
+
+	for (int i = 0; i < MAX_WATCHES; i++) {
+		if (! shim->watches[i].pollable && shim->watches[i].events) {
+			ready[i] |= shim->watches[i].events;
+			timeout = 0;
+		}
+	}
+
+	if (shim->stdin_deadline) {
+		now = monotonic_ms();
+		if (now >= shim->stdin_deadline) {
+			ready[STDIN_WATCH] |= EPOLLIN;
+			timeout = 0;
+		} else if (timeout) {
+			timeout = (int)(shim->stdin_deadline - now);
+		}
+	}
+
+	return timeout;
+}
+
+/*!
+ * Handle the events the watched fds are ready for: forward the signals,
+ * write out what is buffered, then read more
+ *
+ * \param shim \ref cc_shim
+ * \param ready epoll events each watched fd is ready for
+ */
+void
+shim_handle_events(struct cc_shim *shim, const uint32_t ready[MAX_WATCHES])
+{
+	if (! (shim && ready)) {
+		return;
+	}
+
+	/* check if signal was received first */
+	if ((shim->watches[SIGNAL_WATCH].events & EPOLLIN) &&
+			ready[SIGNAL_WATCH] != 0) {
+		handle_signals(shim);
+	}
+
+	/* Write out what is buffered before reading more, to
+	 * make room for it
+	 */
+	for (int i = 0; i < MAX_WATCHES; i++) {
+		if ((shim->watches[i].events & EPOLLOUT) && ready[i] != 0) {
+			flush_watch(shim, (enum shim_watch_index)i);
+		}
+	}
+
+	// frames held back for stdout/stderr to have room
+	dispatch_proxy_output(shim);
+
+	//check proxy_io_fd
+	if ((shim->watches[PROXY_IO_WATCH].events & EPOLLIN) &&
+			ready[PROXY_IO_WATCH] != 0) {
+		handle_proxy_output(shim);
+	}
+
+	// check for proxy sockfd
+	if ((shim->watches[PROXY_CTL_WATCH].events & EPOLLIN) &&
+			ready[PROXY_CTL_WATCH] != 0) {
+		handle_proxy_ctl(shim);
+	}
+
+	// check stdin fd
+	if ((shim->watches[STDIN_WATCH].events & EPOLLIN) &&
+			ready[STDIN_WATCH] != 0) {
+		handle_stdin(shim);
+	}
+}
+
+/*!
+ * Check whether hyperstart has sent the exit code and all the output
+ * received before it has been written out
+ *
+ * \param shim \ref cc_shim
+ *
+ * \return true if the shim is done, false otherwise
+ */
+bool
+shim_finished(const struct cc_shim *shim)
+{
+	return shim && shim->exit_code != -1 &&
+		ring_buffer_empty(&shim->to_stdout) &&
+		ring_buffer_empty(&shim->to_stderr);
+}
+
 /*
  * Parse number from input
  *
@@ -548,6 +1136,7 @@ print_usage(void) {
         printf("  -o,  --proxy-io-fd      File descriptor of I/0 fd sent by the cc-proxy\n");
         printf("  -s,  --seq-no           Sequence no for stdin and stdout\n");
         printf("  -e,  --err-seq-no       Sequence no for stderr\n");
+        printf("  -a,  --args-fd          File descriptor to receive the proxy fds and sequence numbers from\n");
         printf("  -d,  --debug            Enable debug output\n");
         printf("  -h,  --help             Display this help message\n");
         printf("  -w,  --initial-workload This instance represents the initial workload and will destroy the VM when it finishes\n");
@@ -565,12 +1154,21 @@ main(int argc, char **argv)
 		.err_seq_no       =  0,
 		.exiting          =  false,
 		.initial_workload =  false,
+		.exit_code        = -1,
+		.epoll_fd         = -1,
+		.stdio_fds        = { -1, -1, -1 },
+		.stdio_flags      = { -1, -1, -1 },
 	};
 	int                ret;
 	struct sigaction   sa;
 	int                c;
+	int                args_fd = -1;
 	bool               debug = false;
 	long long          val;
+	struct epoll_event events[MAX_WATCHES];
+	uint32_t           ready[MAX_WATCHES];
+	int                timeout;
+	const int          stdio_fds[3] = { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO };
 
 	program_name = argv[0];
 
@@ -580,6 +1178,7 @@ main(int argc, char **argv)
 		{"proxy-io-fd", required_argument, 0, 'o'},
 		{"seq-no", required_argument, 0, 's'},
 		{"err-seq-no", required_argument, 0, 'e'},
+		{"args-fd", required_argument, 0, 'a'},
 		{"debug", no_argument, 0, 'd'},
 		{"help", no_argument, 0, 'h'},
 		{"initial-workload", no_argument, 0, 'w'},
@@ -587,7 +1186,7 @@ main(int argc, char **argv)
 		{ 0, 0, 0, 0},
 	};
 
-	while ((c = getopt_long(argc, argv, "c:p:o:s:e:dhwv", prog_opts, NULL))!= -1) {
+	while ((c = getopt_long(argc, argv, "c:p:o:s:e:a:dhwv", prog_opts, NULL))!= -1) {
 		switch (c) {
 			case 'c':
 				shim.container_id = strdup(optarg);
@@ -618,6 +1217,12 @@ main(int argc, char **argv)
 				}
 				shim.err_seq_no = (uint64_t)val;
 				break;
+			case 'a':
+				args_fd = (int)parse_numeric_option(optarg);
+				if (args_fd < 0) {
+					err_exit("Invalid value for arguments fd\n");
+				}
+				break;
 			case 'd':
 				debug = true;
 				break;
@@ -640,6 +1245,10 @@ main(int argc, char **argv)
 		err_exit("Missing container id\n");
 	}
 
+	if (args_fd != -1) {
+		receive_shim_args(&shim, args_fd);
+	}
+
 	if ( shim.proxy_sock_fd == -1) {
 		err_exit("Missing proxy socket file descriptor\n");
 	}
@@ -673,8 +1282,7 @@ main(int argc, char **argv)
 		err_exit("Error creating pipe\n");
 	}
 
-	// Add read end of pipe to pollfd list and make it non-bocking
-	add_pollfd(poll_fds, SIGNAL_FD_INDEX, signal_pipe_fd[0], POLLIN | POLLPRI);
+	// Make the pipe non-bocking
 	if (! set_fd_nonblocking(signal_pipe_fd[0])) {
 		exit(EXIT_FAILURE);
 	}
@@ -691,14 +1299,6 @@ main(int argc, char **argv)
 		err_exit("sigaction");
 	}
 
-	add_pollfd(poll_fds, PROXY_IO_INDEX, shim.proxy_io_fd, POLLIN | POLLPRI);
-
-	add_pollfd(poll_fds, PROXY_CTL_INDEX, shim.proxy_sock_fd, POLLIN | POLLPRI);
-
-	/* Add stdin only if it is attached to a terminal.
-	 * If we add stdin in the non-interactive case, since stdin is closed by docker
-	 * this causes continuous close events to be generated on the poll loop.
-	 */
 	if (isatty(STDIN_FILENO)) {
 		/*
 		 * Set raw mode on the slave side of the PTY. The local pty
@@ -715,11 +1315,6 @@ main(int argc, char **argv)
 		*saved_term_settings = term_settings;
 		cfmakeraw(&term_settings);
 		tcsetattr(STDIN_FILENO, TCSAFLUSH, &term_settings);
-
-		add_pollfd(poll_fds, STDIN_INDEX, STDIN_FILENO, POLLIN | POLLPRI);
-	} else if (fcntl(STDIN_FILENO, F_GETFD) != -1) {
-		set_fd_nonblocking(STDIN_FILENO);
-		add_pollfd(poll_fds, STDIN_INDEX, STDIN_FILENO, POLLIN | POLLPRI);
 	}
 
 	ret = atexit(restore_terminal);
@@ -727,34 +1322,68 @@ main(int argc, char **argv)
 		shim_debug("Could not register function for atexit");
 	}
 
-	while (1) {
-		ret = poll(poll_fds, MAX_POLL_FDS, -1);
-		if (ret == -1 && errno != EINTR) {
-			shim_error("Error in poll : %s\n", strerror(errno));
-			break;
-		}
+	if (! (ring_buffer_init(&shim.to_proxy_io, SHIM_BUFFER_SIZE) &&
+			ring_buffer_init(&shim.to_proxy_ctl, SHIM_BUFFER_SIZE) &&
+			ring_buffer_init(&shim.from_proxy_io, SHIM_BUFFER_SIZE) &&
+			ring_buffer_init(&shim.to_stdout, SHIM_BUFFER_SIZE) &&
+			ring_buffer_init(&shim.to_stderr, SHIM_BUFFER_SIZE))) {
+		err_exit("Error allocating buffers\n");
+	}
 
-		/* check if signal was received first */
-		if (poll_fds[SIGNAL_FD_INDEX].revents != 0) {
-			handle_signals(&shim);
-		}
+	for (int i = 0; i < MAX_WATCHES; i++) {
+		add_watch(&shim, (enum shim_watch_index)i, -1);
+	}
 
-		//check proxy_io_fd
-		if (poll_fds[PROXY_IO_INDEX].revents != 0) {
-			handle_proxy_output(&shim);
-		}
+	shim.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (shim.epoll_fd == -1) {
+		err_exit("Error creating epoll fd: %s\n", strerror(errno));
+	}
+
+	add_watch(&shim, SIGNAL_WATCH, signal_pipe_fd[0]);
+
+	if (! (set_fd_nonblocking(shim.proxy_io_fd) &&
+			set_fd_nonblocking(shim.proxy_sock_fd))) {
+		exit(EXIT_FAILURE);
+	}
+
+	add_watch(&shim, PROXY_IO_WATCH, shim.proxy_io_fd);
+
+	add_watch(&shim, PROXY_CTL_WATCH, shim.proxy_sock_fd);
+
+	setup_stdio(&shim, stdio_fds);
+
+	main_shim = &shim;
+	ret = atexit(restore_main_stdio_flags);
+	if (ret) {
+		shim_debug("Could not register function for atexit");
+	}
 
-		// check for proxy sockfd
-		if (poll_fds[PROXY_CTL_INDEX].revents != 0) {
-			handle_proxy_ctl(&shim);
+	while (! shim_finished(&shim)) {
+		update_watches(&shim);
+
+		memset(ready, 0, sizeof(ready));
+		timeout = shim_poll_timeout(&shim, ready);
+
+		ret = epoll_wait(shim.epoll_fd, events, MAX_WATCHES, timeout);
+		if (ret == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			shim_error("Error in epoll_wait : %s\n", strerror(errno));
+			break;
 		}
 
-		// check stdin fd
-		if (poll_fds[STDIN_INDEX].revents != 0) {
-			handle_stdin(&shim);
+		for (int i = 0; i < ret; i++) {
+			ready[events[i].data.u32] |= events[i].events;
 		}
+
+		shim_handle_events(&shim, ready);
 	}
 
+	/* Make sure the destroypod message, if any, reaches the proxy */
+	flush_watch_blocking(&shim, PROXY_CTL_WATCH);
+
 	free(shim.container_id);
-	return 0;
+	restore_terminal();
+	exit(shim.exit_code == -1 ? EXIT_FAILURE : shim.exit_code);
 }
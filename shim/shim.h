@@ -13,12 +13,52 @@
 // limitations under the License.
 
 #include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ring_buffer.h"
 
 /* The shim would be handling fixed number of predefined fds.
- * This would be signal fd, stdin fd, proxy socket fd and an I/O
- * fd passed by the runtime
+ * This would be signal fd, stdin, stdout and stderr fds, proxy socket
+ * fd and an I/O fd passed by the runtime, each watched at a specific
+ * index of cc_shim.watches
  */
-#define MAX_POLL_FDS 4
+enum shim_watch_index {
+	SIGNAL_WATCH,
+	PROXY_IO_WATCH,
+	PROXY_CTL_WATCH,
+	STDIN_WATCH,
+	STDOUT_WATCH,
+	STDERR_WATCH,
+	MAX_WATCHES
+};
+
+struct shim_watch {
+	int         fd;
+	/* epoll events the fd is watched for, 0 when not in the epoll set */
+	uint32_t    events;
+	/* false for fds epoll refuses (regular files, /dev/null), which
+	 * are considered always ready */
+	bool        pollable;
+};
+
+/*
+ * Size of the buffers holding the data read from an fd until the fd
+ * it goes to is writable. Reading from an fd stops while the buffer
+ * it is read to is full.
+ */
+#define SHIM_BUFFER_SIZE                (64 * 1024)
+
+/* Maximum number of stream frames written to stdout/stderr at once,
+ * straight from the proxy I/O buffer */
+#define SHIM_MAX_OUTPUT_FRAMES          32
+
+/* Room kept in the proxy ctl buffer for each hyper message */
+#define SHIM_MAX_CTL_MSG_SIZE           1024
+
+/* Longest a stdin that isn't a terminal is left unread for more input
+ * to be sent in the same frame */
+#define SHIM_STDIN_BATCH_MS             2
 
 struct cc_shim {
 	char       *container_id;
@@ -28,8 +68,41 @@ struct cc_shim {
 	uint64_t    err_seq_no;
 	bool        exiting;
 	bool        initial_workload;
+	/* Exit code of the workload, -1 until hyperstart sends it */
+	int         exit_code;
+	int         epoll_fd;
+	struct shim_watch watches[MAX_WATCHES];
+	/* Stream frames and hyper messages waiting to be sent to the proxy */
+	struct ring_buffer to_proxy_io;
+	struct ring_buffer to_proxy_ctl;
+	/* Stream frames received from the proxy and not dispatched yet */
+	struct ring_buffer from_proxy_io;
+	/* Output waiting for stdout and stderr to be writable */
+	struct ring_buffer to_stdout;
+	struct ring_buffer to_stderr;
+	/* stdin, stdout and stderr, and their file status flags before they
+	 * were made non-blocking, -1 for those not open */
+	int         stdio_fds[3];
+	int         stdio_flags[3];
+	/* A terminal stdin is forwarded as typed. Other stdin is read up to
+	 * a full frame at a time, waiting for one to be available until
+	 * stdin_deadline (CLOCK_MONOTONIC ms, 0 when not waiting) */
+	bool        stdin_tty;
+	uint64_t    stdin_deadline;
+};
+
+/*
+ * Arguments sent by the runtime on the socket passed with --args-fd:
+ * the sequence numbers below, along with the proxy socket fd and the
+ * proxy I/O fd (in that order) as SCM_RIGHTS ancillary data.
+ */
+struct cc_shim_args {
+	uint64_t    io_seq_no;
+	uint64_t    err_seq_no;
 };
 
+#define SHIM_ARGS_FD_COUNT              2
+
 /*
  * control message format
  * | ctrl id | length  | payload (length-8)      |
@@ -60,3 +133,5 @@ struct cc_shim {
  */
 #define HYPERSTART_MAX_RECV_BYTES       10240
 
+/* Largest payload of the stdin frames */
+#define SHIM_STDIN_MAX_PAYLOAD  (HYPERSTART_MAX_RECV_BYTES - STREAM_HEADER_SIZE)
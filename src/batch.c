@@ -0,0 +1,544 @@
+/*
+ * This file is part of cc-oci-runtime.
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Creation of many containers by a single runtime invocation.
+ *
+ * The batch is described by a file containing one container per line:
+ *
+ *     <container-id> <bundle-path> [<pid-file>]
+ *
+ * Blank lines and lines starting with '#' are ignored.
+ *
+ * Since creating a container changes the namespaces and the working
+ * directory of the calling process, each container is created by a
+ * child process running cc_oci_create(). The VM configuration
+ * defaults and the hypervisor arguments template are loaded once by
+ * the parent, so every child inherits them rather than reading and
+ * parsing them again.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <glib.h>
+#include <json-glib/json-glib.h>
+
+#include "oci.h"
+#include "oci-config.h"
+#include "util.h"
+#include "logging.h"
+#include "hypervisor.h"
+#include "spec_handler.h"
+#include "trace.h"
+#include "batch.h"
+#include "common.h"
+
+/*!
+ * Free the specified \ref cc_oci_batch_entry.
+ *
+ * \param entry \ref cc_oci_batch_entry.
+ */
+static void
+cc_oci_batch_entry_free (struct cc_oci_batch_entry *entry)
+{
+	if (! entry) {
+		return;
+	}
+
+	if (entry->fd != -1) {
+		close (entry->fd);
+	}
+
+	g_free_if_set (entry->container_id);
+	g_free_if_set (entry->bundle);
+	g_free_if_set (entry->pid_file);
+	g_free_if_set (entry->error);
+	g_free (entry);
+}
+
+/*!
+ * Parse a batch of containers to create.
+ *
+ * \param contents Batch description (see \ref batch.c).
+ * \param[out] entries Newly-allocated array of \ref cc_oci_batch_entry.
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+cc_oci_batch_parse (const gchar *contents, GPtrArray **entries)
+{
+	gchar       **lines = NULL;
+	GHashTable   *ids = NULL;
+	GPtrArray    *array = NULL;
+	gboolean      ret = false;
+
+	if (! (contents && entries)) {
+		return false;
+	}
+
+	lines = g_strsplit (contents, "\n", -1);
+	ids = g_hash_table_new (g_str_hash, g_str_equal);
+	array = g_ptr_array_new_with_free_func
+		((GDestroyNotify)cc_oci_batch_entry_free);
+
+	for (guint i = 0; lines[i]; i++) {
+		struct cc_oci_batch_entry  *entry;
+		gchar                      *fields[3] = { NULL };
+		guint                       count = 0;
+		gchar                      *line;
+		gchar                      *token;
+		gchar                      *saveptr = NULL;
+
+		line = g_strstrip (lines[i]);
+		if (! *line || *line == '#') {
+			continue;
+		}
+
+		for (token = strtok_r (line, " \t", &saveptr); token;
+				token = strtok_r (NULL, " \t", &saveptr)) {
+			if (count == G_N_ELEMENTS (fields)) {
+				count++;
+				break;
+			}
+			fields[count++] = token;
+		}
+
+		if (count < 2 || count > G_N_ELEMENTS (fields)) {
+			g_critical ("invalid batch entry on line %u", i+1);
+			goto out;
+		}
+
+		if (g_hash_table_contains (ids, fields[0])) {
+			g_critical ("container %s specified more than once",
+					fields[0]);
+			goto out;
+		}
+
+		entry = g_new0 (struct cc_oci_batch_entry, 1);
+		entry->container_id = g_strdup (fields[0]);
+		entry->bundle = g_strdup (fields[1]);
+		entry->pid_file = g_strdup (fields[2]);
+		entry->pid = -1;
+		entry->fd = -1;
+
+		g_ptr_array_add (array, entry);
+		(void)g_hash_table_add (ids, entry->container_id);
+	}
+
+	if (! array->len) {
+		g_critical ("no containers specified");
+		goto out;
+	}
+
+	*entries = array;
+	array = NULL;
+	ret = true;
+
+out:
+	if (array) {
+		g_ptr_array_free (array, true);
+	}
+	g_hash_table_destroy (ids);
+	g_strfreev (lines);
+
+	return ret;
+}
+
+/*!
+ * Read a batch of containers to create.
+ *
+ * \param path Batch file, or \ref CC_OCI_BATCH_STDIN to read
+ *   standard input.
+ * \param[out] entries Newly-allocated array of \ref cc_oci_batch_entry.
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+cc_oci_batch_read (const gchar *path, GPtrArray **entries)
+{
+	g_autofree gchar  *contents = NULL;
+	GError            *err = NULL;
+
+	if (! (path && entries)) {
+		return false;
+	}
+
+	if (! g_strcmp0 (path, CC_OCI_BATCH_STDIN)) {
+		GIOChannel *channel;
+
+		channel = g_io_channel_unix_new (STDIN_FILENO);
+		(void)g_io_channel_read_to_end (channel, &contents,
+				NULL, &err);
+		g_io_channel_unref (channel);
+	} else {
+		(void)g_file_get_contents (path, &contents, NULL, &err);
+	}
+
+	if (err) {
+		g_critical ("failed to read batch file %s: %s",
+				path, err->message);
+		g_error_free (err);
+		return false;
+	}
+
+	return cc_oci_batch_parse (contents, entries);
+}
+
+/*!
+ * Load the configuration shared by the containers in the batch, so
+ * that the children creating the containers inherit it.
+ *
+ * Failures are ignored since they will be reported by the children.
+ *
+ * \param entries Array of \ref cc_oci_batch_entry.
+ */
+static void
+cc_oci_batch_preload (const GPtrArray *entries)
+{
+	struct cc_oci_config *config;
+
+	config = cc_oci_config_create ();
+	if (! config) {
+		return;
+	}
+
+	(void)get_spec_vm_from_cfg_file (config);
+
+	/* The template may be provided by the bundle */
+	for (guint i = 0; i < entries->len; i++) {
+		const struct cc_oci_batch_entry *entry;
+
+		entry = g_ptr_array_index (entries, i);
+
+		g_free_if_set (config->bundle_path);
+		config->bundle_path = cc_oci_resolve_path (entry->bundle);
+		if (! config->bundle_path) {
+			continue;
+		}
+
+		(void)cc_oci_vm_args_preload (config);
+	}
+
+	cc_oci_config_free (config);
+}
+
+/*!
+ * Create a single container (called in the child process).
+ *
+ * \param defaults \ref cc_oci_config containing the options that
+ *   apply to all containers.
+ * \param entry \ref cc_oci_batch_entry.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+cc_oci_batch_create_one (const struct cc_oci_config *defaults,
+		const struct cc_oci_batch_entry *entry)
+{
+	struct cc_oci_config  *config;
+	gboolean               ret = false;
+
+	config = cc_oci_config_create ();
+	if (! config) {
+		return false;
+	}
+
+	config->optarg_container_id = entry->container_id;
+	config->root_dir = g_strdup (defaults->root_dir);
+	config->pid_file = g_strdup (entry->pid_file);
+	config->dry_run_mode = defaults->dry_run_mode;
+	config->detached_mode = defaults->detached_mode;
+
+	config->bundle_path = cc_oci_resolve_path (entry->bundle);
+	if (! config->bundle_path) {
+		g_critical ("invalid bundle path: %s", entry->bundle);
+		goto out;
+	}
+
+	ret = cc_oci_create (config);
+
+	(void)cc_oci_trace_write (config);
+
+out:
+	cc_oci_config_free (config);
+
+	return ret;
+}
+
+/*!
+ * Start a child process to create the container described by
+ * \p entry.
+ *
+ * \param defaults \ref cc_oci_config containing the options that
+ *   apply to all containers.
+ * \param entry \ref cc_oci_batch_entry.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+cc_oci_batch_spawn (const struct cc_oci_config *defaults,
+		struct cc_oci_batch_entry *entry)
+{
+	int    fds[2] = { -1, -1 };
+	pid_t  pid;
+
+	if (pipe2 (fds, O_CLOEXEC) < 0) {
+		entry->error = g_strdup_printf ("failed to create pipe: %s",
+				strerror (errno));
+		return false;
+	}
+
+	entry->start = g_get_monotonic_time ();
+	entry->trace_start = cc_oci_trace_now ();
+
+	pid = fork ();
+	if (pid < 0) {
+		entry->error = g_strdup_printf ("failed to create child: %s",
+				strerror (errno));
+		close (fds[0]);
+		close (fds[1]);
+		return false;
+	}
+
+	if (! pid) {
+		const gchar  *msg;
+		gboolean      ret;
+
+		close (fds[0]);
+
+		ret = cc_oci_batch_create_one (defaults, entry);
+		if (! ret) {
+			msg = cc_oci_log_last_error ();
+			if (! msg) {
+				msg = "failed to create container";
+			}
+
+			/* small enough to never block */
+			(void)write (fds[1], msg, MIN (strlen (msg),
+						PIPE_BUF - 1));
+		}
+
+		_exit (ret ? EXIT_SUCCESS : EXIT_FAILURE);
+	}
+
+	close (fds[1]);
+
+	/* The child may leave descendants holding the write end open
+	 * (until they exec), so never block reading the error.
+	 */
+	(void)fcntl (fds[0], F_SETFL, O_NONBLOCK);
+
+	entry->pid = pid;
+	entry->fd = fds[0];
+
+	return true;
+}
+
+/*!
+ * Record the outcome of creating a container.
+ *
+ * \param entry \ref cc_oci_batch_entry.
+ * \param status Exit status of the child process.
+ */
+static void
+cc_oci_batch_reap (struct cc_oci_batch_entry *entry, int status)
+{
+	gchar    buffer[PIPE_BUF] = { 0 };
+	ssize_t  bytes;
+
+	entry->duration = g_get_monotonic_time () - entry->start;
+
+	cc_oci_trace_end (CC_OCI_TRACE_COMMAND, entry->container_id,
+			entry->trace_start);
+
+	entry->success = WIFEXITED (status) && ! WEXITSTATUS (status);
+
+	bytes = read (entry->fd, buffer, sizeof (buffer) - 1);
+
+	close (entry->fd);
+	entry->fd = -1;
+	entry->pid = -1;
+
+	if (entry->success) {
+		return;
+	}
+
+	if (bytes > 0) {
+		entry->error = g_strndup (buffer, (gsize)bytes);
+	} else if (WIFSIGNALED (status)) {
+		entry->error = g_strdup_printf ("killed by signal %d",
+				WTERMSIG (status));
+	} else {
+		entry->error = g_strdup ("failed to create container");
+	}
+}
+
+/*!
+ * Create all the containers in a batch, creating at most \p parallel
+ * containers at the same time.
+ *
+ * \param config \ref cc_oci_config containing the options that apply
+ *   to all containers.
+ * \param entries Array of \ref cc_oci_batch_entry (updated with the
+ *   outcome for each container).
+ * \param parallel Maximum number of containers to create at the same
+ *   time (\c 0 to use the number of processors).
+ *
+ * \return \c true if all containers were created, else \c false.
+ */
+gboolean
+cc_oci_batch_create (const struct cc_oci_config *config,
+		GPtrArray *entries, guint parallel)
+{
+	guint     next = 0;
+	guint     running = 0;
+	gboolean  ret = true;
+
+	if (! (config && entries)) {
+		return false;
+	}
+
+	if (! parallel) {
+		parallel = g_get_num_processors ();
+	}
+
+	cc_oci_batch_preload (entries);
+
+	while (next < entries->len || running) {
+		struct cc_oci_batch_entry  *entry = NULL;
+		pid_t                       pid;
+		int                         status = 0;
+
+		while (running < parallel && next < entries->len) {
+			entry = g_ptr_array_index (entries, next++);
+
+			if (cc_oci_batch_spawn (config, entry)) {
+				running++;
+			}
+		}
+
+		if (! running) {
+			break;
+		}
+
+		pid = waitpid (-1, &status, 0);
+		if (pid < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+
+			g_critical ("failed to wait for children: %s",
+					strerror (errno));
+			return false;
+		}
+
+		entry = NULL;
+
+		for (guint i = 0; i < entries->len; i++) {
+			struct cc_oci_batch_entry *e;
+
+			e = g_ptr_array_index (entries, i);
+			if (e->pid == pid) {
+				entry = e;
+				break;
+			}
+		}
+
+		if (! entry) {
+			continue;
+		}
+
+		running--;
+
+		cc_oci_batch_reap (entry, status);
+	}
+
+	for (guint i = 0; i < entries->len; i++) {
+		const struct cc_oci_batch_entry *entry;
+
+		entry = g_ptr_array_index (entries, i);
+		if (! entry->success) {
+			g_debug ("failed to create container %s: %s",
+					entry->container_id, entry->error);
+			ret = false;
+		}
+	}
+
+	return ret;
+}
+
+/*!
+ * Describe the outcome of a batch in JSON format.
+ *
+ * \param entries Array of \ref cc_oci_batch_entry.
+ *
+ * \return Newly-allocated string on success, else \c NULL.
+ */
+gchar *
+cc_oci_batch_to_json (const GPtrArray *entries)
+{
+	JsonArray  *array;
+	gchar      *str;
+
+	if (! entries) {
+		return NULL;
+	}
+
+	array = json_array_new ();
+
+	for (guint i = 0; i < entries->len; i++) {
+		const struct cc_oci_batch_entry  *entry;
+		JsonObject                       *obj;
+
+		entry = g_ptr_array_index (entries, i);
+
+		obj = json_object_new ();
+		json_object_set_string_member (obj, "id",
+				entry->container_id);
+		json_object_set_string_member (obj, "bundle", entry->bundle);
+		json_object_set_boolean_member (obj, "success",
+				entry->success);
+		if (! entry->success) {
+			json_object_set_string_member (obj, "error",
+					entry->error ? entry->error
+					: "container not created");
+		}
+		json_object_set_int_member (obj, "duration_ms",
+				entry->duration / 1000);
+
+		json_array_add_object_element (array, obj);
+	}
+
+	str = cc_oci_json_arr_to_string (array, true);
+	json_array_unref (array);
+
+	return str;
+}
@@ -0,0 +1,70 @@
+/*
+ * This file is part of cc-oci-runtime.
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _CC_OCI_BATCH_H
+#define _CC_OCI_BATCH_H
+
+#include <glib.h>
+
+#include "oci.h"
+
+/** Value of the batch file argument denoting standard input. */
+#define CC_OCI_BATCH_STDIN	"-"
+
+/** A container to create as part of a batch. */
+struct cc_oci_batch_entry {
+	/** Name of the container. */
+	gchar    *container_id;
+
+	/** Bundle path, as specified. */
+	gchar    *bundle;
+
+	/** File to write the workload pid to (or \c NULL). */
+	gchar    *pid_file;
+
+	/** Process creating the container (\c -1 if not running). */
+	GPid      pid;
+
+	/** Read end of the pipe the error message is returned on. */
+	int       fd;
+
+	/** Monotonic time the creation started. */
+	gint64    start;
+
+	/** Value of cc_oci_trace_now() when the creation started. */
+	gint64    trace_start;
+
+	/** Time (in microseconds) the creation took. */
+	gint64    duration;
+
+	/** \c true if the container was created. */
+	gboolean  success;
+
+	/** Reason the container could not be created (or \c NULL). */
+	gchar    *error;
+};
+
+gboolean cc_oci_batch_parse (const gchar *contents, GPtrArray **entries);
+gboolean cc_oci_batch_read (const gchar *path, GPtrArray **entries);
+gboolean cc_oci_batch_create (const struct cc_oci_config *config,
+		GPtrArray *entries, guint parallel);
+gchar *cc_oci_batch_to_json (const GPtrArray *entries);
+
+#endif /* _CC_OCI_BATCH_H */
@@ -0,0 +1,410 @@
+/*
+ * This file is part of cc-oci-runtime.
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Checkpoint and restore of a container VM.
+ *
+ * A checkpoint pauses the VM and streams its complete state (devices
+ * and guest RAM) to an image file using QMP "migrate":
+ *
+ *     <image dir>/vm.state     (or vm.state.gz if compressed)
+ *
+ * The default image directory is
+ * \ref CC_OCI_CHECKPOINT_DIR_PREFIX/<container-id>.
+ *
+ * A restore creates the container as normal, but starts the
+ * hypervisor with "-incoming" so that it loads the image rather than
+ * booting the guest. Since hyperstart and the workload are already
+ * running inside the restored guest, no pod is created: the proxy is
+ * only told about the VM and the shim is connected to the workloads
+ * I/O streams before the VM is resumed.
+ */
+
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "oci.h"
+#include "util.h"
+#include "network.h"
+#include "state.h"
+#include "process.h"
+#include "vmpool.h"
+#include "vmtemplate.h"
+#include "ready.h"
+#include "command.h"
+#include "checkpoint.h"
+#include "common.h"
+
+extern struct start_data start_data;
+
+/** Directory below which checkpoint images are saved by default. */
+private gchar *checkpoint_dir = CC_OCI_CHECKPOINT_DIR_PREFIX;
+
+/*!
+ * Determine the directory holding the checkpoint image of a container.
+ *
+ * \param container_id Container id.
+ * \param image_path Directory specified by the user, or \c NULL.
+ *
+ * \return Newly-allocated string on success, else \c NULL.
+ */
+gchar *
+cc_oci_checkpoint_dir (const gchar *container_id, const gchar *image_path)
+{
+	g_autofree gchar  *cwd = NULL;
+
+	/* The directory need not exist yet, so it cannot be resolved */
+	if (image_path && g_path_is_absolute (image_path)) {
+		return g_strdup (image_path);
+	} else if (image_path && *image_path) {
+		cwd = g_get_current_dir ();
+		return g_build_path ("/", cwd, image_path, NULL);
+	}
+
+	if (! (container_id && *container_id)) {
+		return NULL;
+	}
+
+	return g_build_path ("/", checkpoint_dir, container_id, NULL);
+}
+
+/*!
+ * Find the checkpoint image saved in \p dir.
+ *
+ * \param dir Checkpoint image directory.
+ *
+ * \return Newly-allocated path to the image on success, else \c NULL.
+ */
+gchar *
+cc_oci_checkpoint_image_find (const gchar *dir)
+{
+	const gchar  *names[] = {
+		CC_OCI_CHECKPOINT_IMAGE,
+		CC_OCI_CHECKPOINT_IMAGE_GZ
+	};
+	gchar        *path;
+
+	if (! dir) {
+		return NULL;
+	}
+
+	for (gsize i = 0; i < CC_OCI_ARRAY_SIZE (names); i++) {
+		path = g_build_path ("/", dir, names[i], NULL);
+
+		if (g_file_test (path, G_FILE_TEST_IS_REGULAR)) {
+			return path;
+		}
+
+		g_free (path);
+	}
+
+	return NULL;
+}
+
+/*!
+ * Create the migration URI used to save or load \p image.
+ *
+ * The hypervisor runs the command given in an "exec:" URI using the
+ * shell, so the image is compressed or decompressed in the same
+ * pipeline if its name ends in ".gz".
+ *
+ * \param image Full path to image file.
+ * \param incoming \c true to create the URI used to load the image,
+ *   \c false to create the URI used to save it.
+ *
+ * \return Newly-allocated string on success, else \c NULL.
+ */
+gchar *
+cc_oci_checkpoint_uri (const gchar *image, gboolean incoming)
+{
+	g_autofree gchar  *quoted = NULL;
+	gboolean           compress;
+
+	if (! (image && *image)) {
+		return NULL;
+	}
+
+	compress = g_str_has_suffix (image, ".gz");
+	quoted = g_shell_quote (image);
+
+	if (incoming) {
+		return g_strdup_printf ("exec:%s < %s",
+				compress ? "gzip -d -c" : "cat",
+				quoted);
+	}
+
+	return g_strdup_printf ("exec:%s > %s",
+			compress ? "gzip -1 -c" : "cat",
+			quoted);
+}
+
+/*!
+ * Save the state of the VM running a container.
+ *
+ * The VM is paused whilst it is saved. Unless
+ * \ref cc_oci_checkpoint_options.leave_running is set, the hypervisor
+ * is then shut down which stops the container.
+ *
+ * \param config \ref cc_oci_config.
+ * \param state \ref oci_state.
+ * \param options \ref cc_oci_checkpoint_options.
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+cc_oci_checkpoint (struct cc_oci_config *config,
+		struct oci_state *state,
+		const struct cc_oci_checkpoint_options *options)
+{
+	g_autofree gchar  *dir = NULL;
+	g_autofree gchar  *image = NULL;
+	g_autofree gchar  *stale = NULL;
+	g_autofree gchar  *uri = NULL;
+	g_autofree gchar  *slot_link = NULL;
+	g_autofree gchar  *template_link = NULL;
+	gboolean           running;
+	gboolean           ret = false;
+
+	if (! (config && state && options)) {
+		return false;
+	}
+
+	if (! (state->vm && state->vm->pid > 0)) {
+		g_critical ("no hypervisor for container %s",
+				config->optarg_container_id);
+		return false;
+	}
+
+	if (state->pod) {
+		g_critical ("cannot checkpoint container %s: "
+				"pods are not supported",
+				config->optarg_container_id);
+		return false;
+	}
+
+	if (! (state->status == OCI_STATUS_RUNNING ||
+				state->status == OCI_STATUS_PAUSED)) {
+		g_critical ("cannot checkpoint container %s in state %s",
+				config->optarg_container_id,
+				cc_oci_status_to_str (state->status));
+		return false;
+	}
+
+	/* The devices of a VM claimed from the pool were hot-attached, so
+	 * the hypervisor started by a restore would not match it.
+	 */
+	slot_link = g_build_path ("/", config->state.runtime_path,
+			CC_OCI_VM_POOL_SLOT_LINK, NULL);
+	if (g_file_test (slot_link, G_FILE_TEST_IS_SYMLINK)) {
+		g_critical ("cannot checkpoint container %s: "
+				"VM was claimed from the pool",
+				config->optarg_container_id);
+		return false;
+	}
+
+	/* Nor would it map the template files of a cloned VM */
+	template_link = g_build_path ("/", config->state.runtime_path,
+			CC_OCI_VM_TEMPLATE_LINK, NULL);
+	if (g_file_test (template_link, G_FILE_TEST_IS_SYMLINK)) {
+		g_critical ("cannot checkpoint container %s: "
+				"VM was cloned from a template",
+				config->optarg_container_id);
+		return false;
+	}
+
+	dir = cc_oci_checkpoint_dir (config->optarg_container_id,
+			options->image_path);
+	if (! dir) {
+		return false;
+	}
+
+	if (g_mkdir_with_parents (dir, 0700) < 0) {
+		g_critical ("failed to create directory %s: %s",
+				dir, strerror (errno));
+		return false;
+	}
+
+	image = g_build_path ("/", dir, options->compress
+			? CC_OCI_CHECKPOINT_IMAGE_GZ
+			: CC_OCI_CHECKPOINT_IMAGE, NULL);
+
+	/* Ensure a restore cannot pick up an older image */
+	stale = g_build_path ("/", dir, options->compress
+			? CC_OCI_CHECKPOINT_IMAGE
+			: CC_OCI_CHECKPOINT_IMAGE_GZ, NULL);
+	if (g_remove (stale) < 0 && errno != ENOENT) {
+		g_critical ("failed to remove %s: %s",
+				stale, strerror (errno));
+		return false;
+	}
+
+	uri = cc_oci_checkpoint_uri (image, false);
+	if (! uri) {
+		return false;
+	}
+
+	running = state->status == OCI_STATUS_RUNNING;
+
+	/* Stop the guest so the image is consistent (and the migration
+	 * does not have to chase dirtied pages).
+	 */
+	if (running && ! cc_oci_vm_pause (state->comms_path, state->pid)) {
+		g_critical ("failed to pause container %s",
+				config->optarg_container_id);
+		return false;
+	}
+
+	g_debug ("saving VM state to %s", image);
+
+	if (! cc_oci_vm_migrate (state->comms_path, state->pid, uri,
+				false, start_data.ready_timeout)) {
+		g_critical ("failed to save state of container %s",
+				config->optarg_container_id);
+		(void)g_remove (image);
+		goto out;
+	}
+
+	if (options->leave_running) {
+		ret = true;
+		goto out;
+	}
+
+	/* Shutting down the hypervisor makes the proxy drop the shims
+	 * connections, so the shim exits as it would if the workload
+	 * had.
+	 */
+	if (kill (state->vm->pid, SIGTERM) < 0 && errno != ESRCH) {
+		g_critical ("failed to stop hypervisor %u: %s",
+				(unsigned)state->vm->pid,
+				strerror (errno));
+		goto out;
+	}
+
+	config->state.status = OCI_STATUS_STOPPED;
+
+	if (! cc_oci_state_file_create (config, state->create_time)) {
+		g_critical ("failed to recreate state file");
+		return false;
+	}
+
+	return true;
+
+out:
+	/* Leave the container in the state it was found in */
+	if (running && ! cc_oci_vm_resume (state->comms_path, state->pid)) {
+		g_critical ("failed to resume container %s",
+				config->optarg_container_id);
+		ret = false;
+	}
+
+	return ret;
+}
+
+/*!
+ * Wait for a hypervisor started by cc_oci_restore() to load its
+ * checkpoint image, then let the guest run.
+ *
+ * \param config \ref cc_oci_config.
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+cc_oci_restore_resume (struct cc_oci_config *config)
+{
+	if (! (config && config->vm && config->restore_image)) {
+		return false;
+	}
+
+	if (! cc_oci_wait_for_path (config->state.comms_path,
+				start_data.ready_timeout,
+				"hypervisor-socket-ready")) {
+		return false;
+	}
+
+	if (! cc_oci_vm_incoming_resume (config->state.comms_path,
+				config->vm->pid, start_data.ready_timeout)) {
+		g_critical ("failed to restore VM from %s",
+				config->restore_image);
+		return false;
+	}
+
+	return true;
+}
+
+/*!
+ * Create a container whose VM is restored from a checkpoint image
+ * rather than booted.
+ *
+ * Unlike "create", the container is left running.
+ *
+ * \param config \ref cc_oci_config.
+ * \param image_path Directory containing the image, or \c NULL for
+ *   the default.
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+cc_oci_restore (struct cc_oci_config *config, const gchar *image_path)
+{
+	g_autofree gchar  *dir = NULL;
+
+	if (! config) {
+		return false;
+	}
+
+	dir = cc_oci_checkpoint_dir (config->optarg_container_id,
+			image_path);
+	if (! dir) {
+		return false;
+	}
+
+	config->restore_image = cc_oci_checkpoint_image_find (dir);
+	if (! config->restore_image) {
+		g_critical ("no checkpoint image found in %s", dir);
+		return false;
+	}
+
+	g_debug ("restoring VM state from %s", config->restore_image);
+
+	if (! cc_oci_create (config)) {
+		return false;
+	}
+
+	if (config->dry_run_mode) {
+		return true;
+	}
+
+	/* If a hook returns a non-zero exit code, then an error is
+	 * logged and the remaining hooks are executed.
+	 */
+	cc_run_hooks (config->oci.hooks.poststart,
+			config->state.state_file_path, false);
+
+	return true;
+}
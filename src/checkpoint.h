@@ -0,0 +1,63 @@
+/*
+ * This file is part of cc-oci-runtime.
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _CC_OCI_CHECKPOINT_H
+#define _CC_OCI_CHECKPOINT_H
+
+#include <glib.h>
+
+#include "oci.h"
+
+/** Directory below which checkpoint images are saved by default
+ * (one sub-directory per container).
+ */
+#define CC_OCI_CHECKPOINT_DIR_PREFIX	LOCALSTATEDIR \
+					"/run/cc-oci-runtime-checkpoint"
+
+/** Name of the file holding the saved VM state. */
+#define CC_OCI_CHECKPOINT_IMAGE		"vm.state"
+
+/** Name of the file holding the compressed saved VM state. */
+#define CC_OCI_CHECKPOINT_IMAGE_GZ	"vm.state.gz"
+
+/** Options controlling a checkpoint. */
+struct cc_oci_checkpoint_options {
+	/** Directory to save the image to (\c NULL for the default). */
+	gchar *image_path;
+
+	/** If \c true, resume the VM once it has been saved. */
+	gboolean leave_running;
+
+	/** If \c true, compress the image. */
+	gboolean compress;
+};
+
+gchar *cc_oci_checkpoint_dir (const gchar *container_id,
+		const gchar *image_path);
+gchar *cc_oci_checkpoint_image_find (const gchar *dir);
+gchar *cc_oci_checkpoint_uri (const gchar *image, gboolean incoming);
+gboolean cc_oci_checkpoint (struct cc_oci_config *config,
+		struct oci_state *state,
+		const struct cc_oci_checkpoint_options *options);
+gboolean cc_oci_restore_resume (struct cc_oci_config *config);
+gboolean cc_oci_restore (struct cc_oci_config *config,
+		const gchar *image_path);
+
+#endif /* _CC_OCI_CHECKPOINT_H */
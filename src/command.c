@@ -34,6 +34,8 @@ struct subcommand *subcommands[] =
 {
 	&command_checkpoint,
 	&command_create,
+	&command_create_batch,
+	&command_daemon,
 	&command_delete,
 	&command_events,
 	&command_exec,
@@ -41,6 +43,7 @@ struct subcommand *subcommands[] =
 	&command_kill,
 	&command_list,
 	&command_pause,
+	&command_pool,
 	&command_ps,
 	&command_restore,
 	&command_resume,
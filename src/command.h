@@ -83,6 +83,8 @@ struct start_data {
 	gchar *shim_path;
 	/* Path to cc-proxy's socket */
 	gchar *proxy_socket_path;
+	/* Milliseconds to wait for the VM sockets to be created */
+	gint ready_timeout;
 	gboolean debug;
 };
 
@@ -107,6 +109,8 @@ gboolean handle_option_user (const gchar *option_name,
 
 extern struct subcommand command_checkpoint;
 extern struct subcommand command_create;
+extern struct subcommand command_create_batch;
+extern struct subcommand command_daemon;
 extern struct subcommand command_delete;
 extern struct subcommand command_events;
 extern struct subcommand command_exec;
@@ -114,6 +118,7 @@ extern struct subcommand command_help;
 extern struct subcommand command_kill;
 extern struct subcommand command_list;
 extern struct subcommand command_pause;
+extern struct subcommand command_pool;
 extern struct subcommand command_ps;
 extern struct subcommand command_restore;
 extern struct subcommand command_resume;
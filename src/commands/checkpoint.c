@@ -18,36 +18,102 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
  */
 
+#include <glib.h>
+
 #include "command.h"
-#include "state.h"
+#include "util.h"
+#include "oci.h"
+#include "checkpoint.h"
+
+static gchar *checkpoint_image_path = NULL;
+static gboolean checkpoint_leave_running = false;
+static gboolean checkpoint_compress = false;
+
+static GOptionEntry options_checkpoint[] =
+{
+	{
+		"image-path", 0, G_OPTION_FLAG_NONE,
+		G_OPTION_ARG_STRING, &checkpoint_image_path,
+		"directory to save the checkpoint image to "
+		"(default: " CC_OCI_CHECKPOINT_DIR_PREFIX "/<container-id>)",
+		NULL
+	},
+	{
+		"leave-running", 0, G_OPTION_FLAG_NONE,
+		G_OPTION_ARG_NONE, &checkpoint_leave_running,
+		"leave the container running after checkpointing it",
+		NULL
+	},
+	{
+		"compress", 0, G_OPTION_FLAG_NONE,
+		G_OPTION_ARG_NONE, &checkpoint_compress,
+		"compress the checkpoint image",
+		NULL
+	},
+	{ NULL }
+};
 
 static gboolean
 handler_checkpoint (const struct subcommand *sub,
 		struct cc_oci_config *config,
 		int argc, char *argv[])
 {
-	gboolean  ret = true;
+	struct cc_oci_checkpoint_options  options = { 0 };
+	struct oci_state                 *state = NULL;
+	gchar                            *config_file = NULL;
+	gboolean                          ret;
 
 	g_assert (sub);
 	g_assert (config);
 
 	if (handle_default_usage (argc, argv, sub->name,
 				&ret, 1, NULL)) {
-		return ret;
+		goto out;
 	}
 
-	if (! cc_oci_state_file_exists(config)) {
-		g_warning ("state file does not exist for container %s",
+	/* Used to allow us to find the state file */
+	config->optarg_container_id = argv[0];
+
+	ret = cc_oci_get_config_and_state (&config_file, config, &state);
+	if (! ret) {
+		goto out;
+	}
+
+	/* Transfer certain state elements to config to allow the state *
+	 * file to be rewritten with full details.
+	 */
+	ret = cc_oci_config_update (config, state);
+	if (! ret) {
+		goto out;
+	}
+
+	options.image_path = checkpoint_image_path;
+	options.leave_running = checkpoint_leave_running;
+	options.compress = checkpoint_compress;
+
+	ret = cc_oci_checkpoint (config, state, &options);
+	if (! ret) {
+		g_critical ("failed to checkpoint container %s",
 				config->optarg_container_id);
-		ret = false;
+		goto out;
 	}
 
+	g_print ("checkpointed container %s\n",
+			config->optarg_container_id);
+
+out:
+	g_free_if_set (checkpoint_image_path);
+	checkpoint_image_path = NULL;
+	g_free_if_set (config_file);
+	cc_oci_state_free (state);
+
 	return ret;
 }
 
 struct subcommand command_checkpoint =
 {
-	.name    = "checkpoint",
-	.handler = handler_checkpoint,
+	.name        = "checkpoint",
+	.options     = options_checkpoint,
+	.handler     = handler_checkpoint,
 	.description = "checkpoint a running container",
 };
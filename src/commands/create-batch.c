@@ -0,0 +1,103 @@
+/*
+ * This file is part of cc-oci-runtime.
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <glib.h>
+
+#include "command.h"
+#include "batch.h"
+
+extern struct start_data start_data;
+
+static gint batch_parallel = 0;
+
+static GOptionEntry options_create_batch[] =
+{
+	{
+		"parallel", 0, G_OPTION_FLAG_NONE,
+		G_OPTION_ARG_INT, &batch_parallel,
+		"maximum number of containers to create at the same time "
+		"(default: number of processors)",
+		NULL
+	},
+	{ NULL }
+};
+
+static gboolean
+handler_create_batch (const struct subcommand *sub,
+		struct cc_oci_config *config,
+		int argc, char *argv[])
+{
+	GPtrArray  *entries = NULL;
+	gchar      *str;
+	gboolean    ret;
+
+	g_assert (sub);
+	g_assert (config);
+
+	if (argc != 1 || ! g_strcmp0 (argv[0], "--help")
+			|| ! g_strcmp0 (argv[0], "-h")) {
+		ret = argc == 1;
+		g_print ("Usage: %s [<options>] <batch-file>\n", sub->name);
+		g_print ("\n");
+		g_print ("Each line of <batch-file> (or standard input if "
+				"\"%s\") specifies:\n", CC_OCI_BATCH_STDIN);
+		g_print ("\n");
+		g_print ("  <container-id> <bundle-path> [<pid-file>]\n");
+		return ret;
+	}
+
+	if (batch_parallel < 0) {
+		g_critical ("invalid parallel value: %d", batch_parallel);
+		return false;
+	}
+
+	if (! cc_oci_batch_read (argv[0], &entries)) {
+		return false;
+	}
+
+	config->dry_run_mode = start_data.dry_run_mode;
+	config->detached_mode = start_data.detach;
+
+	ret = cc_oci_batch_create (config, entries, (guint)batch_parallel);
+
+	/* Always report the outcome for each container so that the
+	 * caller can retry those that failed.
+	 */
+	str = cc_oci_batch_to_json (entries);
+	if (str) {
+		g_print ("%s\n", str);
+		g_free (str);
+	} else {
+		ret = false;
+	}
+
+	g_ptr_array_free (entries, true);
+
+	return ret;
+}
+
+struct subcommand command_create_batch =
+{
+	.name        = "create-batch",
+	.options     = options_create_batch,
+	.handler     = handler_create_batch,
+	.description = "create many containers, "
+		       "reporting the outcome for each in JSON format",
+};
@@ -0,0 +1,59 @@
+/*
+ * This file is part of cc-oci-runtime.
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <glib.h>
+
+#include "command.h"
+#include "daemon.h"
+#include "state.h"
+#include "proxy.h"
+
+static gboolean
+handler_daemon (const struct subcommand *sub,
+		struct cc_oci_config *config,
+		int argc, char *argv[])
+{
+	g_assert (sub);
+	g_assert (config);
+
+	if (argc) {
+		g_print ("Usage: %s\n", sub->name);
+		g_print ("\n");
+		g_print ("Serve commands on %s until interrupted.\n",
+				CC_OCI_DAEMON_SOCKET);
+		g_print ("Set %s to stop commands being sent to the daemon.\n",
+				CC_OCI_DAEMON_DISABLE_ENV);
+		return argc == 1 && (! g_strcmp0 (argv[0], "--help")
+				|| ! g_strcmp0 (argv[0], "-h"));
+	}
+
+	/* Only worthwhile in a long-running process */
+	cc_oci_state_cache_enable ();
+	cc_proxy_conn_cache_enable ();
+
+	return cc_oci_daemon_run (CC_OCI_DAEMON_SOCKET);
+}
+
+struct subcommand command_daemon =
+{
+	.name        = "daemon",
+	.handler     = handler_daemon,
+	.description = "serve commands from a resident process",
+};
@@ -0,0 +1,120 @@
+/*
+ * This file is part of cc-oci-runtime.
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <glib.h>
+
+#include "command.h"
+#include "util.h"
+#include "oci.h"
+#include "vmpool.h"
+
+extern struct start_data start_data;
+
+static gint pool_size = CC_OCI_VM_POOL_DEFAULT_SIZE;
+static gint pool_refill_rate = CC_OCI_VM_POOL_DEFAULT_REFILL_RATE;
+static gint pool_boot_wait = CC_OCI_VM_POOL_DEFAULT_BOOT_WAIT;
+static gboolean pool_status = false;
+
+static GOptionEntry options_pool[] =
+{
+	{
+		"bundle", 'b', G_OPTION_FLAG_NONE,
+		G_OPTION_ARG_STRING, &start_data.bundle,
+		"path to the bundle directory",
+		NULL
+	},
+	{
+		"size", 0, G_OPTION_FLAG_NONE,
+		G_OPTION_ARG_INT, &pool_size,
+		"number of paused VMs to keep ready",
+		NULL
+	},
+	{
+		"refill-rate", 0, G_OPTION_FLAG_NONE,
+		G_OPTION_ARG_INT, &pool_refill_rate,
+		"maximum number of VMs to boot per second",
+		NULL
+	},
+	{
+		"boot-wait", 0, G_OPTION_FLAG_NONE,
+		G_OPTION_ARG_INT, &pool_boot_wait,
+		"milliseconds to let a VM boot before pausing it",
+		NULL
+	},
+	{
+		"status", 0, G_OPTION_FLAG_NONE,
+		G_OPTION_ARG_NONE, &pool_status,
+		"display the state of all pools and exit",
+		NULL
+	},
+	{ NULL }
+};
+
+static gboolean
+handler_pool (const struct subcommand *sub,
+		struct cc_oci_config *config,
+		int argc, char *argv[])
+{
+	struct cc_oci_vm_pool_options  options = { 0 };
+	gboolean                       ret;
+
+	g_assert (sub);
+	g_assert (config);
+
+	if (pool_status) {
+		return cc_oci_vm_pool_status ();
+	}
+
+	if (start_data.bundle) {
+		config->bundle_path = cc_oci_resolve_path (start_data.bundle);
+		g_free (start_data.bundle);
+		start_data.bundle = NULL;
+	} else if (argc == 1 && g_strcmp0 (argv[0], "--help")
+			&& g_strcmp0 (argv[0], "-h")) {
+		config->bundle_path = cc_oci_resolve_path (argv[0]);
+	} else {
+		ret = argc == 1;
+		g_print ("Usage: %s [<options>] <bundle-path>\n", sub->name);
+		return ret;
+	}
+
+	if (! config->bundle_path) {
+		return false;
+	}
+
+	if (pool_size <= 0 || pool_refill_rate <= 0 || pool_boot_wait < 0) {
+		g_critical ("invalid pool options specified");
+		return false;
+	}
+
+	options.size = (guint)pool_size;
+	options.refill_rate = (guint)pool_refill_rate;
+	options.boot_wait = (guint)pool_boot_wait;
+
+	return cc_oci_pool (config, &options);
+}
+
+struct subcommand command_pool =
+{
+	.name        = "pool",
+	.options     = options_pool,
+	.handler     = handler_pool,
+	.description = "maintain a pool of pre-booted VMs",
+};
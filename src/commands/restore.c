@@ -18,36 +18,90 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
  */
 
+#include <glib.h>
+
 #include "command.h"
-#include "state.h"
+#include "util.h"
+#include "oci.h"
+#include "checkpoint.h"
+
+extern struct start_data start_data;
+
+static gchar *restore_image_path = NULL;
+
+/* ignore -pedantic to cast handle_option_console, a function pointer, to a
+ * void* */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+static GOptionEntry options_restore[] =
+{
+	{
+		"bundle", 'b', G_OPTION_FLAG_NONE,
+		G_OPTION_ARG_STRING, &start_data.bundle,
+		"path to the bundle directory",
+		NULL
+	},
+	{
+		"console", 0, G_OPTION_FLAG_OPTIONAL_ARG,
+		G_OPTION_ARG_CALLBACK, handle_option_console,
+		"set pty console that will be used in the container",
+		NULL
+	},
+	{
+		"image-path", 0, G_OPTION_FLAG_NONE,
+		G_OPTION_ARG_STRING, &restore_image_path,
+		"directory containing the checkpoint image "
+		"(default: " CC_OCI_CHECKPOINT_DIR_PREFIX "/<container-id>)",
+		NULL
+	},
+	{
+		"pid-file", 0, G_OPTION_FLAG_NONE,
+		G_OPTION_ARG_STRING, &start_data.pid_file,
+		"the file to write the process ID of the restored "
+		"container to",
+		NULL
+	},
+	{ NULL }
+};
+#pragma GCC diagnostic pop
 
 static gboolean
 handler_restore (const struct subcommand *sub,
 		struct cc_oci_config *config,
 		int argc, char *argv[])
 {
-	gboolean  ret = true;
+	gboolean  ret = false;
 
 	g_assert (sub);
 	g_assert (config);
 
-	if (handle_default_usage (argc, argv, sub->name,
-				&ret, 1, NULL)) {
-		return ret;
+	if (! handle_command_setup (sub, config, argc, argv)) {
+		goto out;
+	}
+
+	/* usage was displayed */
+	if (! config->optarg_container_id) {
+		ret = true;
+		goto out;
 	}
 
-	if (! cc_oci_state_file_exists(config)) {
-		g_warning ("state file does not exist for container %s",
+	ret = cc_oci_restore (config, restore_image_path);
+	if (! ret) {
+		g_critical ("failed to restore container %s",
 				config->optarg_container_id);
-		ret = false;
 	}
 
+out:
+	g_free_if_set (restore_image_path);
+	restore_image_path = NULL;
+
 	return ret;
 }
 
 struct subcommand command_restore =
 {
-	.name    = "restore",
-	.handler = handler_restore,
+	.name        = "restore",
+	.options     = options_restore,
+	.handler     = handler_restore,
 	.description = "restore a container from a previous checkpoint",
 };
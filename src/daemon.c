@@ -0,0 +1,836 @@
+/*
+ * This file is part of cc-oci-runtime.
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Resident runtime daemon.
+ *
+ * The "daemon" sub-command serves commands over
+ * \ref CC_OCI_DAEMON_SOCKET so that they are run by a process which
+ * has already paid the start-up costs (dynamic linking, parsing the
+ * runtime configuration) and which can keep state between commands.
+ * When the daemon is running, the runtime forwards the commands it
+ * supports to it and exits with the status the daemon replies with.
+ *
+ * A request is sent as a single message:
+ *
+ *     <length><cwd>\0<argv[0]>\0<argv[1]>\0...
+ *
+ * where \c length is the size of the remainder of the message (as a
+ * native-endian \c guint32). The clients standard output and standard
+ * error are passed alongside the request (\c SCM_RIGHTS) and the
+ * daemon replies with a \c gint32 status once the command has
+ * completed.
+ *
+ * Requests are handled one at a time, in the order they are accepted.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/un.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <glib-unix.h>
+
+#include "util.h"
+#include "daemon.h"
+#include "common.h"
+
+/** Mode of the directory containing \ref CC_OCI_DAEMON_SOCKET. */
+#define CC_OCI_DAEMON_DIR_MODE		0700
+
+/** Reply sent when the command succeeded. */
+#define CC_OCI_DAEMON_REPLY_SUCCESS	0
+
+/** Reply sent when the command failed. */
+#define CC_OCI_DAEMON_REPLY_FAILURE	1
+
+/** Reply sent when the daemon will not run the command (the client
+ * should run it itself).
+ */
+#define CC_OCI_DAEMON_REPLY_REJECTED	2
+
+/** Number of file descriptors passed with a request. */
+#define CC_OCI_DAEMON_FDS		2
+
+/** Commands the daemon may run.
+ *
+ * Commands which block (for example "start" and "events") or which
+ * need to be the parent of the processes they create ("create",
+ * "exec") must be run by the caller.
+ */
+static const gchar *cc_oci_daemon_commands[] =
+{
+	"kill",
+	"list",
+	"pause",
+	"resume",
+	"state",
+	NULL
+};
+
+/** Function used to run requests. */
+static cc_oci_daemon_handler cc_oci_daemon_request_handler;
+
+/*!
+ * Specify the function the daemon uses to run requests.
+ *
+ * \param handler \ref cc_oci_daemon_handler.
+ */
+void
+cc_oci_daemon_handler_set (cc_oci_daemon_handler handler)
+{
+	cc_oci_daemon_request_handler = handler;
+}
+
+/*!
+ * Determine if the daemon can run the specified sub-command.
+ *
+ * \param cmd Name of sub-command.
+ *
+ * \return \c true if \p cmd can be forwarded to the daemon,
+ * else \c false.
+ */
+gboolean
+cc_oci_daemon_command_supported (const gchar *cmd)
+{
+	if (! cmd) {
+		return false;
+	}
+
+	for (const gchar **c = cc_oci_daemon_commands; *c; c++) {
+		if (! g_strcmp0 (cmd, *c)) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/*!
+ * Find the name of the sub-command in an argument vector, skipping
+ * any global options (and their values).
+ *
+ * \param options Global options.
+ * \param argc Argument count.
+ * \param argv Argument vector (including the program name).
+ *
+ * \return Name of sub-command, or \c NULL if it cannot be determined.
+ */
+const gchar *
+cc_oci_daemon_command_name (const GOptionEntry *options,
+		int argc, char **argv)
+{
+	if (! (options && argv)) {
+		return NULL;
+	}
+
+	for (int i = 1; i < argc; i++) {
+		const gchar        *arg = argv[i];
+		const GOptionEntry *entry = NULL;
+
+		if (! arg) {
+			return NULL;
+		}
+
+		if (arg[0] != '-' || ! arg[1]) {
+			return arg;
+		}
+
+		if (! g_strcmp0 (arg, "--")) {
+			return i + 1 < argc ? argv[i+1] : NULL;
+		}
+
+		if (arg[1] == '-') {
+			if (strchr (arg, '=')) {
+				/* value specified inline */
+				continue;
+			}
+
+			for (const GOptionEntry *e = options; e->long_name; e++) {
+				if (! g_strcmp0 (arg + 2, e->long_name)) {
+					entry = e;
+					break;
+				}
+			}
+		} else {
+			if (arg[2]) {
+				/* grouped short options or inline value */
+				return NULL;
+			}
+
+			for (const GOptionEntry *e = options; e->long_name; e++) {
+				if (e->short_name == arg[1]) {
+					entry = e;
+					break;
+				}
+			}
+		}
+
+		if (! entry) {
+			/* Let the runtime report the error */
+			return NULL;
+		}
+
+		if (entry->arg != G_OPTION_ARG_NONE) {
+			/* skip the value */
+			i++;
+		}
+	}
+
+	return NULL;
+}
+
+/*!
+ * Read exactly \p len bytes.
+ *
+ * \param fd File descriptor to read from.
+ * \param buffer Buffer to read into.
+ * \param len Number of bytes to read.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+cc_oci_daemon_read_all (int fd, void *buffer, gsize len)
+{
+	gchar  *p = buffer;
+
+	while (len) {
+		ssize_t bytes = read (fd, p, len);
+
+		if (bytes < 0 && errno == EINTR) {
+			continue;
+		}
+
+		if (bytes <= 0) {
+			return false;
+		}
+
+		p += bytes;
+		len -= (gsize)bytes;
+	}
+
+	return true;
+}
+
+/*!
+ * Write exactly \p len bytes.
+ *
+ * \param fd File descriptor to write to.
+ * \param buffer Data to write.
+ * \param len Number of bytes to write.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+cc_oci_daemon_write_all (int fd, const void *buffer, gsize len)
+{
+	const gchar  *p = buffer;
+
+	while (len) {
+		ssize_t bytes = write (fd, p, len);
+
+		if (bytes < 0 && errno == EINTR) {
+			continue;
+		}
+
+		if (bytes <= 0) {
+			return false;
+		}
+
+		p += bytes;
+		len -= (gsize)bytes;
+	}
+
+	return true;
+}
+
+/*!
+ * Send a reply to a client.
+ *
+ * \param fd Connection to client.
+ * \param reply \c CC_OCI_DAEMON_REPLY_* value.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+cc_oci_daemon_reply (int fd, gint32 reply)
+{
+	return cc_oci_daemon_write_all (fd, &reply, sizeof (reply));
+}
+
+/*!
+ * Forward a command to the daemon.
+ *
+ * \param socket_path Path to \ref CC_OCI_DAEMON_SOCKET.
+ * \param argc Argument count.
+ * \param argv Argument vector.
+ * \param[out] result Outcome of the command.
+ *
+ * \return \c true if the command was run by the daemon (and \p result
+ * set), else \c false (in which case the caller should run the command
+ * itself).
+ */
+gboolean
+cc_oci_daemon_forward (const gchar *socket_path,
+		int argc, char **argv, gboolean *result)
+{
+	struct sockaddr_un  addr = { .sun_family = AF_UNIX };
+	g_autofree gchar   *cwd = NULL;
+	GString            *payload = NULL;
+	gboolean            ret = false;
+	int                 fd = -1;
+	int                 fds[CC_OCI_DAEMON_FDS] = { STDOUT_FILENO, STDERR_FILENO };
+	guint32             len;
+	gint32              reply;
+	ssize_t             bytes;
+	struct iovec        iov[2];
+	struct msghdr       msg = { 0 };
+	struct cmsghdr     *cmsg;
+	union {
+		char            buf[CMSG_SPACE (sizeof (fds))];
+		struct cmsghdr  align;
+	} control;
+
+	if (! (socket_path && argc > 0 && argv && result)) {
+		return false;
+	}
+
+	if (strlen (socket_path) >= sizeof (addr.sun_path)) {
+		return false;
+	}
+
+	cwd = g_get_current_dir ();
+
+	payload = g_string_new_len (cwd, (gssize)strlen (cwd) + 1);
+	for (int i = 0; i < argc; i++) {
+		g_string_append_len (payload, argv[i],
+				(gssize)strlen (argv[i]) + 1);
+	}
+
+	if (payload->len > CC_OCI_DAEMON_MAX_REQUEST) {
+		goto out;
+	}
+
+	fd = socket (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0) {
+		goto out;
+	}
+
+	g_strlcpy (addr.sun_path, socket_path, sizeof (addr.sun_path));
+
+	if (connect (fd, (struct sockaddr *)&addr, sizeof (addr)) < 0) {
+		/* daemon not running */
+		goto out;
+	}
+
+	len = (guint32)payload->len;
+
+	iov[0].iov_base = &len;
+	iov[0].iov_len = sizeof (len);
+	iov[1].iov_base = payload->str;
+	iov[1].iov_len = payload->len;
+
+	msg.msg_iov = iov;
+	msg.msg_iovlen = 2;
+	msg.msg_control = control.buf;
+	msg.msg_controllen = sizeof (control.buf);
+
+	cmsg = CMSG_FIRSTHDR (&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN (sizeof (fds));
+	memcpy (CMSG_DATA (cmsg), fds, sizeof (fds));
+
+	do {
+		bytes = sendmsg (fd, &msg, MSG_NOSIGNAL);
+	} while (bytes < 0 && errno == EINTR);
+
+	if (bytes < (ssize_t)sizeof (len)) {
+		goto out;
+	}
+
+	/* Send whatever the socket did not accept in one go */
+	if ((gsize)bytes < sizeof (len) + payload->len) {
+		gsize sent = (gsize)bytes - sizeof (len);
+
+		if (! cc_oci_daemon_write_all (fd, payload->str + sent,
+					payload->len - sent)) {
+			goto out;
+		}
+	}
+
+	if (! cc_oci_daemon_read_all (fd, &reply, sizeof (reply))) {
+		/* The command may already have been run, so must not
+		 * be run again.
+		 */
+		g_critical ("no reply from runtime daemon (%s)",
+				socket_path);
+		*result = false;
+		ret = true;
+		goto out;
+	}
+
+	if (reply == CC_OCI_DAEMON_REPLY_REJECTED) {
+		goto out;
+	}
+
+	*result = reply == CC_OCI_DAEMON_REPLY_SUCCESS;
+	ret = true;
+
+out:
+	close_if_set (fd);
+	g_string_free (payload, true);
+
+	return ret;
+}
+
+/*!
+ * Read a request from a client.
+ *
+ * \param fd Connection to client.
+ * \param[out] fds Standard output and standard error of the client.
+ * \param[out] len Size of request.
+ *
+ * \return Newly-allocated request on success, else \c NULL.
+ */
+static gchar *
+cc_oci_daemon_request_read (int fd, int *fds, gsize *len)
+{
+	gchar           *payload = NULL;
+	guint32          size = 0;
+	ssize_t          bytes;
+	struct iovec     iov = { .iov_base = &size, .iov_len = sizeof (size) };
+	struct msghdr    msg = { 0 };
+	struct cmsghdr  *cmsg;
+	union {
+		char            buf[CMSG_SPACE (sizeof (int) * CC_OCI_DAEMON_FDS)];
+		struct cmsghdr  align;
+	} control;
+
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buf;
+	msg.msg_controllen = sizeof (control.buf);
+
+	do {
+		bytes = recvmsg (fd, &msg, MSG_CMSG_CLOEXEC);
+	} while (bytes < 0 && errno == EINTR);
+
+	if (! bytes) {
+		/* for example, a check for a running daemon */
+		g_debug ("client disconnected without sending a request");
+		return NULL;
+	}
+
+	if (bytes < 0) {
+		g_critical ("failed to receive request: %s",
+				strerror (errno));
+		return NULL;
+	}
+
+	for (cmsg = CMSG_FIRSTHDR (&msg); cmsg;
+			cmsg = CMSG_NXTHDR (&msg, cmsg)) {
+		if (cmsg->cmsg_level != SOL_SOCKET
+				|| cmsg->cmsg_type != SCM_RIGHTS) {
+			continue;
+		}
+
+		if (cmsg->cmsg_len == CMSG_LEN (sizeof (int) * CC_OCI_DAEMON_FDS)) {
+			memcpy (fds, CMSG_DATA (cmsg),
+					sizeof (int) * CC_OCI_DAEMON_FDS);
+		} else {
+			/* Close whatever was passed */
+			gsize count = (cmsg->cmsg_len - CMSG_LEN (0)) / sizeof (int);
+			int   passed[CC_OCI_DAEMON_FDS];
+
+			memcpy (passed, CMSG_DATA (cmsg),
+					MIN (count, CC_OCI_DAEMON_FDS) * sizeof (int));
+			for (gsize i = 0; i < MIN (count, CC_OCI_DAEMON_FDS); i++) {
+				close (passed[i]);
+			}
+		}
+	}
+
+	if (fds[0] < 0 || fds[1] < 0) {
+		g_critical ("request did not include standard streams");
+		return NULL;
+	}
+
+	if (! cc_oci_daemon_read_all (fd, (gchar *)&size + bytes,
+				sizeof (size) - (gsize)bytes)) {
+		g_critical ("failed to read request size");
+		return NULL;
+	}
+
+	if (! size || size > CC_OCI_DAEMON_MAX_REQUEST) {
+		g_critical ("invalid request size: %u", size);
+		return NULL;
+	}
+
+	payload = g_malloc (size);
+
+	if (! cc_oci_daemon_read_all (fd, payload, size)) {
+		g_critical ("failed to read request");
+		g_free (payload);
+		return NULL;
+	}
+
+	if (payload[size-1]) {
+		g_critical ("request is not terminated");
+		g_free (payload);
+		return NULL;
+	}
+
+	*len = size;
+
+	return payload;
+}
+
+/*!
+ * Run a request with the standard streams of the client and from the
+ * clients working directory.
+ *
+ * \param cwd Working directory of the client.
+ * \param argc Argument count.
+ * \param argv Argument vector.
+ * \param fds Standard output and standard error of the client.
+ *
+ * \return \c true if the command succeeded, else \c false.
+ */
+static gboolean
+cc_oci_daemon_request_run (const gchar *cwd, int argc, char **argv,
+		const int *fds)
+{
+	gboolean  ret = false;
+	int       saved_cwd;
+	int       saved_out;
+	int       saved_err;
+
+	saved_cwd = open (".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	saved_out = fcntl (STDOUT_FILENO, F_DUPFD_CLOEXEC, 3);
+	saved_err = fcntl (STDERR_FILENO, F_DUPFD_CLOEXEC, 3);
+
+	if (saved_cwd < 0 || saved_out < 0 || saved_err < 0) {
+		g_critical ("failed to save daemon state: %s",
+				strerror (errno));
+		goto out;
+	}
+
+	if (chdir (cwd) < 0) {
+		g_critical ("failed to change directory to %s: %s",
+				cwd, strerror (errno));
+		goto out;
+	}
+
+	fflush (stdout);
+	fflush (stderr);
+
+	if (dup2 (fds[0], STDOUT_FILENO) < 0
+			|| dup2 (fds[1], STDERR_FILENO) < 0) {
+		g_critical ("failed to redirect output: %s",
+				strerror (errno));
+	} else {
+		ret = cc_oci_daemon_request_handler (argc, argv);
+	}
+
+	fflush (stdout);
+	fflush (stderr);
+
+	(void)dup2 (saved_out, STDOUT_FILENO);
+	(void)dup2 (saved_err, STDERR_FILENO);
+
+	if (fchdir (saved_cwd) < 0) {
+		g_critical ("failed to restore directory: %s",
+				strerror (errno));
+	}
+
+out:
+	close_if_set (saved_cwd);
+	close_if_set (saved_out);
+	close_if_set (saved_err);
+
+	return ret;
+}
+
+/*!
+ * Handle a single client connection.
+ *
+ * \param fd Connection to client.
+ */
+static void
+cc_oci_daemon_serve (int fd)
+{
+	struct ucred      cred;
+	socklen_t         cred_len = sizeof (cred);
+	struct timeval    timeout = { .tv_sec = CC_OCI_DAEMON_TIMEOUT };
+	g_autofree gchar *payload = NULL;
+	g_autofree char **argv = NULL;
+	gsize             len = 0;
+	int               fds[CC_OCI_DAEMON_FDS] = { -1, -1 };
+	int               argc = 0;
+	gchar            *p;
+	gboolean          ret;
+
+	if (getsockopt (fd, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) < 0) {
+		g_critical ("failed to determine client credentials: %s",
+				strerror (errno));
+		return;
+	}
+
+	if (cred.uid != geteuid ()) {
+		g_debug ("rejecting request from uid %u", (unsigned)cred.uid);
+		(void)cc_oci_daemon_reply (fd, CC_OCI_DAEMON_REPLY_REJECTED);
+		return;
+	}
+
+	/* Don't let a client which never sends a complete request
+	 * stall all others.
+	 */
+	(void)setsockopt (fd, SOL_SOCKET, SO_RCVTIMEO,
+			&timeout, sizeof (timeout));
+	(void)setsockopt (fd, SOL_SOCKET, SO_SNDTIMEO,
+			&timeout, sizeof (timeout));
+
+	payload = cc_oci_daemon_request_read (fd, fds, &len);
+	if (! payload) {
+		goto out;
+	}
+
+	for (p = payload; p < payload + len; p += strlen (p) + 1) {
+		argc++;
+	}
+
+	/* working directory followed by at least the program name */
+	if (argc < 2) {
+		g_critical ("invalid request");
+		goto out;
+	}
+
+	argv = g_new0 (char *, (gsize)argc);
+
+	/* skip the working directory */
+	p = payload + strlen (payload) + 1;
+	argc--;
+
+	for (int i = 0; i < argc; i++) {
+		argv[i] = p;
+		p += strlen (p) + 1;
+	}
+
+	g_debug ("handling request from pid %d: %s", (int)cred.pid,
+			argc > 1 ? argv[1] : argv[0]);
+
+	ret = cc_oci_daemon_request_run (payload, argc, argv, fds);
+
+	if (! cc_oci_daemon_reply (fd, ret
+				? CC_OCI_DAEMON_REPLY_SUCCESS
+				: CC_OCI_DAEMON_REPLY_FAILURE)) {
+		g_debug ("failed to reply to pid %d", (int)cred.pid);
+	}
+
+out:
+	for (int i = 0; i < CC_OCI_DAEMON_FDS; i++) {
+		close_if_set (fds[i]);
+	}
+}
+
+/*!
+ * Accept and handle a client connection.
+ *
+ * \param fd Listening socket.
+ * \param condition Unused.
+ * \param user_data Unused.
+ *
+ * \return \c G_SOURCE_CONTINUE.
+ */
+static gboolean
+cc_oci_daemon_accept (gint fd, GIOCondition condition,
+		gpointer user_data)
+{
+	int conn;
+
+	(void)condition;
+	(void)user_data;
+
+	conn = accept4 (fd, NULL, NULL, SOCK_CLOEXEC);
+	if (conn < 0) {
+		if (errno != EINTR && errno != EAGAIN) {
+			g_critical ("failed to accept connection: %s",
+					strerror (errno));
+		}
+		return G_SOURCE_CONTINUE;
+	}
+
+	cc_oci_daemon_serve (conn);
+
+	close (conn);
+
+	return G_SOURCE_CONTINUE;
+}
+
+/*!
+ * Signal handler used to stop the daemon.
+ *
+ * \param loop \c GMainLoop.
+ *
+ * \return \c G_SOURCE_CONTINUE.
+ */
+static gboolean
+cc_oci_daemon_quit (GMainLoop *loop)
+{
+	g_main_loop_quit (loop);
+
+	return G_SOURCE_CONTINUE;
+}
+
+/*!
+ * Create the socket the daemon listens on.
+ *
+ * \param socket_path Path to create the socket at.
+ *
+ * \return listening socket on success, else \c -1.
+ */
+static int
+cc_oci_daemon_listen (const gchar *socket_path)
+{
+	struct sockaddr_un  addr = { .sun_family = AF_UNIX };
+	g_autofree gchar   *dir = NULL;
+	mode_t              mask;
+	int                 fd = -1;
+	int                 ret;
+
+	if (strlen (socket_path) >= sizeof (addr.sun_path)) {
+		g_critical ("socket path too long: %s", socket_path);
+		return -1;
+	}
+
+	g_strlcpy (addr.sun_path, socket_path, sizeof (addr.sun_path));
+
+	dir = g_path_get_dirname (socket_path);
+
+	if (g_mkdir_with_parents (dir, CC_OCI_DAEMON_DIR_MODE) < 0) {
+		g_critical ("failed to create %s: %s", dir, strerror (errno));
+		return -1;
+	}
+
+	fd = socket (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0) {
+		g_critical ("failed to create socket: %s", strerror (errno));
+		return -1;
+	}
+
+	if (connect (fd, (struct sockaddr *)&addr, sizeof (addr)) == 0) {
+		g_critical ("daemon already running on %s", socket_path);
+		goto err;
+	}
+
+	/* Remove the socket of a daemon that is no longer running */
+	if (g_unlink (socket_path) < 0 && errno != ENOENT) {
+		g_critical ("failed to remove %s: %s",
+				socket_path, strerror (errno));
+		goto err;
+	}
+
+	/* Only the owner may connect */
+	mask = umask (0177);
+	ret = bind (fd, (struct sockaddr *)&addr, sizeof (addr));
+	(void)umask (mask);
+
+	if (ret < 0) {
+		g_critical ("failed to bind to %s: %s",
+				socket_path, strerror (errno));
+		goto err;
+	}
+
+	if (listen (fd, SOMAXCONN) < 0) {
+		g_critical ("failed to listen on %s: %s",
+				socket_path, strerror (errno));
+		(void)g_unlink (socket_path);
+		goto err;
+	}
+
+	return fd;
+
+err:
+	close (fd);
+	return -1;
+}
+
+/*!
+ * Serve requests on \p socket_path until interrupted.
+ *
+ * \param socket_path Path to create the socket at.
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+cc_oci_daemon_run (const gchar *socket_path)
+{
+	GMainLoop  *loop;
+	guint       sources[3];
+	int         fd;
+
+	if (! (socket_path && cc_oci_daemon_request_handler)) {
+		return false;
+	}
+
+	fd = cc_oci_daemon_listen (socket_path);
+	if (fd < 0) {
+		return false;
+	}
+
+	loop = g_main_loop_new (NULL, false);
+
+	sources[0] = g_unix_signal_add (SIGINT,
+			(GSourceFunc)cc_oci_daemon_quit, loop);
+	sources[1] = g_unix_signal_add (SIGTERM,
+			(GSourceFunc)cc_oci_daemon_quit, loop);
+	sources[2] = g_unix_fd_add (fd, G_IO_IN,
+			cc_oci_daemon_accept, NULL);
+
+	g_debug ("serving requests on %s", socket_path);
+
+	g_main_loop_run (loop);
+
+	g_debug ("daemon stopping");
+
+	for (gsize i = 0; i < CC_OCI_ARRAY_SIZE (sources); i++) {
+		g_source_remove (sources[i]);
+	}
+
+	(void)g_unlink (socket_path);
+	close (fd);
+	g_main_loop_unref (loop);
+
+	return true;
+}
@@ -0,0 +1,59 @@
+/*
+ * This file is part of cc-oci-runtime.
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _CC_OCI_DAEMON_H
+#define _CC_OCI_DAEMON_H
+
+#include <glib.h>
+
+/** Socket the runtime daemon accepts requests on. */
+#define CC_OCI_DAEMON_SOCKET		LOCALSTATEDIR \
+					"/run/cc-oci-runtime-daemon/daemon.sock"
+
+/** If set in the environment, commands are never forwarded to the
+ * daemon.
+ */
+#define CC_OCI_DAEMON_DISABLE_ENV	"CC_OCI_NO_DAEMON"
+
+/** Maximum size (in bytes) of a request. */
+#define CC_OCI_DAEMON_MAX_REQUEST	65536
+
+/** Seconds a client has to send its request. */
+#define CC_OCI_DAEMON_TIMEOUT		5
+
+/*!
+ * Function the daemon calls to run a command.
+ *
+ * \param argc Argument count.
+ * \param argv Argument vector (as passed to the client).
+ *
+ * \return \c true on success, else \c false.
+ */
+typedef gboolean (*cc_oci_daemon_handler) (int argc, char **argv);
+
+void cc_oci_daemon_handler_set (cc_oci_daemon_handler handler);
+gboolean cc_oci_daemon_command_supported (const gchar *cmd);
+const gchar *cc_oci_daemon_command_name (const GOptionEntry *options,
+		int argc, char **argv);
+gboolean cc_oci_daemon_forward (const gchar *socket_path,
+		int argc, char **argv, gboolean *result);
+gboolean cc_oci_daemon_run (const gchar *socket_path);
+
+#endif /* _CC_OCI_DAEMON_H */
@@ -0,0 +1,802 @@
+/*
+ * This file is part of cc-oci-runtime.
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Compiled \ref CC_OCI_HYPERVISOR_CMDLINE_FILE templates.
+ *
+ * The template is parsed once into literal segments and tag slots (see
+ * \ref cc_oci_vm_args_template) and cached below
+ * \ref CC_OCI_VM_ARGS_CACHE_DIR, keyed by the template path and
+ * validated against its modification time, size and inode. Launching
+ * a VM then only requires filling in the slots.
+ *
+ * A compiled template is a \ref cc_oci_vm_args_header followed by the
+ * value of \c PATH used to resolve the command and then, for each
+ * line, the number of tags (\c guint32), the tags (one byte each) and
+ * the \c NUL-terminated literals. The cache file is simply a copy of
+ * this buffer, so loading it only requires a single validation pass.
+ */
+
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "oci.h"
+#include "util.h"
+#include "common.h"
+#include "hypervisor-args.h"
+
+/** Identifies a compiled template ("CCVA"). */
+#define CC_OCI_VM_ARGS_TEMPLATE_MAGIC	0x41564343
+
+/** Version of the compiled template format. */
+#define CC_OCI_VM_ARGS_TEMPLATE_VERSION	1
+
+/** Suffix of cached template files. */
+#define CC_OCI_VM_ARGS_CACHE_SUFFIX	".args"
+
+/** Templates modified less than this many seconds ago are not cached
+ * since a further modification within the granularity of the file
+ * timestamps would not be detected.
+ */
+#define CC_OCI_VM_ARGS_CACHE_MIN_AGE	2
+
+/** Header of a compiled template. */
+struct cc_oci_vm_args_header {
+	/** \ref CC_OCI_VM_ARGS_TEMPLATE_MAGIC. */
+	guint32 magic;
+
+	/** \ref CC_OCI_VM_ARGS_TEMPLATE_VERSION. */
+	guint32 version;
+
+	/** Template modification time in nanoseconds (\c 0 if not
+	 * compiled from a file).
+	 */
+	guint64 mtime;
+
+	/** Template size (\c 0 if not compiled from a file). */
+	guint64 size;
+
+	/** Template inode (\c 0 if not compiled from a file). */
+	guint64 ino;
+
+	/** Number of lines. */
+	guint32 lines;
+
+	/** Total number of literals. */
+	guint32 literals;
+};
+
+/* Value passed in from automake.
+ *
+ * XXX: Assigned to a variable to allow the tests
+ * to modify the value.
+ */
+private gchar *vm_args_cache_dir = CC_OCI_VM_ARGS_CACHE_DIR;
+
+/** Compiled templates (as \c GBytes) already obtained by this
+ * process, keyed by template path.
+ */
+static GHashTable *cc_oci_vm_args_loaded;
+
+/** Names of the \ref cc_oci_vm_args_tag values. */
+static const gchar *cc_oci_vm_args_tag_names[CC_OCI_VM_ARGS_TAG_COUNT] = {
+	"@KERNEL@",
+	"@KERNEL_PARAMS@",
+	"@KERNEL_NET_PARAMS@",
+	"@IMAGE@",
+	"@SIZE@",
+	"@COMMS_SOCKET@",
+	"@PROCESS_SOCKET@",
+	"@CONSOLE_DEVICE@",
+	"@NAME@",
+	"@UUID@",
+	"@AGENT_CTL_SOCKET@",
+	"@AGENT_TTY_SOCKET@",
+};
+
+/*!
+ * Determine the name of a tag.
+ *
+ * \param tag \ref cc_oci_vm_args_tag.
+ *
+ * \return Tag name (including the surrounding '@') on success,
+ * else \c NULL.
+ */
+const gchar *
+cc_oci_vm_args_tag_name (enum cc_oci_vm_args_tag tag)
+{
+	if (tag >= CC_OCI_VM_ARGS_TAG_COUNT) {
+		return NULL;
+	}
+
+	return cc_oci_vm_args_tag_names[tag];
+}
+
+/*!
+ * Convert a file modification time to nanoseconds.
+ *
+ * \param st File details.
+ *
+ * \return Modification time.
+ */
+static guint64
+cc_oci_vm_args_mtime (const struct stat *st)
+{
+	return (guint64)st->st_mtim.tv_sec * G_GUINT64_CONSTANT (1000000000)
+		+ (guint64)st->st_mtim.tv_nsec;
+}
+
+/*!
+ * Remove a trailing comment from \p line.
+ *
+ * A line starting with '#' is a comment, as is anything following a
+ * whitespace-prefixed '#'.
+ *
+ * \param line Line to modify.
+ */
+static void
+cc_oci_vm_args_strip_comment (gchar *line)
+{
+	gchar *ptr;
+
+	if (*line == '#') {
+		*line = '\0';
+		return;
+	}
+
+	for (ptr = strchr (line, '#'); ptr; ptr = strchr (ptr+1, '#')) {
+		if (g_ascii_isspace (*(ptr-1))) {
+			*ptr = '\0';
+			return;
+		}
+	}
+}
+
+/*!
+ * Determine if \p line contains any special tags.
+ *
+ * \param line Line to check.
+ *
+ * \return \c true if a tag is found, else \c false.
+ */
+static gboolean
+cc_oci_vm_args_has_tag (const gchar *line)
+{
+	for (guint tag = 0; tag < CC_OCI_VM_ARGS_TAG_COUNT; tag++) {
+		if (strstr (line, cc_oci_vm_args_tag_names[tag])) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/*!
+ * Split \p line into literals and tags and append them to \p buf.
+ *
+ * \param line Line to tokenise.
+ * \param buf Compiled template.
+ *
+ * \return Number of literals added.
+ */
+static guint32
+cc_oci_vm_args_tokenise (const gchar *line, GString *buf)
+{
+	const gchar  *start = line;
+	const gchar  *p = line;
+	GString      *tags;
+	GString      *literals;
+	guint32       count;
+
+	tags = g_string_new ("");
+	literals = g_string_sized_new (strlen (line) + 1);
+
+	while ((p = strchr (p, '@')) != NULL) {
+		guchar tag;
+		gsize  len = 0;
+
+		for (tag = 0; tag < CC_OCI_VM_ARGS_TAG_COUNT; tag++) {
+			len = strlen (cc_oci_vm_args_tag_names[tag]);
+			if (! strncmp (p, cc_oci_vm_args_tag_names[tag], len)) {
+				break;
+			}
+		}
+
+		if (tag == CC_OCI_VM_ARGS_TAG_COUNT) {
+			p++;
+			continue;
+		}
+
+		/* literal up to the tag, including a terminator */
+		g_string_append_len (literals, start, p - start);
+		g_string_append_c (literals, '\0');
+
+		g_string_append_c (tags, (gchar)tag);
+
+		p += len;
+		start = p;
+	}
+
+	g_string_append_len (literals, start, (gssize)strlen (start) + 1);
+
+	count = (guint32)tags->len;
+
+	g_string_append_len (buf, (const gchar *)&count, sizeof (count));
+	g_string_append_len (buf, tags->str, (gssize)tags->len);
+	g_string_append_len (buf, literals->str, (gssize)literals->len);
+
+	g_string_free (tags, true);
+	g_string_free (literals, true);
+
+	return count + 1;
+}
+
+/*!
+ * Compile a template.
+ *
+ * \param lines Template lines.
+ * \param st Template file details (or \c NULL).
+ * \param[out] len Size of the compiled template.
+ *
+ * \return Newly-allocated compiled template.
+ */
+static gchar *
+cc_oci_vm_args_template_build (gchar **lines, const struct stat *st,
+		gsize *len)
+{
+	struct cc_oci_vm_args_header   header = { 0 };
+	GString                       *buf;
+	const gchar                   *path_env = "";
+	GString                       *body;
+
+	header.magic = CC_OCI_VM_ARGS_TEMPLATE_MAGIC;
+	header.version = CC_OCI_VM_ARGS_TEMPLATE_VERSION;
+
+	if (st) {
+		header.mtime = cc_oci_vm_args_mtime (st);
+		header.size = (guint64)st->st_size;
+		header.ino = (guint64)st->st_ino;
+	}
+
+	body = g_string_sized_new (LINE_MAX);
+
+	for (guint i = 0; lines && lines[i]; i++) {
+		g_autofree gchar *line = g_strdup (lines[i]);
+
+		cc_oci_vm_args_strip_comment (line);
+
+		/* command must be the first entry */
+		if (! i && *line && ! g_path_is_absolute (line)
+				&& ! cc_oci_vm_args_has_tag (line)) {
+			gchar *cmd = g_find_program_in_path (line);
+
+			if (cmd) {
+				g_free (line);
+				line = cmd;
+				path_env = g_getenv ("PATH");
+				if (! path_env) {
+					path_env = "";
+				}
+			}
+		}
+
+		header.literals += cc_oci_vm_args_tokenise (line, body);
+		header.lines++;
+	}
+
+	buf = g_string_sized_new (sizeof (header) + body->len + PATH_MAX);
+
+	g_string_append_len (buf, (const gchar *)&header, sizeof (header));
+	g_string_append_len (buf, path_env, (gssize)strlen (path_env) + 1);
+	g_string_append_len (buf, body->str, (gssize)body->len);
+
+	g_string_free (body, true);
+
+	*len = buf->len;
+
+	return g_string_free (buf, false);
+}
+
+/*!
+ * Create a template from a compiled template, validating it.
+ *
+ * \param data Compiled template (which the returned template
+ *   takes ownership of).
+ * \param len Size of \p data.
+ *
+ * \return Newly-allocated \ref cc_oci_vm_args_template on success,
+ * else \c NULL.
+ */
+static struct cc_oci_vm_args_template *
+cc_oci_vm_args_template_load (gchar *data, gsize len)
+{
+	struct cc_oci_vm_args_template  *template;
+	struct cc_oci_vm_args_header     header;
+	const gchar                     *p;
+	const gchar                     *q;
+	const gchar                     *end = data + len;
+	guint32                          literal = 0;
+
+	if (len < sizeof (header)) {
+		g_free (data);
+		return NULL;
+	}
+
+	memcpy (&header, data, sizeof (header));
+
+	if (header.magic != CC_OCI_VM_ARGS_TEMPLATE_MAGIC
+			|| header.version != CC_OCI_VM_ARGS_TEMPLATE_VERSION
+			/* each line requires at least 5 bytes */
+			|| header.lines > len / 5
+			|| header.literals > len) {
+		g_free (data);
+		return NULL;
+	}
+
+	template = g_new0 (struct cc_oci_vm_args_template, 1);
+	template->data = data;
+	template->len = len;
+	template->lines_len = header.lines;
+	template->lines = g_new0 (struct cc_oci_vm_args_line, header.lines);
+	template->literals = g_new0 (const gchar *, header.literals);
+
+	/* skip the PATH value */
+	p = data + sizeof (header);
+	q = memchr (p, '\0', (gsize)(end - p));
+	if (! q) {
+		goto err;
+	}
+	p = q + 1;
+
+	for (guint32 i = 0; i < header.lines; i++) {
+		struct cc_oci_vm_args_line  *line = &template->lines[i];
+		guint32                      tags_len;
+
+		if ((gsize)(end - p) < sizeof (tags_len)) {
+			goto err;
+		}
+
+		memcpy (&tags_len, p, sizeof (tags_len));
+		p += sizeof (tags_len);
+
+		if ((gsize)(end - p) < tags_len
+				|| tags_len >= header.literals - literal) {
+			goto err;
+		}
+
+		line->tags_len = tags_len;
+		line->tags = (const guchar *)p;
+		line->literals = &template->literals[literal];
+
+		for (guint32 j = 0; j < tags_len; j++) {
+			if (line->tags[j] >= CC_OCI_VM_ARGS_TAG_COUNT) {
+				goto err;
+			}
+		}
+
+		p += tags_len;
+
+		for (guint32 j = 0; j <= tags_len; j++) {
+			q = memchr (p, '\0', (gsize)(end - p));
+			if (! q) {
+				goto err;
+			}
+
+			template->literals[literal++] = p;
+			p = q + 1;
+		}
+	}
+
+	if (literal != header.literals || p != end) {
+		goto err;
+	}
+
+	return template;
+
+err:
+	g_critical ("invalid hypervisor arguments template");
+	cc_oci_vm_args_template_free (template);
+	return NULL;
+}
+
+/*!
+ * Compile a template from the specified lines.
+ *
+ * \param lines \c NULL-terminated array of template lines.
+ *
+ * \return Newly-allocated \ref cc_oci_vm_args_template on success,
+ * else \c NULL.
+ */
+struct cc_oci_vm_args_template *
+cc_oci_vm_args_template_compile (gchar **lines)
+{
+	gchar *data;
+	gsize  len;
+
+	if (! lines) {
+		return NULL;
+	}
+
+	data = cc_oci_vm_args_template_build (lines, NULL, &len);
+
+	return cc_oci_vm_args_template_load (data, len);
+}
+
+/*!
+ * Determine the path of the cache file for \p path.
+ *
+ * \param path Full path to the template file.
+ *
+ * \return Newly-allocated string.
+ */
+static gchar *
+cc_oci_vm_args_cache_path (const gchar *path)
+{
+	g_autofree gchar *hash = NULL;
+	g_autofree gchar *name = NULL;
+
+	hash = g_compute_checksum_for_string (G_CHECKSUM_SHA256, path, -1);
+	name = g_strconcat (hash, CC_OCI_VM_ARGS_CACHE_SUFFIX, NULL);
+
+	return g_build_path ("/", vm_args_cache_dir, name, NULL);
+}
+
+/*!
+ * Determine if a compiled template is still valid for the template
+ * file described by \p st.
+ *
+ * \param template \ref cc_oci_vm_args_template.
+ * \param st Template file details.
+ *
+ * \return \c true if \p template is current, else \c false.
+ */
+static gboolean
+cc_oci_vm_args_template_current (const struct cc_oci_vm_args_template *template,
+		const struct stat *st)
+{
+	struct cc_oci_vm_args_header  header;
+	const gchar                  *path_env;
+
+	memcpy (&header, template->data, sizeof (header));
+
+	if (header.mtime != cc_oci_vm_args_mtime (st)
+			|| header.size != (guint64)st->st_size
+			|| header.ino != (guint64)st->st_ino) {
+		return false;
+	}
+
+	/* the command was resolved using a different PATH */
+	path_env = template->data + sizeof (header);
+	if (*path_env && g_strcmp0 (path_env, g_getenv ("PATH"))) {
+		return false;
+	}
+
+	return true;
+}
+
+/*!
+ * Load a cached template, checking it is still valid for the
+ * template file described by \p st.
+ *
+ * \param cache_path Full path to the cache file.
+ * \param st Template file details.
+ *
+ * \return Newly-allocated \ref cc_oci_vm_args_template on success,
+ * else \c NULL.
+ */
+static struct cc_oci_vm_args_template *
+cc_oci_vm_args_cache_read (const gchar *cache_path, const struct stat *st)
+{
+	struct cc_oci_vm_args_template  *template;
+	gchar                           *contents = NULL;
+	gsize                            len = 0;
+
+	if (! g_file_get_contents (cache_path, &contents, &len, NULL)) {
+		return NULL;
+	}
+
+	template = cc_oci_vm_args_template_load (contents, len);
+	if (! template) {
+		return NULL;
+	}
+
+	if (! cc_oci_vm_args_template_current (template, st)) {
+		g_debug ("cached template %s is stale", cache_path);
+		cc_oci_vm_args_template_free (template);
+		return NULL;
+	}
+
+	return template;
+}
+
+/*!
+ * Obtain a template compiled earlier by this process.
+ *
+ * \param path Full path to the template file.
+ * \param st Template file details.
+ *
+ * \return Newly-allocated \ref cc_oci_vm_args_template on success,
+ * else \c NULL.
+ */
+static struct cc_oci_vm_args_template *
+cc_oci_vm_args_loaded_get (const gchar *path, const struct stat *st)
+{
+	struct cc_oci_vm_args_template  *template;
+	GBytes                          *bytes;
+	gconstpointer                    data;
+	gsize                            len = 0;
+
+	if (! cc_oci_vm_args_loaded) {
+		return NULL;
+	}
+
+	bytes = g_hash_table_lookup (cc_oci_vm_args_loaded, path);
+	if (! bytes) {
+		return NULL;
+	}
+
+	data = g_bytes_get_data (bytes, &len);
+
+	template = cc_oci_vm_args_template_load (g_memdup (data, (guint)len),
+			len);
+	if (! template) {
+		return NULL;
+	}
+
+	if (! cc_oci_vm_args_template_current (template, st)) {
+		(void)g_hash_table_remove (cc_oci_vm_args_loaded, path);
+		cc_oci_vm_args_template_free (template);
+		return NULL;
+	}
+
+	return template;
+}
+
+/*!
+ * Remember a compiled template for the lifetime of the process.
+ *
+ * \param path Full path to the template file.
+ * \param template \ref cc_oci_vm_args_template.
+ */
+static void
+cc_oci_vm_args_loaded_add (const gchar *path,
+		const struct cc_oci_vm_args_template *template)
+{
+	if (! cc_oci_vm_args_loaded) {
+		cc_oci_vm_args_loaded = g_hash_table_new_full (g_str_hash,
+				g_str_equal, g_free,
+				(GDestroyNotify)g_bytes_unref);
+	}
+
+	g_hash_table_replace (cc_oci_vm_args_loaded, g_strdup (path),
+			g_bytes_new (template->data, template->len));
+}
+
+/*!
+ * Save a compiled template to the cache.
+ *
+ * Failure is not fatal (the template will just be recompiled
+ * next time).
+ *
+ * \param cache_path Full path to the cache file.
+ * \param st Template file details.
+ * \param template \ref cc_oci_vm_args_template.
+ */
+static void
+cc_oci_vm_args_cache_write (const gchar *cache_path,
+		const struct stat *st,
+		const struct cc_oci_vm_args_template *template)
+{
+	GError *err = NULL;
+
+	if (time (NULL) - st->st_mtim.tv_sec < CC_OCI_VM_ARGS_CACHE_MIN_AGE) {
+		g_debug ("not caching recently modified template");
+		return;
+	}
+
+	if (g_mkdir_with_parents (vm_args_cache_dir, CC_OCI_DIR_MODE) < 0) {
+		g_debug ("failed to create %s: %s", vm_args_cache_dir,
+				strerror (errno));
+		return;
+	}
+
+	/* written atomically so concurrent launches never see a
+	 * partial file.
+	 */
+	if (! g_file_set_contents (cache_path, template->data,
+				(gssize)template->len, &err)) {
+		g_debug ("failed to cache template: %s", err->message);
+		g_error_free (err);
+	}
+}
+
+/*!
+ * Obtain the compiled template for the specified file, from memory
+ * (see cc_oci_vm_args_template_preload()) or the cache if possible.
+ *
+ * \param path Full path to \ref CC_OCI_HYPERVISOR_CMDLINE_FILE.
+ *
+ * \return Newly-allocated \ref cc_oci_vm_args_template on success,
+ * else \c NULL.
+ */
+struct cc_oci_vm_args_template *
+cc_oci_vm_args_template_get (const gchar *path)
+{
+	struct cc_oci_vm_args_template  *template = NULL;
+	struct stat                      st;
+	g_autofree gchar                *cache_path = NULL;
+	gchar                          **lines = NULL;
+	gchar                           *data;
+	gsize                            len;
+
+	if (! path) {
+		return NULL;
+	}
+
+	if (stat (path, &st) < 0) {
+		g_critical ("failed to stat %s: %s", path, strerror (errno));
+		return NULL;
+	}
+
+	template = cc_oci_vm_args_loaded_get (path, &st);
+	if (template) {
+		return template;
+	}
+
+	cache_path = cc_oci_vm_args_cache_path (path);
+
+	template = cc_oci_vm_args_cache_read (cache_path, &st);
+	if (template) {
+		return template;
+	}
+
+	if (! cc_oci_file_to_strv (path, &lines)) {
+		return NULL;
+	}
+
+	data = cc_oci_vm_args_template_build (lines, &st, &len);
+	g_strfreev (lines);
+
+	template = cc_oci_vm_args_template_load (data, len);
+	if (template) {
+		cc_oci_vm_args_cache_write (cache_path, &st, template);
+	}
+
+	return template;
+}
+
+/*!
+ * Compile the specified template file and keep it in memory so that
+ * later calls to cc_oci_vm_args_template_get() (including those made
+ * by child processes) do not need to read the cache file.
+ *
+ * The template is still checked for modifications on each use.
+ *
+ * \param path Full path to \ref CC_OCI_HYPERVISOR_CMDLINE_FILE.
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+cc_oci_vm_args_template_preload (const gchar *path)
+{
+	struct cc_oci_vm_args_template  *template;
+	struct stat                      st;
+
+	if (! path) {
+		return false;
+	}
+
+	template = cc_oci_vm_args_template_get (path);
+	if (! template) {
+		return false;
+	}
+
+	/* as for the cache file, a further modification might not
+	 * be detected.
+	 */
+	if (stat (path, &st) == 0
+			&& time (NULL) - st.st_mtim.tv_sec
+			>= CC_OCI_VM_ARGS_CACHE_MIN_AGE) {
+		cc_oci_vm_args_loaded_add (path, template);
+	}
+
+	cc_oci_vm_args_template_free (template);
+
+	return true;
+}
+
+/*!
+ * Expand a template.
+ *
+ * \param template \ref cc_oci_vm_args_template.
+ * \param values Array of \ref CC_OCI_VM_ARGS_TAG_COUNT values,
+ *   indexed by \ref cc_oci_vm_args_tag. A \c NULL value leaves the
+ *   tag unexpanded.
+ *
+ * \return Newly-allocated \c NULL-terminated array (with one entry per
+ * template line, empty for comments) on success, else \c NULL.
+ */
+gchar **
+cc_oci_vm_args_template_expand (const struct cc_oci_vm_args_template *template,
+		const gchar * const *values)
+{
+	gchar    **args;
+	GString   *str;
+
+	if (! (template && values)) {
+		return NULL;
+	}
+
+	args = g_new0 (gchar *, template->lines_len + 1);
+	str = g_string_sized_new (LINE_MAX);
+
+	for (guint i = 0; i < template->lines_len; i++) {
+		const struct cc_oci_vm_args_line *line = &template->lines[i];
+
+		g_string_truncate (str, 0);
+
+		for (guint j = 0; j < line->tags_len; j++) {
+			const gchar *value = values[line->tags[j]];
+
+			if (! value) {
+				value = cc_oci_vm_args_tag_names[line->tags[j]];
+			}
+
+			g_string_append (str, line->literals[j]);
+			g_string_append (str, value);
+		}
+
+		g_string_append (str, line->literals[line->tags_len]);
+
+		args[i] = g_strndup (str->str, str->len);
+	}
+
+	g_string_free (str, true);
+
+	return args;
+}
+
+/*!
+ * Free the specified template.
+ *
+ * \param template \ref cc_oci_vm_args_template.
+ */
+void
+cc_oci_vm_args_template_free (struct cc_oci_vm_args_template *template)
+{
+	if (! template) {
+		return;
+	}
+
+	g_free (template->data);
+	g_free (template->lines);
+	g_free (template->literals);
+	g_free (template);
+}
@@ -0,0 +1,102 @@
+/*
+ * This file is part of cc-oci-runtime.
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _CC_OCI_HYPERVISOR_ARGS_H
+#define _CC_OCI_HYPERVISOR_ARGS_H
+
+#include <glib.h>
+
+/** Directory below which compiled hypervisor argument templates are
+ * cached (outside of \ref CC_OCI_RUNTIME_DIR_PREFIX, where every
+ * directory is a container).
+ */
+#define CC_OCI_VM_ARGS_CACHE_DIR	LOCALSTATEDIR \
+					"/run/cc-oci-runtime-cache"
+
+/** Special tags that may appear in \ref CC_OCI_HYPERVISOR_CMDLINE_FILE. */
+enum cc_oci_vm_args_tag {
+	CC_OCI_VM_ARGS_TAG_KERNEL = 0,
+	CC_OCI_VM_ARGS_TAG_KERNEL_PARAMS,
+	CC_OCI_VM_ARGS_TAG_KERNEL_NET_PARAMS,
+	CC_OCI_VM_ARGS_TAG_IMAGE,
+	CC_OCI_VM_ARGS_TAG_SIZE,
+	CC_OCI_VM_ARGS_TAG_COMMS_SOCKET,
+	CC_OCI_VM_ARGS_TAG_PROCESS_SOCKET,
+	CC_OCI_VM_ARGS_TAG_CONSOLE_DEVICE,
+	CC_OCI_VM_ARGS_TAG_NAME,
+	CC_OCI_VM_ARGS_TAG_UUID,
+	CC_OCI_VM_ARGS_TAG_AGENT_CTL_SOCKET,
+	CC_OCI_VM_ARGS_TAG_AGENT_TTY_SOCKET,
+
+	CC_OCI_VM_ARGS_TAG_COUNT
+};
+
+/** A line of a \ref cc_oci_vm_args_template.
+ *
+ * The line is stored as \c n tags and \c n+1 literals such that the
+ * expanded line is
+ * \c literal[0] \c value[tag[0]] \c literal[1] ... \c literal[n].
+ */
+struct cc_oci_vm_args_line {
+	/** Number of tags. */
+	guint          tags_len;
+
+	/** \ref cc_oci_vm_args_tag values. */
+	const guchar  *tags;
+
+	/** Literal segments. */
+	const gchar  **literals;
+};
+
+/** Hypervisor arguments template, pre-tokenised into literal
+ * segments and tag slots.
+ *
+ * Comments are removed and a relative command (first line) is
+ * resolved when the template is compiled.
+ */
+struct cc_oci_vm_args_template {
+	/** Serialised template (which \ref lines points into). */
+	gchar                       *data;
+
+	/** Size of \ref data in bytes. */
+	gsize                        len;
+
+	/** Number of lines. */
+	guint                        lines_len;
+
+	/** Template lines. */
+	struct cc_oci_vm_args_line  *lines;
+
+	/** Storage for all \ref cc_oci_vm_args_line literals. */
+	const gchar                **literals;
+};
+
+const gchar *cc_oci_vm_args_tag_name (enum cc_oci_vm_args_tag tag);
+struct cc_oci_vm_args_template *
+cc_oci_vm_args_template_compile (gchar **lines);
+struct cc_oci_vm_args_template *
+cc_oci_vm_args_template_get (const gchar *path);
+gchar **cc_oci_vm_args_template_expand (
+		const struct cc_oci_vm_args_template *template,
+		const gchar * const *values);
+gboolean cc_oci_vm_args_template_preload (const gchar *path);
+void cc_oci_vm_args_template_free (struct cc_oci_vm_args_template *template);
+
+#endif /* _CC_OCI_HYPERVISOR_ARGS_H */
@@ -32,6 +32,9 @@
 #include "oci.h"
 #include "util.h"
 #include "hypervisor.h"
+#include "hypervisor-args.h"
+#include "checkpoint.h"
+#include "vmtemplate.h"
 #include "common.h"
 
 /** Length of an ASCII-formatted UUID */
@@ -179,56 +182,73 @@ cc_oci_append_storage_args(struct cc_oci_config *config,
 	return true;
 }
 
+/** Values of the special tags for a particular VM. */
+struct cc_oci_vm_args_values {
+	/** Values indexed by \ref cc_oci_vm_args_tag (\c NULL values
+	 * leave the tag unexpanded).
+	 */
+	const gchar *values[CC_OCI_VM_ARGS_TAG_COUNT];
+
+	/* Storage for the values that are generated. */
+	gchar        uuid[UUID_MAX];
+	gchar       *size;
+	gchar       *console_device;
+	gchar       *procsock_device;
+	gchar       *kernel_net_params;
+};
+
 /*!
- * Replace any special tokens found in \p args with their expanded
- * values.
+ * Free the values generated by cc_oci_vm_args_values_get().
  *
- * \param config \ref cc_oci_config.
- * \param[in, out] args Command-line to expand.
+ * \param v \ref cc_oci_vm_args_values.
+ */
+static void
+cc_oci_vm_args_values_clear (struct cc_oci_vm_args_values *v)
+{
+	g_free_if_set (v->size);
+	g_free_if_set (v->console_device);
+	g_free_if_set (v->procsock_device);
+	g_free_if_set (v->kernel_net_params);
+}
+
+/*!
+ * Determine the values of the special tags for \p config.
  *
- * \warning this is not very efficient.
+ * \note The proxy socket paths are also set.
+ *
+ * \param config \ref cc_oci_config.
+ * \param[out] v \ref cc_oci_vm_args_values (to be cleared with
+ *   cc_oci_vm_args_values_clear()).
  *
  * \return \c true on success, else \c false.
  */
-gboolean
-cc_oci_expand_cmdline (struct cc_oci_config *config,
-		gchar **args)
+static gboolean
+cc_oci_vm_args_values_get (struct cc_oci_config *config,
+		struct cc_oci_vm_args_values *v)
 {
 	struct stat       st;
-	gchar           **arg;
-	gchar            *bytes = NULL;
-	gchar            *console_device = NULL;
 	gchar		 *hypervisor_console = NULL;
-	g_autofree gchar *procsock_device = NULL;
-
-	gboolean          ret = false;
-	gint              count;
 	uuid_t            uuid;
 	/* uuid pattern */
 	const char        uuid_pattern[UUID_MAX] = "00000000-0000-0000-0000-000000000000";
-	char              uuid_str[UUID_MAX] = { 0 };
 	gint              uuid_index = 0;
-
-	gchar            *kernel_net_params = NULL;
 	struct cc_proxy  *proxy;
 
-	if (! (config && args)) {
-		return false;
-	}
+	memset (v, 0, sizeof (*v));
 
 	if (! config->vm) {
 		g_critical ("No vm configuration");
-		goto out;
+		return false;
 	}
 
 	if (! config->bundle_path) {
 		g_critical ("No bundle path");
-		goto out;
+		return false;
 	}
 
 	if (! config->proxy) {
 		g_critical ("No proxy");
-		goto out;
+		return false;
 	}
 
 	/* We're about to launch the hypervisor so validate paths.*/
@@ -251,27 +271,27 @@ cc_oci_expand_cmdline (struct cc_oci_config *config,
 	uuid_generate_random(uuid);
 	for(size_t i=0; i<sizeof(uuid_t) && uuid_index < sizeof(uuid_pattern); ++i) {
 		/* hex to char */
-		uuid_index += g_snprintf(uuid_str+uuid_index,
+		uuid_index += g_snprintf(v->uuid+uuid_index,
 		                  sizeof(uuid_pattern)-(gulong)uuid_index,
 		                  "%02x", uuid[i]);
 
 		/* copy separator '-' */
 		if (uuid_pattern[uuid_index] == '-') {
-			uuid_index += g_snprintf(uuid_str+uuid_index,
+			uuid_index += g_snprintf(v->uuid+uuid_index,
 			                  sizeof(uuid_pattern)-(gulong)uuid_index, "-");
 		}
 	}
 
-	bytes = g_strdup_printf ("%lu", (unsigned long int)st.st_size);
+	v->size = g_strdup_printf ("%lu", (unsigned long int)st.st_size);
 
 	hypervisor_console = g_build_path ("/", config->state.runtime_path,
 			CC_OCI_CONSOLE_SOCKET, NULL);
 
-	console_device = g_strdup_printf (
+	v->console_device = g_strdup_printf (
 			"socket,path=%s,server,nowait,id=charconsole0,signal=off",
 			hypervisor_console);
 
-	procsock_device = g_strdup_printf ("socket,id=procsock,path=%s,server,nowait", config->state.procsock_path);
+	v->procsock_device = g_strdup_printf ("socket,id=procsock,path=%s,server,nowait", config->state.procsock_path);
 
 	proxy = config->proxy;
 
@@ -287,70 +307,77 @@ cc_oci_expand_cmdline (struct cc_oci_config *config,
 
 	g_debug("guest agent tty socket: %s", proxy->agent_tty_socket);
 
-	kernel_net_params = cc_oci_expand_net_cmdline(config);
-
-	struct special_tag {
-		const gchar* name;
-		const gchar* value;
-	} special_tags[] = {
-		{ "@KERNEL@"            , config->vm->kernel_path    },
-		{ "@KERNEL_PARAMS@"     , config->vm->kernel_params  },
-		{ "@KERNEL_NET_PARAMS@" , kernel_net_params          },
-		{ "@IMAGE@"             , config->vm->image_path     },
-		{ "@SIZE@"              , bytes                      },
-		{ "@COMMS_SOCKET@"      , config->state.comms_path   },
-		{ "@PROCESS_SOCKET@"    , procsock_device            },
-		{ "@CONSOLE_DEVICE@"    , console_device             },
-		{ "@NAME@"              , g_strrstr(uuid_str, "-")+1 },
-		{ "@UUID@"              , uuid_str                   },
-		{ "@AGENT_CTL_SOCKET@"  , proxy->agent_ctl_socket    },
-		{ "@AGENT_TTY_SOCKET@"  , proxy->agent_tty_socket    },
-		{ NULL }
-	};
-
-	for (arg = args, count = 0; arg && *arg; arg++, count++) {
-		if (! count) {
-			/* command must be the first entry */
-			if (! g_path_is_absolute (*arg)) {
-				gchar *cmd = g_find_program_in_path (*arg);
-
-				if (cmd) {
-					g_free (*arg);
-					*arg = cmd;
-				}
-			}
-		}
+	v->kernel_net_params = cc_oci_expand_net_cmdline(config);
+
+	v->values[CC_OCI_VM_ARGS_TAG_KERNEL] = config->vm->kernel_path;
+	v->values[CC_OCI_VM_ARGS_TAG_KERNEL_PARAMS] = config->vm->kernel_params;
+	v->values[CC_OCI_VM_ARGS_TAG_KERNEL_NET_PARAMS] = v->kernel_net_params;
+	v->values[CC_OCI_VM_ARGS_TAG_IMAGE] = config->vm->image_path;
+	v->values[CC_OCI_VM_ARGS_TAG_SIZE] = v->size;
+	v->values[CC_OCI_VM_ARGS_TAG_COMMS_SOCKET] = config->state.comms_path;
+	v->values[CC_OCI_VM_ARGS_TAG_PROCESS_SOCKET] = v->procsock_device;
+	v->values[CC_OCI_VM_ARGS_TAG_CONSOLE_DEVICE] = v->console_device;
+	v->values[CC_OCI_VM_ARGS_TAG_NAME] = g_strrstr(v->uuid, "-")+1;
+	v->values[CC_OCI_VM_ARGS_TAG_UUID] = v->uuid;
+	v->values[CC_OCI_VM_ARGS_TAG_AGENT_CTL_SOCKET] = proxy->agent_ctl_socket;
+	v->values[CC_OCI_VM_ARGS_TAG_AGENT_TTY_SOCKET] = proxy->agent_tty_socket;
 
-		/* when first character is '#' line is a comment and must be ignored */
-		if (**arg == '#') {
-			g_strlcpy(*arg, "\0", LINE_MAX);
-			continue;
-		}
+	return true;
+}
 
-		/* looking for '#' */
-		gchar* ptr = g_strstr_len(*arg, LINE_MAX, "#");
-		while (ptr) {
-			/* if '[:space:]#' then replace '#' with '\0' (EOL) */
-			if (g_ascii_isspace(*(ptr-1))) {
-				g_strlcpy(ptr, "\0", LINE_MAX);
-				break;
-			}
-			ptr = g_strstr_len(ptr+1, LINE_MAX, "#");
-		}
+/*!
+ * Replace any special tokens found in \p args with their expanded
+ * values.
+ *
+ * \note To avoid re-parsing the template for every VM, use
+ * cc_oci_vm_args_template_get() and cc_oci_vm_args_template_expand().
+ *
+ * \param config \ref cc_oci_config.
+ * \param[in, out] args Command-line to expand.
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+cc_oci_expand_cmdline (struct cc_oci_config *config,
+		gchar **args)
+{
+	struct cc_oci_vm_args_values     v = { { 0 } };
+	struct cc_oci_vm_args_template  *template = NULL;
+	gchar                          **expanded = NULL;
+	gboolean                         ret = false;
 
-		for (struct special_tag* tag=special_tags; tag && tag->name; tag++) {
-			if (! cc_oci_replace_string(arg, tag->name, tag->value)) {
-				goto out;
-			}
-		}
+	if (! (config && args)) {
+		return false;
+	}
+
+	if (! cc_oci_vm_args_values_get (config, &v)) {
+		goto out;
 	}
 
+	template = cc_oci_vm_args_template_compile (args);
+	if (! template) {
+		goto out;
+	}
+
+	expanded = cc_oci_vm_args_template_expand (template, v.values);
+	if (! expanded) {
+		goto out;
+	}
+
+	/* The template has exactly one line per arg */
+	for (guint i = 0; args[i]; i++) {
+		g_free (args[i]);
+		args[i] = expanded[i];
+	}
+
+	/* only free pointer to gchar* */
+	g_free (expanded);
+
 	ret = true;
 
 out:
-	g_free_if_set (bytes);
-	g_free_if_set (console_device);
-	g_free_if_set (kernel_net_params);
+	cc_oci_vm_args_template_free (template);
+	cc_oci_vm_args_values_clear (&v);
 
 	return ret;
 }
@@ -417,6 +444,32 @@ out:
 	return args_file;
 }
 
+/*!
+ * Compile the \ref CC_OCI_HYPERVISOR_CMDLINE_FILE file that will be
+ * used for \p config and keep it in memory for the lifetime of the
+ * process.
+ *
+ * \param config \ref cc_oci_config.
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+cc_oci_vm_args_preload (const struct cc_oci_config *config)
+{
+	g_autofree gchar *args_file = NULL;
+
+	if (! config) {
+		return false;
+	}
+
+	args_file = cc_oci_vm_args_file_path (config);
+	if (! args_file) {
+		return false;
+	}
+
+	return cc_oci_vm_args_template_preload (args_file);
+}
+
 /*!
  * Generate the unexpanded list of hypervisor arguments to use.
  *
@@ -433,6 +486,8 @@ cc_oci_vm_args_get (struct cc_oci_config *config,
 {
 	gboolean  ret;
 	gchar    *args_file = NULL;
+	struct cc_oci_vm_args_template *template = NULL;
+	struct cc_oci_vm_args_values v = { { 0 } };
 	guint     line_count = 0;
 	gchar   **arg;
 	gchar   **new_args;
@@ -446,18 +501,26 @@ cc_oci_vm_args_get (struct cc_oci_config *config,
 	if (! args_file) {
 		g_critical("File %s not found",
 				CC_OCI_HYPERVISOR_CMDLINE_FILE);
+		return false;
 	}
 
-	ret = cc_oci_file_to_strv (args_file, args);
-	if (! ret) {
+	template = cc_oci_vm_args_template_get (args_file);
+	if (! template) {
+		ret = false;
 		goto out;
 	}
 
-	ret = cc_oci_expand_cmdline (config, *args);
+	ret = cc_oci_vm_args_values_get (config, &v);
 	if (! ret) {
 		goto out;
 	}
 
+	*args = cc_oci_vm_args_template_expand (template, v.values);
+	if (! *args) {
+		ret = false;
+		goto out;
+	}
+
 	/* count non-empty lines */
 	for (arg = *args; arg && *arg; arg++) {
 		if (**arg != '\0') {
@@ -499,12 +562,110 @@ cc_oci_vm_args_get (struct cc_oci_config *config,
 	/* copy new args */
 	*args = new_args;
 
+	/* Back the guest memory by the files of the VM template */
+	if (config->vm_template && ! cc_oci_vm_template_args (config, args)) {
+		g_strfreev (*args);
+		*args = NULL;
+		ret = false;
+		goto out;
+	}
+
 	ret = true;
 out:
+	cc_oci_vm_args_template_free (template);
+	cc_oci_vm_args_values_clear (&v);
 	g_free_if_set (args_file);
 	return ret;
 }
 
+/*!
+ * Calculate a hash identifying the guest that would be booted for
+ * \p config.
+ *
+ * Only the values that determine what the guest boots with (the
+ * hypervisor arguments template, kernel, kernel parameters and image)
+ * are expanded. Instance-specific tags (sockets, name, UUID, ...) are
+ * left untouched so that all containers using the same VM
+ * configuration produce the same hash.
+ *
+ * \param config \ref cc_oci_config.
+ *
+ * \return Newly-allocated string on success, else \c NULL.
+ */
+gchar *
+cc_oci_vm_args_template_hash (const struct cc_oci_config *config)
+{
+	struct stat                      st;
+	gchar                           *args_file = NULL;
+	struct cc_oci_vm_args_template  *template = NULL;
+	gchar                          **args = NULL;
+	gchar                          **arg;
+	gchar                           *bytes = NULL;
+	GString                         *str = NULL;
+	gchar                           *hash = NULL;
+	const gchar                     *values[CC_OCI_VM_ARGS_TAG_COUNT] = { NULL };
+
+	if (! (config && config->vm)) {
+		return NULL;
+	}
+
+	args_file = cc_oci_vm_args_file_path (config);
+	if (! args_file) {
+		goto out;
+	}
+
+	template = cc_oci_vm_args_template_get (args_file);
+	if (! template) {
+		goto out;
+	}
+
+	if (stat (config->vm->image_path, &st) < 0) {
+		g_critical ("image file: %s does not exist",
+			    config->vm->image_path);
+		goto out;
+	}
+
+	bytes = g_strdup_printf ("%lu", (unsigned long int)st.st_size);
+
+	/* all other tags are left unexpanded */
+	values[CC_OCI_VM_ARGS_TAG_KERNEL] = config->vm->kernel_path;
+	values[CC_OCI_VM_ARGS_TAG_KERNEL_PARAMS] = config->vm->kernel_params;
+	values[CC_OCI_VM_ARGS_TAG_IMAGE] = config->vm->image_path;
+	values[CC_OCI_VM_ARGS_TAG_SIZE] = bytes;
+
+	args = cc_oci_vm_args_template_expand (template, values);
+	if (! args) {
+		goto out;
+	}
+
+	str = g_string_new ("");
+
+	for (arg = args; arg && *arg; arg++) {
+		g_strstrip (*arg);
+		if (**arg == '\0') {
+			continue;
+		}
+
+		g_string_append_printf (str, "%s\n", *arg);
+	}
+
+	hash = g_compute_checksum_for_string (G_CHECKSUM_SHA256,
+			str->str, (gssize)str->len);
+
+out:
+	cc_oci_vm_args_template_free (template);
+	g_free_if_set (args_file);
+	g_free_if_set (bytes);
+	if (args) {
+		g_strfreev (args);
+	}
+	if (str) {
+		g_string_free (str, true);
+	}
+
+	return hash;
+}
+
 /*!
  * Populate array that will be appended to hypervisor command line.
  *
@@ -522,8 +683,33 @@ cc_oci_populate_extra_args(struct cc_oci_config *config ,
 	/* Add args to be appended here.*/
 	//g_ptr_array_add(additional_args, g_strdup("-device testdevice"));
 
-	cc_oci_append_network_args(config, additional_args);
+	/* The network devices of a VM cloned from a template are
+	 * hot-attached once its state has been loaded.
+	 */
+	if (! (config->vm_template && ! config->vm_template_save)) {
+		cc_oci_append_network_args(config, additional_args);
+	}
+
 	cc_oci_append_storage_args(config, additional_args);
 
+	/* Load the guest from a checkpoint rather than booting it, and
+	 * leave it paused until the host side has been set up.
+	 */
+	if (config->restore_image) {
+		g_ptr_array_add(additional_args, g_strdup("-S"));
+		g_ptr_array_add(additional_args, g_strdup("-incoming"));
+		g_ptr_array_add(additional_args,
+				cc_oci_checkpoint_uri(config->restore_image, true));
+	}
+
+	/* A VM cloned from a template is given the template state
+	 * once the hypervisor is listening (see cc_oci_vm_template_load()).
+	 */
+	if (config->vm_template && ! config->vm_template_save) {
+		g_ptr_array_add(additional_args, g_strdup("-S"));
+		g_ptr_array_add(additional_args, g_strdup("-incoming"));
+		g_ptr_array_add(additional_args, g_strdup("defer"));
+	}
+
 	return;
 }
@@ -28,6 +28,8 @@ gboolean cc_oci_vm_args_get (struct cc_oci_config *config,
 		gchar ***args, GPtrArray *hypervisor_extra_args);
 gboolean cc_oci_expand_cmdline (struct cc_oci_config *config,
 		gchar **args);
+gboolean cc_oci_vm_args_preload (const struct cc_oci_config *config);
+gchar *cc_oci_vm_args_template_hash (const struct cc_oci_config *config);
 void cc_oci_populate_extra_args(struct cc_oci_config *config,
                 GPtrArray *additional_args);
 
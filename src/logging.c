@@ -62,6 +62,12 @@
 
 static gchar* hypervisor_log_dir;
 
+/** Most recent error or critical message logged. */
+static gchar *last_error;
+
+/** Identifier of the installed log handler (or \c 0). */
+static guint log_handler_id;
+
 /*!
  * Last-ditch logging routine which sends an error
  * message to syslog.
@@ -339,6 +345,11 @@ cc_oci_log_handler (const gchar *log_domain,
 
 	g_assert (options);
 
+	if (log_level == G_LOG_LEVEL_ERROR || log_level == G_LOG_LEVEL_CRITICAL) {
+		g_free_if_set (last_error);
+		last_error = g_strdup (message);
+	}
+
 	if (! (options->filename || options->global_logfile)) {
 		/* No log files, so nothing to do */
 		return;
@@ -480,7 +491,12 @@ cc_oci_log_init (const struct cc_log_options *options)
 
 	hypervisor_log_dir = options->hypervisor_log_dir;
 
-	(void)g_log_set_handler (G_LOG_DOMAIN,
+	/* Logging is re-initialised for each command the daemon runs */
+	if (log_handler_id) {
+		g_log_remove_handler (G_LOG_DOMAIN, log_handler_id);
+	}
+
+	log_handler_id = g_log_set_handler (G_LOG_DOMAIN,
 			(GLogLevelFlags)CC_OCI_LOG_FLAGS,
 			cc_oci_log_handler,
 			(gpointer)options);
@@ -488,45 +504,57 @@ cc_oci_log_init (const struct cc_log_options *options)
 	return true;
 }
 
+/*!
+ * Obtain the most recent error or critical message logged.
+ *
+ * \return The message (which must not be freed), or \c NULL if no
+ * error has been logged.
+ */
+const gchar *
+cc_oci_log_last_error (void)
+{
+	return last_error;
+}
+
 /**
  *
- * Setup hypervisor logs
+ * Open hypervisor logs
  *
- * redirect hypervisor's stdout and stderr to $containerId-hypervisor.stdout and
- * $containerId-hypervisor.stderr respectively. Directory where log files will
- * be created can be specified with --hypervisor-log-dir option, if not path is
- * provided hypervisor output won't be logged therefore will be ignored
+ * Open $containerId-hypervisor.stdout and $containerId-hypervisor.stderr
+ * so that the hypervisor's stdout and stderr can be redirected to them.
+ * Directory where log files will be created can be specified with
+ * --hypervisor-log-dir option, if not path is provided hypervisor output
+ * won't be logged therefore will be ignored (and \p stdout_fd and
+ * \p stderr_fd are set to \c -1).
  *
  * \param config \ref cc_oci_config.
+ * \param[out] stdout_fd Close-on-exec fd for the hypervisor's stdout.
+ * \param[out] stderr_fd Close-on-exec fd for the hypervisor's stderr.
  *
  * \return \c true on success, else \c false.
  */
 gboolean
-cc_oci_setup_hypervisor_logs (struct cc_oci_config *config)
+cc_oci_hypervisor_logs_open (struct cc_oci_config *config,
+		int *stdout_fd, int *stderr_fd)
 {
-	gboolean ret = false;
 	const struct qemu_log_file {
 		const gchar *path;
-		const int std_fd;
+		int *fd;
 	} qemu_log_files[] = {
-		{ HYPERVISOR_STDOUT_FILE, STDOUT_FILENO },
-		{ HYPERVISOR_STDERR_FILE, STDERR_FILENO },
+		{ HYPERVISOR_STDOUT_FILE, stdout_fd },
+		{ HYPERVISOR_STDERR_FILE, stderr_fd },
 		{ NULL }
 	};
 
-	/* ensure that we have a directory for hypervisor logs */
-	if (! hypervisor_log_dir) {
-		return true;
-	}
-
-	if (! (config && config->vm)) {
+	if (! (config && stdout_fd && stderr_fd)) {
 		return false;
 	}
 
+	*stdout_fd = *stderr_fd = -1;
 
-	/* ensure that current pid is the hypervisor */
-	if (config->vm->pid != getpid ()) {
-		return false;
+	/* ensure that we have a directory for hypervisor logs */
+	if (! hypervisor_log_dir) {
+		return true;
 	}
 
 	if (g_mkdir_with_parents(hypervisor_log_dir, CC_OCI_DIR_MODE)) {
@@ -544,28 +572,25 @@ cc_oci_setup_hypervisor_logs (struct cc_oci_config *config)
 		/* creating log file
 		 * i.e: $hypervisor_log_dir/$containerId-hypervidor.stdout
 		 */
-		int std_file_fd = g_creat(std_file_path, CC_OCI_LOGFILE_MODE);
+		*i->fd = open (std_file_path,
+				O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC,
+				CC_OCI_LOGFILE_MODE);
 
-		if (std_file_fd < 0) {
+		if (*i->fd < 0) {
 			g_critical("failed to create file: %s", std_file_path);
-			return false;
+			goto err;
 		}
+	}
 
-		/* redirecting stdout/stderr to a file */
-		if (dup2(std_file_fd, i->std_fd) < 0) {
-			g_critical("failed to dup %s : %s", std_file_path, strerror(errno));
-			close (std_file_fd);
-			goto out;
-		}
+	return true;
 
-		/* Close unused file descriptor */
-		close (std_file_fd);
+err:
+	if (*stdout_fd != -1) {
+		close (*stdout_fd);
+		*stdout_fd = -1;
 	}
 
-	ret  = true;
-out:
-	return ret;
-
+	return false;
 }
 
 /**
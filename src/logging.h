@@ -47,6 +47,8 @@ struct cc_log_options
 
 gboolean cc_oci_log_init (const struct cc_log_options *options);
 void cc_oci_log_free (struct cc_log_options *options);
-gboolean cc_oci_setup_hypervisor_logs (struct cc_oci_config *config);
+const gchar *cc_oci_log_last_error (void);
+gboolean cc_oci_hypervisor_logs_open (struct cc_oci_config *config,
+		int *stdout_fd, int *stderr_fd);
 
 #endif /* _CC_OCI_LOGGING_H */
@@ -30,6 +30,9 @@
 #include "command.h"
 #include "oci-config.h"
 #include "priv.h"
+#include "trace.h"
+#include "ready.h"
+#include "daemon.h"
 
 #define KVM_PATH "/dev/kvm"
 
@@ -39,11 +42,16 @@ static char *program_name;
 /** Logging options */
 static struct cc_log_options cc_log_options;
 
+/** Logging options the daemon was started with */
+static struct cc_log_options daemon_log_options;
+static gboolean daemon_log_options_saved;
+
 static gchar *format;
 static gchar *criu;
 static gboolean show_version;
 static gboolean show_help;
 static gboolean systemd_cgroup;
+static gboolean trace;
 
 /** Path to create state under */
 static gchar *root_dir;
@@ -104,6 +112,13 @@ static GOptionEntry options_global[] =
 		"not implemented",
 		NULL
 	},
+	{
+		"trace", 0, G_OPTION_FLAG_NONE,
+		G_OPTION_ARG_NONE, &trace,
+		"write a trace of the command phases "
+			"(also enabled by " CC_OCI_TRACE_ENV ")",
+		NULL
+	},
 	{
 		"version", 'v', G_OPTION_FLAG_NONE,
 		G_OPTION_ARG_NONE, &show_version,
@@ -128,6 +143,13 @@ static GOptionEntry options_global[] =
 		"specify path to cc-proxy's socket",
 		NULL
 	},
+	{
+		"ready-timeout", 0, G_OPTION_FLAG_NONE,
+		G_OPTION_ARG_INT, &start_data.ready_timeout,
+		"milliseconds to wait for the VM to become ready "
+			"(default " G_STRINGIFY (CC_OCI_READY_DEFAULT_TIMEOUT) ")",
+		NULL
+	},
 	/* terminator */
 	{NULL}
 };
@@ -281,6 +303,7 @@ handle_arguments (int argc, char **argv)
 	GError                *error = NULL;
 	const char            *cmd;
 	struct cc_oci_config  *config = NULL;
+	gint64                 trace_start;
 
 	program_name = argv[0];
 	context = g_option_context_new ("- OCI runtime for Clear Containers");
@@ -329,7 +352,14 @@ handle_arguments (int argc, char **argv)
 
 	if (format && ! g_strcmp0 (format, "json")) {
 		cc_log_options.use_json = true;
-		g_free (format);
+		g_free_if_set (format);
+	}
+
+	if (start_data.ready_timeout < 0) {
+		g_critical ("%s: invalid ready timeout: %d", program_name,
+				start_data.ready_timeout);
+		ret = false;
+		goto out;
 	}
 
 	if (show_version) {
@@ -402,11 +432,21 @@ handle_arguments (int argc, char **argv)
 		start_data.debug = true;
 	}
 
+	if (trace || g_getenv (CC_OCI_TRACE_ENV)) {
+		cc_oci_trace_init (sub->name);
+	}
+
+	trace_start = cc_oci_trace_now ();
+
 	/* Now, deal with the sub-commands
 	 * (and their corresponding options)
 	 */
 	ret = handle_sub_commands (argc, argv, sub, config);
 
+	cc_oci_trace_end (CC_OCI_TRACE_COMMAND, sub->name, trace_start);
+	(void)cc_oci_trace_write (config);
+	cc_oci_trace_free ();
+
 	if (! ret) {
 		goto out;
 	}
@@ -423,6 +463,129 @@ out:
 	return ret;
 }
 
+/*!
+ * Reset the values of the specified options.
+ *
+ * \param entries Options to reset.
+ */
+static void
+reset_options (const GOptionEntry *entries)
+{
+	for (const GOptionEntry *e = entries; e && e->long_name; e++) {
+		switch (e->arg) {
+		case G_OPTION_ARG_NONE:
+			*(gboolean *)e->arg_data = false;
+			break;
+		case G_OPTION_ARG_INT:
+			*(gint *)e->arg_data = 0;
+			break;
+		case G_OPTION_ARG_STRING:
+		case G_OPTION_ARG_FILENAME:
+			g_free_if_set (*(gchar **)e->arg_data);
+			break;
+		default:
+			/* callbacks store their values in start_data */
+			break;
+		}
+	}
+}
+
+/*!
+ * Copy logging options.
+ *
+ * \param dest Options to update.
+ * \param src Options to copy.
+ */
+static void
+copy_log_options (struct cc_log_options *dest,
+		const struct cc_log_options *src)
+{
+	dest->enable_debug = src->enable_debug;
+	dest->use_json = src->use_json;
+	dest->filename = g_strdup (src->filename);
+	dest->global_logfile = g_strdup (src->global_logfile);
+	dest->hypervisor_log_dir = g_strdup (src->hypervisor_log_dir);
+}
+
+/*!
+ * Handle a command forwarded to the daemon.
+ *
+ * Options are held in globals, so those set by the daemon itself or
+ * by a previous command are reset first.
+ *
+ * \param argc Argument count.
+ * \param argv Argument vector.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+handle_daemon_request (int argc, char **argv)
+{
+	struct subcommand  *sub;
+	const gchar        *cmd;
+	gboolean            ret;
+
+	cmd = cc_oci_daemon_command_name (options_global, argc, argv);
+	if (! cc_oci_daemon_command_supported (cmd)) {
+		g_critical ("command not supported by daemon: %s",
+				cmd ? cmd : "(none)");
+		return false;
+	}
+
+	sub = get_subcmd (cmd);
+	g_assert (sub);
+
+	if (! daemon_log_options_saved) {
+		copy_log_options (&daemon_log_options, &cc_log_options);
+		daemon_log_options_saved = true;
+	}
+
+	reset_options (options_global);
+	reset_options (sub->options);
+	cc_log_options.use_json = false;
+	start_data.debug = false;
+
+	ret = handle_arguments (argc, argv);
+
+	reset_options (options_global);
+	reset_options (sub->options);
+
+	/* Log the daemons own messages where they went before */
+	copy_log_options (&cc_log_options, &daemon_log_options);
+	(void)setup_logging (&cc_log_options);
+
+	return ret;
+}
+
+/*!
+ * Forward the command to the daemon if it is running and can
+ * handle the command.
+ *
+ * \param argc Argument count.
+ * \param argv Argument vector.
+ * \param[out] result Outcome of the command.
+ *
+ * \return \c true if the daemon ran the command, else \c false (in
+ * which case it must be run by the caller).
+ */
+static gboolean
+forward_to_daemon (int argc, char **argv, gboolean *result)
+{
+	const gchar *cmd;
+
+	if (g_getenv (CC_OCI_DAEMON_DISABLE_ENV)) {
+		return false;
+	}
+
+	cmd = cc_oci_daemon_command_name (options_global, argc, argv);
+	if (! cc_oci_daemon_command_supported (cmd)) {
+		return false;
+	}
+
+	return cc_oci_daemon_forward (CC_OCI_DAEMON_SOCKET,
+			argc, argv, result);
+}
+
 /**
  * Handle global setup.
  */
@@ -447,6 +610,7 @@ cleanup (struct cc_log_options *options)
 	g_free_if_set (root_dir);
 	g_free_if_set (start_data.shim_path);
 	g_free_if_set (start_data.proxy_socket_path);
+	cc_oci_log_free (&daemon_log_options);
 }
 
 /** Entry point. */
@@ -460,6 +624,12 @@ main (int argc, char **argv)
 		goto out;
 	}
 
+	if (forward_to_daemon (argc, argv, &ret)) {
+		goto out;
+	}
+
+	cc_oci_daemon_handler_set (handle_daemon_request);
+
 	ret = handle_arguments (argc, argv);
 
 	cleanup (&cc_log_options);
@@ -32,16 +32,20 @@
 #include <stdbool.h>
 #include <sys/types.h>
 #include <signal.h>
+#include <unistd.h>
 
 #include <glib.h>
 #include <glib/gprintf.h>
 #include <gio/gio.h>
 #include <gio/gunixsocketaddress.h>
+#include <gio/gunixfdmessage.h>
 
 #include "oci.h"
 #include "util.h"
 #include "network.h"
+#include "networking.h"
 #include "common.h"
+#include "ready.h"
 
 /** Size of buffer to use to receive network data */
 #define CC_OCI_NET_BUF_SIZE 2048
@@ -49,6 +53,9 @@
 /** String that separates messages returned from the hypervisor */
 #define CC_OCI_MSG_SEPARATOR "\r\n"
 
+/** Microseconds to wait between polls of a migration's progress. */
+#define CC_OCI_MIGRATE_POLL_INTERVAL (10 * 1000)
+
 /*! VM connection object. */
 struct cc_oci_vm_conn
 {
@@ -60,6 +67,9 @@ struct cc_oci_vm_conn
 
 	/*! The socket. */
 	GSocket *socket;
+
+	/*! \c true once QMP capabilities have been negotiated. */
+	gboolean initialised;
 };
 
 /*!
@@ -195,7 +205,10 @@ cc_oci_qmp_msg_recv (GSocket *socket,
 			msg = NULL;
 		}
 
-		if (*count == expected_count) {
+		/* A single chunk may hold more messages than expected
+		 * (for example an event sent alongside a response).
+		 */
+		if (*count >= expected_count) {
 			g_debug ("found expected number of messages (%lu)",
 					(unsigned long int)expected_count);
 			break;
@@ -218,7 +231,7 @@ cc_oci_qmp_msg_recv (GSocket *socket,
 			(unsigned long int)expected_count,
 			(unsigned long int)total);
 
-	ret = *count == expected_count;
+	ret = *count >= expected_count;
 
 out:
 	return ret;
@@ -295,12 +308,85 @@ out:
 	return ret;
 }
 
+/*!
+ * Negotiate QMP capabilities on a new connection.
+ *
+ * The QMP protocol requires we query its capabilities before sending
+ * any further messages.
+ *
+ * \param conn \ref cc_oci_vm_conn to use.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+cc_oci_qmp_capabilities (struct cc_oci_vm_conn *conn)
+{
+	const  gchar      capabilities[] = "{ \"execute\": \"qmp_capabilities\" }";
+	GError           *error = NULL;
+	gssize            size;
+	gboolean          ret = false;
+	GSList           *msgs = NULL;
+	GString          *recv_msg = NULL;
+	gsize             msg_count = 0;
+
+	g_assert (conn);
+
+	if (conn->initialised) {
+		return true;
+	}
+
+	g_debug ("sending required initial capabilities "
+			"message (%s)", capabilities);
+
+	size = g_socket_send (conn->socket, capabilities,
+			sizeof (capabilities)-1, NULL, &error);
+	if (size < 0) {
+		g_critical ("failed to send json: %s", capabilities);
+		if (error) {
+			g_critical ("error: %s", error->message);
+			g_error_free (error);
+		}
+		goto out;
+	}
+
+	/* Get the response */
+	ret = cc_oci_qmp_msg_recv (conn->socket,
+			1, &msgs, &msg_count);
+	if (! ret) {
+		goto out;
+	}
+
+	recv_msg = g_slist_nth_data (msgs, 0);
+	if (! recv_msg) {
+		ret = false;
+		goto out;
+	}
+
+	/* Check it */
+	ret = cc_oci_qmp_check_result (recv_msg->str,
+			recv_msg->len, true);
+	if (! ret) {
+		goto out;
+	}
+
+	conn->initialised = true;
+
+out:
+	if (msgs) {
+		cc_oci_net_msgs_free_all (msgs);
+	}
+
+	return ret;
+}
+
 /*!
  * Send a QMP message to the hypervisor.
  *
  * \param conn \ref cc_oci_vm_conn to use.
  * \param msg Data to send (json format).
  * \param msg_len message length.
+ * \param fd File descriptor to pass alongside \p msg
+ *   (\c SCM_RIGHTS), or \c -1.
  * \param expected_resp_count Expected number of response messages.
  * \param expect_empty \c true if the response message is expected
  *   to be an empty json message, else \c false.
@@ -308,77 +394,52 @@ out:
  * \return \c true on success, else \c false.
  */
 static gboolean
-cc_oci_qmp_msg_send (struct cc_oci_vm_conn *conn,
+cc_oci_qmp_msg_send_fd (struct cc_oci_vm_conn *conn,
 		const char *msg,
 		gsize msg_len,
+		int fd,
 		gsize expected_resp_count,
 		gboolean expect_empty)
 {
-	private gboolean   initialised = false;
-	const  gchar      capabilities[] = "{ \"execute\": \"qmp_capabilities\" }";
 	GError           *error = NULL;
 	gssize            size;
 	gboolean          ret = false;
 	GSList           *msgs = NULL;
 	GString          *recv_msg = NULL;
 	gsize             msg_count = 0;
+	GOutputVector     vector;
+	GSocketControlMessage *fd_msg = NULL;
 
 	g_assert (conn);
 	g_assert (msg);
 
-	if (! initialised) {
-		/* The QMP protocol requires we query its capabilities
-		 * before sending any further messages.
-		 */
-
-		g_debug ("sending required initial capabilities "
-				"message (%s)", capabilities);
-
-		size = g_socket_send (conn->socket, capabilities,
-				sizeof (capabilities)-1, NULL, &error);
-		if (size < 0) {
-			g_critical ("failed to send json: %s", capabilities);
-			if (error) {
-				g_critical ("error: %s", error->message);
-				g_error_free (error);
-			}
-			goto out;
-		}
-
-		/* Get the response */
-		ret = cc_oci_qmp_msg_recv (conn->socket,
-				1, &msgs, &msg_count);
-		if (! ret) {
-			goto out;
-		}
+	if (! cc_oci_qmp_capabilities (conn)) {
+		goto out;
+	}
 
-		recv_msg = g_slist_nth_data (msgs, 0);
-		if (! recv_msg) {
-			ret = false;
-			goto out;
-		}
+	g_debug ("sending message '%s'", msg);
 
-		/* Check it */
-		ret = cc_oci_qmp_check_result (recv_msg->str,
-				recv_msg->len, true);
-		if (! ret) {
+	if (fd < 0) {
+		size = g_socket_send (conn->socket, msg, msg_len,
+				NULL, &error);
+	} else {
+		fd_msg = g_unix_fd_message_new ();
+		if (! g_unix_fd_message_append_fd (G_UNIX_FD_MESSAGE (fd_msg),
+					fd, &error)) {
+			g_critical ("failed to add fd %d to message: %s",
+					fd, error->message);
+			g_error_free (error);
 			goto out;
 		}
 
-		cc_oci_net_msgs_free_all (msgs);
-
-		initialised = true;
+		vector.buffer = msg;
+		vector.size = msg_len;
 
-		/* reset */
-		recv_msg = NULL;
-		msgs = NULL;
-		msg_count = 0;
+		size = g_socket_send_message (conn->socket, NULL,
+				&vector, 1, &fd_msg, 1,
+				G_SOCKET_MSG_NONE, NULL, &error);
 	}
 
-	g_debug ("sending message '%s'", msg);
-
-	size = g_socket_send (conn->socket, msg, msg_len,
-			NULL, &error);
 	if (size < 0) {
 		g_critical ("failed to send json: %s", msg);
 		if (error) {
@@ -445,6 +506,9 @@ cc_oci_qmp_msg_send (struct cc_oci_vm_conn *conn,
 	ret = true;
 
 out:
+	if (fd_msg) {
+		g_object_unref (fd_msg);
+	}
 	if (msgs) {
 		cc_oci_net_msgs_free_all (msgs);
 	}
@@ -452,6 +516,29 @@ out:
 	return ret;
 }
 
+/*!
+ * Send a QMP message to the hypervisor.
+ *
+ * \param conn \ref cc_oci_vm_conn to use.
+ * \param msg Data to send (json format).
+ * \param msg_len message length.
+ * \param expected_resp_count Expected number of response messages.
+ * \param expect_empty \c true if the response message is expected
+ *   to be an empty json message, else \c false.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+cc_oci_qmp_msg_send (struct cc_oci_vm_conn *conn,
+		const char *msg,
+		gsize msg_len,
+		gsize expected_resp_count,
+		gboolean expect_empty)
+{
+	return cc_oci_qmp_msg_send_fd (conn, msg, msg_len, -1,
+			expected_resp_count, expect_empty);
+}
+
 /*!
  * Send a QMP pause message to the hypervisor.
  *
@@ -490,6 +577,172 @@ cc_oci_qmp_resume (struct cc_oci_vm_conn *conn, GPid pid)
 			sizeof(resume_msg)-1, 2, false);
 }
 
+/*!
+ * Extract a string member from the object returned by a QMP command.
+ *
+ * \param result Message from server.
+ * \param bytes Size of \p result.
+ * \param member Name of member of the "return" object to extract.
+ * \param[out] value Newly-allocated value of \p member.
+ * \param[out] handled \c false if \p result is not a response (but
+ *   an asynchronous event), else \c true.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+cc_oci_qmp_result_member (const char *result, gsize bytes,
+		const gchar *member, gchar **value, gboolean *handled)
+{
+	gboolean      ret = false;
+	JsonParser   *parser = NULL;
+	JsonObject   *obj;
+	JsonObject   *error_obj;
+	JsonObject   *return_obj;
+	JsonNode     *root;
+	GError       *error = NULL;
+
+	g_assert (result);
+	g_assert (member);
+	g_assert (value);
+	g_assert (handled);
+
+	*handled = false;
+
+	parser = json_parser_new ();
+
+	if (! json_parser_load_from_data (parser, result,
+			(gssize)bytes, &error)) {
+		g_critical ("failed to parse qmp response: %s",
+				error->message);
+		g_error_free (error);
+		goto out;
+	}
+
+	root = json_parser_get_root (parser);
+	if (! (root && JSON_NODE_HOLDS_OBJECT (root))) {
+		g_critical ("unexpected qmp response: %s", result);
+		goto out;
+	}
+
+	obj = json_node_get_object (root);
+
+	if (json_object_has_member (obj, "event")) {
+		g_debug ("ignoring qmp event: %s", result);
+		ret = true;
+		goto out;
+	}
+
+	*handled = true;
+
+	if (json_object_has_member (obj, "error")) {
+		error_obj = json_object_get_object_member (obj, "error");
+		g_critical ("qmp command failed: %s",
+				error_obj && json_object_has_member (error_obj, "desc")
+				? json_object_get_string_member (error_obj, "desc")
+				: result);
+		goto out;
+	}
+
+	if (! json_object_has_member (obj, "return")) {
+		g_critical ("unexpected qmp response: %s", result);
+		goto out;
+	}
+
+	return_obj = json_object_get_object_member (obj, "return");
+	if (! (return_obj && json_object_has_member (return_obj, member))) {
+		g_critical ("no %s in qmp response: %s", member, result);
+		goto out;
+	}
+
+	*value = g_strdup (json_object_get_string_member (return_obj,
+				member));
+
+	ret = *value != NULL;
+
+out:
+	g_object_unref (parser);
+
+	return ret;
+}
+
+/*!
+ * Send a QMP query and return a string member of the object it
+ * returns.
+ *
+ * Asynchronous events received before the response are skipped.
+ *
+ * \param conn \ref cc_oci_vm_conn to use.
+ * \param msg Data to send (json format).
+ * \param member Name of member of the "return" object to extract.
+ * \param[out] value Newly-allocated value of \p member.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+cc_oci_qmp_query (struct cc_oci_vm_conn *conn,
+		const char *msg,
+		const gchar *member,
+		gchar **value)
+{
+	GError      *error = NULL;
+	GSList      *msgs = NULL;
+	GSList      *l;
+	GString     *recv_msg;
+	gsize        msg_count;
+	gboolean     handled = false;
+	gboolean     ret = false;
+
+	g_assert (conn);
+	g_assert (msg);
+	g_assert (member);
+	g_assert (value);
+
+	if (! cc_oci_qmp_capabilities (conn)) {
+		return false;
+	}
+
+	g_debug ("sending message '%s'", msg);
+
+	if (g_socket_send (conn->socket, msg, strlen (msg),
+				NULL, &error) < 0) {
+		g_critical ("failed to send json: %s: %s",
+				msg, error->message);
+		g_error_free (error);
+		return false;
+	}
+
+	while (! handled) {
+		msg_count = 0;
+
+		if (! cc_oci_qmp_msg_recv (conn->socket, 1,
+					&msgs, &msg_count)) {
+			goto out;
+		}
+
+		for (l = msgs; l && ! handled; l = g_slist_next (l)) {
+			recv_msg = l->data;
+
+			if (! cc_oci_qmp_result_member (recv_msg->str,
+						recv_msg->len, member,
+						value, &handled)) {
+				goto out;
+			}
+		}
+
+		cc_oci_net_msgs_free_all (msgs);
+		msgs = NULL;
+	}
+
+	ret = true;
+
+out:
+	if (msgs) {
+		cc_oci_net_msgs_free_all (msgs);
+	}
+
+	return ret;
+}
+
 /*!
  * Read the expected QMP welcome message.
  *
@@ -714,3 +967,443 @@ out:
 
 	return ret;
 }
+
+/*!
+ * Hot-attach the network interfaces of \p config to a running (or
+ * paused) hypervisor.
+ *
+ * Each tap device is opened in the callers network namespace and
+ * passed to the hypervisor over QMP ("getfd") since the hypervisor
+ * may have been started in a different network namespace.
+ *
+ * \param socket_path Path to \ref CC_OCI_HYPERVISOR_SOCKET.
+ * \param pid \c GPid of hypervisor process.
+ * \param config \ref cc_oci_config.
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+cc_oci_vm_netdev_add (const gchar *socket_path, GPid pid,
+		const struct cc_oci_config *config)
+{
+	gboolean                 ret = false;
+	struct cc_oci_vm_conn  *conn = NULL;
+	GSList                 *l;
+	int                     fd = -1;
+	gchar                  *msg = NULL;
+
+	if (! (socket_path != NULL && pid > 0 && config)) {
+		return false;
+	}
+
+	if (! config->net.interfaces) {
+		return true;
+	}
+
+	conn = cc_oci_vm_conn_new (socket_path, pid);
+	if (! conn) {
+		goto out;
+	}
+
+	for (l = config->net.interfaces; l && l->data; l = g_slist_next (l)) {
+		struct cc_oci_net_if_cfg *if_cfg =
+			(struct cc_oci_net_if_cfg *)l->data;
+
+		fd = cc_oci_tap_open (if_cfg->tap_device);
+		if (fd < 0) {
+			goto out;
+		}
+
+		msg = g_strdup_printf ("{ \"execute\": \"getfd\", "
+				"\"arguments\": { \"fdname\": \"fd-%s\" } }",
+				if_cfg->tap_device);
+
+		ret = cc_oci_qmp_msg_send_fd (conn, msg, strlen (msg),
+				fd, 1, true);
+		if (! ret) {
+			goto out;
+		}
+
+		close (fd);
+		fd = -1;
+		g_free (msg);
+
+		msg = g_strdup_printf ("{ \"execute\": \"netdev_add\", "
+				"\"arguments\": { \"type\": \"tap\", "
+				"\"id\": \"%s\", \"fd\": \"fd-%s\", "
+				"\"vhost\": true } }",
+				if_cfg->tap_device,
+				if_cfg->tap_device);
+
+		ret = cc_oci_qmp_msg_send (conn, msg, strlen (msg),
+				1, true);
+		if (! ret) {
+			goto out;
+		}
+
+		g_free (msg);
+
+		msg = g_strdup_printf ("{ \"execute\": \"device_add\", "
+				"\"arguments\": { "
+				"\"driver\": \"virtio-net-pci\", "
+				"\"id\": \"dev-%s\", \"netdev\": \"%s\", "
+				"\"mac\": \"%s\" } }",
+				if_cfg->tap_device,
+				if_cfg->tap_device,
+				if_cfg->mac_address);
+
+		ret = cc_oci_qmp_msg_send (conn, msg, strlen (msg),
+				1, true);
+		if (! ret) {
+			goto out;
+		}
+
+		g_free (msg);
+		msg = NULL;
+
+		g_debug ("hot-attached network interface %s",
+				if_cfg->tap_device);
+	}
+
+	ret = true;
+
+out:
+	if (fd != -1) {
+		close (fd);
+	}
+	g_free_if_set (msg);
+	if (conn) {
+		cc_oci_vm_conn_free (conn);
+	}
+
+	return ret;
+}
+
+/*!
+ * Send a QMP command whose only argument is a migration URI.
+ *
+ * \param conn \ref cc_oci_vm_conn to use.
+ * \param command QMP command ("migrate" or "migrate-incoming").
+ * \param uri Migration URI.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+cc_oci_qmp_migrate_uri (struct cc_oci_vm_conn *conn,
+		const gchar *command, const gchar *uri)
+{
+	JsonObject      *obj;
+	JsonObject      *args;
+	JsonNode        *root;
+	JsonGenerator   *generator;
+	gchar           *msg;
+	gboolean         ret;
+
+	g_assert (conn);
+	g_assert (command);
+	g_assert (uri);
+
+	/* The URI may contain characters that need escaping */
+	obj = json_object_new ();
+	args = json_object_new ();
+
+	json_object_set_string_member (obj, "execute", command);
+	json_object_set_string_member (args, "uri", uri);
+	json_object_set_object_member (obj, "arguments", args);
+
+	root = json_node_new (JSON_NODE_OBJECT);
+	json_node_take_object (root, obj);
+
+	generator = json_generator_new ();
+	json_generator_set_root (generator, root);
+
+	msg = json_generator_to_data (generator, NULL);
+
+	ret = cc_oci_qmp_msg_send (conn, msg, strlen (msg), 1, true);
+
+	g_free (msg);
+	g_object_unref (generator);
+	json_node_free (root);
+
+	return ret;
+}
+
+/*!
+ * Stop the migration stream from including guest RAM that is backed
+ * by a shared file (the destination maps the same file instead).
+ *
+ * \note Both sides of the migration must enable the capability.
+ *
+ * \param conn \ref cc_oci_vm_conn to use.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+cc_oci_qmp_ignore_shared (struct cc_oci_vm_conn *conn)
+{
+	const char msg[] = "{ \"execute\": \"migrate-set-capabilities\", "
+		"\"arguments\": { \"capabilities\": [ "
+		"{ \"capability\": \"x-ignore-shared\", "
+		"\"state\": true } ] } }";
+
+	g_assert (conn);
+
+	return cc_oci_qmp_msg_send (conn, msg, sizeof(msg)-1, 1, true);
+}
+
+/*!
+ * Cancel the outgoing migration of a hypervisor.
+ *
+ * \param conn \ref cc_oci_vm_conn to use.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+cc_oci_qmp_migrate_cancel (struct cc_oci_vm_conn *conn)
+{
+	const char msg[] = "{ \"execute\": \"migrate_cancel\" }";
+
+	g_assert (conn);
+
+	return cc_oci_qmp_msg_send (conn, msg, sizeof(msg)-1, 1, true);
+}
+
+/*!
+ * Determine the time by which a migration must have finished.
+ *
+ * \param timeout Timeout in milliseconds (\c 0 for
+ *   \ref CC_OCI_READY_DEFAULT_TIMEOUT).
+ *
+ * \return Deadline, in \c g_get_monotonic_time() microseconds.
+ */
+static gint64
+cc_oci_migrate_deadline (gint timeout)
+{
+	if (! timeout) {
+		timeout = CC_OCI_READY_DEFAULT_TIMEOUT;
+	}
+
+	return g_get_monotonic_time () + (gint64)timeout * 1000;
+}
+
+/*!
+ * Wait for a hypervisor to finish loading its state.
+ *
+ * \param conn \ref cc_oci_vm_conn to use.
+ * \param timeout Maximum time to wait in milliseconds (\c 0 for
+ *   \ref CC_OCI_READY_DEFAULT_TIMEOUT).
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+cc_oci_qmp_incoming_wait (struct cc_oci_vm_conn *conn, gint timeout)
+{
+	const char   query_msg[] = "{ \"execute\": \"query-status\" }";
+	gchar       *status = NULL;
+	gint64       deadline;
+
+	g_assert (conn);
+
+	deadline = cc_oci_migrate_deadline (timeout);
+
+	/* If loading the state fails, the hypervisor exits (which
+	 * causes the query to fail).
+	 */
+	while (true) {
+		if (! cc_oci_qmp_query (conn, query_msg, "status", &status)) {
+			return false;
+		}
+
+		if (g_strcmp0 (status, "inmigrate")) {
+			break;
+		}
+
+		g_free (status);
+		status = NULL;
+
+		if (g_get_monotonic_time () >= deadline) {
+			g_critical ("timed out waiting for the VM state to load");
+			return false;
+		}
+
+		g_usleep (CC_OCI_MIGRATE_POLL_INTERVAL);
+	}
+
+	g_debug ("incoming migration finished (status %s)", status);
+
+	g_free (status);
+
+	return true;
+}
+
+/*!
+ * Save the state of a paused hypervisor using QMP "migrate" and wait
+ * for the migration to finish.
+ *
+ * \param socket_path Path to \ref CC_OCI_HYPERVISOR_SOCKET.
+ * \param pid \c GPid of hypervisor process.
+ * \param uri Migration URI (for example "exec:cat > file").
+ * \param ignore_shared If \c true, do not save guest RAM backed by a
+ *   shared file.
+ * \param timeout Maximum time the migration may take in milliseconds
+ *   (\c 0 for \ref CC_OCI_READY_DEFAULT_TIMEOUT), after which it is
+ *   cancelled.
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+cc_oci_vm_migrate (const gchar *socket_path, GPid pid, const gchar *uri,
+		gboolean ignore_shared, gint timeout)
+{
+	const char               query_msg[] = "{ \"execute\": \"query-migrate\" }";
+	gboolean                 ret = false;
+	struct cc_oci_vm_conn   *conn = NULL;
+	gchar                   *status = NULL;
+	gint64                   deadline;
+
+	if (! (socket_path && pid > 0 && uri)) {
+		return false;
+	}
+
+	conn = cc_oci_vm_conn_new (socket_path, pid);
+	if (! conn) {
+		goto out;
+	}
+
+	if (ignore_shared && ! cc_oci_qmp_ignore_shared (conn)) {
+		goto out;
+	}
+
+	if (! cc_oci_qmp_migrate_uri (conn, "migrate", uri)) {
+		goto out;
+	}
+
+	deadline = cc_oci_migrate_deadline (timeout);
+
+	while (true) {
+		if (! cc_oci_qmp_query (conn, query_msg, "status", &status)) {
+			goto out;
+		}
+
+		if (! g_strcmp0 (status, "completed")) {
+			break;
+		}
+
+		if (! g_strcmp0 (status, "failed") ||
+				! g_strcmp0 (status, "cancelled")) {
+			g_critical ("migration to %s %s", uri, status);
+			goto out;
+		}
+
+		g_free (status);
+		status = NULL;
+
+		if (g_get_monotonic_time () >= deadline) {
+			g_critical ("timed out migrating to %s", uri);
+			if (! cc_oci_qmp_migrate_cancel (conn)) {
+				g_critical ("failed to cancel migration");
+			}
+			goto out;
+		}
+
+		g_usleep (CC_OCI_MIGRATE_POLL_INTERVAL);
+	}
+
+	ret = true;
+
+out:
+	g_free_if_set (status);
+	if (conn) {
+		cc_oci_vm_conn_free (conn);
+	}
+
+	return ret;
+}
+
+/*!
+ * Wait for a hypervisor started with "-incoming" to load its state,
+ * then resume it.
+ *
+ * \param socket_path Path to \ref CC_OCI_HYPERVISOR_SOCKET.
+ * \param pid \c GPid of hypervisor process.
+ * \param timeout Maximum time to wait in milliseconds (\c 0 for
+ *   \ref CC_OCI_READY_DEFAULT_TIMEOUT).
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+cc_oci_vm_incoming_resume (const gchar *socket_path, GPid pid,
+		gint timeout)
+{
+	gboolean                 ret = false;
+	struct cc_oci_vm_conn   *conn = NULL;
+
+	if (! (socket_path && pid > 0)) {
+		return false;
+	}
+
+	conn = cc_oci_vm_conn_new (socket_path, pid);
+	if (! conn) {
+		goto out;
+	}
+
+	if (! cc_oci_qmp_incoming_wait (conn, timeout)) {
+		goto out;
+	}
+
+	ret = cc_oci_qmp_resume (conn, pid);
+
+out:
+	if (conn) {
+		cc_oci_vm_conn_free (conn);
+	}
+
+	return ret;
+}
+
+/*!
+ * Load the state of a hypervisor started with "-incoming defer" from
+ * \p uri, sharing (rather than loading) the guest RAM backed by a
+ * file. The hypervisor remains paused.
+ *
+ * \param socket_path Path to \ref CC_OCI_HYPERVISOR_SOCKET.
+ * \param pid \c GPid of hypervisor process.
+ * \param uri Migration URI (for example "exec:cat < file").
+ * \param timeout Maximum time to wait in milliseconds (\c 0 for
+ *   \ref CC_OCI_READY_DEFAULT_TIMEOUT).
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+cc_oci_vm_migrate_incoming (const gchar *socket_path, GPid pid,
+		const gchar *uri, gint timeout)
+{
+	gboolean                 ret = false;
+	struct cc_oci_vm_conn   *conn = NULL;
+
+	if (! (socket_path && pid > 0 && uri)) {
+		return false;
+	}
+
+	conn = cc_oci_vm_conn_new (socket_path, pid);
+	if (! conn) {
+		goto out;
+	}
+
+	if (! cc_oci_qmp_ignore_shared (conn)) {
+		goto out;
+	}
+
+	if (! cc_oci_qmp_migrate_uri (conn, "migrate-incoming", uri)) {
+		goto out;
+	}
+
+	ret = cc_oci_qmp_incoming_wait (conn, timeout);
+
+out:
+	if (conn) {
+		cc_oci_vm_conn_free (conn);
+	}
+
+	return ret;
+}
@@ -23,5 +23,13 @@
 
 gboolean cc_oci_vm_pause (const gchar *socket_path, GPid pid);
 gboolean cc_oci_vm_resume (const gchar *socket_path, GPid pid);
+gboolean cc_oci_vm_netdev_add (const gchar *socket_path, GPid pid,
+		const struct cc_oci_config *config);
+gboolean cc_oci_vm_migrate (const gchar *socket_path, GPid pid,
+		const gchar *uri, gboolean ignore_shared, gint timeout);
+gboolean cc_oci_vm_incoming_resume (const gchar *socket_path, GPid pid,
+		gint timeout);
+gboolean cc_oci_vm_migrate_incoming (const gchar *socket_path, GPid pid,
+		const gchar *uri, gint timeout);
 
 #endif /* _CC_OCI_NETWORK_H */
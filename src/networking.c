@@ -209,6 +209,47 @@ out:
 	return ret;
 }
 
+/*!
+ * Open an existing tap interface.
+ *
+ * Used to hand the interface over to a hypervisor that is not running
+ * in the network namespace the interface was created in.
+ *
+ * \param tap \c tap interface name to open.
+ *
+ * \return Open file descriptor on success, else \c -1.
+ */
+int
+cc_oci_tap_open (const gchar *const tap)
+{
+	struct ifreq ifr;
+	int fd = -1;
+
+	if (tap == NULL) {
+		g_critical("invalid tap interface");
+		return -1;
+	}
+
+	fd = open(TUNDEV, O_RDWR | O_CLOEXEC);
+	if (fd < 0) {
+		g_critical("Failed to open [%s] [%s]", TUNDEV, strerror(errno));
+		return -1;
+	}
+
+	memset(&ifr, 0, sizeof(ifr));
+	ifr.ifr_flags = IFF_TAP | IFF_NO_PI | IFF_VNET_HDR;
+	g_strlcpy(ifr.ifr_name, tap, IFNAMSIZ);
+
+	if (ioctl(fd, TUNSETIFF, (void *) &ifr) < 0) {
+		g_critical("Failed to open tap [%s] [%s]",
+			tap, strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
 /*!
  * Helper function for setting/getting MTU for network interface.
  *
@@ -316,6 +357,65 @@ cc_oci_get_interface_mtu(char *ifname, unsigned int *mtu)
 gboolean
 cc_oci_network_create(const struct cc_oci_config *const config,
 		      struct netlink_handle *const hndl) {
+	if (! cc_oci_network_taps_create(config)) {
+		return false;
+	}
+
+	return cc_oci_network_links_create(config, hndl);
+}
+
+/*!
+ * Create the tap interfaces for the container networks.
+ *
+ * This is the only part of the network setup that
+ * must be complete before the hypervisor is started.
+ *
+ * \param config \ref cc_oci_config.
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+cc_oci_network_taps_create(const struct cc_oci_config *const config) {
+	struct cc_oci_net_if_cfg *if_cfg = NULL;
+	guint index = 0;
+
+	if (config == NULL) {
+		return false;
+	}
+
+	for (index=0; index<g_slist_length(config->net.interfaces); index++) {
+		if_cfg = (struct cc_oci_net_if_cfg *)
+			g_slist_nth_data(config->net.interfaces, index);
+
+		if (!cc_oci_tap_create(if_cfg->tap_device)) {
+			return false;
+		}
+
+		/* Set the MTU for the tap interface.
+		 */
+		if (! cc_oci_set_interface_mtu(if_cfg->tap_device, if_cfg->mtu)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/*!
+ * Connect the tap interfaces created by
+ * \ref cc_oci_network_taps_create() to the
+ * container networks (veth) and bring them up.
+ *
+ * This can run whilst the hypervisor is booting.
+ *
+ * \param config \ref cc_oci_config.
+ * \param hndl handle returned from a call to \ref netlink_init().
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+cc_oci_network_links_create(const struct cc_oci_config *const config,
+		      struct netlink_handle *const hndl) {
 	struct cc_oci_net_if_cfg *if_cfg = NULL;
 	guint index = 0;
 
@@ -336,16 +436,6 @@ cc_oci_network_create(const struct cc_oci_config *const config,
 		if_cfg = (struct cc_oci_net_if_cfg *)
 			g_slist_nth_data(config->net.interfaces, index);
 
-		if (!cc_oci_tap_create(if_cfg->tap_device)) {
-			goto out;
-		}
-
-		/* Set the MTU for the tap interface.
-		 */
-		if (! cc_oci_set_interface_mtu(if_cfg->tap_device, if_cfg->mtu)) {
-			goto out;
-		}
-
 		if (!netlink_link_add_bridge(hndl, if_cfg->bridge)) {
 			goto out;
 		}
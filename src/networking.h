@@ -29,6 +29,11 @@ void cc_oci_net_ipv4_route_free(struct cc_oci_net_ipv4_route *route);
 
 gboolean cc_oci_network_create(const struct cc_oci_config *const config,
 		      struct netlink_handle *hndl);
+gboolean cc_oci_network_taps_create(const struct cc_oci_config *const config);
+gboolean cc_oci_network_links_create(const struct cc_oci_config *const config,
+				struct netlink_handle *const hndl);
+
+int cc_oci_tap_open (const gchar *const tap);
 
 gchar * cc_net_get_ip_address(const gint family, const void *const sin_addr);
 
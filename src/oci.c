@@ -59,6 +59,9 @@
 #include "proxy.h"
 #include "pod.h"
 #include "namespace.h"
+#include "vmpool.h"
+#include "trace.h"
+#include "ready.h"
 
 extern struct start_data start_data;
 private gboolean cc_oci_container_running (const struct oci_state *state);
@@ -577,6 +580,11 @@ cc_oci_cleanup (struct cc_oci_config *config)
 		return false;
 	}
 
+	/* Destroy the pre-booted VM the container was using (if any) */
+	if (! cc_oci_vm_pool_release (config)) {
+		return false;
+	}
+
 	if (! cc_oci_state_file_delete (config)) {
 		return false;
 	}
@@ -666,6 +674,34 @@ out:
 	return ret;
 }
 
+/*!
+ * Keep a pool of pre-booted, paused VMs suitable for the bundle
+ * specified by \p config.
+ *
+ * \param config \ref cc_oci_config.
+ * \param options \ref cc_oci_vm_pool_options.
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+cc_oci_pool (struct cc_oci_config *config,
+		const struct cc_oci_vm_pool_options *options)
+{
+	if (! (config && options)) {
+		return false;
+	}
+
+	if (! cc_oci_config_file_parse (config)) {
+		return false;
+	}
+
+	if (! cc_oci_config_check (config)) {
+		return false;
+	}
+
+	return cc_oci_vm_pool_run (config, options);
+}
+
 /*!
  * Create the state file, apply mounts and run hooks,
  * but do not start the VM.
@@ -769,39 +805,6 @@ out:
 	return ret;
 }
 
-/**
- * Determine when \ref CC_OCI_PROCESS_SOCKET is created.
- *
- * \param monitor \c GFileMonitor.
- * \param file \c GFile (unused).
- * \param other_file \c GFile (unused).
- * \param event_type \c GFileMonitorEvent (unused).
- * \param loop GMainLoop.
- */
-static void
-cc_oci_procsock_monitor_callback(
-		GFileMonitor                 *monitor,
-		GFile                        *file,
-		GFile                        *other_file,
-		GFileMonitorEvent             event_type,
-		GMainLoop                   **loop)
-{
-	(void)file;
-	(void)other_file;
-	(void)event_type;
-
-	g_assert (loop);
-
-	/* CC_OCI_PROCESS_SOCKET has now been created, so delete the
-	 * monitor.
-	 */
-	g_object_unref (monitor);
-
-	g_main_loop_quit (*loop);
-	g_main_loop_unref (*loop);
-	*loop = NULL;
-}
-
 /*!
  * Start a VM previously setup by a call to cc_oci_create().
  *
@@ -815,15 +818,11 @@ cc_oci_start (struct cc_oci_config *config,
 		struct oci_state *state)
 {
 	gboolean       ret = false;
-	GFileMonitor  *monitor = NULL;
-	GFile         *file = NULL;
-	GError        *error = NULL;
 	gboolean       wait = false;
 	gchar         *config_file = NULL;
-	struct stat    st;
 	int            shim_flock_fd = -1;
 	char          *shim_flock_path = NULL;
-	GMainLoop     *loop = NULL;
+	gint64         trace_start;
 
 	if (! config || ! state) {
 		return false;
@@ -870,39 +869,6 @@ cc_oci_start (struct cc_oci_config *config,
 		wait = true;
 	}
 
-	if (wait) {
-		/* Create a file monitor if CC_OCI_PROCESS_SOCKET does not exist */
-		if (stat(config->state.procsock_path, &st)) {
-			loop = g_main_loop_new (NULL, 0);
-			if (! loop) {
-				g_critical ("cannot create main loop for client");
-				return false;
-			}
-			file = g_file_new_for_path (config->state.procsock_path);
-			if (! file) {
-				g_main_loop_unref (loop);
-				return false;
-			}
-
-			/* create inotify watch on file */
-			monitor = g_file_monitor(file, G_FILE_MONITOR_NONE, NULL, &error);
-			if (! monitor) {
-				g_critical ("failed to monitor %s: %s",
-						g_file_get_path (file),
-						error->message);
-				g_error_free (error);
-				g_object_unref (file);
-				g_main_loop_unref (loop);
-
-				return false;
-			}
-
-			g_signal_connect (monitor, "changed",
-				G_CALLBACK (cc_oci_procsock_monitor_callback),
-				&loop);
-		}
-	}
-
 	if (! config->pod) {
 		if (! cc_proxy_hyper_new_container (config)) {
 			ret = false;
@@ -947,11 +913,14 @@ cc_oci_start (struct cc_oci_config *config,
 	              config->state.state_file_path, false);
 
 	if (wait) {
-		if (loop) {
-			/* waiting for CC_OCI_PROCESS_SOCKET
-			 * this socket indicates that VM is running
-			 */
-			g_main_loop_run (loop);
+		/* waiting for CC_OCI_PROCESS_SOCKET
+		 * this socket indicates that VM is running
+		 */
+		if (! cc_oci_wait_for_path (config->state.procsock_path,
+					start_data.ready_timeout,
+					"procsock-wait")) {
+			ret = false;
+			goto out;
 		}
 
 		/* try to lock shim flock file
@@ -965,11 +934,16 @@ cc_oci_start (struct cc_oci_config *config,
 			goto out;
 		}
 
+		trace_start = cc_oci_trace_now ();
+
 		if (flock (shim_flock_fd, LOCK_EX) < 0) {
 			g_critical ("failed to flock shim file: %s", strerror(errno));
 			goto out;
 		}
 
+		cc_oci_trace_end (CC_OCI_TRACE_PHASE, "workload-wait",
+				trace_start);
+
 		/* Read state file to detect if the VM was stopped */
 		ret = cc_oci_get_config_and_state (&config_file, config,
 				&state);
@@ -988,16 +962,7 @@ cc_oci_start (struct cc_oci_config *config,
 	}
 
 out:
-	if (wait) {
-		if (file) {
-			g_object_unref (file);
-		}
-		if (loop) {
-			g_main_loop_unref (loop);
-			loop = NULL;
-		}
-		g_free_if_set (config_file);
-	}
+	g_free_if_set (config_file);
 
 	g_free_if_set (shim_flock_path);
 	if (shim_flock_fd >= 0) {
@@ -1071,6 +1036,9 @@ gboolean
 cc_oci_stop (struct cc_oci_config *config,
 		struct oci_state *state)
 {
+	gint64    trace_start;
+	gboolean  ret;
+
 	if (! (config && state)){
 		return false;
 	}
@@ -1122,7 +1090,13 @@ cc_oci_stop (struct cc_oci_config *config,
 	cc_run_hooks (config->oci.hooks.poststop,
 	              config->state.state_file_path, false);
 
-	return cc_oci_cleanup (config);
+	trace_start = cc_oci_trace_now ();
+
+	ret = cc_oci_cleanup (config);
+
+	cc_oci_trace_end (CC_OCI_TRACE_PHASE, "cleanup", trace_start);
+
+	return ret;
 }
 
 /*!
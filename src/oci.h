@@ -564,6 +564,11 @@ struct cc_proxy {
 	 * from hyperstart when asked for it.
 	 */
 	gchar *vm_console_socket;
+
+	/** If \c true, the VM has been handed over to the proxy with
+	 * cc_proxy_cmd_register() and the proxy waits for it to be ready.
+	 */
+	gboolean registered;
 };
 
 /**
@@ -647,6 +652,24 @@ struct cc_oci_config {
 	/** If \c true, don't wait for hypervisor process to finish. */
 	gboolean detached_mode;
 
+	/** Full path to the checkpoint image to restore the VM from
+	 * (see cc_oci_restore()), or \c NULL to boot the VM.
+	 */
+	gchar *restore_image;
+
+	/** If \c true, clone the VM from a template if one is available
+	 * (see \ref CC_OCI_VM_TEMPLATE_ANNOTATION).
+	 */
+	gboolean vm_template_wanted;
+
+	/** Directory of the VM template the VM is cloned from (or is
+	 * being saved to if \ref vm_template_save is set), else \c NULL.
+	 */
+	gchar *vm_template;
+
+	/** If \c true, the VM is booted to create \ref vm_template. */
+	gboolean vm_template_save;
+
 	struct cc_proxy *proxy;
 
 	/** Workload directory for regular container
@@ -696,6 +719,9 @@ gboolean cc_oci_delete (struct cc_oci_config *config,
 		struct oci_state *state);
 gboolean cc_oci_kill (struct cc_oci_config *config,
 		struct oci_state *state, int signum, gboolean all_processes);
+struct cc_oci_vm_pool_options;
+gboolean cc_oci_pool (struct cc_oci_config *config,
+		const struct cc_oci_vm_pool_options *options);
 
 gboolean cc_oci_config_update (struct cc_oci_config *config,
 		struct oci_state *state);
@@ -220,17 +220,11 @@ gboolean
 cc_pod_container_create (struct cc_oci_config *config)
 {
 	gboolean           ret = false;
-	ssize_t            bytes;
-	char               buffer[2] = { '\0' };
 	g_autofree gchar  *timestamp = NULL;
-	int                shim_err_fd = -1;
 	int                shim_args_fd = -1;
-	int                shim_socket_fd = -1;
 	int                proxy_fd = -1;
 	int                proxy_io_fd = -1;
 	int                ioBase = -1;
-	GSocketConnection *shim_socket_connection = NULL;
-	GError            *error = NULL;
 	int                status = 1;
 
 	if (! (config && config->pod && config->proxy)) {
@@ -258,9 +252,10 @@ cc_pod_container_create (struct cc_oci_config *config)
 	 * Required since the state file must contain the workloads pid,
 	 * and for our purposes the workload pid is the pid of the shim.
 	 *
-	 * The child blocks waiting for a write to shim_args_fd.
+	 * The shim is stopped when it calls exec and then blocks
+	 * waiting for its arguments on shim_args_fd.
 	 */
-	if (! cc_shim_launch (config, &shim_err_fd, &shim_args_fd, &shim_socket_fd, true)) {
+	if (! cc_shim_launch (config, &shim_args_fd, true)) {
 		goto out;
 	}
 
@@ -283,38 +278,15 @@ cc_pod_container_create (struct cc_oci_config *config)
 		goto out;
 	}
 
-	bytes = write (shim_args_fd, &proxy_fd, sizeof (proxy_fd));
-	if (bytes < 0) {
-		g_critical ("failed to send proxy fd to shim child: %s",
-			strerror (errno));
-		goto out;
-	}
-
 	if (! cc_proxy_cmd_allocate_io(config->proxy,
 				&proxy_io_fd, &ioBase,
 				config->oci.process.terminal)) {
 		goto out;
 	}
 
-	bytes = write (shim_args_fd, &ioBase, sizeof (ioBase));
-	if (bytes < 0) {
-		g_critical ("failed to send proxy ioBase to shim child: %s",
-			strerror (errno));
-		goto out;
-	}
-
-	/* send proxy IO fd to cc-shim child */
-	shim_socket_connection = cc_oci_socket_connection_from_fd(shim_socket_fd);
-	if (! shim_socket_connection) {
-		g_critical("failed to create a socket connection to send proxy IO fd");
-		goto out;
-	}
-
-	ret = g_unix_connection_send_fd (G_UNIX_CONNECTION (shim_socket_connection),
-		proxy_io_fd, NULL, &error);
-
-	if (! ret) {
-		g_critical("failed to send proxy IO fd");
+	/* send proxy fds and ioBase to cc-shim child */
+	if (! cc_shim_args_send (shim_args_fd, proxy_fd, proxy_io_fd,
+				ioBase, config->oci.process.terminal)) {
 		goto out;
 	}
 
@@ -332,17 +304,6 @@ cc_pod_container_create (struct cc_oci_config *config)
 	close (shim_args_fd);
 	shim_args_fd = -1;
 
-	g_debug ("checking shim setup (blocking)");
-
-	bytes = read (shim_err_fd,
-			buffer,
-			sizeof (buffer));
-	if (bytes > 0) {
-		g_critical ("shim setup failed");
-		ret = false;
-		goto out;
-	}
-
 	/* Create the state file now that all information is
 	 * available.
 	 */
@@ -393,9 +354,8 @@ cc_pod_container_create (struct cc_oci_config *config)
 	ret = cc_proxy_disconnect (config->proxy);
 
 out:
-	if (shim_err_fd != -1) close (shim_err_fd);
+	if (proxy_io_fd != -1) close (proxy_io_fd);
 	if (shim_args_fd != -1) close (shim_args_fd);
-	if (shim_socket_fd != -1) close (shim_socket_fd);
 
 	return ret;
 }
@@ -21,7 +21,7 @@
 /*
  * Architecture:
  *
- * - fork.
+ * - spawn (see spawn.c).
  * - set std streams to the console device specified by containerd.
  * - exec the hypervisor.
  * - parent exits. This causes the child (hypervisor) to be reparented
@@ -68,174 +68,122 @@
 #include "pod.h"
 #include "proxy.h"
 #include "command.h"
+#include "vmpool.h"
+#include "vmtemplate.h"
+#include "checkpoint.h"
+#include "trace.h"
+#include "spawn.h"
 
-#define SHIM_ARG_COUNT 13
+#define SHIM_ARG_COUNT 8
 
 extern struct start_data start_data;
 
 static GMainLoop* main_loop = NULL;
 
+/** Stages of cc_oci_vm_launch() whose latency is reported. */
+enum cc_oci_launch_stage {
+	CC_OCI_LAUNCH_VM_TEMPLATE = 0,
+	CC_OCI_LAUNCH_VM_POOL_CLAIM,
+	CC_OCI_LAUNCH_SHIM,
+	CC_OCI_LAUNCH_STATE_FILE,
+	CC_OCI_LAUNCH_HOOKS,
+	CC_OCI_LAUNCH_NETWORK_DISCOVERY,
+	CC_OCI_LAUNCH_NETWORK_TAPS,
+	CC_OCI_LAUNCH_HYPERVISOR_START,
+	CC_OCI_LAUNCH_NETWORK_LINKS,
+	CC_OCI_LAUNCH_VM_BOOT,
+	CC_OCI_LAUNCH_POD_CREATE,
+	CC_OCI_LAUNCH_SHIM_SETUP,
+	CC_OCI_LAUNCH_CGROUPS,
+
+	CC_OCI_LAUNCH_STAGE_COUNT
+};
+
+/** Names of the \ref cc_oci_launch_stage values. */
+static const gchar *cc_oci_launch_stage_names[CC_OCI_LAUNCH_STAGE_COUNT] = {
+	"vm-template",
+	"vm-pool-claim",
+	"shim-launch",
+	"state-file",
+	"prestart-hooks",
+	"network-discovery",
+	"network-taps",
+	"hypervisor-start",
+	"network-links",
+	"vm-boot",
+	"pod-create",
+	"shim-setup",
+	"cgroups",
+};
+
+/** Monotonic start and end times (in microseconds) of each stage. */
+struct cc_oci_launch_timing {
+	/** Time cc_oci_vm_launch() was called. */
+	gint64 origin;
+
+	gint64 start[CC_OCI_LAUNCH_STAGE_COUNT];
+	gint64 end[CC_OCI_LAUNCH_STAGE_COUNT];
+};
+
 /*!
- * Close file descriptors, excluding standard streams.
- *
- * \param fds Array of file descriptors that should not be closed
+ * Record the start of a launch stage.
  *
- * \return \c true on success, else \c false.
+ * \param timing \ref cc_oci_launch_timing.
+ * \param stage \ref cc_oci_launch_stage.
  */
-static gboolean
-cc_oci_close_fds (GArray *fds) {
-	char           *fd_dir = "/proc/self/fd";
-	DIR            *dir;
-	struct dirent  *ent;
-	int             fd;
-
-	dir = opendir (fd_dir);
-
-	if (! dir) {
-		return false;
-	}
-
-	while ((ent = readdir (dir)) != NULL) {
-		if (! (g_strcmp0 (ent->d_name, ".") &&
-		    g_strcmp0 (ent->d_name, ".."))) {
-			continue;
-		}
-
-		fd = atoi (ent->d_name);
-		if (fd < 3) {
-			/* ignore stdandard fds */
-			continue;
-		}
-
-		if (fds) {
-			uint i;
-			for (i = 0; i < fds->len; i++) {
-				if (g_array_index (fds, int, i) == fd) {
-					break;
-				}
-			}
-			if (i != fds->len) {
-				continue;
-			}
-		}
-
-		if (fd == dirfd (dir)) {
-			/* ignore the fd created by opendir(3) */
-			continue;
-		}
-
-		(void)close (fd);
-	}
-
-	if (closedir (dir) < 0) {
-		return false;
-	}
-
-	return true;
+static void
+cc_oci_launch_stage_begin (struct cc_oci_launch_timing *timing,
+		enum cc_oci_launch_stage stage)
+{
+	timing->start[stage] = g_get_monotonic_time ();
 }
 
-/*! Perform setup on spawned child process.
- *
- * \param config \ref cc_oci_config.
+/*!
+ * Record the end of a launch stage.
  *
- * \return \c true on success, else \c false.
+ * \param timing \ref cc_oci_launch_timing.
+ * \param stage \ref cc_oci_launch_stage.
  */
-private gboolean
-cc_oci_setup_child (struct cc_oci_config *config)
+static void
+cc_oci_launch_stage_end (struct cc_oci_launch_timing *timing,
+		enum cc_oci_launch_stage stage)
 {
-	if (! config) {
-		return false;
-	}
-
-	/* become session leader */
-	setsid ();
-
-	/* Do not close fds when VM runs in detached mode*/
-	if (! config->detached_mode) {
-		if (! cc_oci_close_fds (NULL)) {
-			return false;
-		}
-	}
-
-	if (! cc_oci_setup_hypervisor_logs(config)) {
-		return false;
-	}
-
-	return true;
+	timing->end[stage] = g_get_monotonic_time ();
 
+	cc_oci_trace_add (CC_OCI_TRACE_LAUNCH,
+			cc_oci_launch_stage_names[stage],
+			timing->start[stage], timing->end[stage]);
 }
 
-/*! Perform setup on spawned shim process.
+/*!
+ * Log the offset and duration of all completed launch stages.
  *
- * \param config \ref cc_oci_config.
- * \param proxy_fd Proxy socket connection.
- * \param proxy_io_fd Proxy IO fd.
+ * Since stages overlap, the offsets (relative to the start of the
+ * launch) show which host-side work ran whilst the VM was booting.
  *
- * \return \c true on success, else \c false.
+ * \param timing \ref cc_oci_launch_timing.
  */
-private gboolean
-cc_oci_setup_shim (struct cc_oci_config *config,
-			int proxy_fd,
-			int proxy_io_fd,
-			int shim_flock_fd)
+static void
+cc_oci_launch_timing_report (const struct cc_oci_launch_timing *timing)
 {
-	gboolean        ret = false;
-	int             tty_fd = -1;
-	GArray         *fds = NULL;
-
-	if (! config || proxy_fd < 0 || proxy_io_fd < 0 || shim_flock_fd < 0) {
-		return false;
-	}
-
-	/* become session leader */
-	setsid ();
+	gint64 last = timing->origin;
 
-	// In the console case, the terminal needs to be dup'ed to stdio
-	if (config->oci.process.terminal && config->console) {
-		tty_fd = open(config->console, O_RDWR |  O_NOCTTY);
-
-		if (tty_fd == -1) {
-			g_warning("Error opening slave pty %s: %s",
-					config->console,
-					strerror(errno));
-			return false;
-		}
-
-		if (dup2(tty_fd, STDIN_FILENO) < 0) {
-			goto out;
-		}
-		if (dup2(tty_fd, STDOUT_FILENO) < 0) {
-			goto out;
-		}
-		if (dup2(tty_fd, STDERR_FILENO) < 0) {
-			goto out;
-		}
-
-		if (ioctl(STDIN_FILENO, TIOCSCTTY, 1) < 0) {
-			goto out;
+	for (int i = 0; i < CC_OCI_LAUNCH_STAGE_COUNT; i++) {
+		if (! (timing->start[i] && timing->end[i])) {
+			continue;
 		}
-	}
-
-	fds = g_array_sized_new(FALSE, FALSE, sizeof(int), 3);
-	g_array_append_val (fds, proxy_fd);
-	g_array_append_val (fds, proxy_io_fd);
-	g_array_append_val (fds, shim_flock_fd);
 
-	cc_oci_close_fds (fds);
+		g_debug ("launch stage %s: start +%" G_GINT64_FORMAT
+				"us, duration %" G_GINT64_FORMAT "us",
+				cc_oci_launch_stage_names[i],
+				timing->start[i] - timing->origin,
+				timing->end[i] - timing->start[i]);
 
-	g_array_free(fds, TRUE);
-
-	ret = true;
-
-out:
-	/* Close on error, or if the fd does not refer to
-	 * one of the standard streams.
-	 */
-	if (ret == false || tty_fd > 2) {
-		close (tty_fd);
+		last = MAX (last, timing->end[i]);
 	}
 
-	return ret;
+	g_debug ("launch total: %" G_GINT64_FORMAT "us",
+			last - timing->origin);
 }
 
 /*!
@@ -275,16 +223,14 @@ private gboolean
 cc_run_hook(struct oci_cfg_hook* hook, const gchar* state,
              gsize state_length)
 {
-	int stdin_pipe[2]        = { -1, -1 };
-	int pipe_child_error[2]  = { -1, -1 };
-	int pipe_parent_error[2] = { -1, -1 };
-	pid_t pid = 0;
+	struct cc_oci_spawn spawn;
+	int stdin_pipe[2] = { -1, -1 };
+	GPid pid = -1;
 	int pipe_sz = 0;
 	bool ret = false;
-	char c = 0;
 	int status = 1;
-	char **args = NULL;
-	int saved_errno = 0;
+	gchar *default_args[] = { NULL, NULL };
+	gchar *empty_env[] = { NULL };
 
 	if (! hook) {
 		return false;
@@ -295,128 +241,65 @@ cc_run_hook(struct oci_cfg_hook* hook, const gchar* state,
 		return false;
 	}
 
-	if (pipe (stdin_pipe) < 0) {
+	if (pipe2 (stdin_pipe, O_CLOEXEC) < 0) {
 		g_critical ("failed to create stdin pipe: %s", strerror(errno));
-		goto fail1;
-	}
-
-	if (pipe2 (pipe_child_error, O_CLOEXEC) < 0) {
-		g_critical ("failed to create child pipe: %s", strerror(errno));
-		goto fail2;
-	}
-
-	if (pipe(pipe_parent_error) < 0) {
-		g_critical ("failed to create parent pipe: %s", strerror(errno));
-		goto fail3;
-	}
-
-	pid = fork ();
-	if (pid < 0) {
-		g_critical ("failed to fork parent: %s", strerror(errno));
-		goto fail4;
-	} else if (! pid) {
-		//child
-		close_if_set (stdin_pipe[1]);
-		close_if_set (pipe_child_error[0]);
-		close_if_set (pipe_parent_error[1]);
-
-		/* waiting for parent setup */
-		if (read (pipe_parent_error[0], &c, sizeof(c)) > 0) {
-			saved_errno = errno;
-			g_critical ("parent setup failed");
-			goto fail_child;
-		}
-
-		if (dup2 (stdin_pipe[0], STDIN_FILENO) < 0) {
-			saved_errno = errno;
-			g_critical ("failed to dup hook stdin");
-			goto fail_child;
-		}
-
-		args = hook->args;
-		if (! (hook->args && *hook->args)) {
-			args = g_new0(gchar *, 2);
-			args[0] = hook->path;
-		}
-
-		if (execvpe (hook->path, args, hook->env) < 0) {
-			saved_errno = errno;
-			g_critical ("failed to exec hook %s: %s",
-					hook->path, strerror (errno));
-		}
-
-fail_child:
-		if (write (pipe_child_error[1], "E", 1) < 0) {
-			g_critical ("failed to write error in child pipe: %s",
-				strerror(errno));
-		}
-		close_if_set (stdin_pipe[0]);
-		close_if_set (pipe_child_error[1]);
-		close_if_set (pipe_parent_error[0]);
-		exit(saved_errno);
+		goto out;
 	}
 
-	//parent
-	close_if_set (stdin_pipe[0]);
-	close_if_set (pipe_child_error[1]);
-	close_if_set (pipe_parent_error[0]);
-
 	/* if needed resize pipe size */
 	pipe_sz = fcntl (stdin_pipe[1], F_GETPIPE_SZ);
 	if (pipe_sz < state_length) {
 		if (fcntl (stdin_pipe[1], F_SETPIPE_SZ, state_length+1) < 0) {
 			g_critical ("failed to change pipe size: %s", strerror(errno));
-			goto fail5;
+			goto out;
 		}
 	}
 
-	/* send state to hook */
+	/* send state to hook (the pipe is large enough to hold all
+	 * of it, so this cannot block).
+	 */
 	if (write (stdin_pipe[1], state, state_length) < 0) {
 		g_critical ("failed to send state to hook: %s", strerror(errno));
-		goto fail5;
+		goto out;
 	}
 
-	/* notify to child that setup finished successfully */
 	close_if_set (stdin_pipe[1]);
-	close_if_set (pipe_parent_error[1])
 
-	/* waiting for parent setup */
-	if (read (pipe_child_error[0], &c, sizeof(c)) > 0) {
-		g_critical ("hook setup failed");
-		goto fail4;
+	cc_oci_spawn_init (&spawn);
+
+	spawn.path = hook->path;
+	spawn.argv = hook->args;
+	if (! (hook->args && *hook->args)) {
+		default_args[0] = hook->path;
+		spawn.argv = default_args;
+	}
+	spawn.envp = hook->env ? hook->env : empty_env;
+	spawn.stdio[STDIN_FILENO] = stdin_pipe[0];
+
+	pid = cc_oci_spawn (&spawn);
+	if (pid < 0) {
+		g_critical ("failed to run hook %s", hook->path);
+		goto out;
 	}
 
 	if (waitpid (pid, &status, 0) != pid) {
 		g_critical ("waitpid failed: %s", strerror(errno));
-		goto fail4;
+		goto out;
 	}
 
 	/* check hook exit code */
 	if (WEXITSTATUS (status) != 0) {
 		g_critical("hook process %d failed with exit code: %d",
 				(int)pid, WEXITSTATUS (status));
-		goto fail4;
+		goto out;
 	}
 
 	ret = true;
 
-fail5:
-	if (pipe_parent_error[1] != -1) {
-		if (write (pipe_parent_error[1], "E", 1) < 0) {
-			g_critical ("failed to write error in parent pipe: %s",
-				strerror(errno));
-		}
-	}
-fail4:
-	close_if_set (pipe_parent_error[0]);
-	close_if_set (pipe_parent_error[1]);
-fail3:
-	close_if_set (pipe_child_error[0]);
-	close_if_set (pipe_child_error[1]);
-fail2:
+out:
 	close_if_set (stdin_pipe[0]);
 	close_if_set (stdin_pipe[1]);
-fail1:
+
 	return ret;
 }
 
@@ -492,54 +375,45 @@ out:
 /*!
  * Start \ref CC_OCI_SHIM as a child process.
  *
+ * The shim is spawned immediately, but blocks after exec until the
+ * caller sends it the proxy file descriptors and I/O sequence numbers
+ * using cc_shim_args_send(). If \p initial_workload is \c true, the
+ * shim is also stopped by \c SIGTRAP when it calls exec (since it is
+ * traced by the runtime).
+ *
  * \param config \ref cc_oci_config.
- * \param child_err_fd Readable file descriptor caller should use
- *   to determine if the shim launched successfully
- *   (any data that can be read from this fd denotes failure).
- * \param shim_args_fd Writable file descriptor caller should use to
- *   send the proxy_socket_fd to the child before \ref CC_OCI_SHIM is
- *   launched.
- * \param shim_socket_fd Writable file descriptor caller should use to
- *   send the proxy IO fd to child before \ref CC_OCI_SHIM is launched.
+ * \param[out] shim_args_fd Socket caller should pass to
+ *   cc_shim_args_send().
+ * \param initial_workload \c true if the shim represents the
+ *   initial workload of the VM.
  *
  * \return \c true on success, else \c false.
  */
 gboolean
 cc_shim_launch (struct cc_oci_config *config,
-		int *child_err_fd,
 		int *shim_args_fd,
-		int *shim_socket_fd,
 		gboolean initial_workload)
 {
-	gboolean  ret = false;
-	GPid      pid = -1;
-	int       child_err_pipe[2] = {-1, -1};
-	int       shim_args_pipe[2] = {-1, -1};
-	int       shim_socket[2] = {-1, -1};
-	int       shim_flock_fd = -1;
-	char     *shim_flock_path = NULL;
-
-	if (! (config && config->proxy)) {
-		return false;
-	}
-
-	if (! (child_err_fd && shim_args_fd && shim_socket_fd)) {
+	struct cc_oci_spawn  spawn;
+	gboolean             ret = false;
+	GPid                 pid = -1;
+	int                  shim_socket[2] = {-1, -1};
+	int                  shim_flock_fd = -1;
+	int                  tty_fd = -1;
+	g_autofree gchar    *shim_flock_path = NULL;
+	gchar               *args[SHIM_ARG_COUNT+1] = { NULL };
+	gchar                args_fd_str[16];
+	int                  i = 0;
+
+	if (! (config && shim_args_fd)) {
 		return false;
 	}
 
-	if (pipe2 (child_err_pipe, O_CLOEXEC) < 0) {
-		g_critical ("failed to create shim err pipe: %s",
-				strerror (errno));
-		goto out;
-	}
-
-	if (pipe2 (shim_args_pipe, O_CLOEXEC) < 0) {
-		g_critical ("failed to create shim args pipe: %s",
-				strerror (errno));
-		goto out;
-	}
-
-	if (socketpair(PF_UNIX, SOCK_STREAM, 0, shim_socket) < 0) {
+	/* Both ends are close-on-exec: the child end is kept by the
+	 * spawn, all other children (hypervisor, hooks) never see it.
+	 */
+	if (socketpair (PF_UNIX, SOCK_STREAM|SOCK_CLOEXEC,
+				0, shim_socket) < 0) {
 		g_critical ("failed to create shim socket: %s",
 				strerror (errno));
 		goto out;
@@ -547,235 +421,415 @@ cc_shim_launch (struct cc_oci_config *config,
 
 	shim_flock_path = g_strdup_printf ("%s/%s", config->state.runtime_path,
 		CC_OCI_SHIM_LOCK_FILE);
-	shim_flock_fd = open(shim_flock_path, O_RDONLY|O_CREAT, S_IRUSR);
-	g_free (shim_flock_path);
+	shim_flock_fd = open(shim_flock_path,
+			O_RDONLY|O_CREAT|O_CLOEXEC, S_IRUSR);
 	if (shim_flock_fd < 0) {
 		g_critical ("failed to create shim flock file: %s",
 			strerror (errno));
 		goto out;
 	}
 
-	/* Inform caller of workload PID */
-	config->state.workload_pid = pid = fork ();
-
-	if (pid < 0) {
-		g_critical ("failed to spawn shim child: %s",
-				strerror (errno));
+	/* When run interactively, the fds 0,1,2 may be closed.
+	 * Since these need to be assigned to the terminal fd, make sure
+	 * the fds the shim inherits are assigned >= 3.
+	 */
+	if (! (dup_over_stdio (&shim_socket[0]) &&
+			dup_over_stdio (&shim_flock_fd))) {
+		g_critical ("failed to move shim fds above stdio");
 		goto out;
-	} else if (! pid) {
-		gchar   **args = NULL;
-		ssize_t   bytes;
-		int       proxy_socket_fd = -1;
-		int       proxy_io_fd = -1;
-		int       proxy_io_base = -1;
-		GSocketConnection *connection = NULL;
-		GError   *error = NULL;
-		int       i = 0;
-
-		/* child */
-		close (child_err_pipe[0]);
-		close (shim_args_pipe[1]);
-		close (shim_socket[1]);
-
-		g_debug ("shim child waiting for proxy socket fd on fd %d", shim_args_pipe[0]);
-
-		/* block reading proxy fd */
-		bytes = read (shim_args_pipe[0],
-				&proxy_socket_fd,
-				sizeof (proxy_socket_fd));
-
-		if (bytes <= 0) {
-			g_critical ("failed to read proxy socket fd");
-			goto child_failed;
-		}
+	}
 
-		/* block reading proxy ioBase */
-		bytes = read (shim_args_pipe[0],
-				&proxy_io_base,
-				sizeof (proxy_io_base));
+	cc_oci_spawn_init (&spawn);
 
-		if (bytes <= 0) {
-			g_critical ("failed to read proxy ioBase");
-			goto child_failed;
+	if (config->oci.process.terminal && config->console) {
+		tty_fd = open (config->console, O_RDWR|O_NOCTTY|O_CLOEXEC);
+		if (tty_fd == -1) {
+			g_critical ("Error opening slave pty %s: %s",
+					config->console,
+					strerror(errno));
+			goto out;
 		}
 
-		/* read proxy IO fd from socket out-of-band */
-		connection = cc_oci_socket_connection_from_fd(shim_socket[0]);
-		if (!connection) {
-			g_critical ("failed to read proxy IO fd");
-			goto child_failed;
-		}
+		spawn.stdio[STDIN_FILENO] = tty_fd;
+		spawn.stdio[STDOUT_FILENO] = tty_fd;
+		spawn.stdio[STDERR_FILENO] = tty_fd;
+		spawn.ctty = true;
+	}
 
-		proxy_io_fd = g_unix_connection_receive_fd (
-			G_UNIX_CONNECTION (connection), NULL, &error);
-		if (proxy_io_fd < 0) {
-			g_critical ("failed to read proxy IO fd from socket");
-			if (error) {
-				g_critical("%s", error->message);
-				g_error_free(error);
-			}
-			goto child_failed;
-		}
+	/* cc-shim path can be specified via command line */
+	if (start_data.shim_path) {
+		args[i++] = start_data.shim_path;
+	} else {
+		args[i++] = CC_OCI_SHIM;
+	}
+	args[i++] = "-c";
+	args[i++] = config->optarg_container_id;
+	args[i++] = "-a";
+	g_snprintf (args_fd_str, sizeof (args_fd_str), "%d", shim_socket[0]);
+	args[i++] = args_fd_str;
+	if (initial_workload) {
+		/* cc-shim will destroy the VM when initial workload ends */
+		args[i++] = "-w";
+	}
 
-		close (shim_args_pipe[0]);
-		shim_args_pipe[0] = -1;
+	/* Pass debug flag to shim if the runtime is invoked
+	 * with debug flag
+	 */
+	if (start_data.debug) {
+		args[i++] = "-d";
+	}
 
-		close (shim_socket[0]);
-		shim_socket[0] = -1;
+	g_debug ("running command:");
+	for (gchar** p = args; p && *p; p++) {
+		g_debug ("arg: '%s'", *p);
+	}
 
-		g_debug ("proxy socket fd from parent=%d",
-				proxy_socket_fd);
+	spawn.path = args[0];
+	spawn.argv = args;
+	spawn.setsid = true;
+	spawn.close_fds = true;
 
-		if (proxy_socket_fd < 0) {
-			g_critical ("parent provided invalid proxy fd");
-			goto child_failed;
-		}
+	if (! (cc_oci_spawn_add_fd (&spawn, shim_socket[0]) &&
+			cc_oci_spawn_add_fd (&spawn, shim_flock_fd))) {
+		goto out;
+	}
 
-		/* When run interactively, the fds 0,1,2 are closed.
-		 * Since these need to be assigned to the terminal fd, make sure the
-		 * proxy fds are assigned >= 3
-		 */
+	/* Arrange for the process to be paused when the shim command
+	 * is exec'd to ensure that the shim does not launch until
+	 * "start" is called.
+	 */
+	if (initial_workload) {
+		spawn.flock_fd = shim_flock_fd;
+		spawn.traceme = true;
+	}
 
-		if (! dup_over_stdio(&proxy_socket_fd)) {
-			g_critical("failed to dup proxy_socket_fd");
-			goto child_failed;
-		}
+	/* Inform caller of workload PID */
+	config->state.workload_pid = pid = cc_oci_spawn (&spawn);
+	if (pid < 0) {
+		g_critical ("failed to spawn shim child");
+		goto out;
+	}
 
-		if(! dup_over_stdio(&proxy_io_fd)) {
-			g_critical("failed to dup proxy_io_fd");
-			goto child_failed;
-		}
+	g_debug ("shim process running with pid %d", (int)pid);
 
-		if (! dup_over_stdio(&shim_flock_fd)) {
-			g_critical("failed to dup shim_flock_fd");
-			goto child_failed;
-		}
+	*shim_args_fd = shim_socket[1];
+	shim_socket[1] = -1;
 
-		cc_oci_fd_toggle_cloexec(proxy_socket_fd, false);
+	ret = true;
 
-		cc_oci_fd_toggle_cloexec(proxy_io_fd, false);
+out:
+	close_if_set (shim_socket[0]);
+	close_if_set (shim_socket[1]);
+	close_if_set (shim_flock_fd);
+	close_if_set (tty_fd);
 
-		cc_oci_fd_toggle_cloexec(shim_flock_fd, false);
+	return ret;
+}
 
-		if (initial_workload && flock (shim_flock_fd, LOCK_EX) < 0) {
-			g_critical("failed to lock %s: %s",
-				CC_OCI_SHIM_LOCK_FILE, strerror(errno));
-			goto child_failed;
-		}
+/*!
+ * Send the proxy file descriptors and I/O sequence numbers to a shim
+ * started by cc_shim_launch().
+ *
+ * \param shim_args_fd Socket returned by cc_shim_launch().
+ * \param proxy_fd Socket connected to the proxy.
+ * \param proxy_io_fd I/O fd allocated by the proxy.
+ * \param ioBase Sequence number for stdin and stdout.
+ * \param terminal \c true if the workload uses a terminal.
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+cc_shim_args_send (int shim_args_fd, int proxy_fd, int proxy_io_fd,
+		int ioBase, gboolean terminal)
+{
+	struct cc_shim_args  shim_args;
+	struct msghdr        msg = { 0 };
+	struct iovec         iov;
+	struct cmsghdr      *cmsg;
+	int                  fds[2] = { proxy_fd, proxy_io_fd };
+	union {
+		char            buf[CMSG_SPACE (sizeof (fds))];
+		struct cmsghdr  align;
+	} control;
+	ssize_t              bytes;
+
+	if (shim_args_fd < 0 || proxy_fd < 0 || proxy_io_fd < 0 ||
+			ioBase <= 0) {
+		return false;
+	}
 
-		/* +1 for for NULL terminator */
-		args = g_new0 (gchar *, SHIM_ARG_COUNT+1);
+	shim_args.io_seq_no = (guint64)ioBase;
 
-		/* cc-shim path can be specified via command line */
-		if (start_data.shim_path) {
-			args[i++] = g_strdup (start_data.shim_path);
-		} else {
-			args[i++] = g_strdup (CC_OCI_SHIM);
-		}
-		args[i++] = g_strdup ("-c");
-		args[i++] = g_strdup (config->optarg_container_id);
-		args[i++] = g_strdup ("-p");
-		args[i++] = g_strdup_printf ("%d", proxy_socket_fd);
-		args[i++] = g_strdup ("-o");
-		args[i++] = g_strdup_printf ("%d", proxy_io_fd);
-		args[i++] = g_strdup ("-s");
-		args[i++] = g_strdup_printf ("%d", proxy_io_base);
-		if ( ! config->oci.process.terminal) {
-			args[i++] = g_strdup ("-e");
-			args[i++] = g_strdup_printf ("%d", proxy_io_base + 1);
-		}
-		if (initial_workload) {
-			/* cc-shim will destroy the VM when initial workload ends */
-			args[i++] = g_strdup ("-w");
-		}
+	/* For tty, pass stderr seq as 0, so that stdout and
+	 * and stderr are redirected to the terminal
+	 */
+	shim_args.err_seq_no = terminal ? 0 : (guint64)ioBase + 1;
 
-		/* Pass debug flag to shim if the runtime is invoked
-		 * with debug flag
-		 */
-		if (start_data.debug) {
-			args[i++] = g_strdup("-d");
-		}
+	iov.iov_base = &shim_args;
+	iov.iov_len = sizeof (shim_args);
 
-		if (i > SHIM_ARG_COUNT) {
-			g_critical("args index exceeds SHIM_ARG_COUNT: %d > %d",
-				i, SHIM_ARG_COUNT);
-			goto child_failed;
-		}
+	memset (&control, 0, sizeof (control));
 
-		g_debug ("running command:");
-		for (gchar** p = args; p && *p; p++) {
-			g_debug ("arg: '%s'", *p);
-		}
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buf;
+	msg.msg_controllen = sizeof (control.buf);
 
-		if (! cc_oci_setup_shim (config, proxy_socket_fd, proxy_io_fd,
-				shim_flock_fd)) {
-			goto child_failed;
-		}
+	cmsg = CMSG_FIRSTHDR (&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN (sizeof (fds));
+	memcpy (CMSG_DATA (cmsg), fds, sizeof (fds));
 
-		/* arrange for the process to be paused when the shim command
-		 * is exec(3)'d to ensure that the shim does not launch until
-		 * "start" is called.
-		 */
-		if (initial_workload) {
-			if (ptrace (PTRACE_TRACEME, 0, NULL, 0) < 0) {
-				g_critical ("failed to ptrace in shim: %s",
-					strerror (errno));
-				goto child_failed;
-			}
-		}
+	do {
+		bytes = sendmsg (shim_args_fd, &msg, MSG_NOSIGNAL);
+	} while (bytes < 0 && errno == EINTR);
 
-		if (execvp (args[0], args) < 0) {
-			g_critical ("failed to exec child %s: %s",
-					args[0],
-					strerror (errno));
-			abort ();
-		}
+	if (bytes != (ssize_t)sizeof (shim_args)) {
+		g_critical ("failed to send arguments to shim: %s",
+				bytes < 0 ? strerror (errno) : "short write");
+		return false;
+	}
 
-child_failed:
-		/* Any data written by the child to this pipe signifies failure,
-		 * so send a very short message ("E", denoting Error).
-		 */
-		close (shim_args_pipe[0]);
-		shim_args_pipe[0] = -1;
+	return true;
+}
 
-		close (shim_socket[0]);
-		shim_socket[0] = -1;
+/*!
+ * Function called when a data element in GPtrArray is destroyed
+ */
+private void
+cc_free_pointer(gpointer str)
+{
+	if (! str) {
+		return;
+	}
+	g_free(str);
+}
 
-		(void)write (child_err_pipe[1], "E", 1);
-		exit (EXIT_FAILURE);
+/*!
+ * Build the hypervisor command-line and spawn the hypervisor.
+ *
+ * \param config \ref cc_oci_config.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+cc_oci_hypervisor_spawn (struct cc_oci_config *config)
+{
+	struct cc_oci_spawn  spawn;
+	gboolean             ret = false;
+	gchar              **args = NULL;
+	gchar              **argv = NULL;
+	gchar              **p;
+	GPtrArray           *additional_args = NULL;
+	g_autofree gchar    *hypervisor_args = NULL;
+	g_autofree gchar    *path = NULL;
+	int                  stdout_fd = -1;
+	int                  stderr_fd = -1;
+	GPid                 pid;
+	gint64               trace_start;
+
+	additional_args = g_ptr_array_new_with_free_func(cc_free_pointer);
+
+	trace_start = cc_oci_trace_now ();
+
+	cc_oci_populate_extra_args(config, additional_args);
+	ret = cc_oci_vm_args_get (config, &args, additional_args);
+	if (! (ret && args)) {
+		ret = false;
+		goto out;
 	}
 
-	/* parent */
+	cc_oci_trace_end (CC_OCI_TRACE_LAUNCH, "hypervisor-args-expand",
+			trace_start);
 
-	g_debug ("shim process running with pid %d", (int)pid);
+	ret = false;
+
+	/* Expanded arguments may contain embedded newlines (for
+	 * example "-net\nnone"), each of which starts a new argument.
+	 */
+	hypervisor_args = g_strjoinv("\n", args);
+	if (! hypervisor_args) {
+		g_critical("failed to join hypervisor args");
+		goto out;
+	}
 
-	*child_err_fd = child_err_pipe[0];
-	*shim_args_fd = shim_args_pipe[1];
-	*shim_socket_fd = shim_socket[1];
+	argv = g_strsplit_set(hypervisor_args, "\n", -1);
+	if (! (argv && argv[0])) {
+		g_critical ("failed split hypervisor args");
+		goto out;
+	}
+
+	/* Resolve the path now since the child cannot search PATH */
+	path = g_find_program_in_path (argv[0]);
+	if (! path) {
+		g_critical ("hypervisor %s not found", argv[0]);
+		goto out;
+	}
+
+	g_debug ("running command:");
+	for (p = argv; p && *p; p++) {
+		g_debug ("arg: '%s'", *p);
+	}
+
+	if (! cc_oci_hypervisor_logs_open (config, &stdout_fd, &stderr_fd)) {
+		goto out;
+	}
+
+	cc_oci_spawn_init (&spawn);
+
+	spawn.path = path;
+	spawn.argv = argv;
+	spawn.stdio[STDOUT_FILENO] = stdout_fd;
+	spawn.stdio[STDERR_FILENO] = stderr_fd;
+
+	/* become session leader */
+	spawn.setsid = true;
+
+	/* Do not close fds when VM runs in detached mode*/
+	spawn.close_fds = ! config->detached_mode;
+
+	pid = cc_oci_spawn (&spawn);
+	if (pid < 0) {
+		g_critical ("failed to launch hypervisor %s", path);
+		goto out;
+	}
+
+	config->vm->pid = pid;
+
+	g_debug ("hypervisor child pid is %u", (unsigned)pid);
 
 	ret = true;
 
 out:
-	close (child_err_pipe[1]);
-	close (shim_args_pipe[0]);
-	close (shim_socket[0]);
-	if (shim_flock_fd > -1) {
-		close (shim_flock_fd);
-	}
+	close_if_set (stdout_fd);
+	close_if_set (stderr_fd);
+	g_strfreev (args);
+	g_strfreev (argv);
+	g_ptr_array_free(additional_args, TRUE);
 
 	return ret;
 }
 
 /*!
- * Function called when a data element in GPtrArray is destroyed
+ * Let the VM run the container: either resume a VM claimed from the
+ * pool or spawn the hypervisor.
+ *
+ * \param config \ref cc_oci_config.
+ * \param pooled \c true if the VM was claimed from the pool.
+ *
+ * \return \c true on success, else \c false.
  */
-private void
-cc_free_pointer(gpointer str)
+static gboolean
+cc_oci_hypervisor_start (struct cc_oci_config *config,
+		gboolean pooled)
 {
-	if (! str) {
-		return;
+	gboolean ret;
+
+	if (pooled) {
+		/* Hand the workload and network over to the paused VM */
+		ret = cc_oci_vm_pool_attach (config);
+	} else {
+		g_debug ("building hypervisor command-line");
+
+		ret = cc_oci_hypervisor_spawn (config);
 	}
-	g_free(str);
+
+	if (! ret) {
+		return false;
+	}
+
+	/* Let the proxy connect to the VM whilst it boots. Restored and
+	 * cloned VMs are only usable once their state has been loaded, so
+	 * they are left to the hello.
+	 *
+	 * Older proxies don't know about register, which isn't a problem:
+	 * the hello then waits for the VM as it always has.
+	 */
+	if (! (config->restore_image || config->vm_template)) {
+		if (! cc_proxy_cmd_register (config)) {
+			g_debug ("proxy did not register the VM");
+		}
+	}
+
+	return true;
+}
+
+/*!
+ * Discover the network of the container and create the tap interfaces
+ * the VM needs (if networking is required), then start the VM and
+ * bridge the taps to the container network whilst it boots.
+ *
+ * \param config \ref cc_oci_config.
+ * \param timing \ref cc_oci_launch_timing.
+ * \param setup_networking \c true if the VM needs networking.
+ * \param pooled \c true if the VM was claimed from the pool.
+ * \param[out] hndl Netlink handle, to be closed by the caller.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+cc_oci_vm_start (struct cc_oci_config *config,
+		struct cc_oci_launch_timing *timing,
+		gboolean setup_networking,
+		gboolean pooled,
+		struct netlink_handle **hndl)
+{
+	if (setup_networking) {
+		cc_oci_launch_stage_begin (timing,
+				CC_OCI_LAUNCH_NETWORK_DISCOVERY);
+
+		*hndl = netlink_init();
+		if (*hndl == NULL) {
+			g_critical("failed to setup netlink socket");
+			return false;
+		}
+
+		if (! cc_oci_vm_netcfg_get (config, *hndl)) {
+			g_critical("failed to discover network configuration");
+			return false;
+		}
+
+		cc_oci_launch_stage_end (timing,
+				CC_OCI_LAUNCH_NETWORK_DISCOVERY);
+
+		/* The hypervisor only needs the tap interfaces to exist */
+		cc_oci_launch_stage_begin (timing, CC_OCI_LAUNCH_NETWORK_TAPS);
+
+		if (! cc_oci_network_taps_create (config)) {
+			g_critical ("failed to create network");
+			return false;
+		}
+
+		cc_oci_launch_stage_end (timing, CC_OCI_LAUNCH_NETWORK_TAPS);
+	}
+
+	cc_oci_launch_stage_begin (timing, CC_OCI_LAUNCH_HYPERVISOR_START);
+
+	if (! cc_oci_hypervisor_start (config, pooled)) {
+		return false;
+	}
+
+	cc_oci_launch_stage_end (timing, CC_OCI_LAUNCH_HYPERVISOR_START);
+	cc_oci_launch_stage_begin (timing, CC_OCI_LAUNCH_VM_BOOT);
+
+	if (! setup_networking) {
+		return true;
+	}
+
+	/* Bridge the taps to the container network whilst the VM boots */
+	cc_oci_launch_stage_begin (timing, CC_OCI_LAUNCH_NETWORK_LINKS);
+
+	if (! cc_oci_network_links_create (config, *hndl)) {
+		g_critical ("failed to create network");
+		return false;
+	}
+
+	cc_oci_launch_stage_end (timing, CC_OCI_LAUNCH_NETWORK_LINKS);
+
+	g_debug ("network configuration complete");
+
+	return true;
 }
 
 /*!
@@ -784,6 +838,27 @@ cc_free_pointer(gpointer str)
  * Due to the way networking is handled in Docker, the logic here
  * is unfortunately rather complex.
  *
+ * The launch is ordered by data dependency rather than run strictly
+ * in sequence: the hypervisor command-line only depends on the
+ * network configuration, so the VM is started as soon as that is
+ * known and the remaining host-side setup runs whilst the VM boots.
+ *
+ * Networking is only set up as root. Its configuration is discovered
+ * in the network namespace, which a prestart hook (such as Docker's
+ * libnetwork one) may be what creates. The hooks are passed the state
+ * file, which holds the pid of the shim, so in that case the VM can't
+ * start before the shim, state file and hooks: only the creation of
+ * the links (and the proxy waiting for the VM) overlaps the boot.
+ * Without prestart hooks the namespace is already set up (for example
+ * by CNI) and the VM starts straight away:
+ *
+ *     fork -> [no networking or no hooks] -> start VM
+ *     shim -> state file -> hooks -> [networking and hooks] -> start VM
+ *     ... -> wait for hypervisor exec -> wait for VM (proxy ready)
+ *
+ * where "start VM" is: [networking] discover -> taps -> hypervisor
+ * -> [networking] links.
+ *
  * \param config \ref cc_oci_config.
  *
  * \return \c true on success, else \c false.
@@ -792,34 +867,26 @@ gboolean
 cc_oci_vm_launch (struct cc_oci_config *config)
 {
 	gboolean           ret = false;
-	GPid               pid = -1;
-	ssize_t            bytes;
-	char               buffer[2] = { '\0' };
-	int                hypervisor_args_pipe[2] = {-1, -1};
-	int                child_err_pipe[2] = {-1, -1};
-	gchar            **args = NULL;
-	gchar            **p;
 	g_autofree gchar  *timestamp = NULL;
 	struct netlink_handle *hndl = NULL;
 	gboolean           setup_networking;
+	gboolean           start_early;
 	gboolean           hook_status = false;
-	GPtrArray         *additional_args = NULL;
-	gint               hypervisor_args_len = 0;
-	g_autofree gchar  *hypervisor_args = NULL;
-	int                shim_err_fd = -1;
+	gboolean           pooled = false;
 	int                shim_args_fd = -1;
-	int                shim_socket_fd = -1;
 	int                proxy_fd = -1;
 	int                proxy_io_fd = -1;
 	int                ioBase = -1;
-	GSocketConnection *shim_socket_connection = NULL;
-	GError            *error = NULL;
 	int                status = 0;
+	struct cc_oci_launch_timing timing = { 0 };
+	gint64             trace_start;
 
 	if (! config) {
 		return false;
 	}
 
+	timing.origin = g_get_monotonic_time ();
+
 	setup_networking = cc_oci_enable_networking ();
 
 	timestamp = cc_oci_get_iso8601_timestamp ();
@@ -827,8 +894,6 @@ cc_oci_vm_launch (struct cc_oci_config *config)
 		goto out;
 	}
 
-        additional_args = g_ptr_array_new_with_free_func(cc_free_pointer);
-
 	config->state.status = OCI_STATUS_CREATED;
 
 	/* Connect to the proxy before launching the shim so that the
@@ -838,143 +903,57 @@ cc_oci_vm_launch (struct cc_oci_config *config)
 		return false;
 	}
 
-	/* Set up comms channels to the child:
-	 *
-	 * - one to pass the full list of expanded hypervisor arguments.
-	 *
-	 * - one to allow detection of successful child setup: if
-	 *   the child closes the pipe, it was successful, but if it
-	 *   writes data to the pipe, setup failed.
+	/* Clone the VM from a template if the bundle asks for it
+	 * (creating the template the first time round).
 	 */
+	cc_oci_launch_stage_begin (&timing, CC_OCI_LAUNCH_VM_TEMPLATE);
 
-	if (pipe2 (child_err_pipe, O_CLOEXEC) < 0) {
-		g_critical ("failed to create child error pipe: %s",
-				strerror (errno));
+	if (! cc_oci_vm_template_get (config)) {
 		goto out;
 	}
 
-	if (pipe2 (hypervisor_args_pipe, O_CLOEXEC) < 0) {
-		g_critical ("failed to create hypervisor args pipe: %s",
-				strerror (errno));
-		goto out;
-	}
+	cc_oci_launch_stage_end (&timing, CC_OCI_LAUNCH_VM_TEMPLATE);
+	cc_oci_launch_stage_begin (&timing, CC_OCI_LAUNCH_VM_POOL_CLAIM);
 
-	pid = config->vm->pid = fork ();
-	if (pid < 0) {
-		g_critical ("failed to create child: %s",
-				strerror (errno));
+	/* Use a pre-booted VM if the pool has one available (unless
+	 * the VM is being restored from a checkpoint or cloned from a
+	 * template).
+	 */
+	if (! (config->restore_image || config->vm_template) &&
+			! cc_oci_vm_pool_claim (config, &pooled)) {
 		goto out;
 	}
 
-	if (! pid) {
-		/* child */
+	cc_oci_launch_stage_end (&timing, CC_OCI_LAUNCH_VM_POOL_CLAIM);
 
-		/* inform the child who they are */
-		config->vm->pid = getpid ();
-
-		close (hypervisor_args_pipe[1]);
-		close (child_err_pipe[0]);
-
-		/* The child doesn't need the proxy connection */
-		if (! cc_proxy_disconnect (config->proxy)) {
-			goto child_failed;
-		}
-
-		/* first - read hypervisor args length */
-		g_debug ("reading hypervisor command-line length from pipe");
-		bytes = read (hypervisor_args_pipe[0], &hypervisor_args_len,
-			sizeof (hypervisor_args_len));
-		if (bytes < 0 || hypervisor_args_len < 0) {
-			g_critical ("failed to read hypervisor args length");
-			goto child_failed;
-		}
-
-		/* Perform a basic validation check.
-		 *
-		 * ARG_MAX is technically the maximum size of the args *and*
-		 * the environment for a process, but atleast this
-		 * provides an upper-bound to protect against any
-		 * potential DoS.
-		 */
-		if (hypervisor_args_len >= ARG_MAX) {
-			g_critical ("max args len is %d, but parent sent %d",
-					ARG_MAX, hypervisor_args_len);
-			goto child_failed;
-		}
-
-		hypervisor_args = g_new0(gchar, (gsize)(1+hypervisor_args_len));
-		if (! hypervisor_args) {
-			g_critical ("failed alloc memory for hypervisor args");
-			goto child_failed;
-		}
-
-		/* second - read hypervisor args */
-		g_debug ("reading hypervisor command-line from pipe");
-		bytes = read (hypervisor_args_pipe[0], hypervisor_args,
-			(size_t)hypervisor_args_len);
-		if (bytes < 0) {
-			g_critical ("failed to read hypervisor args");
-			goto child_failed;
-		}
-
-		/* third - convert string to args, the string that was read
-		 * from pipe has '\n' as delimiter
-		 */
-		args = g_strsplit_set(hypervisor_args, "\n", -1);
-		if (! args) {
-			g_critical ("failed split hypervisor args");
-			goto child_failed;
-		}
-
-		g_debug ("running command:");
-		for (p = args; p && *p; p++) {
-			g_debug ("arg: '%s'", *p);
-		}
-
-		if (! cc_oci_setup_child (config)) {
-			goto child_failed;
-		}
-
-		if (execvp (args[0], args) < 0) {
-			g_critical ("failed to exec child %s: %s",
-					args[0],
-					strerror (errno));
-			abort ();
-		}
-
-child_failed:
-		/* Any data written by the child to this pipe signifies failure,
-		 * so send a very short message ("E", denoting Error).
-		 */
-		(void)write (child_err_pipe[1], "E", 1);
-		exit (EXIT_FAILURE);
-	}
-
-	/* parent */
-
-	g_debug ("hypervisor child pid is %u", (unsigned)pid);
-
-	/* Before fork this process again
-	 * we have to close unused file descriptors
+	/* Unless a prestart hook may create the network the VM is
+	 * given, nothing the shim, state file or hooks do affects the
+	 * hypervisor command-line, so start the VM now to let it boot
+	 * whilst they are dealt with.
 	 */
-	close (hypervisor_args_pipe[0]);
-	hypervisor_args_pipe[0] = -1;
+	start_early = ! (setup_networking && config->oci.hooks.prestart);
 
-	close (child_err_pipe[1]);
-	child_err_pipe[1] = -1;
+	if (start_early && ! cc_oci_vm_start (config, &timing,
+				setup_networking, pooled, &hndl)) {
+		goto out;
+	}
 
 	/* Launch the shim child before the state file is created.
 	 *
 	 * Required since the state file must contain the workloads pid,
 	 * and for our purposes the workload pid is the pid of the shim.
 	 *
-	 * The child blocks waiting for a write to shim_args_fd.
+	 * The shim is stopped when it calls exec and then blocks
+	 * waiting for its arguments on shim_args_fd.
 	 */
-	if (! cc_shim_launch (config, &shim_err_fd, &shim_args_fd,
-				&shim_socket_fd, true)) {
+	cc_oci_launch_stage_begin (&timing, CC_OCI_LAUNCH_SHIM);
+
+	if (! cc_shim_launch (config, &shim_args_fd, true)) {
 		goto out;
 	}
 
+	cc_oci_launch_stage_end (&timing, CC_OCI_LAUNCH_SHIM);
+
 	/* Create state file before hooks run.
 	 *
 	 * Required since the hooks must be passed the runtime state.
@@ -985,12 +964,16 @@ child_failed:
 	 * file. For this reason, the state file is recreated (with full
 	 * details) later.
 	 */
+	cc_oci_launch_stage_begin (&timing, CC_OCI_LAUNCH_STATE_FILE);
+
 	ret = cc_oci_state_file_create (config, timestamp);
 	if (! ret) {
 		g_critical ("failed to create state file");
 		goto out;
 	}
 
+	cc_oci_launch_stage_end (&timing, CC_OCI_LAUNCH_STATE_FILE);
+
 	/* Run the pre-start hooks.
 	 *
 	 * Note that one of these hooks will configure the networking
@@ -1000,6 +983,8 @@ child_failed:
 	 * including the exit code and the stderr is returned to
 	 * the caller and the container is torn down.
 	 */
+	cc_oci_launch_stage_begin (&timing, CC_OCI_LAUNCH_HOOKS);
+
 	hook_status = cc_run_hooks (config->oci.hooks.prestart,
 			config->state.state_file_path,
 			true);
@@ -1008,7 +993,7 @@ child_failed:
 		g_critical ("failed to run prestart hooks");
 	}
 
-	g_debug ("building hypervisor command-line");
+	cc_oci_launch_stage_end (&timing, CC_OCI_LAUNCH_HOOKS);
 
 	// FIXME: add network config bits to following functions:
 	//
@@ -1018,126 +1003,63 @@ child_failed:
 
 	ret = false;
 
-	if (setup_networking) {
-		hndl = netlink_init();
-		if (hndl == NULL) {
-			g_critical("failed to setup netlink socket");
-			goto out;
-		}
-
-		if (! cc_oci_vm_netcfg_get (config, hndl)) {
-			g_critical("failed to discover network configuration");
-			goto out;
-		}
-
-		if (! cc_oci_network_create(config, hndl)) {
-			g_critical ("failed to create network");
-			goto out;
-		}
-		g_debug ("network configuration complete");
-
-	}
-
-	cc_oci_populate_extra_args(config, additional_args);
-	ret = cc_oci_vm_args_get (config, &args, additional_args);
-	if (! (ret && args)) {
+	if (! start_early && ! cc_oci_vm_start (config, &timing,
+				setup_networking, pooled, &hndl)) {
 		goto out;
 	}
 
-	hypervisor_args = g_strjoinv("\n", args);
-	if (! hypervisor_args) {
-		g_critical("failed to join hypervisor args");
+	/* A restored VM only needs its state loading */
+	if (config->restore_image && ! cc_oci_restore_resume (config)) {
 		goto out;
 	}
 
-	hypervisor_args_len = (gint)g_utf8_strlen(hypervisor_args, -1);
-
-	/* first - write hypervisor length */
-	bytes = write (hypervisor_args_pipe[1], &hypervisor_args_len,
-		sizeof(hypervisor_args_len));
-	if (bytes < 0) {
-		g_critical ("failed to send hypervisor args length to child: %s",
-			strerror (errno));
-		goto out;
-	}
-
-	/* second - write hypervisor args */
-	bytes = write (hypervisor_args_pipe[1], hypervisor_args,
-		(size_t)hypervisor_args_len);
-	if (bytes < 0) {
-		g_critical ("failed to send hypervisor args to child: %s",
-			strerror (errno));
-		goto out;
-	}
-
-	g_debug ("checking child setup (blocking)");
-
-	/* block reading child error state */
-	bytes = read (child_err_pipe[0],
-			buffer,
-			sizeof (buffer));
-	if (bytes > 0) {
-		g_critical ("child setup failed");
-		ret = false;
+	/* A cloned VM needs the template state loading and its network
+	 * attaching.
+	 */
+	if (config->vm_template && ! cc_oci_vm_template_load (config)) {
 		goto out;
 	}
 
-	g_debug ("child setup successful");
-
-	/* Wait for the proxy to signal readiness.
+	/* Wait for the agent sockets to appear, unless the proxy is
+	 * already doing so for a registered VM.
 	 *
 	 * This can only happen once the agent details have been added
 	 * to the proxy object.
 	 */
-	if (! cc_proxy_wait_until_ready (config)) {
+	if (! config->proxy->registered
+			&& ! cc_proxy_wait_for_agent (config)) {
 		g_critical ("failed to wait for proxy %s", CC_OCI_PROXY);
 		goto out;
 	}
 
+	cc_oci_launch_stage_end (&timing, CC_OCI_LAUNCH_VM_BOOT);
+
 	/* At this point ctl and tty sockets already exist,
-	 * is time to communicate with the proxy
+	 * is time to communicate with the proxy.
+	 *
+	 * Registering the VM (which waits for hyperstart to be ready),
+	 * creating the pod and allocating the workload I/O streams is
+	 * a single request to the proxy, so this stage also includes
+	 * the end of the VM boot.
 	 */
-	if (! cc_proxy_hyper_pod_create (config)) {
+	cc_oci_launch_stage_begin (&timing, CC_OCI_LAUNCH_POD_CREATE);
+
+	if (! cc_proxy_cmd_create (config, &proxy_io_fd, &ioBase)) {
 		goto out;
 	}
 
+	cc_oci_launch_stage_end (&timing, CC_OCI_LAUNCH_POD_CREATE);
+	cc_oci_launch_stage_begin (&timing, CC_OCI_LAUNCH_SHIM_SETUP);
+
 	proxy_fd = g_socket_get_fd (config->proxy->socket);
 	if (proxy_fd < 0) {
 		g_critical ("invalid proxy fd: %d", proxy_fd);
 		goto out;
 	}
 
-	bytes = write (shim_args_fd, &proxy_fd, sizeof (proxy_fd));
-	if (bytes < 0) {
-		g_critical ("failed to send proxy fd to shim child: %s",
-			strerror (errno));
-		goto out;
-	}
-
-	if (! cc_proxy_cmd_allocate_io(config->proxy,
-			&proxy_io_fd, &ioBase, config->oci.process.terminal)) {
-		goto out;
-	}
-
-	bytes = write (shim_args_fd, &ioBase, sizeof (ioBase));
-	if (bytes < 0) {
-		g_critical ("failed to send proxy ioBase to shim child: %s",
-			strerror (errno));
-		goto out;
-	}
-
-	/* send proxy IO fd to cc-shim child */
-	shim_socket_connection = cc_oci_socket_connection_from_fd(shim_socket_fd);
-	if (! shim_socket_connection) {
-		g_critical("failed to create a socket connection to send proxy IO fd");
-		goto out;
-	}
-
-	ret = g_unix_connection_send_fd (G_UNIX_CONNECTION (shim_socket_connection),
-		proxy_io_fd, NULL, &error);
-
-	if (! ret) {
-		g_critical("failed to send proxy IO fd");
+	/* send proxy fds and ioBase to cc-shim child */
+	if (! cc_shim_args_send (shim_args_fd, proxy_fd, proxy_io_fd,
+				ioBase, config->oci.process.terminal)) {
 		goto out;
 	}
 
@@ -1155,15 +1077,13 @@ child_failed:
 	close (shim_args_fd);
 	shim_args_fd = -1;
 
-	g_debug ("checking shim setup (blocking)");
+	cc_oci_launch_stage_end (&timing, CC_OCI_LAUNCH_SHIM_SETUP);
 
-	bytes = read (shim_err_fd,
-			buffer,
-			sizeof (buffer));
-	if (bytes > 0) {
-		g_critical ("shim setup failed");
-		ret = false;
-		goto out;
+	/* The workload of a restored VM is already running, so there
+	 * is nothing for "start" to do.
+	 */
+	if (config->restore_image) {
+		config->state.status = OCI_STATUS_RUNNING;
 	}
 
 	/* Recreate the state file now that all information is
@@ -1180,6 +1100,8 @@ child_failed:
 	/* wait for child to receive the expected SIGTRAP caused
 	 * by it calling exec() whilst under PTRACE control.
 	 */
+	trace_start = cc_oci_trace_now ();
+
 	if (waitpid (config->state.workload_pid,
 			&status, 0) != config->state.workload_pid) {
 		g_critical ("failed to wait for shim %d: %s",
@@ -1188,6 +1110,9 @@ child_failed:
 		goto out;
 	}
 
+	cc_oci_trace_end (CC_OCI_TRACE_LAUNCH, "shim-sigtrap-wait",
+			trace_start);
+
 	if (! WIFSTOPPED (status)) {
 		g_critical ("shim %d not stopped by signal",
 				config->state.workload_pid);
@@ -1201,9 +1126,11 @@ child_failed:
 	}
 
 	/* Stop tracing, but send a stop signal to the shim so that it
-	 * remains in a paused state.
+	 * remains in a paused state (unless the workload is already
+	 * running).
 	 */
-	if (ptrace (PTRACE_DETACH, config->state.workload_pid, NULL, SIGSTOP) < 0) {
+	if (ptrace (PTRACE_DETACH, config->state.workload_pid, NULL,
+				config->restore_image ? 0 : SIGSTOP) < 0) {
 		g_critical ("failed to ptrace detach in child %d: %s",
 				(int)config->state.workload_pid,
 				strerror (errno));
@@ -1223,10 +1150,14 @@ child_failed:
 	 * With this change docker WILL NOT create a new cgroup and WILL NOT copy
 	 * the workload pid to this new cgroup avoiding file descriptor leaks
 	 */
+	cc_oci_launch_stage_begin (&timing, CC_OCI_LAUNCH_CGROUPS);
+
 	if (! cc_oci_create_cgroups(config)) {
 		goto out;
 	}
 
+	cc_oci_launch_stage_end (&timing, CC_OCI_LAUNCH_CGROUPS);
+
 	/* Finally, create the pid file.
 	 *
 	 * This MUST be done after all setup since containerd
@@ -1241,24 +1172,14 @@ child_failed:
 		}
 	}
 out:
-	if (hypervisor_args_pipe[0] != -1) close (hypervisor_args_pipe[0]);
-	if (hypervisor_args_pipe[1] != -1) close (hypervisor_args_pipe[1]);
-	if (child_err_pipe[0] != -1) close (child_err_pipe[0]);
-	if (child_err_pipe[1] != -1) close (child_err_pipe[1]);
-	if (shim_err_fd != -1) close (shim_err_fd);
+	if (proxy_io_fd != -1) close (proxy_io_fd);
 	if (shim_args_fd != -1) close (shim_args_fd);
-	if (shim_socket_fd != -1) close (shim_socket_fd);
 
 	if (setup_networking) {
 		netlink_close (hndl);
 	}
 
-	if (args) {
-		g_strfreev (args);
-	}
-	if (additional_args) {
-		g_ptr_array_free(additional_args, TRUE);
-	}
+	cc_oci_launch_timing_report (&timing);
 
 	if ( !ret && config->state.workload_pid > 0 ) {
 		g_critical("killing shim with pid:%d",
@@ -1269,15 +1190,19 @@ out:
 	/* We have force killed the shim if it is running at this point,
 	 * kill the hypervisor as well.
 	 */
-	if ( !ret && pid > 0) {
+	if ( !ret && config->vm && config->vm->pid > 0) {
 		g_critical("killing VM forcefully with pid:%d",
-				pid);
-		if (kill(pid, SIGKILL) == -1) {
+				config->vm->pid);
+		if (kill(config->vm->pid, SIGKILL) == -1) {
 			g_critical("Could not kill VM : %s\n",
 				strerror(errno));
 		}
 	}
 
+	if (! ret) {
+		cc_proxy_unregister (config);
+	}
+
 	return ret;
 }
 
@@ -1318,8 +1243,15 @@ cc_run_hooks(GSList* hooks, const gchar* state_file_path,
 	}
 
 	for (i=g_slist_nth(hooks, 0); i; i=g_slist_next(i) ) {
+		gint64   trace_start = cc_oci_trace_now ();
+		gboolean hook_ret;
+
 		hook = (struct oci_cfg_hook*)i->data;
-		if ((!cc_run_hook(hook, container_state, length)) && stop_on_failure) {
+		hook_ret = cc_run_hook(hook, container_state, length);
+
+		cc_oci_trace_end (CC_OCI_TRACE_HOOK, hook->path, trace_start);
+
+		if ((!hook_ret) && stop_on_failure) {
 			goto exit;
 		}
 	}
@@ -1348,14 +1280,9 @@ cc_oci_exec_shim (struct cc_oci_config *config, int ioBase, int proxy_io_fd,
 		gboolean initial_workload) {
 
 	gboolean           ret = false;
-	GSocketConnection *shim_socket_connection = NULL;
 	int                shim_args_fd = -1;
-	int                shim_socket_fd = -1;
-	int                shim_err_fd = -1;
-	ssize_t            bytes;
-	char               err_buffer[2] = { '\0' };
 	int                proxy_fd = -1;
-	GError            *error = NULL;
+	gint64             trace_start;
 
 	if(! config){
 		return false;
@@ -1363,85 +1290,35 @@ cc_oci_exec_shim (struct cc_oci_config *config, int ioBase, int proxy_io_fd,
 
 	/* FIXME: Close proxy_fd before launch shim to avoid race conditions */
 
-	if (! cc_shim_launch (config, &shim_err_fd, &shim_args_fd,
-				&shim_socket_fd, initial_workload)) {
-		goto out;
-	}
+	trace_start = cc_oci_trace_now ();
 
-	/*
-	 * 1. The child blocks waiting for a write proxy fd to shim_args_fd.
-	*/
-	proxy_fd = g_socket_get_fd (config->proxy->socket);
-	if (proxy_fd < 0) {
-		g_critical ("invalid proxy fd: %d", proxy_fd);
+	if (! cc_shim_launch (config, &shim_args_fd, initial_workload)) {
 		goto out;
 	}
 
-	bytes = write (shim_args_fd, &proxy_fd, sizeof (proxy_fd));
-	if (bytes < 0) {
-		g_critical ("failed to send proxy fd to shim child: %s",
-			strerror (errno));
-		goto out;
-	}
-
-	/*
-	 * 2. The child blocks waiting for a write ioBase to shim_args_fd.
-	*/
+	cc_oci_trace_end (CC_OCI_TRACE_PHASE, "shim-launch", trace_start);
+	trace_start = cc_oci_trace_now ();
 
-	bytes = write (shim_args_fd, &ioBase, sizeof (ioBase));
-	if (bytes < 0) {
-		g_critical ("failed to send proxy ioBase to shim child: %s",
-			strerror (errno));
-		goto out;
-	}
-
-
-	/*
-	 * 3. The child blocks waiting for a write proxy IO fd to shim_socket_fd.
-	*/
 	proxy_fd = g_socket_get_fd (config->proxy->socket);
 	if (proxy_fd < 0) {
 		g_critical ("invalid proxy fd: %d", proxy_fd);
 		goto out;
 	}
 
-	/* send proxy IO fd to cc-shim child */
-	shim_socket_connection = cc_oci_socket_connection_from_fd(shim_socket_fd);
-	if (! shim_socket_connection) {
-		g_critical("failed to create a socket connection to send proxy IO fd");
+	/* send proxy fds and ioBase to cc-shim child */
+	if (! cc_shim_args_send (shim_args_fd, proxy_fd, proxy_io_fd,
+				ioBase, config->oci.process.terminal)) {
 		goto out;
 	}
 
-	if (! g_unix_connection_send_fd (
-				G_UNIX_CONNECTION (shim_socket_connection),
-				proxy_io_fd, NULL, &error) ) {
-
-		g_critical("failed to send proxy IO fd");
-		goto out;
-	}
-	/*
-	 * Finally. Check if an error happend
-	*/
-	bytes = read (shim_err_fd,
-			err_buffer,
-			sizeof (err_buffer));
-	if (bytes > 0) {
-		g_critical ("shim setup failed");
-		goto out;
-	}
+	cc_oci_trace_end (CC_OCI_TRACE_PHASE, "shim-setup", trace_start);
 
 	ret = true;
 out:
-	if (shim_err_fd != -1) {
-		close (shim_err_fd);
-	}
 	if (shim_args_fd != -1) {
 		close (shim_args_fd);
 	}
-	if (shim_socket_fd != -1) {
-		close (shim_socket_fd);
-	}
-	if (! ret) {
+	if (! ret && config->state.workload_pid > 0) {
 		g_critical ("killing shim with pid:%d", config->state.workload_pid);
 		kill (config->state.workload_pid, SIGTERM);
 	}
@@ -1482,6 +1359,7 @@ cc_oci_vm_connect (struct cc_oci_config *config)
 	int         proxy_io_fd = -1;
 	gint        exit_code = -1;
 	const gchar *container_id;
+	gint64      trace_start;
 
 	if(! config){
 		goto out;
@@ -1535,8 +1413,13 @@ cc_oci_vm_connect (struct cc_oci_config *config)
 				&exit_code);
 
 		/* wait for child to finish */
+		trace_start = cc_oci_trace_now ();
+
 		g_main_loop_run (main_loop);
 
+		cc_oci_trace_end (CC_OCI_TRACE_PHASE, "workload-wait",
+				trace_start);
+
 		g_debug ("child pid %u exited with code %d",
 				(unsigned )config->state.workload_pid, (int)exit_code);
 
@@ -28,12 +28,26 @@ gboolean cc_run_hooks(GSList* hooks, const gchar* state_file_path,
 
 gboolean cc_oci_vm_connect (struct cc_oci_config *config);
 
+/** Arguments sent to \ref CC_OCI_SHIM by cc_shim_args_send().
+ *
+ * The message also carries (as \c SCM_RIGHTS ancillary data) the
+ * socket connected to the proxy followed by the proxy I/O fd.
+ */
+struct cc_shim_args {
+	/** Sequence number for stdin and stdout. */
+	guint64 io_seq_no;
+
+	/** Sequence number for stderr (\c 0 if a terminal is used). */
+	guint64 err_seq_no;
+};
+
 gboolean cc_shim_launch (struct cc_oci_config *config,
-			int *child_err_fd,
 			int *shim_args_fd,
-			int *shim_socket_fd,
 			gboolean initial_workload);
 
+gboolean cc_shim_args_send (int shim_args_fd, int proxy_fd,
+			int proxy_io_fd, int ioBase, gboolean terminal);
+
 GSocketConnection *cc_oci_socket_connection_from_fd (int fd);
 
 #endif /* _CC_OCI_PROCESS_H */
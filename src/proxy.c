@@ -20,7 +20,10 @@
 
 #include <string.h>
 #include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <arpa/inet.h>
 #include <gio/gunixsocketaddress.h>
 #include "oci.h"
@@ -31,35 +34,28 @@
 #include "util.h"
 #include "networking.h"
 #include "command.h"
+#include "trace.h"
+#include "ready.h"
 
 extern struct start_data start_data;
 
-struct watcher_proxy_data
-{
-	GMainLoop   *loop;
-	GIOChannel  *channel;
-	gchar       *msg_to_send;
-	GString     *msg_received;
-	int          socket_fd;
-	/**
-	 * Indicates that we expect an out-of-band file descriptor
-	 * from proxy socket.
-	 */
-	int         *oob_fd;
-};
-
-/** Format of a proxy message */
-struct proxy_msg {
-	/** Number of bytes in payload. */
+/** Header of a proxy message */
+struct proxy_msg_header {
+	/** Number of bytes in payload (big endian). */
 	guint32  length;
 
-	/** Not used. */
-	guint32  reserved;
-
-	/** Message payload (JSON). */
-	gchar   *data;
+	/** Flags (unused). */
+	guint32  flags;
 };
 
+/**
+ * The proxy sends back very small messages usually just a:
+ *    '{"status":"success"}'
+ * The biggest response is from a batch, which holds the response
+ * of each of its commands, so 4k is quite a high boundary.
+ */
+#define CC_PROXY_MSG_MAX_LENGTH 4096
+
 /**
  * Free resources associated with \p proxy.
  *
@@ -221,11 +217,239 @@ out:
 	return ret;
 }
 
+/** Maximum number of attached connections to keep. */
+#define CC_PROXY_CONN_CACHE_MAX 64
+
+/** Connections attached to a container (keyed by proxy socket path
+ * and container id), or \c NULL if connections are not kept.
+ */
+static GHashTable *cc_proxy_conns;
+
+/**
+ * Keep connections attached to a container for reuse.
+ *
+ * This saves connecting to the proxy and attaching to the VM for
+ * each command a long-running process (such as the daemon) runs
+ * for the same container.
+ */
+void
+cc_proxy_conn_cache_enable (void)
+{
+	if (cc_proxy_conns) {
+		return;
+	}
+
+	cc_proxy_conns = g_hash_table_new_full (g_str_hash, g_str_equal,
+			g_free, g_object_unref);
+}
+
+/**
+ * Create the key used for connections attached to \p container_id.
+ *
+ * \param container_id container id.
+ *
+ * \return Newly-allocated string.
+ */
+static gchar *
+cc_proxy_conn_key (const gchar *container_id)
+{
+	return g_strdup_printf ("%s:%s",
+			start_data.proxy_socket_path
+			? start_data.proxy_socket_path
+			: CC_OCI_PROXY_SOCKET,
+			container_id);
+}
+
+/**
+ * Determine if a kept connection can no longer be used.
+ *
+ * An idle connection has nothing to read unless the proxy has
+ * closed it.
+ *
+ * \param key Unused.
+ * \param socket \c GSocket.
+ * \param user_data Unused.
+ *
+ * \return \c true if \p socket is unusable, else \c false.
+ */
+static gboolean
+cc_proxy_conn_stale (gpointer key, GSocket *socket, gpointer user_data)
+{
+	(void)key;
+	(void)user_data;
+
+	return g_socket_condition_check (socket,
+			G_IO_IN | G_IO_HUP | G_IO_ERR) != 0;
+}
+
+/**
+ * Reuse a connection previously attached to \p container_id.
+ *
+ * \param proxy \ref cc_proxy (which must not be connected).
+ * \param container_id container id.
+ *
+ * \return \c true if \p proxy is now connected and attached,
+ * else \c false.
+ */
+static gboolean
+cc_proxy_conn_take (struct cc_proxy *proxy, const gchar *container_id)
+{
+	g_autofree gchar  *key = NULL;
+	GSocket           *socket;
+
+	if (! cc_proxy_conns || cc_proxy_connected (proxy)) {
+		return false;
+	}
+
+	key = cc_proxy_conn_key (container_id);
+
+	socket = g_hash_table_lookup (cc_proxy_conns, key);
+	if (! socket) {
+		return false;
+	}
+
+	g_object_ref (socket);
+	(void)g_hash_table_remove (cc_proxy_conns, key);
+
+	if (cc_proxy_conn_stale (NULL, socket, NULL)) {
+		g_debug ("discarding stale proxy connection for %s",
+				container_id);
+		g_object_unref (socket);
+		return false;
+	}
+
+	g_debug ("reusing proxy connection for %s", container_id);
+
+	proxy->socket = socket;
+
+	return true;
+}
+
+/**
+ * Keep the connection of \p proxy (attached to \p container_id)
+ * for reuse.
+ *
+ * \param proxy \ref cc_proxy.
+ * \param container_id container id.
+ *
+ * \return \c true if the connection was kept (and \p proxy is no
+ * longer connected), else \c false.
+ */
+static gboolean
+cc_proxy_conn_put (struct cc_proxy *proxy, const gchar *container_id)
+{
+	if (! (cc_proxy_conns && cc_proxy_connected (proxy))) {
+		return false;
+	}
+
+	if (g_hash_table_size (cc_proxy_conns) >= CC_PROXY_CONN_CACHE_MAX) {
+		(void)g_hash_table_foreach_remove (cc_proxy_conns,
+				(GHRFunc)cc_proxy_conn_stale, NULL);
+	}
+
+	if (g_hash_table_size (cc_proxy_conns) >= CC_PROXY_CONN_CACHE_MAX) {
+		g_hash_table_remove_all (cc_proxy_conns);
+	}
+
+	g_hash_table_replace (cc_proxy_conns,
+			cc_proxy_conn_key (container_id), proxy->socket);
+
+	proxy->socket = NULL;
+
+	return true;
+}
+
+/**
+ * Wait for the proxy socket to be ready.
+ *
+ * \param fd proxy socket.
+ * \param events \c poll(2) events to wait for.
+ * \param deadline monotonic time (in microseconds) after which to
+ *   give up.
+ *
+ * \return \c true if \p fd is ready (or in error, which the next
+ * read or write reports), else \c false.
+ */
+static gboolean
+cc_proxy_poll (int fd, short events, gint64 deadline)
+{
+	struct pollfd pfd = { .fd = fd, .events = events };
+	gint64 now;
+	int ret;
+
+	while (1) {
+		now = g_get_monotonic_time ();
+		if (now >= deadline) {
+			g_critical ("timed out waiting for proxy");
+			return false;
+		}
+
+		ret = poll (&pfd, 1, (int)((deadline - now + 999) / 1000));
+		if (ret < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			g_critical ("failed to poll proxy socket: %s",
+					strerror (errno));
+			return false;
+		}
+
+		if (ret > 0) {
+			return true;
+		}
+	}
+}
+
+/**
+ * Read exactly \p len bytes from the proxy's socket.
+ *
+ * \param fd proxy socket.
+ * \param buf buffer to read into.
+ * \param len number of bytes to read.
+ * \param deadline monotonic time (in microseconds) after which to
+ *   give up.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+cc_proxy_read_full (int fd, void *buf, size_t len, gint64 deadline)
+{
+	size_t total = 0;
+	ssize_t bytes_read;
+
+	while (total < len) {
+		if (! cc_proxy_poll (fd, POLLIN, deadline)) {
+			return false;
+		}
+
+		bytes_read = recv (fd, (char *)buf + total, len - total, 0);
+		if (bytes_read < 0) {
+			if (errno == EAGAIN || errno == EINTR) {
+				continue;
+			}
+			g_critical ("lost proxy connection: %s",
+					strerror (errno));
+			return false;
+		}
+
+		if (bytes_read == 0) {
+			g_critical ("lost proxy connection: EOF");
+			return false;
+		}
+
+		total += (size_t)bytes_read;
+	}
+
+	return true;
+}
+
 /**
  * Read a file descriptor from the proxy's socket.
  *
  * \param proxy_fd the fd of the proxy socket
  * \param fd fd read out of proxy_fd (out parameter)
+ * \param deadline monotonic time (in microseconds) after which to
+ *   give up.
  *
  * The proxy can send fds through OOB data after a successful reply of certain
  * payloads. proxy will send us a 1 byte dummy message containing 'F'
@@ -234,7 +458,7 @@ out:
  * \return \c true on success, \c false otherwise.
  */
 static gboolean
-cc_proxy_receive_fd(int proxy_fd, int *fd)
+cc_proxy_receive_fd(int proxy_fd, int *fd, gint64 deadline)
 {
 	struct msghdr msg = { 0 };
 	gchar iov_buffer[1] = { 0 };
@@ -243,7 +467,6 @@ cc_proxy_receive_fd(int proxy_fd, int *fd)
 	char ctl_buffer[CMSG_SPACE(sizeof(int))];
 	struct cmsghdr *cmsg = NULL;
 	ssize_t bytes_read;
-	unsigned char *data;
 
 	msg.msg_iov = &io;
 	msg.msg_iovlen = 1;
@@ -251,6 +474,10 @@ cc_proxy_receive_fd(int proxy_fd, int *fd)
 	msg.msg_controllen = sizeof(ctl_buffer);
 
 	while (1) {
+		if (! cc_proxy_poll (proxy_fd, POLLIN, deadline)) {
+			return false;
+		}
+
 		bytes_read = recvmsg(proxy_fd, &msg, 0);
 		if (bytes_read < 0 && (errno == EAGAIN || errno == EINTR)) {
 			continue;
@@ -274,19 +501,20 @@ cc_proxy_receive_fd(int proxy_fd, int *fd)
 		return false;
 	}
 
-	cmsg = CMSG_FIRSTHDR(&msg);
-	if (!cmsg) {
-		g_critical("could not read the control message");
+	if (msg.msg_flags & MSG_CTRUNC) {
+		g_critical("control message truncated");
 		return false;
 	}
 
-	data = CMSG_DATA(cmsg);
-	if (!data) {
-		g_critical("missing out of band data");
+	cmsg = CMSG_FIRSTHDR(&msg);
+	if (! (cmsg && cmsg->cmsg_level == SOL_SOCKET
+				&& cmsg->cmsg_type == SCM_RIGHTS
+				&& cmsg->cmsg_len == CMSG_LEN(sizeof(int)))) {
+		g_critical("could not read the control message");
 		return false;
 	}
 
-	*fd = *((int*) data);
+	memcpy (fd, CMSG_DATA(cmsg), sizeof(int));
 
 	g_message("received fd from proxy %d", *fd);
 
@@ -296,183 +524,119 @@ cc_proxy_receive_fd(int proxy_fd, int *fd)
 /**
  * Read a message from proxy's socket.
  *
- * \param source GIOChannel.
- * \param condition GIOCondition.
- * \param proxy_data struct watcher_proxy_data.
+ * The payload is read straight into \p msg_received, whose
+ * allocation is reused from one message to the next.
+ *
+ * \param fd proxy socket.
+ * \param msg_received \c GString holding the payload on return.
+ * \param deadline monotonic time (in microseconds) after which to
+ *   give up.
  *
  * \return \c true on success, else \c false.
  */
 static gboolean
-cc_proxy_msg_read (GIOChannel *source, GIOCondition condition,
-	struct watcher_proxy_data *proxy_data)
+cc_proxy_msg_read (int fd, GString *msg_received, gint64 deadline)
 {
-	ssize_t bytes_read, total_bytes_read = 0;
+	struct proxy_msg_header header;
 	size_t payload_length;
-	guint8 header[MESSAGE_HEADER_LENGTH] = { 0 };
-	gchar buf[LINE_MAX];
 
-	/*
-	 * Start by reading the message header and the payload length.
-	 */
-	bytes_read = read(proxy_data->socket_fd, header, sizeof(header));
-	if (bytes_read <= 0) {
-		g_critical("couldn't read header from proxy: %s",
-			   strerror(errno));
-		goto out;
+	if (! cc_proxy_read_full (fd, &header, sizeof (header),
+				deadline)) {
+		g_critical("couldn't read header from proxy");
+		return false;
 	}
 
-	payload_length = cc_oci_get_big_endian_32 (header);
-	g_debug ("proxy msg length: %ld", payload_length);
+	payload_length = ntohl (header.length);
+	g_debug ("proxy msg length: %zu", payload_length);
 
-	/*
-	 * The proxy sends back very small messages usually just a:
-	 *    '{"status":"success"}'
-	 * The biggest response is from allocateIO that adds an ioBase field,
-	 * so 1k is quite a high boundary.
-	 */
-	if (payload_length > 1024) {
+	if (payload_length > CC_PROXY_MSG_MAX_LENGTH) {
 		g_critical("received bogus payload length");
-		goto out;
+		return false;
 	}
 
-	/*
-	 * Read the payload
-	 */
-	while(total_bytes_read < payload_length) {
-		bytes_read = read(proxy_data->socket_fd, buf,
-				  payload_length - (size_t)total_bytes_read);
-		if (bytes_read <= 0) {
-			/* Continue if we're missing some bytes */
-			if (errno == EAGAIN || errno == EINTR) {
-				continue;
-			}
-			g_critical("lost proxy connection: %s",
-				   strerror(errno));
-			break;
-		}
-
-		g_string_append_len(proxy_data->msg_received, buf, bytes_read);
+	g_string_set_size (msg_received, payload_length);
 
-		total_bytes_read += bytes_read;
+	if (! cc_proxy_read_full (fd, msg_received->str, payload_length,
+				deadline)) {
+		g_string_truncate (msg_received, 0);
+		return false;
 	}
 
-	if (proxy_data->msg_received->len > 0) {
+	if (msg_received->len > 0) {
 		g_debug("message read from proxy socket: %s",
-			proxy_data->msg_received->str);
+			msg_received->str);
 	}
 
-out:
-	g_main_loop_quit (proxy_data->loop);
-
-	/* Unregister this watcher */
-	return false;
+	return true;
 }
 
 /**
  * Write down a message into proxy's socket.
  *
- * \param source GIOChannel.
- * \param condition GIOCondition.
- * \param proxy_data struct watcher_proxy_data.
+ * The header and payload are sent with a single \c sendmsg(2) call
+ * (short writes aside).
+ *
+ * \param fd proxy socket.
+ * \param msg_to_send JSON payload.
+ * \param deadline monotonic time (in microseconds) after which to
+ *   give up.
  *
  * \return \c true on success, else \c false.
  */
 static gboolean
-cc_proxy_msg_write (GIOChannel *source, GIOCondition condition,
-	struct watcher_proxy_data *proxy_data)
+cc_proxy_msg_write (int fd, const gchar *msg_to_send, gint64 deadline)
 {
-	gsize bytes_written = 0;
-	gsize len = 0;
-	GIOStatus status;
-	GError *error = NULL;
-	struct proxy_msg msg = { 0 };
+	struct proxy_msg_header header = { 0 };
+	struct iovec iov[2];
+	struct msghdr msg = { 0 };
+	size_t len;
+	ssize_t bytes_written;
 
-	if (condition == G_IO_HUP) {
-		g_io_channel_unref(source);
-		goto out;
-	}
+	len = strlen (msg_to_send);
 
-	len = (gsize)g_utf8_strlen(proxy_data->msg_to_send, -1);
+	header.length = htonl ((guint32)len);
 
-	msg.length = htonl ((guint32)len);
-	msg.data = proxy_data->msg_to_send;
+	iov[0].iov_base = &header;
+	iov[0].iov_len = sizeof (header);
+	iov[1].iov_base = (void *)msg_to_send;
+	iov[1].iov_len = len;
 
-	g_debug ("sending message (length %lu) to proxy socket",
-			(unsigned long int)len);
+	msg.msg_iov = iov;
+	msg.msg_iovlen = 2;
 
-	do {
-		status = g_io_channel_write_chars(source,
-				(const gchar *)&msg,
-				(gssize)sizeof (msg.length) +
-				sizeof (msg.reserved),
-				&bytes_written,
-				&error);
-	} while (status == G_IO_STATUS_AGAIN);
+	g_debug("writing message data to proxy socket: %s", msg_to_send);
 
-	if (status == G_IO_STATUS_ERROR) {
-		g_debug ("proxy message length write failed: %s",
-				error->message);
-		g_error_free (error);
-		goto out;
-	}
-
-	g_debug("writing message data to proxy socket: %s",
-			proxy_data->msg_to_send);
-
-	do {
-		status = g_io_channel_write_chars(source,
-				proxy_data->msg_to_send,
-				(gssize)len,
-				&bytes_written,
-				&error);
-	} while (status == G_IO_STATUS_AGAIN);
+	while (msg.msg_iovlen > 0) {
+		if (! cc_proxy_poll (fd, POLLOUT, deadline)) {
+			return false;
+		}
 
-	if (status == G_IO_STATUS_ERROR) {
-		g_debug ("proxy write failed: %s", error->message);
-		g_error_free (error);
-		goto out;
-	}
+		bytes_written = sendmsg (fd, &msg, MSG_NOSIGNAL);
+		if (bytes_written < 0) {
+			if (errno == EAGAIN || errno == EINTR) {
+				continue;
+			}
+			g_critical ("proxy write failed: %s",
+					strerror (errno));
+			return false;
+		}
 
-	do {
-		status = g_io_channel_flush (source, &error);
-	} while (status == G_IO_STATUS_AGAIN);
+		/* skip what has been written */
+		while (msg.msg_iovlen > 0 &&
+				(size_t)bytes_written >= msg.msg_iov->iov_len) {
+			bytes_written -= (ssize_t)msg.msg_iov->iov_len;
+			msg.msg_iov++;
+			msg.msg_iovlen--;
+		}
 
-	if (status == G_IO_STATUS_ERROR) {
-		g_debug ("proxy flush failed: %s",
-		    error->message);
-		g_error_free (error);
-		goto out;
+		if (msg.msg_iovlen > 0) {
+			msg.msg_iov->iov_base =
+				(char *)msg.msg_iov->iov_base + bytes_written;
+			msg.msg_iov->iov_len -= (size_t)bytes_written;
+		}
 	}
 
-	/* Now we've sent the initial negotiation message,
-	 * register a handler to wait for a reply.
-	 */
-	g_io_add_watch(source, G_IO_IN | G_IO_HUP,
-	    (GIOFunc)cc_proxy_msg_read, proxy_data);
-
-out:
-	/* unregister this watcher */
-	return false;
-}
-/**
- * Callback used to monitor CTL socket creation
- *
- * \param monitor GFileMonitor.
- * \param file GFile.
- * \param other_file GFile.
- * \param event_type GFileMonitorEvent.
- * \param loop GMainLoop.
- */
-static void
-cc_proxy_ctl_socket_created_callback(GFileMonitor *monitor, GFile *file,
-	GFile *other_file, GFileMonitorEvent event_type, GMainLoop *loop)
-{
-	(void)monitor;
-	(void)file;
-	(void)other_file;
-
-	g_debug("CTL created event: %d", event_type);
-	g_main_loop_quit(loop);
+	return true;
 }
 
 /**
@@ -539,62 +703,72 @@ out:
 	return ret;
 }
 
+/**
+ * Determine how long to wait for commands that wait for the VM to be
+ * ready.
+ *
+ * \return Timeout in milliseconds.
+ */
+static gint
+cc_proxy_ready_timeout (void)
+{
+	return start_data.ready_timeout
+		? start_data.ready_timeout
+		: CC_OCI_READY_DEFAULT_TIMEOUT;
+}
+
 /**
  * Run any command via the \ref CC_OCI_PROXY.
  *
+ * The request is written and the response read synchronously on the
+ * (blocking) proxy socket, the whole exchange having to complete
+ * within \p timeout.
+ *
  * \param proxy \ref cc_proxy.
+ * \param name Name of the command (for tracing).
  * \param msg_to_send gchar.
  * \param msg_received GString.
  * \param oob_fd int.
+ * \param timeout Maximum time (in milliseconds) the command can take.
  *
  * \return \c true on success, else \c false.
  */
 static gboolean
 cc_proxy_run_cmd(struct cc_proxy *proxy,
+		const gchar *name,
 		gchar *msg_to_send,
 		GString* msg_received,
-		int *oob_fd)
+		int *oob_fd,
+		gint timeout)
 {
-	GIOChannel        *channel = NULL;
-	struct watcher_proxy_data proxy_data;
 	gboolean ret = false;
 	gboolean hyper_result = false;
+	gint64   trace_start;
+	gint64   deadline;
+	int      fd;
 
 	if (! (proxy && msg_to_send && msg_received)) {
 		return false;
 	}
 
+	trace_start = cc_oci_trace_now ();
+
 	if (! proxy->socket) {
 		g_critical ("no proxy connection");
-		return false;
-	}
-
-	proxy_data.loop = g_main_loop_new (NULL, false);
-
-	proxy_data.msg_to_send = msg_to_send;
-
-	proxy_data.oob_fd = oob_fd;
-
-	proxy_data.socket_fd = g_socket_get_fd (proxy->socket);
-
-	channel = g_io_channel_unix_new(proxy_data.socket_fd);
-	if (! channel) {
-		g_critical("failed to create I/O channel");
 		goto out;
 	}
 
-	g_io_channel_set_encoding (channel, NULL, NULL);
-
-	proxy_data.msg_received = msg_received;
+	fd = g_socket_get_fd (proxy->socket);
 
-	/* add a watcher for proxy's socket stdin */
-	g_io_add_watch(channel, G_IO_OUT | G_IO_HUP,
-	    (GIOFunc)cc_proxy_msg_write, &proxy_data);
+	deadline = g_get_monotonic_time () + (gint64)timeout * 1000;
 
 	g_debug ("communicating with proxy");
 
-	/* waiting for proxy response */
-	g_main_loop_run(proxy_data.loop);
+	if (! (cc_proxy_msg_write (fd, msg_to_send, deadline)
+			&& cc_proxy_msg_read (fd, msg_received, deadline))) {
+		g_critical ("failed to run proxy command %s", name);
+		goto out_broken;
+	}
 
 	if (! cc_proxy_hyper_check_response (msg_received,
 			&hyper_result)) {
@@ -609,22 +783,62 @@ cc_proxy_run_cmd(struct cc_proxy *proxy,
 	 * succeeded, we can now read it.
 	 */
 	if (oob_fd && ret == true) {
-		gboolean fd_received;
-
-		fd_received = cc_proxy_receive_fd(proxy_data.socket_fd, oob_fd);
-		if (!fd_received) {
+		if (! cc_proxy_receive_fd(fd, oob_fd, deadline)) {
 			g_critical ("failed to receive fd");
 			ret = false;
+			goto out_broken;
 		}
 	}
 
+	cc_oci_trace_end (CC_OCI_TRACE_PROXY, name, trace_start);
+
 out:
-	g_main_loop_unref (proxy_data.loop);
-	g_free (proxy_data.msg_to_send);
-	if (channel) {
-		g_io_channel_unref(channel);
-	}
+	g_free (msg_to_send);
 	return ret;
+
+out_broken:
+	/* Part of a message may be left on the connection, so it can't
+	 * be used any more. Shutting it down also makes it look stale
+	 * to the connection cache.
+	 */
+	(void)shutdown (fd, SHUT_RDWR);
+	g_free (msg_to_send);
+	return false;
+}
+
+/**
+ * Create the data of a hello command.
+ *
+ * \param proxy \ref cc_proxy.
+ * \param container_id container id.
+ * \param restore \c true if the VM was restored from a checkpoint or
+ *   cloned from a template (and so will not announce it is ready).
+ *
+ * \return \c JsonObject.
+ */
+static JsonObject *
+cc_proxy_hello_data (struct cc_proxy *proxy, const char *container_id,
+		gboolean restore)
+{
+	JsonObject *data = json_object_new ();
+
+	json_object_set_string_member (data, "containerId",
+			container_id);
+
+	json_object_set_string_member (data, "ctlSerial",
+			proxy->agent_ctl_socket);
+
+	json_object_set_string_member (data, "ioSerial",
+			proxy->agent_tty_socket);
+
+	json_object_set_string_member (data, "console",
+			proxy->vm_console_socket);
+
+	if (restore) {
+		json_object_set_boolean_member (data, "restore", true);
+	}
+
+	return data;
 }
 
 /**
@@ -633,14 +847,16 @@ out:
  *
  * \param proxy \ref cc_proxy.
  * \param container_id container id.
+ * \param restore \c true if the VM was restored from a checkpoint or
+ *   cloned from a template (and so will not announce it is ready).
  *
  * \return \c true on success, else \c false.
  */
 static gboolean
-cc_proxy_cmd_hello (struct cc_proxy *proxy, const char *container_id)
+cc_proxy_cmd_hello (struct cc_proxy *proxy, const char *container_id,
+		gboolean restore)
 {
 	JsonObject        *obj = NULL;
-	JsonObject        *data = NULL;
 	JsonNode          *root = NULL;
 	JsonGenerator     *generator = NULL;
 	gchar             *msg_to_send = NULL;
@@ -657,21 +873,94 @@ cc_proxy_cmd_hello (struct cc_proxy *proxy, const char *container_id)
 	}
 
 	obj = json_object_new ();
-	data = json_object_new ();
 
 	json_object_set_string_member (obj, "id", proxy_cmd);
 
-	json_object_set_string_member (data, "containerId",
-			container_id);
+	json_object_set_object_member (obj, "data",
+			cc_proxy_hello_data (proxy, container_id, restore));
 
-	json_object_set_string_member (data, "ctlSerial",
-			proxy->agent_ctl_socket);
+	root = json_node_new (JSON_NODE_OBJECT);
+	generator = json_generator_new ();
+	json_node_take_object (root, obj);
 
-	json_object_set_string_member (data, "ioSerial",
-			proxy->agent_tty_socket);
+	json_generator_set_root (generator, root);
+	g_object_set (generator, "pretty", FALSE, NULL);
 
-	json_object_set_string_member (data, "console",
-			proxy->vm_console_socket);
+	msg_to_send = json_generator_to_data (generator, NULL);
+
+	msg_received = g_string_new("");
+
+	if (! msg_received ) {
+		goto out;
+	}
+
+	if (! cc_proxy_run_cmd(proxy, proxy_cmd, msg_to_send, msg_received, NULL,
+			cc_proxy_ready_timeout ())) {
+		g_critical("failed to run proxy command %s: %s",
+				proxy_cmd,
+				msg_received->str);
+		goto out;
+	}
+
+	ret = true;
+
+	g_debug("msg received: %s", msg_received->str);
+
+out:
+	if (msg_received) {
+		g_string_free(msg_received, true);
+	}
+	if (obj) {
+		json_object_unref (obj);
+	}
+
+	return ret;
+}
+
+/**
+ * Hand the VM over to the proxy as soon as the hypervisor has been
+ * started.
+ *
+ * The proxy connects to the agent sockets and waits for hyperstart to
+ * be ready in the background, so the VM boots whilst the runtime
+ * carries on setting the container up. The hello sent later binds to
+ * the registered VM.
+ *
+ * \param config \ref cc_oci_config.
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+cc_proxy_cmd_register (struct cc_oci_config *config)
+{
+	JsonObject        *obj = NULL;
+	JsonObject        *data = NULL;
+	JsonNode          *root = NULL;
+	JsonGenerator     *generator = NULL;
+	gchar             *msg_to_send = NULL;
+	GString           *msg_received = NULL;
+	gboolean           ret = false;
+
+	const gchar       *proxy_cmd = "register";
+
+	if (! (config && config->proxy && config->proxy->socket
+				&& config->optarg_container_id)) {
+		return false;
+	}
+
+	/* Same data as the hello, plus the time the proxy can wait for
+	 * the VM.
+	 */
+	data = cc_proxy_hello_data (config->proxy,
+			config->optarg_container_id,
+			config->restore_image || config->vm_template);
+
+	json_object_set_int_member (data, "timeout",
+			cc_proxy_ready_timeout ());
+
+	obj = json_object_new ();
+
+	json_object_set_string_member (obj, "id", proxy_cmd);
 
 	json_object_set_object_member (obj, "data", data);
 
@@ -690,13 +979,15 @@ cc_proxy_cmd_hello (struct cc_proxy *proxy, const char *container_id)
 		goto out;
 	}
 
-	if (! cc_proxy_run_cmd(proxy, msg_to_send, msg_received, NULL)) {
-		g_critical("failed to run proxy command %s: %s",
+	if (! cc_proxy_run_cmd(config->proxy, proxy_cmd, msg_to_send,
+				msg_received, NULL, CC_PROXY_CMD_TIMEOUT)) {
+		g_debug ("failed to run proxy command %s: %s",
 				proxy_cmd,
 				msg_received->str);
 		goto out;
 	}
 
+	config->proxy->registered = true;
 	ret = true;
 
 	g_debug("msg received: %s", msg_received->str);
@@ -712,6 +1003,37 @@ out:
 	return ret;
 }
 
+/**
+ * Make the proxy forget a VM registered by \ref cc_proxy_cmd_register
+ * when the container fails to be created (so that "delete" won't
+ * send the bye).
+ *
+ * \param config \ref cc_oci_config.
+ */
+void
+cc_proxy_unregister (struct cc_oci_config *config)
+{
+	if (! (config && config->proxy && config->proxy->registered)) {
+		return;
+	}
+
+	/* The bye needs a connection of its own */
+	if (cc_proxy_connected (config->proxy)) {
+		cc_proxy_disconnect (config->proxy);
+	}
+
+	if (! cc_proxy_cmd_bye (config->proxy, config->optarg_container_id)) {
+		g_warning ("failed to unregister VM %s from proxy",
+				config->optarg_container_id);
+	}
+
+	if (cc_proxy_connected (config->proxy)) {
+		cc_proxy_disconnect (config->proxy);
+	}
+
+	config->proxy->registered = false;
+}
+
 /**
  * Attach current proxy connection to a
  * previous registered VM (hello command)
@@ -767,7 +1089,8 @@ cc_proxy_attach (struct cc_proxy *proxy, const char *container_id)
 		goto out;
 	}
 
-	if (! cc_proxy_run_cmd(proxy, msg_to_send, msg_received, NULL)) {
+	if (! cc_proxy_run_cmd(proxy, proxy_cmd, msg_to_send, msg_received, NULL,
+			CC_PROXY_CMD_TIMEOUT)) {
 		g_critical("failed to run proxy command %s: %s",
 				proxy_cmd,
 				msg_received->str);
@@ -839,30 +1162,90 @@ cc_proxy_cmd_bye (struct cc_proxy *proxy, const char *container_id)
 
 	msg_to_send = json_generator_to_data (generator, NULL);
 
-	msg_received = g_string_new ("");
+	msg_received = g_string_new ("");
+
+	if (! msg_received ) {
+		goto out;
+	}
+
+	if (! cc_proxy_run_cmd(proxy, proxy_cmd, msg_to_send, msg_received, NULL,
+			CC_PROXY_CMD_TIMEOUT)) {
+		g_critical ("failed to run proxy command %s: %s",
+				proxy_cmd,
+				msg_received->str);
+		goto out;
+	}
+
+	ret = true;
+
+	g_debug("msg received: %s", msg_received->str);
+
+out:
+	if (msg_received) {
+		g_string_free(msg_received, true);
+	}
+	if (obj) {
+		json_object_unref (obj);
+	}
+
+	return ret;
+}
+
+/**
+ * Create the data of an allocateIO command.
+ *
+ * \param tty \c true if the workload is connected to a terminal.
+ *
+ * \return \c JsonObject.
+ */
+static JsonObject *
+cc_proxy_allocate_io_data (bool tty)
+{
+	JsonObject *data = json_object_new ();
+
+	/* If run interactively, allocate just 1 stream since
+	 * stdout and stderr are both connected to the terminal
+	 */
+	if (tty) {
+		json_object_set_int_member (data, "nStreams", 1);
+	} else {
+		json_object_set_int_member (data, "nStreams",
+			IO_STREAMS_NUMBER);
+	}
+
+	return data;
+}
+
+/**
+ * Read the ioBase returned by an allocateIO command.
+ *
+ * \param reader \c JsonReader positioned on the proxy response.
+ * \param[out] ioBase first I/O stream sequence number.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+cc_proxy_read_io_base (JsonReader *reader, int *ioBase)
+{
+	gboolean ret;
 
-	if (! msg_received ) {
+	ret = json_reader_read_member (reader, "data");
+	if (! ret) {
+		g_critical ("failed to find proxy data");
 		goto out;
 	}
 
-	if (! cc_proxy_run_cmd(proxy, msg_to_send, msg_received, NULL)) {
-		g_critical ("failed to run proxy command %s: %s",
-				proxy_cmd,
-				msg_received->str);
+	ret = json_reader_read_member (reader, "ioBase");
+	if (! ret) {
+		g_critical ("failed to find ioBase");
 		goto out;
 	}
 
-	ret = true;
-
-	g_debug("msg received: %s", msg_received->str);
+	*ioBase = (int) json_reader_get_int_value(reader);
 
 out:
-	if (msg_received) {
-		g_string_free(msg_received, true);
-	}
-	if (obj) {
-		json_object_unref (obj);
-	}
+	json_reader_end_member (reader);
+	json_reader_end_member (reader);
 
 	return ret;
 }
@@ -881,7 +1264,6 @@ cc_proxy_cmd_allocate_io (struct cc_proxy *proxy,
 	bool tty)
 {
 	JsonObject        *obj = NULL;
-	JsonObject        *data = NULL;
 	JsonNode          *root = NULL;
 	JsonGenerator     *generator = NULL;
 	gchar             *msg_to_send = NULL;
@@ -892,28 +1274,17 @@ cc_proxy_cmd_allocate_io (struct cc_proxy *proxy,
 	JsonReader        *reader = NULL;
 
 	const gchar       *proxy_cmd = "allocateIO";
-	int n_streams = IO_STREAMS_NUMBER;
 
 	if (! proxy) {
 		return false;
 	}
 
 	obj = json_object_new ();
-	data = json_object_new ();
 
 	json_object_set_string_member (obj, "id", proxy_cmd);
 
-	/* If run interactively, allocate just 1 stream since
-	 * stdout and stderr are both connected to the terminal
-	 */
-	if (tty) {
-		json_object_set_int_member (data, "nStreams", 1);
-	} else {
-		json_object_set_int_member (data, "nStreams",
-			n_streams);
-	}
-
-	json_object_set_object_member (obj, "data", data);
+	json_object_set_object_member (obj, "data",
+			cc_proxy_allocate_io_data (tty));
 
 	root = json_node_new (JSON_NODE_OBJECT);
 	generator = json_generator_new ();
@@ -930,7 +1301,8 @@ cc_proxy_cmd_allocate_io (struct cc_proxy *proxy,
 		goto out;
 	}
 
-	if (! cc_proxy_run_cmd(proxy, msg_to_send, msg_received, proxy_io_fd)) {
+	if (! cc_proxy_run_cmd(proxy, proxy_cmd, msg_to_send, msg_received,
+			proxy_io_fd, CC_PROXY_CMD_TIMEOUT)) {
 		g_critical("failed to run proxy command %s: %s",
 				proxy_cmd,
 				msg_received->str);
@@ -961,26 +1333,11 @@ cc_proxy_cmd_allocate_io (struct cc_proxy *proxy,
 	reader = json_reader_new(json_parser_get_root(parser));
 	if (!reader) {
 		g_critical("failed to create reader");
+		ret = false;
 		goto out;
 	}
 
-	ret = json_reader_read_member (reader, "data");
-	if (! ret) {
-		g_critical ("failed to find proxy data");
-		goto out;
-	}
-
-	ret = json_reader_read_member (reader, "ioBase");
-	if (! ret) {
-		g_critical ("failed to find ioBase");
-		goto out;
-	}
-
-	*ioBase = (int) json_reader_get_int_value(reader);
-
-	json_reader_end_member (reader);
-
-	ret = true;
+	ret = cc_proxy_read_io_base (reader, ioBase);
 
 out:
 	if (reader) {
@@ -1000,20 +1357,15 @@ out:
 }
 
 /**
- * Connect to \ref CC_OCI_PROXY and wait until it is ready.
+ * Wait for the agent sockets of the VM to exist.
  *
  * \param config \ref cc_oci_config.
  *
  * \return \c true on success, else \c false.
  */
 gboolean
-cc_proxy_wait_until_ready (struct cc_oci_config *config)
+cc_proxy_wait_for_agent (struct cc_oci_config *config)
 {
-	GFile             *ctl_file = NULL;
-	GFileMonitor      *monitor = NULL;
-	GMainLoop         *loop = NULL;
-	struct stat        st;
-
 	if (! (config && config->proxy
 				&& config->proxy->agent_ctl_socket)) {
 		return false;
@@ -1023,42 +1375,8 @@ cc_proxy_wait_until_ready (struct cc_oci_config *config)
 	 * CTL and TTY exist, for this reason we MUST wait for them before
 	 * writing down any message into proxy's socket
 	 */
-	if (stat(config->proxy->agent_ctl_socket, &st)) {
-		loop = g_main_loop_new (NULL, false);
-
-		ctl_file = g_file_new_for_path( config->proxy->agent_ctl_socket);
-
-		monitor = g_file_monitor(ctl_file, G_FILE_MONITOR_NONE, NULL, NULL);
-		if (! monitor) {
-			g_critical("failed to create a file monitor for %s",
-				 config->proxy->agent_ctl_socket);
-			goto out;
-		}
-
-		g_signal_connect(monitor, "changed",
-			G_CALLBACK(cc_proxy_ctl_socket_created_callback), loop);
-
-		/* last chance, if CTL socket does not exist we MUST wait for it */
-		if (stat(config->proxy->agent_ctl_socket, &st)) {
-			g_main_loop_run(loop);
-		}
-	}
-
-	if (! cc_proxy_cmd_hello (config->proxy, config->optarg_container_id)) {
-		return false;
-	}
-out:
-	if (loop) {
-		g_main_loop_unref(loop);
-	}
-	if (ctl_file) {
-		g_object_unref(ctl_file);
-	}
-	if (monitor) {
-		g_object_unref(monitor);
-	}
-
-	return true;
+	return cc_oci_wait_for_path (config->proxy->agent_ctl_socket,
+			start_data.ready_timeout, "agent-ctl-ready");
 }
 
 /**
@@ -1120,7 +1438,9 @@ cc_proxy_run_hyper_cmd (struct cc_oci_config *config,
 		goto out;
 	}
 
-	if (! cc_proxy_run_cmd(config->proxy, msg_to_send, msg_received, NULL)) {
+	if (! cc_proxy_run_cmd(config->proxy, cmd,
+			msg_to_send, msg_received, NULL,
+			CC_PROXY_HYPER_CMD_TIMEOUT)) {
 		g_critical("failed to run hyper cmd %s: %s",
 				cmd,
 				msg_received->str);
@@ -1143,20 +1463,17 @@ out:
 }
 
 /**
- * Request \ref CC_OCI_PROXY create a new POD (container group).
- *
- * \note Must already be connected to the proxy.
+ * Create the data of the hyperstart startpod command.
  *
  * \param config \ref cc_oci_config.
  *
- * \return \c true on success, else \c false.
+ * \return \c JsonObject.
  */
-gboolean
-cc_proxy_hyper_pod_create (struct cc_oci_config *config)
+static JsonObject *
+cc_proxy_pod_create_data (struct cc_oci_config *config)
 {
 	JsonObject                   *data = NULL;
 	JsonArray                    *array = NULL;
-	gboolean                      ret = false;
 	JsonArray                    *iface_array = NULL;
 	JsonObject                   *iface_data = NULL;
 	struct cc_oci_net_if_cfg     *if_cfg = NULL;
@@ -1168,10 +1485,6 @@ cc_proxy_hyper_pod_create (struct cc_oci_config *config)
 	JsonObject                   *route_data = NULL;
 	struct cc_oci_net_ipv4_route *route = NULL;
 
-	if (! (config && config->proxy && config->net.hostname)) {
-		return false;
-	}
-
 	/* json stanza for create pod (STARTPOD without containers)*/
 	data = json_object_new ();
 
@@ -1258,6 +1571,30 @@ cc_proxy_hyper_pod_create (struct cc_oci_config *config)
 				config->net.iptable_rules);
 	}
 
+	return data;
+}
+
+/**
+ * Request \ref CC_OCI_PROXY create a new POD (container group).
+ *
+ * \note Must already be connected to the proxy.
+ *
+ * \param config \ref cc_oci_config.
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+cc_proxy_hyper_pod_create (struct cc_oci_config *config)
+{
+	JsonObject *data = NULL;
+	gboolean    ret = false;
+
+	if (! (config && config->proxy && config->net.hostname)) {
+		return false;
+	}
+
+	data = cc_proxy_pod_create_data (config);
+
 	if (! cc_proxy_run_hyper_cmd (config, "startpod", data)) {
 		g_critical("failed to run pod create");
 		goto out;
@@ -1273,6 +1610,221 @@ out:
 	return ret;
 }
 
+/**
+ * Determine if a failed batch was run by the proxy.
+ *
+ * Proxies predating batches reject them without returning any result.
+ *
+ * \param response \c GString containing raw proxy response message.
+ *
+ * \return \c true if the batch was run, else \c false.
+ */
+static gboolean
+cc_proxy_batch_was_run (const GString *response)
+{
+	JsonParser  *parser = NULL;
+	JsonObject  *obj;
+	gboolean     ret = false;
+
+	parser = json_parser_new ();
+
+	if (! json_parser_load_from_data (parser, response->str,
+				(gssize)response->len, NULL)) {
+		goto out;
+	}
+
+	obj = json_node_get_object (json_parser_get_root (parser));
+	ret = obj && json_object_has_member (obj, "data");
+
+out:
+	g_object_unref (parser);
+
+	return ret;
+}
+
+/**
+ * Register the VM with \ref CC_OCI_PROXY, create its POD and
+ * allocate the I/O streams of the workload.
+ *
+ * The hello, startpod and allocateIO commands are sent as a single
+ * batch so that they only cost one round trip to the proxy. The
+ * commands are sent one at a time to proxies that do not support
+ * batches.
+ *
+ * \note Must already be connected to the proxy and the agent sockets
+ * must exist (see cc_proxy_wait_for_agent()).
+ *
+ * \param config \ref cc_oci_config.
+ * \param[out] proxy_io_fd I/O file descriptor of the workload.
+ * \param[out] ioBase first I/O stream sequence number of the workload.
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+cc_proxy_cmd_create (struct cc_oci_config *config, int *proxy_io_fd,
+		int *ioBase)
+{
+	JsonObject        *obj = NULL;
+	JsonObject        *data = NULL;
+	JsonObject        *hyper = NULL;
+	JsonObject        *request = NULL;
+	JsonArray         *requests = NULL;
+	JsonNode          *root = NULL;
+	JsonGenerator     *generator = NULL;
+	JsonParser        *parser = NULL;
+	JsonReader        *reader = NULL;
+	GError            *error = NULL;
+	gchar             *msg_to_send = NULL;
+	GString           *msg_received = NULL;
+	gboolean           restore;
+	gboolean           ret = false;
+	gint               count;
+
+	const gchar       *proxy_cmd = "batch";
+
+	if (! (config && config->proxy && config->proxy->socket
+				&& proxy_io_fd && ioBase)) {
+		return false;
+	}
+
+	/* The pod of a restored VM already exists */
+	if (! (config->restore_image || config->net.hostname)) {
+		return false;
+	}
+
+	restore = config->restore_image || config->vm_template;
+
+	requests = json_array_new ();
+
+	request = json_object_new ();
+	json_object_set_string_member (request, "id", "hello");
+	json_object_set_object_member (request, "data",
+			cc_proxy_hello_data (config->proxy,
+				config->optarg_container_id, restore));
+	json_array_add_object_element (requests, request);
+
+	if (! config->restore_image) {
+		hyper = json_object_new ();
+		json_object_set_string_member (hyper, "hyperName",
+				"startpod");
+		json_object_set_object_member (hyper, "data",
+				cc_proxy_pod_create_data (config));
+
+		request = json_object_new ();
+		json_object_set_string_member (request, "id", "hyper");
+		json_object_set_object_member (request, "data", hyper);
+		json_array_add_object_element (requests, request);
+	}
+
+	request = json_object_new ();
+	json_object_set_string_member (request, "id", "allocateIO");
+	json_object_set_object_member (request, "data",
+			cc_proxy_allocate_io_data (config->oci.process.terminal));
+	json_array_add_object_element (requests, request);
+
+	data = json_object_new ();
+	json_object_set_array_member (data, "requests", requests);
+
+	obj = json_object_new ();
+	json_object_set_string_member (obj, "id", proxy_cmd);
+	json_object_set_object_member (obj, "data", data);
+
+	root = json_node_new (JSON_NODE_OBJECT);
+	generator = json_generator_new ();
+	json_node_take_object (root, obj);
+
+	json_generator_set_root (generator, root);
+	g_object_set (generator, "pretty", FALSE, NULL);
+
+	msg_to_send = json_generator_to_data (generator, NULL);
+
+	msg_received = g_string_new("");
+
+	if (! msg_received ) {
+		goto out;
+	}
+
+	/* allocateIO comes last, so the batch response is followed by
+	 * its fd when all the commands have succeeded.
+	 */
+	if (! cc_proxy_run_cmd(config->proxy, proxy_cmd, msg_to_send,
+				msg_received, proxy_io_fd,
+				cc_proxy_ready_timeout ()
+				+ CC_PROXY_HYPER_CMD_TIMEOUT)) {
+		if (! msg_received->len
+				|| cc_proxy_batch_was_run (msg_received)) {
+			g_critical("failed to run proxy command %s: %s",
+					proxy_cmd,
+					msg_received->str);
+			goto out;
+		}
+
+		g_debug ("proxy does not support batches, "
+				"sending commands one at a time");
+
+		ret = cc_proxy_cmd_hello (config->proxy,
+				config->optarg_container_id, restore)
+			&& (config->restore_image
+					|| cc_proxy_hyper_pod_create (config))
+			&& cc_proxy_cmd_allocate_io (config->proxy,
+					proxy_io_fd, ioBase,
+					config->oci.process.terminal);
+		goto out;
+	}
+
+	g_debug("msg received: %s", msg_received->str);
+
+	/* The ioBase is in the result of the last command */
+	parser = json_parser_new();
+	ret = json_parser_load_from_data(parser,
+		msg_received->str,
+		(gssize) msg_received->len,
+		&error);
+
+	if (! ret) {
+		g_critical ("failed to parse proxy response: %s",
+				error->message);
+		g_error_free (error);
+		goto out;
+	}
+
+	reader = json_reader_new(json_parser_get_root(parser));
+
+	ret = json_reader_read_member (reader, "data")
+		&& json_reader_read_member (reader, "results");
+	if (! ret) {
+		g_critical ("failed to find batch results");
+		goto out;
+	}
+
+	count = json_reader_count_elements (reader);
+
+	ret = count > 0 && json_reader_read_element (reader,
+			(guint)count - 1);
+	if (! ret) {
+		g_critical ("failed to find allocateIO result");
+		goto out;
+	}
+
+	ret = cc_proxy_read_io_base (reader, ioBase);
+
+out:
+	if (reader) {
+		g_object_unref (reader);
+	}
+	if (parser) {
+		g_object_unref (parser);
+	}
+	if (msg_received) {
+		g_string_free(msg_received, true);
+	}
+	if (obj) {
+		json_object_unref (obj);
+	}
+
+	return ret;
+}
+
 /**
  * Construct an hyperstart fsmap structure
  *
@@ -1578,6 +2130,7 @@ cc_proxy_hyper_kill_container (struct cc_oci_config *config,
 {
 	JsonObject *killcontainer_payload;
 	gboolean    ret = false;
+	gboolean    cached;
 	const gchar *container_id;
 
 	if (! (config && config->proxy)) {
@@ -1589,11 +2142,14 @@ cc_proxy_hyper_kill_container (struct cc_oci_config *config,
 		return false;
 	}
 
-	if (! cc_proxy_connect (config->proxy)) {
-		return false;
-	}
-	if (! cc_proxy_attach (config->proxy, container_id)) {
-		return false;
+	cached = cc_proxy_conn_take (config->proxy, container_id);
+	if (! cached) {
+		if (! cc_proxy_connect (config->proxy)) {
+			return false;
+		}
+		if (! cc_proxy_attach (config->proxy, container_id)) {
+			return false;
+		}
 	}
 
 	killcontainer_payload = json_object_new ();
@@ -1605,16 +2161,34 @@ cc_proxy_hyper_kill_container (struct cc_oci_config *config,
 	json_object_set_boolean_member (killcontainer_payload, "allProcesses",
 		all_processes);
 
-	if (! cc_proxy_run_hyper_cmd (config, "killcontainer", killcontainer_payload)) {
+	ret = cc_proxy_run_hyper_cmd (config, "killcontainer",
+			killcontainer_payload);
+	if (! ret && cached) {
+		/* The proxy may no longer know about the kept
+		 * connection, so retry on a new one.
+		 */
+		g_debug ("retrying killcontainer on a new connection");
+
+		(void)cc_proxy_disconnect (config->proxy);
+
+		ret = cc_proxy_connect (config->proxy)
+			&& cc_proxy_attach (config->proxy, container_id)
+			&& cc_proxy_run_hyper_cmd (config, "killcontainer",
+					killcontainer_payload);
+	}
+
+	if (! ret) {
 		g_critical("failed to run cmd killcontainer");
 		goto out;
 	}
 
-	ret = true;
 out:
 	json_object_unref (killcontainer_payload);
 
-	cc_proxy_disconnect (config->proxy);
+	if (! (ret && cc_proxy_conn_put (config->proxy, container_id))
+			&& cc_proxy_connected (config->proxy)) {
+		cc_proxy_disconnect (config->proxy);
+	}
 
 	return ret;
 }
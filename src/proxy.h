@@ -43,11 +43,25 @@
  */
 #define OOB_FD_FLAG 'F'
 
+/** Time (in milliseconds) a command handled by the proxy itself is
+ * allowed to take.
+ */
+#define CC_PROXY_CMD_TIMEOUT		10000
+
+/** Time (in milliseconds) a command forwarded to hyperstart is
+ * allowed to take.
+ */
+#define CC_PROXY_HYPER_CMD_TIMEOUT	60000
+
 gboolean cc_proxy_connect (struct cc_proxy *proxy);
 gboolean cc_proxy_disconnect (struct cc_proxy *proxy);
 gboolean cc_proxy_attach (struct cc_proxy *proxy, const char *container_id);
-gboolean cc_proxy_wait_until_ready (struct cc_oci_config *config);
+gboolean cc_proxy_cmd_register (struct cc_oci_config *config);
+void cc_proxy_unregister (struct cc_oci_config *config);
+gboolean cc_proxy_wait_for_agent (struct cc_oci_config *config);
 gboolean cc_proxy_hyper_pod_create (struct cc_oci_config *config);
+gboolean cc_proxy_cmd_create (struct cc_oci_config *config, int *proxy_io_fd,
+		int *ioBase);
 gboolean cc_proxy_cmd_bye (struct cc_proxy *proxy, const char *container_id);
 gboolean cc_proxy_cmd_allocate_io (struct cc_proxy *proxy, int *proxy_io_fd,
 		int *ioBase, bool tty);
@@ -63,6 +77,7 @@ gboolean cc_proxy_hyper_new_pod_container(struct cc_oci_config *config,
 					const char *rootfs, const char *image);
 gboolean cc_proxy_hyper_new_container (struct cc_oci_config *config);
 void cc_proxy_free (struct cc_proxy *proxy);
+void cc_proxy_conn_cache_enable (void);
 gboolean cc_proxy_attach (struct cc_proxy *proxy, const char *container_id);
 gboolean cc_proxy_hyper_exec_command (struct cc_oci_config *config);
 #endif /* _CC_OCI_PROXY_H */
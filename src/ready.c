@@ -0,0 +1,224 @@
+/*
+ * This file is part of cc-oci-runtime.
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Waiting for resources created asynchronously by the VM.
+ *
+ * The hypervisor creates its sockets (for example the agent control
+ * socket and \ref CC_OCI_PROCESS_SOCKET) some time after it has been
+ * launched. Rather than running a main loop with a \c GFileMonitor
+ * (whose latency depends on the GIO backend and which never times
+ * out), an inotify watch is placed on the parent directory so that
+ * the caller wakes as soon as the path is created, subject to a
+ * deadline.
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+
+#include "common.h"
+#include "trace.h"
+#include "ready.h"
+
+/** inotify instance used to wait for paths to be created. */
+static int cc_oci_ready_fd = -1;
+
+/*!
+ * Determine if \p path exists.
+ *
+ * \param path Path to check.
+ *
+ * \return \c true if \p path exists, else \c false.
+ */
+static gboolean
+cc_oci_ready_path_exists (const gchar *path)
+{
+	struct stat st;
+
+	return stat (path, &st) == 0;
+}
+
+/*!
+ * Create an inotify watch for entries created in the directory
+ * containing \p path.
+ *
+ * \param path Path that will be created.
+ * \param[out] wd Watch descriptor.
+ *
+ * \return inotify file descriptor on success, else \c -1.
+ */
+static int
+cc_oci_ready_watch (const gchar *path, int *wd)
+{
+	g_autofree gchar *dir = NULL;
+
+	/* Releasing an inotify instance which has had watches blocks
+	 * until the kernel has finished freeing them (which can take
+	 * several milliseconds), so a single instance is created on
+	 * demand and kept until the process exits.
+	 */
+	if (cc_oci_ready_fd < 0) {
+		cc_oci_ready_fd = inotify_init1 (IN_NONBLOCK | IN_CLOEXEC);
+		if (cc_oci_ready_fd < 0) {
+			g_debug ("failed to create inotify instance: %s",
+					strerror (errno));
+			return -1;
+		}
+	}
+
+	dir = g_path_get_dirname (path);
+
+	*wd = inotify_add_watch (cc_oci_ready_fd, dir,
+			IN_CREATE | IN_MOVED_TO | IN_ONLYDIR);
+	if (*wd < 0) {
+		g_debug ("failed to watch %s: %s", dir, strerror (errno));
+		return -1;
+	}
+
+	return cc_oci_ready_fd;
+}
+
+/*!
+ * Discard all pending inotify events.
+ *
+ * The events are not examined since the caller simply checks
+ * whether the path now exists (events left over from an earlier
+ * wait just cause an extra check).
+ *
+ * \param fd inotify file descriptor.
+ */
+static void
+cc_oci_ready_drain (int fd)
+{
+	char buffer[sizeof (struct inotify_event) + NAME_MAX + 1]
+		__attribute__ ((aligned (__alignof__ (struct inotify_event))));
+
+	while (read (fd, buffer, sizeof (buffer)) > 0) {
+		;
+	}
+}
+
+/*!
+ * Wait for \p path to be created.
+ *
+ * If the parent directory of \p path cannot be watched, the path is
+ * checked with an exponentially increasing delay between
+ * \ref CC_OCI_READY_POLL_MIN and \ref CC_OCI_READY_POLL_MAX
+ * microseconds.
+ *
+ * \param path Full path to wait for.
+ * \param timeout Maximum time to wait in milliseconds (\c 0 for
+ *   \ref CC_OCI_READY_DEFAULT_TIMEOUT).
+ * \param trace_name Name of the trace event recording how long the
+ *   wait took (or \c NULL).
+ *
+ * \return \c true if \p path exists, else \c false.
+ */
+gboolean
+cc_oci_wait_for_path (const gchar *path, gint timeout,
+		const gchar *trace_name)
+{
+	gboolean  ret = false;
+	int       fd = -1;
+	int       wd = -1;
+	gint64    trace_start;
+	gint64    now;
+	gint64    deadline;
+	gint64    delay = CC_OCI_READY_POLL_MIN;
+
+	if (! path || timeout < 0) {
+		return false;
+	}
+
+	trace_start = cc_oci_trace_now ();
+
+	if (! timeout) {
+		timeout = CC_OCI_READY_DEFAULT_TIMEOUT;
+	}
+
+	now = g_get_monotonic_time ();
+	deadline = now + (gint64)timeout * 1000;
+
+	/* Fast path, which also avoids creating a watch */
+	if (cc_oci_ready_path_exists (path)) {
+		ret = true;
+		goto out;
+	}
+
+	/* The watch must be created before checking again, otherwise
+	 * the path could be created between the check and the watch.
+	 */
+	fd = cc_oci_ready_watch (path, &wd);
+
+	while (! (ret = cc_oci_ready_path_exists (path))) {
+		struct pollfd  pfd = { .fd = fd, .events = POLLIN };
+		gint64         remaining;
+
+		now = g_get_monotonic_time ();
+		if (now >= deadline) {
+			break;
+		}
+
+		remaining = deadline - now;
+
+		if (fd < 0) {
+			g_usleep ((gulong)MIN (delay, remaining));
+			delay = MIN (delay * 2, CC_OCI_READY_POLL_MAX);
+			continue;
+		}
+
+		/* round up so that the deadline is never missed */
+		if (poll (&pfd, 1, (int)((remaining + 999) / 1000)) < 0
+				&& errno != EINTR) {
+			g_debug ("failed to poll inotify: %s",
+					strerror (errno));
+			fd = -1;
+			continue;
+		}
+
+		cc_oci_ready_drain (fd);
+	}
+
+	if (! ret) {
+		g_critical ("timed out after %dms waiting for %s",
+				timeout, path);
+	}
+
+out:
+	if (wd >= 0) {
+		(void)inotify_rm_watch (cc_oci_ready_fd, wd);
+	}
+
+	if (trace_name) {
+		cc_oci_trace_end (CC_OCI_TRACE_READY, trace_name,
+				trace_start);
+	}
+
+	return ret;
+}
@@ -0,0 +1,44 @@
+/*
+ * This file is part of cc-oci-runtime.
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _CC_OCI_READY_H
+#define _CC_OCI_READY_H
+
+#include <glib.h>
+
+/** Default time (in milliseconds) to wait for a VM resource (such as
+ * a socket created by the hypervisor) to appear.
+ */
+#define CC_OCI_READY_DEFAULT_TIMEOUT	30000
+
+/** Initial delay (in microseconds) between checks when the path cannot
+ * be watched.
+ */
+#define CC_OCI_READY_POLL_MIN		100
+
+/** Maximum delay (in microseconds) between checks when the path cannot
+ * be watched.
+ */
+#define CC_OCI_READY_POLL_MAX		10000
+
+gboolean cc_oci_wait_for_path (const gchar *path, gint timeout,
+		const gchar *trace_name);
+
+#endif /* _CC_OCI_READY_H */
@@ -0,0 +1,373 @@
+/*
+ * This file is part of cc-oci-runtime.
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Child process creation.
+ *
+ * Children are created with \c clone(CLONE_VM|CLONE_VFORK): the child
+ * borrows the parents address space (so no page tables are copied and
+ * no copy-on-write faults occur) and the parent is suspended until the
+ * child has exec'd or exited. Since the child shares the parents
+ * memory, it must only call async-signal-safe functions: all
+ * allocations (argv, environment, paths, fds) are performed by the
+ * parent beforehand.
+ *
+ * If setup fails, the child writes \c errno to a close-on-exec pipe
+ * which the parent reads once it resumes (any data read denotes
+ * failure).
+ */
+
+#define _GNU_SOURCE
+
+#include <sched.h>
+#include <signal.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/file.h>
+#include <sys/ioctl.h>
+#include <sys/ptrace.h>
+#include <sys/wait.h>
+
+#include <glib.h>
+
+#include "spawn.h"
+
+/** Size of the stack the child runs on until it calls exec. */
+#define CC_OCI_SPAWN_STACK_SIZE		(64 * 1024)
+
+extern char **environ;
+
+/** Data passed from the parent to the child. */
+struct cc_oci_spawn_ctx {
+	/** Child description. */
+	const struct cc_oci_spawn  *spawn;
+
+	/** Environment to pass to exec. */
+	char                      **envp;
+
+	/** Write end of the error pipe. */
+	int                         err_fd;
+
+	/** Highest file descriptor open in the parent. */
+	int                         max_fd;
+
+	/** Signal mask to restore before calling exec. */
+	sigset_t                    mask;
+};
+
+/*!
+ * Initialise \p spawn with default values (inherit the standard
+ * streams, no additional fds).
+ *
+ * \param spawn \ref cc_oci_spawn.
+ */
+void
+cc_oci_spawn_init (struct cc_oci_spawn *spawn)
+{
+	if (! spawn) {
+		return;
+	}
+
+	memset (spawn, 0, sizeof (*spawn));
+
+	spawn->stdio[0] = spawn->stdio[1] = spawn->stdio[2] = -1;
+	spawn->flock_fd = -1;
+}
+
+/*!
+ * Arrange for the child to inherit \p fd.
+ *
+ * \param spawn \ref cc_oci_spawn.
+ * \param fd File descriptor (which must be greater than \c 2).
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+cc_oci_spawn_add_fd (struct cc_oci_spawn *spawn, int fd)
+{
+	if (! spawn || fd < 3) {
+		return false;
+	}
+
+	if (spawn->fds_len >= CC_OCI_SPAWN_MAX_FDS) {
+		g_critical ("too many fds for child");
+		return false;
+	}
+
+	spawn->fds[spawn->fds_len++] = fd;
+
+	return true;
+}
+
+/*!
+ * Determine the highest open file descriptor.
+ *
+ * \return File descriptor number.
+ */
+static int
+cc_oci_spawn_max_fd (void)
+{
+	DIR            *dir;
+	struct dirent  *ent;
+	int             max = 2;
+
+	dir = opendir ("/proc/self/fd");
+	if (! dir) {
+		return (int)sysconf (_SC_OPEN_MAX);
+	}
+
+	while ((ent = readdir (dir)) != NULL) {
+		int fd = atoi (ent->d_name);
+
+		max = MAX (max, fd);
+	}
+
+	closedir (dir);
+
+	return max;
+}
+
+/*!
+ * Determine if the child should inherit \p fd.
+ *
+ * \param spawn \ref cc_oci_spawn.
+ * \param fd File descriptor.
+ *
+ * \return \c true if \p fd must be kept open, else \c false.
+ */
+static gboolean
+cc_oci_spawn_keep_fd (const struct cc_oci_spawn *spawn, int fd)
+{
+	for (guint i = 0; i < spawn->fds_len; i++) {
+		if (spawn->fds[i] == fd) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/*!
+ * Child setup, run on a separate stack in the parents address space.
+ *
+ * \warning Only async-signal-safe functions may be called here.
+ *
+ * \param data \ref cc_oci_spawn_ctx.
+ *
+ * \return Does not return.
+ */
+static int
+cc_oci_spawn_child (void *data)
+{
+	struct cc_oci_spawn_ctx    *ctx = data;
+	const struct cc_oci_spawn  *spawn = ctx->spawn;
+	struct sigaction            sa;
+	int                         err;
+
+	/* The parents handlers must not run in the child since it
+	 * shares the parents memory, so restore the default
+	 * dispositions (ignored signals remain ignored, as for exec).
+	 */
+	for (int sig = 1; sig < _NSIG; sig++) {
+		if (sigaction (sig, NULL, &sa) < 0) {
+			continue;
+		}
+
+		if (sa.sa_handler == SIG_IGN || sa.sa_handler == SIG_DFL) {
+			continue;
+		}
+
+		sa.sa_handler = SIG_DFL;
+		sa.sa_flags = 0;
+		sigemptyset (&sa.sa_mask);
+
+		(void)sigaction (sig, &sa, NULL);
+	}
+
+	if (spawn->setsid && setsid () < 0) {
+		goto fail;
+	}
+
+	for (int i = 0; i < 3; i++) {
+		int fd = spawn->stdio[i];
+
+		if (fd < 0) {
+			continue;
+		}
+
+		if (fd == i) {
+			if (fcntl (i, F_SETFD, 0) < 0) {
+				goto fail;
+			}
+		} else if (dup2 (fd, i) < 0) {
+			goto fail;
+		}
+	}
+
+	if (spawn->ctty && ioctl (STDIN_FILENO, TIOCSCTTY, 1) < 0) {
+		goto fail;
+	}
+
+	for (guint i = 0; i < spawn->fds_len; i++) {
+		if (fcntl (spawn->fds[i], F_SETFD, 0) < 0) {
+			goto fail;
+		}
+	}
+
+	if (spawn->flock_fd >= 0 && flock (spawn->flock_fd, LOCK_EX) < 0) {
+		goto fail;
+	}
+
+	if (spawn->close_fds) {
+		for (int fd = 3; fd <= ctx->max_fd; fd++) {
+			if (fd == ctx->err_fd || cc_oci_spawn_keep_fd (spawn, fd)) {
+				continue;
+			}
+
+			(void)close (fd);
+		}
+	}
+
+	/* arrange for the child to stop when it calls exec */
+	if (spawn->traceme && ptrace (PTRACE_TRACEME, 0, NULL, 0) < 0) {
+		goto fail;
+	}
+
+	(void)sigprocmask (SIG_SETMASK, &ctx->mask, NULL);
+
+	(void)execve (spawn->path, spawn->argv, ctx->envp);
+
+fail:
+	err = errno;
+
+	/* Any data written by the child to this pipe signifies failure */
+	(void)write (ctx->err_fd, &err, sizeof (err));
+
+	_exit (127);
+}
+
+/*!
+ * Create a child process as described by \p spawn.
+ *
+ * The call returns once the child has exec'd (or failed to).
+ *
+ * \param spawn \ref cc_oci_spawn.
+ *
+ * \return Process ID of the child on success, else \c -1.
+ */
+GPid
+cc_oci_spawn (const struct cc_oci_spawn *spawn)
+{
+	struct cc_oci_spawn_ctx  ctx;
+	int                      err_pipe[2] = { -1, -1 };
+	sigset_t                 all;
+	gchar                   *stack = NULL;
+	GPid                     pid = -1;
+	int                      err = 0;
+	ssize_t                  bytes;
+
+	if (! (spawn && spawn->path && spawn->argv && spawn->argv[0])) {
+		return -1;
+	}
+
+	/* The child cannot search PATH (which requires allocation) */
+	if (spawn->path[0] != '/') {
+		g_critical ("path %s is not absolute", spawn->path);
+		return -1;
+	}
+
+	if (pipe2 (err_pipe, O_CLOEXEC) < 0) {
+		g_critical ("failed to create child error pipe: %s",
+				strerror (errno));
+		return -1;
+	}
+
+	/* Ensure the child cannot overwrite the error pipe when
+	 * setting up its standard streams.
+	 */
+	if (err_pipe[1] <= STDERR_FILENO) {
+		int fd = fcntl (err_pipe[1], F_DUPFD_CLOEXEC, STDERR_FILENO+1);
+
+		if (fd < 0) {
+			g_critical ("failed to move child error pipe: %s",
+					strerror (errno));
+			close (err_pipe[0]);
+			close (err_pipe[1]);
+			return -1;
+		}
+
+		close (err_pipe[1]);
+		err_pipe[1] = fd;
+	}
+
+	ctx.spawn = spawn;
+	ctx.envp = spawn->envp ? spawn->envp : environ;
+	ctx.err_fd = err_pipe[1];
+	ctx.max_fd = spawn->close_fds ? cc_oci_spawn_max_fd () : -1;
+
+	stack = g_malloc (CC_OCI_SPAWN_STACK_SIZE);
+
+	/* Block all signals until the child has reset the handlers */
+	sigfillset (&all);
+	(void)sigprocmask (SIG_BLOCK, &all, &ctx.mask);
+
+	pid = clone (cc_oci_spawn_child,
+			stack + CC_OCI_SPAWN_STACK_SIZE,
+			CLONE_VM | CLONE_VFORK | SIGCHLD,
+			&ctx);
+	err = errno;
+
+	(void)sigprocmask (SIG_SETMASK, &ctx.mask, NULL);
+
+	close (err_pipe[1]);
+
+	if (pid < 0) {
+		g_critical ("failed to spawn %s: %s",
+				spawn->path, strerror (err));
+		goto out;
+	}
+
+	do {
+		bytes = read (err_pipe[0], &err, sizeof (err));
+	} while (bytes < 0 && errno == EINTR);
+
+	if (bytes > 0) {
+		g_critical ("failed to spawn %s: %s",
+				spawn->path, strerror (err));
+		(void)waitpid (pid, NULL, 0);
+		pid = -1;
+		goto out;
+	}
+
+	g_debug ("spawned %s (pid %d)", spawn->path, (int)pid);
+
+out:
+	close (err_pipe[0]);
+	g_free (stack);
+
+	return pid;
+}
@@ -0,0 +1,86 @@
+/*
+ * This file is part of cc-oci-runtime.
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _CC_OCI_SPAWN_H
+#define _CC_OCI_SPAWN_H
+
+#include <glib.h>
+
+/** Maximum number of file descriptors a child can inherit
+ * (in addition to the standard streams).
+ */
+#define CC_OCI_SPAWN_MAX_FDS	8
+
+/** Description of a child process to spawn.
+ *
+ * Everything the child needs is prepared by the parent so that the
+ * child only performs async-signal-safe system calls between
+ * creation and exec.
+ */
+struct cc_oci_spawn {
+	/** Absolute path of the program to run. */
+	const gchar  *path;
+
+	/** Arguments (\c NULL terminated, starting with \c argv[0]). */
+	gchar       **argv;
+
+	/** Environment (\c NULL to inherit the parents environment). */
+	gchar       **envp;
+
+	/** File descriptors to install as the standard streams
+	 * (\c -1 to leave a stream unchanged).
+	 */
+	int           stdio[3];
+
+	/** File descriptors the child should inherit (at the same
+	 * numbers, which must be greater than \c 2).
+	 */
+	int           fds[CC_OCI_SPAWN_MAX_FDS];
+
+	/** Number of valid entries in \ref fds. */
+	guint         fds_len;
+
+	/** If \c true, close all other file descriptors above \c 2. */
+	gboolean      close_fds;
+
+	/** If \c true, make the child a session leader. */
+	gboolean      setsid;
+
+	/** If \c true, make stdin the controlling terminal of the
+	 * child (requires \ref setsid).
+	 */
+	gboolean      ctty;
+
+	/** File descriptor to take an exclusive \c flock(2) on
+	 * (\c -1 for none).
+	 */
+	int           flock_fd;
+
+	/** If \c true, stop the child when it calls exec (see
+	 * \c PTRACE_TRACEME).
+	 */
+	gboolean      traceme;
+};
+
+void cc_oci_spawn_init (struct cc_oci_spawn *spawn);
+gboolean cc_oci_spawn_add_fd (struct cc_oci_spawn *spawn, int fd);
+GPid cc_oci_spawn (const struct cc_oci_spawn *spawn);
+
+#endif /* _CC_OCI_SPAWN_H */
@@ -23,12 +23,17 @@
 #include "json.h"
 #include "common.h"
 
+/** Parsed VM configuration defaults, kept for the lifetime of the
+ * process since they are the same for every container.
+ */
+static GNode *vm_defaults;
 
 /*!
  * If the virtual machine attribute ("vm") in config is NULL,
  * this function will create create it using the json from
  * SYSCONFDIR/CC_OCI_VM_CONFIG
  * or fallback default DEFAULTSDIR/CC_OCI_VM_CONFIG
+ * (which is only parsed once per process).
  *
  * \param[in,out] config cc_oci_config struct
  *
@@ -38,7 +43,6 @@ gboolean
 get_spec_vm_from_cfg_file (struct cc_oci_config* config)
 {
 	bool result= true;
-	GNode* vm_config = NULL;
 	GNode* vm_node= NULL;
 	gchar* sys_json_file = NULL;
 
@@ -50,6 +54,10 @@ get_spec_vm_from_cfg_file (struct cc_oci_config* config)
 		/* If vm spec data exist, do nothing */
 		goto out;
 	}
+
+	if (vm_defaults) {
+		goto handle;
+	}
 #ifdef UNIT_TESTING
 	sys_json_file = g_strdup (TEST_DATA_DIR"/vm.json");
 #else
@@ -63,12 +71,14 @@ get_spec_vm_from_cfg_file (struct cc_oci_config* config)
 #endif // UNIT_TESTING
 	g_debug ("Reading VM configuration from %s",
 		sys_json_file);
-	if (! cc_oci_json_parse(&vm_config, sys_json_file)) {
+	if (! cc_oci_json_parse(&vm_defaults, sys_json_file)) {
+		vm_defaults = NULL;
 		result = false;
 		goto out;
 	}
 
-	vm_node = g_node_first_child(vm_config);
+handle:
+	vm_node = g_node_first_child(vm_defaults);
 	while (vm_node) {
 		if (g_strcmp0(vm_node->data, vm_spec_handler.name) == 0) {
 			break;
@@ -82,6 +92,5 @@ get_spec_vm_from_cfg_file (struct cc_oci_config* config)
 	}
 out:
 	g_free_if_set (sys_json_file);
-	g_free_node (vm_config);
 	return result;
 }
@@ -22,6 +22,7 @@
 
 #include "spec_handler.h"
 #include "pod.h"
+#include "vmtemplate.h"
 
 static void
 handle_annotation (GNode* root, struct cc_oci_config* config)
@@ -59,6 +60,8 @@ handle_annotation (GNode* root, struct cc_oci_config* config)
 			   a->key, a->value);
 	}
 
+	(void)cc_oci_vm_template_handle_annotation (config, a);
+
 	config->oci.annotations = g_slist_prepend
 		(config->oci.annotations, a);
 }
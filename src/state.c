@@ -26,6 +26,7 @@
 
 #include <string.h>
 #include <stdbool.h>
+#include <sys/stat.h>
 
 #include <glib.h>
 #include <glib/gstdio.h>
@@ -48,6 +49,9 @@
 		(*(data->subelements_count))++; \
 	}
 
+/** Maximum number of parsed state files to keep. */
+#define CC_OCI_STATE_CACHE_MAX	1024
+
 struct handler_data;
 
 static void handle_state_ociVersion_section(GNode*, struct handler_data*);
@@ -769,6 +773,115 @@ cc_oci_state_file_exists (struct cc_oci_config *config)
 			G_FILE_TEST_EXISTS);
 }
 
+/** A parsed state file. */
+struct cc_oci_state_cached {
+	/** Parsed contents of the file. */
+	GNode  *node;
+
+	/** Details of the file when it was parsed. */
+	struct stat st;
+};
+
+/** Parsed state files (keyed by path), or \c NULL if state files
+ * are not cached.
+ */
+static GHashTable *cc_oci_state_cache;
+
+/*!
+ * Free a \ref cc_oci_state_cached.
+ *
+ * \param cached \ref cc_oci_state_cached.
+ */
+static void
+cc_oci_state_cached_free (struct cc_oci_state_cached *cached)
+{
+	g_free_node (cached->node);
+	g_free (cached);
+}
+
+/*!
+ * Keep parsed state files in memory.
+ *
+ * A state file is only parsed again once it has been replaced or
+ * modified, which benefits long-running processes (such as the
+ * daemon) that read the same state files repeatedly.
+ */
+void
+cc_oci_state_cache_enable (void)
+{
+	if (cc_oci_state_cache) {
+		return;
+	}
+
+	cc_oci_state_cache = g_hash_table_new_full (g_str_hash,
+			g_str_equal, g_free,
+			(GDestroyNotify)cc_oci_state_cached_free);
+}
+
+/*!
+ * Parse a state file, using the cached copy if it is still current.
+ *
+ * \param file Full path to \ref CC_OCI_STATE_FILE state file.
+ * \param[out] cached \c true if the returned node is owned by the
+ *   cache (and must not be freed), else \c false.
+ *
+ * \return Parsed contents of \p file on success, else \c NULL.
+ */
+static GNode *
+cc_oci_state_node_get (const char *file, gboolean *cached)
+{
+	struct cc_oci_state_cached  *entry;
+	struct stat                  st;
+	GNode                       *node = NULL;
+
+	*cached = false;
+
+	if (! cc_oci_state_cache) {
+		return cc_oci_json_parse (&node, file) ? node : NULL;
+	}
+
+	if (stat (file, &st) < 0) {
+		(void)g_hash_table_remove (cc_oci_state_cache, file);
+		return NULL;
+	}
+
+	entry = g_hash_table_lookup (cc_oci_state_cache, file);
+
+	/* State files are replaced (rather than rewritten) when they
+	 * change, but the size and times are checked too in case
+	 * the file was modified in place.
+	 */
+	if (entry && entry->st.st_ino == st.st_ino
+			&& entry->st.st_dev == st.st_dev
+			&& entry->st.st_size == st.st_size
+			&& entry->st.st_mtim.tv_sec == st.st_mtim.tv_sec
+			&& entry->st.st_mtim.tv_nsec == st.st_mtim.tv_nsec
+			&& entry->st.st_ctim.tv_sec == st.st_ctim.tv_sec
+			&& entry->st.st_ctim.tv_nsec == st.st_ctim.tv_nsec) {
+		*cached = true;
+		return entry->node;
+	}
+
+	if (! cc_oci_json_parse (&node, file)) {
+		(void)g_hash_table_remove (cc_oci_state_cache, file);
+		return NULL;
+	}
+
+	if (g_hash_table_size (cc_oci_state_cache) >= CC_OCI_STATE_CACHE_MAX) {
+		g_hash_table_remove_all (cc_oci_state_cache);
+	}
+
+	entry = g_new0 (struct cc_oci_state_cached, 1);
+	entry->node = node;
+	entry->st = st;
+
+	g_hash_table_replace (cc_oci_state_cache, g_strdup (file), entry);
+
+	*cached = true;
+
+	return node;
+}
+
 /*!
  * Read the state file.
  *
@@ -782,12 +895,14 @@ cc_oci_state_file_read (const char *file)
 	GNode* node = NULL;
 	struct oci_state *state = NULL;
 	struct state_handler* handler;
+	gboolean cached = false;
 
 	if (! file) {
 		return NULL;
 	}
 
-	if (! cc_oci_json_parse(&node, file)) {
+	node = cc_oci_state_node_get (file, &cached);
+	if (! node) {
 		g_critical("failed to parse json file: %s", file);
 		return NULL;
 	}
@@ -832,7 +947,9 @@ cc_oci_state_file_read (const char *file)
 	}
 
 out:
-	g_free_node(node);
+	if (! cached) {
+		g_free_node(node);
+	}
 	return state;
 }
 
@@ -1191,6 +1308,11 @@ cc_oci_state_file_delete (const struct cc_oci_config *config)
 
 	g_debug ("deleting state file %s", config->state.state_file_path);
 
+	if (cc_oci_state_cache) {
+		(void)g_hash_table_remove (cc_oci_state_cache,
+				config->state.state_file_path);
+	}
+
 	return g_unlink (config->state.state_file_path) == 0;
 }
 
@@ -31,5 +31,6 @@ gboolean cc_oci_state_file_exists (struct cc_oci_config *config);
 const char *cc_oci_status_to_str (enum oci_status status);
 enum oci_status cc_oci_str_to_status (const char *str);
 int cc_oci_status_length (void);
+void cc_oci_state_cache_enable (void);
 
 #endif /* _CC_OCI_STATE_H */
@@ -0,0 +1,289 @@
+/*
+ * This file is part of cc-oci-runtime.
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Phase tracing.
+ *
+ * When enabled, the duration of each phase of a sub-command is
+ * recorded (using the monotonic clock) and written on exit as a
+ * Chrome trace-event JSON file ("complete" events) next to the
+ * container's runtime directory, so that it survives "delete".
+ */
+
+#include <stdbool.h>
+#include <unistd.h>
+
+#include <glib.h>
+#include <json-glib/json-glib.h>
+
+#include "oci.h"
+#include "util.h"
+#include "trace.h"
+
+/** A single completed phase. */
+struct cc_oci_trace_event {
+	/** Event category (static string). */
+	const gchar *category;
+
+	/** Name of the phase. */
+	gchar *name;
+
+	/** Monotonic start time (microseconds). */
+	gint64 start;
+
+	/** Monotonic end time (microseconds). */
+	gint64 end;
+};
+
+/** Recorded \ref cc_oci_trace_event's (\c NULL if tracing is disabled). */
+static GArray *trace_events;
+
+/** Name of the sub-command being traced. */
+static gchar *trace_command;
+
+/*!
+ * Free the specified \ref cc_oci_trace_event.
+ *
+ * \param p \ref cc_oci_trace_event.
+ */
+static void
+cc_oci_trace_event_clear (gpointer p)
+{
+	struct cc_oci_trace_event *event = p;
+
+	g_free_if_set (event->name);
+}
+
+/*!
+ * Enable tracing for the specified sub-command.
+ *
+ * \param command Name of sub-command.
+ */
+void
+cc_oci_trace_init (const gchar *command)
+{
+	if (trace_events || ! command) {
+		return;
+	}
+
+	trace_events = g_array_new (false, true,
+			sizeof (struct cc_oci_trace_event));
+	g_array_set_clear_func (trace_events, cc_oci_trace_event_clear);
+
+	trace_command = g_strdup (command);
+}
+
+/*!
+ * Determine if tracing is enabled.
+ *
+ * \return \c true if enabled, else \c false.
+ */
+gboolean
+cc_oci_trace_enabled (void)
+{
+	return trace_events != NULL;
+}
+
+/*!
+ * Obtain a timestamp suitable for passing to cc_oci_trace_end().
+ *
+ * \return Monotonic time in microseconds, or \c 0 if tracing
+ * is disabled.
+ */
+gint64
+cc_oci_trace_now (void)
+{
+	return trace_events ? g_get_monotonic_time () : 0;
+}
+
+/*!
+ * Record a completed phase.
+ *
+ * \param category Event category (must be a static string).
+ * \param name Name of the phase.
+ * \param start Monotonic start time (microseconds).
+ * \param end Monotonic end time (microseconds).
+ */
+void
+cc_oci_trace_add (const gchar *category, const gchar *name,
+		gint64 start, gint64 end)
+{
+	struct cc_oci_trace_event event;
+
+	if (! (trace_events && category && name && start)) {
+		return;
+	}
+
+	event.category = category;
+	event.name = g_strdup (name);
+	event.start = start;
+	event.end = MAX (start, end);
+
+	g_array_append_val (trace_events, event);
+}
+
+/*!
+ * Record a phase that started at \p start and has just finished.
+ *
+ * \param category Event category (must be a static string).
+ * \param name Name of the phase.
+ * \param start Value returned by cc_oci_trace_now() when the phase
+ * started.
+ */
+void
+cc_oci_trace_end (const gchar *category, const gchar *name,
+		gint64 start)
+{
+	cc_oci_trace_add (category, name, start, cc_oci_trace_now ());
+}
+
+/*!
+ * Determine the path of the trace file for \p config.
+ *
+ * \param config \ref cc_oci_config.
+ *
+ * \return Newly-allocated string on success, else \c NULL.
+ */
+gchar *
+cc_oci_trace_file_path (const struct cc_oci_config *config)
+{
+	if (! (config && trace_command)) {
+		return NULL;
+	}
+
+	if (! config->state.runtime_path[0]) {
+		return NULL;
+	}
+
+	return g_strdup_printf ("%s.%s.%d" CC_OCI_TRACE_FILE_SUFFIX,
+			config->state.runtime_path,
+			trace_command,
+			(int)getpid ());
+}
+
+/*!
+ * Write all recorded phases to the trace file as Chrome trace-event
+ * JSON.
+ *
+ * \param config \ref cc_oci_config.
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+cc_oci_trace_write (const struct cc_oci_config *config)
+{
+	g_autofree gchar  *path = NULL;
+	JsonObject        *obj = NULL;
+	JsonObject        *data;
+	JsonArray         *events;
+	gchar             *str = NULL;
+	gsize              str_len = 0;
+	GError            *err = NULL;
+	gboolean           ret = false;
+	gint64             pid;
+
+	if (! trace_events) {
+		/* tracing disabled */
+		return true;
+	}
+
+	if (! config) {
+		return false;
+	}
+
+	path = cc_oci_trace_file_path (config);
+	if (! path) {
+		g_debug ("no container runtime path, not writing trace");
+		return true;
+	}
+
+	pid = (gint64)getpid ();
+
+	obj = json_object_new ();
+	events = json_array_new ();
+	data = json_object_new ();
+
+	for (guint i = 0; i < trace_events->len; i++) {
+		struct cc_oci_trace_event *event;
+		JsonObject                *e;
+
+		event = &g_array_index (trace_events,
+				struct cc_oci_trace_event, i);
+
+		e = json_object_new ();
+
+		json_object_set_string_member (e, "name", event->name);
+		json_object_set_string_member (e, "cat", event->category);
+		json_object_set_string_member (e, "ph", "X");
+		json_object_set_int_member (e, "ts", event->start);
+		json_object_set_int_member (e, "dur",
+				event->end - event->start);
+		json_object_set_int_member (e, "pid", pid);
+		json_object_set_int_member (e, "tid", pid);
+
+		json_array_add_object_element (events, e);
+	}
+
+	json_object_set_array_member (obj, "traceEvents", events);
+	json_object_set_string_member (obj, "displayTimeUnit", "ms");
+
+	json_object_set_string_member (data, "command", trace_command);
+	json_object_set_string_member (data, "container_id",
+			config->optarg_container_id ?
+			config->optarg_container_id : "");
+	json_object_set_object_member (obj, "otherData", data);
+
+	str = cc_oci_json_obj_to_string (obj, false, &str_len);
+	if (! str) {
+		goto out;
+	}
+
+	ret = g_file_set_contents (path, str, (gssize)str_len, &err);
+	if (! ret) {
+		g_critical ("failed to create trace file %s: %s",
+				path, err->message);
+		g_error_free (err);
+		goto out;
+	}
+
+	g_debug ("created trace file %s", path);
+
+out:
+	json_object_unref (obj);
+	g_free_if_set (str);
+
+	return ret;
+}
+
+/*!
+ * Discard all recorded phases and disable tracing.
+ */
+void
+cc_oci_trace_free (void)
+{
+	if (trace_events) {
+		g_array_free (trace_events, true);
+		trace_events = NULL;
+	}
+
+	g_free_if_set (trace_command);
+}
@@ -0,0 +1,57 @@
+/*
+ * This file is part of cc-oci-runtime.
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _CC_OCI_TRACE_H
+#define _CC_OCI_TRACE_H
+
+#include <glib.h>
+
+#include "oci.h"
+
+/** Environment variable which, if set (to any value), enables
+ * tracing (equivalent to the \c --trace global option).
+ */
+#define CC_OCI_TRACE_ENV		"CC_OCI_TRACE"
+
+/** Suffix of the trace file written next to the container's
+ * runtime directory.
+ */
+#define CC_OCI_TRACE_FILE_SUFFIX	".trace.json"
+
+/** Trace event categories. */
+#define CC_OCI_TRACE_COMMAND		"command"
+#define CC_OCI_TRACE_LAUNCH		"launch"
+#define CC_OCI_TRACE_PHASE		"phase"
+#define CC_OCI_TRACE_HOOK		"hook"
+#define CC_OCI_TRACE_PROXY		"proxy"
+#define CC_OCI_TRACE_READY		"ready"
+
+void cc_oci_trace_init (const gchar *command);
+gboolean cc_oci_trace_enabled (void);
+gint64 cc_oci_trace_now (void);
+void cc_oci_trace_add (const gchar *category, const gchar *name,
+		gint64 start, gint64 end);
+void cc_oci_trace_end (const gchar *category, const gchar *name,
+		gint64 start);
+gchar *cc_oci_trace_file_path (const struct cc_oci_config *config);
+gboolean cc_oci_trace_write (const struct cc_oci_config *config);
+void cc_oci_trace_free (void);
+
+#endif /* _CC_OCI_TRACE_H */
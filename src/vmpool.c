@@ -0,0 +1,1260 @@
+/*
+ * This file is part of cc-oci-runtime.
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Pool of pre-booted, paused VMs.
+ *
+ * A pool is filled by a long-running "pool" sub-command which boots
+ * VMs from the hypervisor arguments template, lets them boot and then
+ * pauses them (QMP "stop"). Each VM lives in its own "slot" directory
+ * below \ref CC_OCI_VM_POOL_DIR_PREFIX:
+ *
+ *     <prefix>/<template hash>/.lock
+ *     <prefix>/<template hash>/stats
+ *     <prefix>/<template hash>/<slot>/{hypervisor.sock,ga-ctl.sock,...}
+ *     <prefix>/<template hash>/<slot>/share
+ *     <prefix>/<template hash>/<slot>/ready
+ *
+ * The "share" directory is a shared tmpfs mount which is exported to
+ * the guest as the 9p workload share. When "create" claims a VM, the
+ * container workload is bind-mounted below it (the mount propagates
+ * to the hypervisors mount namespace), network devices are
+ * hot-attached over QMP and the VM is resumed.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/file.h>
+#include <sys/mount.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <glib-unix.h>
+#include <json-glib/json-glib.h>
+
+#include "oci.h"
+#include "util.h"
+#include "hypervisor.h"
+#include "network.h"
+#include "vmpool.h"
+#include "common.h"
+
+/** Name of the file used to serialise access to a pool. */
+#define CC_OCI_VM_POOL_LOCK_FILE	".lock"
+
+/** Name of the file holding the hit/miss counters of a pool. */
+#define CC_OCI_VM_POOL_STATS_FILE	"stats"
+
+/** Group name used in \ref CC_OCI_VM_POOL_STATS_FILE. */
+#define CC_OCI_VM_POOL_STATS_GROUP	"stats"
+
+/** Name of the 9p-shared directory below a slot. */
+#define CC_OCI_VM_POOL_SHARE_DIR	"share"
+
+/** Name of the file containing the hypervisor pid of a slot. */
+#define CC_OCI_VM_POOL_PID_FILE		"hypervisor.pid"
+
+/** Marker file denoting a slot is booted, paused and claimable. */
+#define CC_OCI_VM_POOL_READY		"ready"
+
+/** Marker file denoting a slot has been claimed by a container. */
+#define CC_OCI_VM_POOL_CLAIMED		"claimed"
+
+/* Value passed in from automake.
+ *
+ * XXX: Assigned to a variable to allow the tests to modify the value.
+ */
+private gchar *vm_pool_dir = CC_OCI_VM_POOL_DIR_PREFIX;
+
+/** A VM that has been launched but not yet paused. */
+struct cc_oci_vm_pool_slot {
+	/** Full path to the slot directory. */
+	gchar   *path;
+
+	/** Hypervisor pid. */
+	GPid     pid;
+
+	/** Monotonic time the hypervisor was launched at. */
+	gint64   launched;
+};
+
+/** State of a running pool. */
+struct cc_oci_vm_pool {
+	/** Configuration used to boot the VMs. */
+	struct cc_oci_config                 *config;
+
+	/** Pool options. */
+	const struct cc_oci_vm_pool_options  *options;
+
+	/** Directory containing the slots of this pool. */
+	gchar                                *key_dir;
+
+	/** List of \ref cc_oci_vm_pool_slot that are still booting. */
+	GSList                               *booting;
+
+	/** Main loop driving the pool. */
+	GMainLoop                            *loop;
+};
+
+/*!
+ * Determine the directory holding the pool to use for \p config.
+ *
+ * \param config \ref cc_oci_config.
+ *
+ * \return Newly-allocated string on success, else \c NULL.
+ */
+private gchar *
+cc_oci_vm_pool_key_dir (const struct cc_oci_config *config)
+{
+	g_autofree gchar *key = NULL;
+
+	if (! config) {
+		return NULL;
+	}
+
+	key = cc_oci_vm_args_template_hash (config);
+	if (! key) {
+		return NULL;
+	}
+
+	return g_build_path ("/", vm_pool_dir, key, NULL);
+}
+
+/*!
+ * Take the (exclusive) lock for the pool in \p key_dir.
+ *
+ * \param key_dir Pool directory.
+ *
+ * \return Locked file descriptor on success, else \c -1.
+ */
+static int
+cc_oci_vm_pool_lock (const gchar *key_dir)
+{
+	g_autofree gchar *path = NULL;
+	int               fd;
+
+	path = g_build_path ("/", key_dir, CC_OCI_VM_POOL_LOCK_FILE, NULL);
+
+	fd = open (path, O_CREAT | O_RDWR | O_CLOEXEC, 0600);
+	if (fd < 0) {
+		g_critical ("failed to open %s: %s", path, strerror (errno));
+		return -1;
+	}
+
+	if (flock (fd, LOCK_EX) < 0) {
+		g_critical ("failed to lock %s: %s", path, strerror (errno));
+		close (fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+/*!
+ * Release a lock taken by cc_oci_vm_pool_lock().
+ *
+ * \param fd Locked file descriptor.
+ */
+static void
+cc_oci_vm_pool_unlock (int fd)
+{
+	if (fd < 0) {
+		return;
+	}
+
+	(void)flock (fd, LOCK_UN);
+	close (fd);
+}
+
+/*!
+ * Increment one of the counters of the pool in \p key_dir.
+ *
+ * \note Caller must hold the pool lock.
+ *
+ * \param key_dir Pool directory.
+ * \param hit If \c true, increment the hit counter, else the miss
+ *   counter.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+cc_oci_vm_pool_stats_update (const gchar *key_dir, gboolean hit)
+{
+	g_autofree gchar *path = NULL;
+	GKeyFile         *key_file = NULL;
+	GError           *error = NULL;
+	const gchar      *name;
+	guint64           value;
+	gboolean          ret = false;
+
+	path = g_build_path ("/", key_dir, CC_OCI_VM_POOL_STATS_FILE, NULL);
+	name = hit ? "hits" : "misses";
+
+	key_file = g_key_file_new ();
+
+	/* the file does not exist until the first update */
+	(void)g_key_file_load_from_file (key_file, path,
+			G_KEY_FILE_NONE, NULL);
+
+	value = g_key_file_get_uint64 (key_file,
+			CC_OCI_VM_POOL_STATS_GROUP, name, NULL);
+	g_key_file_set_uint64 (key_file,
+			CC_OCI_VM_POOL_STATS_GROUP, name, value + 1);
+
+	if (! g_key_file_save_to_file (key_file, path, &error)) {
+		g_critical ("failed to update %s: %s", path, error->message);
+		g_error_free (error);
+		goto out;
+	}
+
+	ret = true;
+
+out:
+	g_key_file_free (key_file);
+
+	return ret;
+}
+
+/*!
+ * Read the hypervisor pid of a slot.
+ *
+ * \param slot Slot directory.
+ *
+ * \return pid on success, else \c -1.
+ */
+static GPid
+cc_oci_vm_pool_slot_pid (const gchar *slot)
+{
+	g_autofree gchar *path = NULL;
+	g_autofree gchar *contents = NULL;
+	gint64            pid;
+
+	path = g_build_path ("/", slot, CC_OCI_VM_POOL_PID_FILE, NULL);
+
+	if (! g_file_get_contents (path, &contents, NULL, NULL)) {
+		return -1;
+	}
+
+	pid = g_ascii_strtoll (contents, NULL, 10);
+	if (pid <= 0 || pid > G_MAXINT) {
+		return -1;
+	}
+
+	return (GPid)pid;
+}
+
+/*!
+ * Determine if the slot has the specified marker file.
+ *
+ * \param slot Slot directory.
+ * \param marker \ref CC_OCI_VM_POOL_READY or \ref CC_OCI_VM_POOL_CLAIMED.
+ *
+ * \return \c true if the marker exists, else \c false.
+ */
+static gboolean
+cc_oci_vm_pool_slot_has (const gchar *slot, const gchar *marker)
+{
+	g_autofree gchar *path = NULL;
+
+	path = g_build_path ("/", slot, marker, NULL);
+
+	return g_file_test (path, G_FILE_TEST_EXISTS);
+}
+
+/*!
+ * Stop the hypervisor of a slot (if any) and remove the slot.
+ *
+ * \param slot Slot directory.
+ * \param pid Hypervisor pid, or \c -1 if unknown.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+cc_oci_vm_pool_slot_destroy (const gchar *slot, GPid pid)
+{
+	g_autofree gchar *share = NULL;
+
+	if (! slot) {
+		return false;
+	}
+
+	if (pid > 0) {
+		(void)kill (pid, SIGKILL);
+	}
+
+	share = g_build_path ("/", slot, CC_OCI_VM_POOL_SHARE_DIR, NULL);
+
+	/* Detach the tmpfs along with any workload mounts below it */
+	if (umount2 (share, MNT_DETACH) < 0
+			&& errno != EINVAL && errno != ENOENT) {
+		g_warning ("failed to unmount %s: %s",
+				share, strerror (errno));
+	}
+
+	return cc_oci_rm_rf (slot);
+}
+
+/*!
+ * Launch a hypervisor that is not a child of the current process.
+ *
+ * The hypervisor is double-forked (and placed in a new session) so
+ * that it survives the pool process and can be adopted by whichever
+ * container claims it.
+ *
+ * \param args Hypervisor command-line.
+ *
+ * \return Hypervisor pid on success, else \c -1.
+ */
+static GPid
+cc_oci_vm_pool_spawn (gchar **args)
+{
+	gchar    *joined = NULL;
+	gchar   **argv = NULL;
+	int       pid_pipe[2] = { -1, -1 };
+	int       err_pipe[2] = { -1, -1 };
+	GPid      pid = -1;
+	GPid      vm_pid = -1;
+	pid_t     child;
+	ssize_t   bytes;
+	char      buffer[2] = { '\0' };
+	int       status = 0;
+	int       fd;
+
+	if (! (args && args[0])) {
+		return -1;
+	}
+
+	/* Expanded arguments may contain embedded newlines (for
+	 * example "-net\nnone"), each of which starts a new argument.
+	 */
+	joined = g_strjoinv ("\n", args);
+	argv = g_strsplit_set (joined, "\n", -1);
+	if (! (argv && argv[0])) {
+		g_critical ("failed to split hypervisor args");
+		goto out;
+	}
+
+	if (pipe2 (pid_pipe, O_CLOEXEC) < 0
+			|| pipe2 (err_pipe, O_CLOEXEC) < 0) {
+		g_critical ("failed to create pipe: %s", strerror (errno));
+		goto out;
+	}
+
+	child = fork ();
+	if (child < 0) {
+		g_critical ("failed to create child: %s", strerror (errno));
+		goto out;
+	}
+
+	if (! child) {
+		/* intermediate child */
+		(void)setsid ();
+
+		child = fork ();
+		if (child < 0) {
+			(void)write (err_pipe[1], "E", 1);
+			_exit (EXIT_FAILURE);
+		} else if (child > 0) {
+			(void)write (pid_pipe[1], &child, sizeof (child));
+			_exit (EXIT_SUCCESS);
+		}
+
+		/* hypervisor */
+		fd = open ("/dev/null", O_RDWR);
+		if (fd >= 0) {
+			dup2 (fd, STDIN_FILENO);
+			dup2 (fd, STDOUT_FILENO);
+			dup2 (fd, STDERR_FILENO);
+			if (fd > STDERR_FILENO) {
+				close (fd);
+			}
+		}
+
+		execvp (argv[0], argv);
+
+		(void)write (err_pipe[1], "E", 1);
+		_exit (EXIT_FAILURE);
+	}
+
+	close (pid_pipe[1]);
+	pid_pipe[1] = -1;
+	close (err_pipe[1]);
+	err_pipe[1] = -1;
+
+	if (waitpid (child, &status, 0) != child) {
+		g_critical ("failed to wait for child %d: %s",
+				(int)child, strerror (errno));
+		goto out;
+	}
+
+	bytes = read (pid_pipe[0], &pid, sizeof (pid));
+	if (bytes != (ssize_t)sizeof (pid) || pid <= 0) {
+		g_critical ("failed to read hypervisor pid");
+		pid = -1;
+		goto out;
+	}
+
+	/* blocks until the exec succeeds (pipe closed) or fails */
+	bytes = read (err_pipe[0], buffer, sizeof (buffer));
+	if (bytes > 0) {
+		g_critical ("failed to launch %s", argv[0]);
+		goto out;
+	}
+
+	vm_pid = pid;
+
+out:
+	g_free_if_set (joined);
+	g_strfreev (argv);
+	if (pid_pipe[0] != -1) close (pid_pipe[0]);
+	if (pid_pipe[1] != -1) close (pid_pipe[1]);
+	if (err_pipe[0] != -1) close (err_pipe[0]);
+	if (err_pipe[1] != -1) close (err_pipe[1]);
+
+	return vm_pid;
+}
+
+/*!
+ * Create a new slot and boot a VM in it.
+ *
+ * \param pool \ref cc_oci_vm_pool.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+cc_oci_vm_pool_slot_launch (struct cc_oci_vm_pool *pool)
+{
+	struct cc_oci_config        *config = NULL;
+	struct cc_oci_vm_pool_slot  *slot = NULL;
+	GPtrArray                   *additional_args = NULL;
+	gchar                      **args = NULL;
+	g_autofree gchar            *name = NULL;
+	g_autofree gchar            *path = NULL;
+	g_autofree gchar            *share = NULL;
+	g_autofree gchar            *pid_file = NULL;
+	uint64_t                    *bytes = NULL;
+	GPid                         pid = -1;
+	gboolean                     ret = false;
+
+	bytes = (uint64_t *)get_random_bytes (8);
+	if (! bytes) {
+		return false;
+	}
+
+	name = g_strdup_printf ("vm-%016" PRIx64, *bytes);
+	g_free (bytes);
+
+	path = g_build_path ("/", pool->key_dir, name, NULL);
+	share = g_build_path ("/", path, CC_OCI_VM_POOL_SHARE_DIR, NULL);
+
+	if (g_mkdir_with_parents (share, CC_OCI_DIR_MODE) < 0) {
+		g_critical ("failed to create %s: %s", share, strerror (errno));
+		goto out;
+	}
+
+	/* The share must be a mount point (so that the hypervisor keeps
+	 * seeing mounts added below it) and shared (so that mounts
+	 * added from a container mount namespace propagate back).
+	 */
+	if (mount ("tmpfs", share, "tmpfs", MS_NOSUID | MS_NODEV,
+				"mode=0755") < 0) {
+		g_critical ("failed to mount tmpfs on %s: %s",
+				share, strerror (errno));
+		goto out;
+	}
+
+	if (mount (NULL, share, NULL, MS_SHARED, NULL) < 0) {
+		g_critical ("failed to make %s shared: %s",
+				share, strerror (errno));
+		goto out;
+	}
+
+	/* Build a throw-away configuration for the slot. The VM
+	 * configuration and bundle are borrowed from the pool.
+	 */
+	config = cc_oci_config_create ();
+	if (! config) {
+		goto out;
+	}
+
+	config->vm = pool->config->vm;
+	config->bundle_path = pool->config->bundle_path;
+
+	g_strlcpy (config->state.runtime_path, path,
+			sizeof (config->state.runtime_path));
+	g_snprintf (config->state.comms_path,
+			sizeof (config->state.comms_path),
+			"%s/%s", path, CC_OCI_HYPERVISOR_SOCKET);
+	g_snprintf (config->state.procsock_path,
+			sizeof (config->state.procsock_path),
+			"%s/%s", path, CC_OCI_PROCESS_SOCKET);
+	g_strlcpy (config->workload_dir, share,
+			sizeof (config->workload_dir));
+
+	additional_args = g_ptr_array_new_with_free_func (g_free);
+
+	cc_oci_populate_extra_args (config, additional_args);
+	if (! cc_oci_vm_args_get (config, &args, additional_args)) {
+		goto out;
+	}
+
+	pid = cc_oci_vm_pool_spawn (args);
+	if (pid < 0) {
+		goto out;
+	}
+
+	pid_file = g_build_path ("/", path, CC_OCI_VM_POOL_PID_FILE, NULL);
+	if (! cc_oci_create_pidfile (pid_file, pid)) {
+		goto out;
+	}
+
+	slot = g_new0 (struct cc_oci_vm_pool_slot, 1);
+	slot->path = g_strdup (path);
+	slot->pid = pid;
+	slot->launched = g_get_monotonic_time ();
+
+	pool->booting = g_slist_append (pool->booting, slot);
+
+	g_debug ("booting pool VM %s (pid %d)", name, (int)pid);
+
+	ret = true;
+
+out:
+	if (config) {
+		config->vm = NULL;
+		config->bundle_path = NULL;
+		cc_oci_config_free (config);
+	}
+	if (additional_args) {
+		g_ptr_array_free (additional_args, TRUE);
+	}
+	if (args) {
+		g_strfreev (args);
+	}
+	if (! ret) {
+		(void)cc_oci_vm_pool_slot_destroy (path, pid);
+	}
+
+	return ret;
+}
+
+/*!
+ * Free a \ref cc_oci_vm_pool_slot.
+ *
+ * \param slot \ref cc_oci_vm_pool_slot.
+ */
+static void
+cc_oci_vm_pool_slot_free (struct cc_oci_vm_pool_slot *slot)
+{
+	if (! slot) {
+		return;
+	}
+
+	g_free_if_set (slot->path);
+	g_free (slot);
+}
+
+/*!
+ * Pause the VMs that have been given enough time to boot and make
+ * them claimable.
+ *
+ * \param pool \ref cc_oci_vm_pool.
+ */
+static void
+cc_oci_vm_pool_settle (struct cc_oci_vm_pool *pool)
+{
+	GSList  *l;
+	GSList  *next;
+	gint64   now = g_get_monotonic_time ();
+	gint64   boot_wait = (gint64)pool->options->boot_wait * 1000;
+
+	for (l = pool->booting; l; l = next) {
+		struct cc_oci_vm_pool_slot *slot = l->data;
+		g_autofree gchar *comms_path = NULL;
+		g_autofree gchar *ready = NULL;
+
+		next = g_slist_next (l);
+
+		if ((now - slot->launched) < boot_wait) {
+			continue;
+		}
+
+		pool->booting = g_slist_delete_link (pool->booting, l);
+
+		comms_path = g_build_path ("/", slot->path,
+				CC_OCI_HYPERVISOR_SOCKET, NULL);
+		ready = g_build_path ("/", slot->path,
+				CC_OCI_VM_POOL_READY, NULL);
+
+		if (! cc_oci_vm_pause (comms_path, slot->pid)) {
+			g_critical ("failed to pause pool VM %s", slot->path);
+			(void)cc_oci_vm_pool_slot_destroy (slot->path, slot->pid);
+		} else if (! g_file_set_contents (ready, "", 0, NULL)) {
+			g_critical ("failed to mark pool VM %s ready",
+					slot->path);
+			(void)cc_oci_vm_pool_slot_destroy (slot->path, slot->pid);
+		} else {
+			g_debug ("pool VM %s ready", slot->path);
+		}
+
+		cc_oci_vm_pool_slot_free (slot);
+	}
+}
+
+/*!
+ * Count the unclaimed slots of a pool, removing any whose hypervisor
+ * has gone away.
+ *
+ * \note Caller must hold the pool lock.
+ *
+ * \param key_dir Pool directory.
+ * \param[out] ready Number of claimable slots (optional).
+ * \param[out] claimed Number of claimed slots (optional).
+ *
+ * \return Number of unclaimed (booting or ready) slots.
+ */
+static guint
+cc_oci_vm_pool_count (const gchar *key_dir, guint *ready, guint *claimed)
+{
+	GDir         *dir;
+	const gchar  *name;
+	guint         count = 0;
+
+	if (ready) {
+		*ready = 0;
+	}
+	if (claimed) {
+		*claimed = 0;
+	}
+
+	dir = g_dir_open (key_dir, 0x0, NULL);
+	if (! dir) {
+		return 0;
+	}
+
+	while ((name = g_dir_read_name (dir)) != NULL) {
+		g_autofree gchar *slot = NULL;
+		GPid              pid;
+		gboolean          is_ready;
+
+		slot = g_build_path ("/", key_dir, name, NULL);
+		if (! g_file_test (slot, G_FILE_TEST_IS_DIR)) {
+			continue;
+		}
+
+		if (cc_oci_vm_pool_slot_has (slot, CC_OCI_VM_POOL_CLAIMED)) {
+			if (claimed) {
+				(*claimed)++;
+			}
+			continue;
+		}
+
+		is_ready = cc_oci_vm_pool_slot_has (slot,
+				CC_OCI_VM_POOL_READY);
+
+		/* A slot without a pid file is still being launched */
+		pid = cc_oci_vm_pool_slot_pid (slot);
+		if ((pid <= 0 && is_ready)
+				|| (pid > 0 && kill (pid, 0) < 0)) {
+			g_warning ("removing stale pool VM %s", slot);
+			(void)cc_oci_vm_pool_slot_destroy (slot, -1);
+			continue;
+		}
+
+		if (ready && is_ready) {
+			(*ready)++;
+		}
+
+		count++;
+	}
+
+	g_dir_close (dir);
+
+	return count;
+}
+
+/*!
+ * Pool timer callback: pause booted VMs and boot a new one if the
+ * pool is not full.
+ *
+ * \param pool \ref cc_oci_vm_pool.
+ *
+ * \return \c G_SOURCE_CONTINUE.
+ */
+static gboolean
+cc_oci_vm_pool_refill (struct cc_oci_vm_pool *pool)
+{
+	guint  count;
+	int    lock_fd;
+
+	cc_oci_vm_pool_settle (pool);
+
+	lock_fd = cc_oci_vm_pool_lock (pool->key_dir);
+	if (lock_fd < 0) {
+		return G_SOURCE_CONTINUE;
+	}
+
+	count = cc_oci_vm_pool_count (pool->key_dir, NULL, NULL);
+
+	cc_oci_vm_pool_unlock (lock_fd);
+
+	if (count < pool->options->size) {
+		(void)cc_oci_vm_pool_slot_launch (pool);
+	}
+
+	return G_SOURCE_CONTINUE;
+}
+
+/*!
+ * Signal handler used to stop the pool.
+ *
+ * \param loop \c GMainLoop.
+ *
+ * \return \c G_SOURCE_REMOVE.
+ */
+static gboolean
+cc_oci_vm_pool_quit (GMainLoop *loop)
+{
+	g_main_loop_quit (loop);
+
+	return G_SOURCE_REMOVE;
+}
+
+/*!
+ * Destroy all unclaimed slots of a pool.
+ *
+ * \param pool \ref cc_oci_vm_pool.
+ */
+static void
+cc_oci_vm_pool_drain (struct cc_oci_vm_pool *pool)
+{
+	GDir         *dir;
+	const gchar  *name;
+	int           lock_fd;
+
+	g_slist_free_full (pool->booting,
+			(GDestroyNotify)cc_oci_vm_pool_slot_free);
+	pool->booting = NULL;
+
+	lock_fd = cc_oci_vm_pool_lock (pool->key_dir);
+	if (lock_fd < 0) {
+		return;
+	}
+
+	dir = g_dir_open (pool->key_dir, 0x0, NULL);
+	if (! dir) {
+		goto out;
+	}
+
+	while ((name = g_dir_read_name (dir)) != NULL) {
+		g_autofree gchar *slot = NULL;
+
+		slot = g_build_path ("/", pool->key_dir, name, NULL);
+		if (! g_file_test (slot, G_FILE_TEST_IS_DIR)) {
+			continue;
+		}
+
+		if (cc_oci_vm_pool_slot_has (slot, CC_OCI_VM_POOL_CLAIMED)) {
+			continue;
+		}
+
+		(void)cc_oci_vm_pool_slot_destroy (slot,
+				cc_oci_vm_pool_slot_pid (slot));
+	}
+
+	g_dir_close (dir);
+
+out:
+	cc_oci_vm_pool_unlock (lock_fd);
+}
+
+/*!
+ * Maintain a pool of pre-booted, paused VMs for \p config until
+ * interrupted.
+ *
+ * \param config \ref cc_oci_config (with the VM configuration loaded).
+ * \param options \ref cc_oci_vm_pool_options.
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+cc_oci_vm_pool_run (struct cc_oci_config *config,
+		const struct cc_oci_vm_pool_options *options)
+{
+	struct cc_oci_vm_pool  pool = { 0 };
+	gboolean               ret = false;
+
+	if (! (config && config->vm && options)) {
+		return false;
+	}
+
+	if (! (options->size && options->refill_rate)) {
+		g_critical ("pool size and refill rate must be non-zero");
+		return false;
+	}
+
+	pool.config = config;
+	pool.options = options;
+
+	pool.key_dir = cc_oci_vm_pool_key_dir (config);
+	if (! pool.key_dir) {
+		g_critical ("failed to determine VM pool");
+		goto out;
+	}
+
+	if (g_mkdir_with_parents (pool.key_dir, CC_OCI_DIR_MODE) < 0) {
+		g_critical ("failed to create %s: %s",
+				pool.key_dir, strerror (errno));
+		goto out;
+	}
+
+	g_debug ("maintaining %u VMs in %s", options->size, pool.key_dir);
+
+	pool.loop = g_main_loop_new (NULL, false);
+
+	g_unix_signal_add (SIGINT, (GSourceFunc)cc_oci_vm_pool_quit,
+			pool.loop);
+	g_unix_signal_add (SIGTERM, (GSourceFunc)cc_oci_vm_pool_quit,
+			pool.loop);
+
+	g_timeout_add (1000 / options->refill_rate,
+			(GSourceFunc)cc_oci_vm_pool_refill, &pool);
+
+	g_main_loop_run (pool.loop);
+
+	cc_oci_vm_pool_drain (&pool);
+
+	ret = true;
+
+out:
+	if (pool.loop) {
+		g_main_loop_unref (pool.loop);
+	}
+	g_free_if_set (pool.key_dir);
+
+	return ret;
+}
+
+/*!
+ * Claim a pre-booted VM for \p config, if one is available.
+ *
+ * On success, the container runtime directory contains links to the
+ * sockets of the claimed VM, and \c config->vm->pid is set. The VM
+ * remains paused until cc_oci_vm_pool_attach() is called.
+ *
+ * \param config \ref cc_oci_config.
+ * \param[out] claimed \c true if a VM was claimed, else \c false
+ *   (caller should launch a VM).
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+cc_oci_vm_pool_claim (struct cc_oci_config *config, gboolean *claimed)
+{
+	g_autofree gchar  *key_dir = NULL;
+	g_autofree gchar  *slot = NULL;
+	GDir              *dir = NULL;
+	const gchar       *name;
+	GPid               pid = -1;
+	int                lock_fd = -1;
+	gboolean           ret = false;
+	struct cc_proxy   *proxy;
+
+	const gchar *sockets[] = {
+		CC_OCI_HYPERVISOR_SOCKET,
+		CC_OCI_PROCESS_SOCKET,
+		CC_OCI_CONSOLE_SOCKET,
+		CC_OCI_AGENT_CTL_SOCKET,
+		CC_OCI_AGENT_TTY_SOCKET,
+		NULL
+	};
+
+	if (! (config && config->vm && config->proxy && claimed)) {
+		return false;
+	}
+
+	*claimed = false;
+
+	if (! g_file_test (vm_pool_dir, G_FILE_TEST_IS_DIR)) {
+		/* pooling disabled */
+		return true;
+	}
+
+	/* Pods add containers to the share after the VM is launched and
+	 * block devices cannot be hot-attached yet.
+	 */
+	if (config->pod || config->device_name) {
+		g_debug ("VM pool not usable for this container");
+		return true;
+	}
+
+	key_dir = cc_oci_vm_pool_key_dir (config);
+	if (! key_dir) {
+		/* let the normal launch report the problem */
+		return true;
+	}
+
+	if (g_mkdir_with_parents (key_dir, CC_OCI_DIR_MODE) < 0) {
+		g_critical ("failed to create %s: %s",
+				key_dir, strerror (errno));
+		return false;
+	}
+
+	lock_fd = cc_oci_vm_pool_lock (key_dir);
+	if (lock_fd < 0) {
+		return false;
+	}
+
+	dir = g_dir_open (key_dir, 0x0, NULL);
+
+	while (dir && (name = g_dir_read_name (dir)) != NULL) {
+		g_autofree gchar *path = NULL;
+		g_autofree gchar *ready = NULL;
+		g_autofree gchar *taken = NULL;
+
+		path = g_build_path ("/", key_dir, name, NULL);
+		ready = g_build_path ("/", path, CC_OCI_VM_POOL_READY, NULL);
+		taken = g_build_path ("/", path, CC_OCI_VM_POOL_CLAIMED, NULL);
+
+		if (! g_file_test (ready, G_FILE_TEST_EXISTS)) {
+			continue;
+		}
+
+		pid = cc_oci_vm_pool_slot_pid (path);
+		if (pid <= 0 || kill (pid, 0) < 0) {
+			g_warning ("removing stale pool VM %s", path);
+			(void)cc_oci_vm_pool_slot_destroy (path, -1);
+			continue;
+		}
+
+		if (g_rename (ready, taken) < 0) {
+			continue;
+		}
+
+		slot = g_strdup (path);
+		break;
+	}
+
+	(void)cc_oci_vm_pool_stats_update (key_dir, slot != NULL);
+
+	if (! slot) {
+		g_debug ("VM pool %s empty", key_dir);
+		ret = true;
+		goto out;
+	}
+
+	/* Make the VM sockets available at their usual locations */
+	for (const gchar **sock = sockets; *sock; sock++) {
+		g_autofree gchar *from = NULL;
+		g_autofree gchar *to = NULL;
+
+		from = g_build_path ("/", slot, *sock, NULL);
+		to = g_build_path ("/", config->state.runtime_path,
+				*sock, NULL);
+
+		if (symlink (from, to) < 0) {
+			g_critical ("failed to link %s to %s: %s",
+					to, from, strerror (errno));
+			goto out;
+		}
+	}
+
+	{
+		g_autofree gchar *to = NULL;
+
+		to = g_build_path ("/", config->state.runtime_path,
+				CC_OCI_VM_POOL_SLOT_LINK, NULL);
+
+		if (symlink (slot, to) < 0) {
+			g_critical ("failed to link %s to %s: %s",
+					to, slot, strerror (errno));
+			goto out;
+		}
+	}
+
+	proxy = config->proxy;
+
+	g_free_if_set (proxy->vm_console_socket);
+	g_free_if_set (proxy->agent_ctl_socket);
+	g_free_if_set (proxy->agent_tty_socket);
+
+	proxy->vm_console_socket = g_build_path ("/",
+			config->state.runtime_path,
+			CC_OCI_CONSOLE_SOCKET, NULL);
+	proxy->agent_ctl_socket = g_build_path ("/",
+			config->state.runtime_path,
+			CC_OCI_AGENT_CTL_SOCKET, NULL);
+	proxy->agent_tty_socket = g_build_path ("/",
+			config->state.runtime_path,
+			CC_OCI_AGENT_TTY_SOCKET, NULL);
+
+	config->vm->pid = pid;
+	*claimed = true;
+
+	g_debug ("claimed pool VM %s (pid %d)", slot, (int)pid);
+
+	ret = true;
+
+out:
+	if (dir) {
+		g_dir_close (dir);
+	}
+
+	if (slot && ! ret) {
+		/* The VM is in an unknown state, so don't return it */
+		(void)cc_oci_vm_pool_slot_destroy (slot, pid);
+	}
+
+	cc_oci_vm_pool_unlock (lock_fd);
+
+	return ret;
+}
+
+/*!
+ * Determine the pool slot used by \p config.
+ *
+ * \param config \ref cc_oci_config.
+ *
+ * \return Newly-allocated string on success, else \c NULL.
+ */
+static gchar *
+cc_oci_vm_pool_slot_get (const struct cc_oci_config *config)
+{
+	g_autofree gchar *link = NULL;
+
+	link = g_build_path ("/", config->state.runtime_path,
+			CC_OCI_VM_POOL_SLOT_LINK, NULL);
+
+	return g_file_read_link (link, NULL);
+}
+
+/*!
+ * Hand a claimed VM over to the container: expose the workload to the
+ * guest, hot-attach the network devices and resume the VM.
+ *
+ * \note Must be called after the container network has been created.
+ *
+ * \param config \ref cc_oci_config.
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+cc_oci_vm_pool_attach (struct cc_oci_config *config)
+{
+	g_autofree gchar  *slot = NULL;
+	g_autofree gchar  *share = NULL;
+	GDir              *dir = NULL;
+	const gchar       *name;
+	gchar             *workload_dir;
+	gboolean           ret = false;
+
+	if (! (config && config->vm)) {
+		return false;
+	}
+
+	slot = cc_oci_vm_pool_slot_get (config);
+	if (! slot) {
+		g_critical ("container is not using a pool VM");
+		return false;
+	}
+
+	share = g_build_path ("/", slot, CC_OCI_VM_POOL_SHARE_DIR, NULL);
+
+	workload_dir = cc_oci_get_workload_dir (config);
+	if (! (workload_dir && *workload_dir)) {
+		g_critical ("No workload");
+		return false;
+	}
+
+	dir = g_dir_open (workload_dir, 0x0, NULL);
+	if (! dir) {
+		g_critical ("failed to open %s", workload_dir);
+		return false;
+	}
+
+	/* Mirror the workload directory into the share. Each entry is
+	 * bind-mounted (rather than the workload directory itself) since
+	 * the hypervisor holds a reference to the share directory.
+	 */
+	while ((name = g_dir_read_name (dir)) != NULL) {
+		g_autofree gchar *from = NULL;
+		g_autofree gchar *to = NULL;
+
+		from = g_build_path ("/", workload_dir, name, NULL);
+		to = g_build_path ("/", share, name, NULL);
+
+		if (g_file_test (from, G_FILE_TEST_IS_DIR)) {
+			if (g_mkdir (to, CC_OCI_DIR_MODE) < 0) {
+				g_critical ("failed to create %s: %s",
+						to, strerror (errno));
+				goto out;
+			}
+		} else if (! g_file_set_contents (to, "", 0, NULL)) {
+			g_critical ("failed to create %s", to);
+			goto out;
+		}
+
+		if (mount (from, to, NULL, MS_BIND | MS_REC, NULL) < 0) {
+			g_critical ("failed to bind mount %s to %s: %s",
+					from, to, strerror (errno));
+			goto out;
+		}
+	}
+
+	if (! cc_oci_vm_netdev_add (config->state.comms_path,
+				config->vm->pid, config)) {
+		g_critical ("failed to attach network to pool VM");
+		goto out;
+	}
+
+	if (! cc_oci_vm_resume (config->state.comms_path,
+				config->vm->pid)) {
+		g_critical ("failed to resume pool VM");
+		goto out;
+	}
+
+	ret = true;
+
+out:
+	g_dir_close (dir);
+
+	return ret;
+}
+
+/*!
+ * Remove the pool slot used by \p config (if any).
+ *
+ * \param config \ref cc_oci_config.
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+cc_oci_vm_pool_release (struct cc_oci_config *config)
+{
+	g_autofree gchar *slot = NULL;
+
+	if (! config) {
+		return false;
+	}
+
+	slot = cc_oci_vm_pool_slot_get (config);
+	if (! slot) {
+		/* VM was not taken from the pool */
+		return true;
+	}
+
+	return cc_oci_vm_pool_slot_destroy (slot, -1);
+}
+
+/*!
+ * Display the state and hit/miss counters of all pools (JSON format).
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+cc_oci_vm_pool_status (void)
+{
+	GDir         *dir;
+	const gchar  *name;
+	JsonArray    *array;
+	gchar        *str;
+
+	array = json_array_new ();
+
+	dir = g_dir_open (vm_pool_dir, 0x0, NULL);
+
+	while (dir && (name = g_dir_read_name (dir)) != NULL) {
+		g_autofree gchar *key_dir = NULL;
+		g_autofree gchar *stats = NULL;
+		JsonObject       *obj;
+		GKeyFile         *key_file;
+		guint             count;
+		guint             ready = 0;
+		guint             claimed = 0;
+		int               lock_fd;
+
+		key_dir = g_build_path ("/", vm_pool_dir, name, NULL);
+		if (! g_file_test (key_dir, G_FILE_TEST_IS_DIR)) {
+			continue;
+		}
+
+		lock_fd = cc_oci_vm_pool_lock (key_dir);
+		if (lock_fd < 0) {
+			continue;
+		}
+
+		count = cc_oci_vm_pool_count (key_dir, &ready, &claimed);
+
+		stats = g_build_path ("/", key_dir,
+				CC_OCI_VM_POOL_STATS_FILE, NULL);
+		key_file = g_key_file_new ();
+		(void)g_key_file_load_from_file (key_file, stats,
+				G_KEY_FILE_NONE, NULL);
+
+		cc_oci_vm_pool_unlock (lock_fd);
+
+		obj = json_object_new ();
+		json_object_set_string_member (obj, "key", name);
+		json_object_set_int_member (obj, "ready", ready);
+		json_object_set_int_member (obj, "booting", count - ready);
+		json_object_set_int_member (obj, "claimed", claimed);
+		json_object_set_int_member (obj, "hits",
+				(gint64)g_key_file_get_uint64 (key_file,
+					CC_OCI_VM_POOL_STATS_GROUP,
+					"hits", NULL));
+		json_object_set_int_member (obj, "misses",
+				(gint64)g_key_file_get_uint64 (key_file,
+					CC_OCI_VM_POOL_STATS_GROUP,
+					"misses", NULL));
+
+		g_key_file_free (key_file);
+
+		json_array_add_object_element (array, obj);
+	}
+
+	if (dir) {
+		g_dir_close (dir);
+	}
+
+	str = cc_oci_json_arr_to_string (array, true);
+	json_array_unref (array);
+
+	if (! str) {
+		return false;
+	}
+
+	g_print ("%s\n", str);
+	g_free (str);
+
+	return true;
+}
@@ -0,0 +1,71 @@
+/*
+ * This file is part of cc-oci-runtime.
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _CC_OCI_VMPOOL_H
+#define _CC_OCI_VMPOOL_H
+
+#include <glib.h>
+
+/** Directory below which pools of pre-booted VMs are kept.
+ *
+ * Each pool lives in a sub-directory named after the hash of the
+ * hypervisor arguments template (see cc_oci_vm_args_template_hash()).
+ * Pooling is disabled if this directory does not exist.
+ */
+#define CC_OCI_VM_POOL_DIR_PREFIX	LOCALSTATEDIR \
+					"/run/cc-oci-runtime-pool"
+
+/** Symbolic link created below the container runtime directory
+ * pointing to the pool slot the container is using.
+ */
+#define CC_OCI_VM_POOL_SLOT_LINK	"vm-pool-slot"
+
+/** Default number of paused VMs to keep per pool. */
+#define CC_OCI_VM_POOL_DEFAULT_SIZE		2
+
+/** Default maximum number of VMs to boot per second. */
+#define CC_OCI_VM_POOL_DEFAULT_REFILL_RATE	1
+
+/** Default time (in milliseconds) a VM is allowed to boot before
+ * being paused.
+ */
+#define CC_OCI_VM_POOL_DEFAULT_BOOT_WAIT	3000
+
+/** Options controlling a pool of pre-booted VMs. */
+struct cc_oci_vm_pool_options {
+	/** Number of paused VMs to keep ready. */
+	guint size;
+
+	/** Maximum number of VMs to boot per second. */
+	guint refill_rate;
+
+	/** Milliseconds to let a VM boot before pausing it. */
+	guint boot_wait;
+};
+
+gboolean cc_oci_vm_pool_run (struct cc_oci_config *config,
+		const struct cc_oci_vm_pool_options *options);
+gboolean cc_oci_vm_pool_claim (struct cc_oci_config *config,
+		gboolean *claimed);
+gboolean cc_oci_vm_pool_attach (struct cc_oci_config *config);
+gboolean cc_oci_vm_pool_release (struct cc_oci_config *config);
+gboolean cc_oci_vm_pool_status (void);
+
+#endif /* _CC_OCI_VMPOOL_H */
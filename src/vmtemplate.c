@@ -0,0 +1,948 @@
+/*
+ * This file is part of cc-oci-runtime.
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * VM templating.
+ *
+ * A template is created by booting a VM (with no container) until
+ * hyperstart reports it is ready, then saving its device state with
+ * QMP "migrate". The guest RAM and the nvdimm image of the template VM
+ * are backed by shared files, so they are left out of the saved state
+ * (QMP capability "x-ignore-shared") and remain in the template
+ * directory below \ref CC_OCI_VM_TEMPLATE_DIR_PREFIX:
+ *
+ *     <prefix>/<template hash>/.lock
+ *     <prefix>/<template hash>/memory     (guest RAM)
+ *     <prefix>/<template hash>/image      (copy of the nvdimm image)
+ *     <prefix>/<template hash>/vm.state   (device state)
+ *
+ * A clone maps "memory" and "image" privately ("share=off") and loads
+ * "vm.state" with "-incoming defer", so the guest kernel and
+ * hyperstart pages are shared copy-on-write by all the VMs cloned
+ * from the template. As for the VM pool, network devices are
+ * hot-attached once the state has been loaded.
+ *
+ * The hypervisor must support "x-ignore-shared" (QEMU 4.0 or later).
+ */
+
+#define _GNU_SOURCE
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/file.h>
+#include <sys/socket.h>
+#include <sys/sendfile.h>
+#include <sys/un.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "oci.h"
+#include "util.h"
+#include "hypervisor.h"
+#include "network.h"
+#include "checkpoint.h"
+#include "ready.h"
+#include "spawn.h"
+#include "vmtemplate.h"
+#include "common.h"
+
+extern struct start_data start_data;
+
+/** Name of the file used to serialise creation of a template. */
+#define CC_OCI_VM_TEMPLATE_LOCK_FILE	".lock"
+
+/** Name of the file backing the guest RAM of a template. */
+#define CC_OCI_VM_TEMPLATE_MEMORY	"memory"
+
+/** Name of the copy of the nvdimm image used by a template. */
+#define CC_OCI_VM_TEMPLATE_IMAGE	"image"
+
+/** Name of the file holding the device state of a template. */
+#define CC_OCI_VM_TEMPLATE_STATE	"vm.state"
+
+/** Name of the 9p-shared directory of the template VM. */
+#define CC_OCI_VM_TEMPLATE_SHARE_DIR	"share"
+
+/** Id of the memory backend used for the guest RAM. */
+#define CC_OCI_VM_TEMPLATE_RAM_ID	"template-ram"
+
+/** Size of the header of a hyperstart control message. */
+#define CC_OCI_VM_TEMPLATE_HYPER_HEADER_SIZE	8
+
+/** Code of the hyperstart control message sent once it is ready
+ * (INIT_READY).
+ */
+#define CC_OCI_VM_TEMPLATE_HYPER_READY		8
+
+/* Value passed in from automake.
+ *
+ * XXX: Assigned to a variable to allow the tests to modify the value.
+ */
+private gchar *vm_template_dir = CC_OCI_VM_TEMPLATE_DIR_PREFIX;
+
+/*!
+ * Handle \ref CC_OCI_VM_TEMPLATE_ANNOTATION.
+ *
+ * \param config \ref cc_oci_config.
+ * \param annotation \ref oci_cfg_annotation.
+ *
+ * \return \c true if \p annotation was handled, else \c false.
+ */
+gboolean
+cc_oci_vm_template_handle_annotation (struct cc_oci_config *config,
+		const struct oci_cfg_annotation *annotation)
+{
+	if (! (config && annotation && annotation->key)) {
+		return false;
+	}
+
+	if (g_strcmp0 (annotation->key, CC_OCI_VM_TEMPLATE_ANNOTATION)) {
+		return false;
+	}
+
+	config->vm_template_wanted = ! g_strcmp0 (annotation->value, "true");
+
+	return true;
+}
+
+/*!
+ * Determine the size of the guest RAM from the value of the
+ * hypervisor "-m" option.
+ *
+ * \param value Value of "-m" (for example "2G,slots=2,maxmem=3G").
+ *
+ * \return Newly-allocated size suitable for a memory backend on
+ *   success, else \c NULL.
+ */
+private gchar *
+cc_oci_vm_template_mem_size (const gchar *value)
+{
+	const gchar  *end;
+	gsize         len;
+
+	if (! value) {
+		return NULL;
+	}
+
+	if (g_str_has_prefix (value, "size=")) {
+		value += strlen ("size=");
+	}
+
+	end = strchr (value, ',');
+	len = end ? (gsize)(end - value) : strlen (value);
+	if (! len) {
+		return NULL;
+	}
+
+	/* "-m" defaults to MiB whereas a backend defaults to bytes */
+	if (g_ascii_isdigit (value[len-1])) {
+		return g_strdup_printf ("%.*sM", (int)len, value);
+	}
+
+	return g_strndup (value, len);
+}
+
+/*!
+ * Point a "memory-backend-file" object at a template file.
+ *
+ * \param arg Value of an "-object" option.
+ * \param from Backing file to replace.
+ * \param to Template file.
+ * \param share Value of the "share" property ("on" or "off").
+ *
+ * \return Newly-allocated replacement for \p arg if it is a backend
+ *   for \p from, else \c NULL.
+ */
+private gchar *
+cc_oci_vm_template_backend_update (const gchar *arg, const gchar *from,
+		const gchar *to, const gchar *share)
+{
+	g_autofree gchar  *mem_path = NULL;
+	gchar            **options = NULL;
+	GString           *str;
+	gboolean           found = false;
+
+	if (! (arg && from && to && share)) {
+		return NULL;
+	}
+
+	if (! g_str_has_prefix (arg, "memory-backend-file,")) {
+		return NULL;
+	}
+
+	mem_path = g_strdup_printf ("mem-path=%s", from);
+	options = g_strsplit (arg, ",", -1);
+
+	for (gchar **option = options; *option; option++) {
+		if (! g_strcmp0 (*option, mem_path)) {
+			found = true;
+			break;
+		}
+	}
+
+	if (! found) {
+		g_strfreev (options);
+		return NULL;
+	}
+
+	str = g_string_new ("");
+
+	for (gchar **option = options; *option; option++) {
+		if (g_str_has_prefix (*option, "share=")) {
+			continue;
+		}
+
+		if (str->len) {
+			g_string_append_c (str, ',');
+		}
+
+		if (! g_strcmp0 (*option, mem_path)) {
+			g_string_append_printf (str, "mem-path=%s", to);
+		} else {
+			g_string_append (str, *option);
+		}
+	}
+
+	g_string_append_printf (str, ",share=%s", share);
+
+	g_strfreev (options);
+
+	return g_string_free (str, false);
+}
+
+/*!
+ * Back the guest RAM and nvdimm image of the VM by the files of the
+ * template \p config is using.
+ *
+ * The files are mapped shared by the VM that creates the template (so
+ * that they hold its memory once it has been saved) and privately by
+ * the VMs cloned from it.
+ *
+ * \param config \ref cc_oci_config.
+ * \param[in,out] args Expanded hypervisor command-line (replaced on
+ *   success).
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+cc_oci_vm_template_args (const struct cc_oci_config *config,
+		gchar ***args)
+{
+	g_autofree gchar  *memory = NULL;
+	g_autofree gchar  *image = NULL;
+	g_autofree gchar  *size = NULL;
+	const gchar       *share;
+	gboolean           image_found = false;
+	GPtrArray         *new_args;
+	gchar            **arg;
+
+	if (! (config && config->vm && config->vm_template
+				&& args && *args)) {
+		return false;
+	}
+
+	share = config->vm_template_save ? "on" : "off";
+
+	memory = g_build_path ("/", config->vm_template,
+			CC_OCI_VM_TEMPLATE_MEMORY, NULL);
+	image = g_build_path ("/", config->vm_template,
+			CC_OCI_VM_TEMPLATE_IMAGE, NULL);
+
+	new_args = g_ptr_array_new_with_free_func (g_free);
+
+	for (arg = *args; *arg; arg++) {
+		gchar *backend;
+
+		if (! g_strcmp0 (*arg, "-m") && arg[1]) {
+			g_free_if_set (size);
+			size = cc_oci_vm_template_mem_size (arg[1]);
+		}
+
+		backend = cc_oci_vm_template_backend_update (*arg,
+				config->vm->image_path, image, share);
+		if (backend) {
+			image_found = true;
+		}
+
+		g_ptr_array_add (new_args, backend ? backend : g_strdup (*arg));
+	}
+
+	if (! (size && image_found)) {
+		g_critical ("cannot use VM template: hypervisor arguments "
+				"do not specify the guest memory size and "
+				"a file-backed image");
+		g_ptr_array_free (new_args, true);
+		return false;
+	}
+
+	g_ptr_array_add (new_args, g_strdup ("-object"));
+	g_ptr_array_add (new_args, g_strdup_printf
+			("memory-backend-file,id=%s,mem-path=%s,size=%s,share=%s",
+			 CC_OCI_VM_TEMPLATE_RAM_ID, memory, size, share));
+	g_ptr_array_add (new_args, g_strdup ("-numa"));
+	g_ptr_array_add (new_args, g_strdup ("node,memdev="
+				CC_OCI_VM_TEMPLATE_RAM_ID));
+	g_ptr_array_add (new_args, NULL);
+
+	g_strfreev (*args);
+
+	g_ptr_array_set_free_func (new_args, NULL);
+	*args = (gchar **)g_ptr_array_free (new_args, false);
+
+	return true;
+}
+
+/*!
+ * Take the (exclusive) lock for the template in \p dir.
+ *
+ * \param dir Template directory.
+ *
+ * \return Locked file descriptor on success, else \c -1.
+ */
+static int
+cc_oci_vm_template_lock (const gchar *dir)
+{
+	g_autofree gchar *path = NULL;
+	int               fd;
+
+	path = g_build_path ("/", dir, CC_OCI_VM_TEMPLATE_LOCK_FILE, NULL);
+
+	fd = open (path, O_CREAT | O_RDWR | O_CLOEXEC, 0600);
+	if (fd < 0) {
+		g_critical ("failed to open %s: %s", path, strerror (errno));
+		return -1;
+	}
+
+	if (flock (fd, LOCK_EX) < 0) {
+		g_critical ("failed to lock %s: %s", path, strerror (errno));
+		close (fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+/*!
+ * Release a lock taken by cc_oci_vm_template_lock().
+ *
+ * \param fd Locked file descriptor.
+ */
+static void
+cc_oci_vm_template_unlock (int fd)
+{
+	if (fd < 0) {
+		return;
+	}
+
+	(void)flock (fd, LOCK_UN);
+	close (fd);
+}
+
+/*!
+ * Determine if the template in \p dir is complete.
+ *
+ * \param dir Template directory.
+ *
+ * \return \c true if the template can be cloned, else \c false.
+ */
+private gboolean
+cc_oci_vm_template_ready (const gchar *dir)
+{
+	const gchar  *names[] = {
+		CC_OCI_VM_TEMPLATE_STATE,
+		CC_OCI_VM_TEMPLATE_MEMORY,
+		CC_OCI_VM_TEMPLATE_IMAGE
+	};
+
+	if (! dir) {
+		return false;
+	}
+
+	for (gsize i = 0; i < CC_OCI_ARRAY_SIZE (names); i++) {
+		g_autofree gchar *path = NULL;
+
+		path = g_build_path ("/", dir, names[i], NULL);
+
+		if (! g_file_test (path, G_FILE_TEST_IS_REGULAR)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/*!
+ * Remove the files of a (partially created) template.
+ *
+ * \param dir Template directory.
+ */
+static void
+cc_oci_vm_template_clean (const gchar *dir)
+{
+	const gchar  *names[] = {
+		CC_OCI_VM_TEMPLATE_STATE,
+		CC_OCI_VM_TEMPLATE_STATE ".tmp",
+		CC_OCI_VM_TEMPLATE_MEMORY,
+		CC_OCI_VM_TEMPLATE_IMAGE
+	};
+
+	for (gsize i = 0; i < CC_OCI_ARRAY_SIZE (names); i++) {
+		g_autofree gchar *path = NULL;
+
+		path = g_build_path ("/", dir, names[i], NULL);
+
+		if (g_remove (path) < 0 && errno != ENOENT) {
+			g_warning ("failed to remove %s: %s",
+					path, strerror (errno));
+		}
+	}
+}
+
+/*!
+ * Copy a file.
+ *
+ * \param from Full path to the file to copy.
+ * \param to Full path to the copy.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+cc_oci_vm_template_copy (const gchar *from, const gchar *to)
+{
+	struct stat  st;
+	off_t        offset = 0;
+	ssize_t      bytes;
+	int          in = -1;
+	int          out = -1;
+	gboolean     ret = false;
+
+	in = open (from, O_RDONLY | O_CLOEXEC);
+	if (in < 0 || fstat (in, &st) < 0) {
+		g_critical ("failed to open %s: %s", from, strerror (errno));
+		goto out;
+	}
+
+	out = open (to, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	if (out < 0) {
+		g_critical ("failed to create %s: %s", to, strerror (errno));
+		goto out;
+	}
+
+	while (offset < st.st_size) {
+		bytes = sendfile (out, in, &offset,
+				(size_t)(st.st_size - offset));
+		if (bytes < 0 && errno == EINTR) {
+			continue;
+		} else if (bytes <= 0) {
+			g_critical ("failed to copy %s to %s: %s",
+					from, to,
+					bytes < 0 ? strerror (errno)
+					: "unexpected end of file");
+			goto out;
+		}
+	}
+
+	ret = true;
+
+out:
+	if (in != -1) close (in);
+	if (out != -1) close (out);
+
+	return ret;
+}
+
+/*!
+ * Read exactly \p len bytes before \p deadline.
+ *
+ * \param fd File descriptor to read from.
+ * \param[out] buf Buffer to read into.
+ * \param len Number of bytes to read.
+ * \param deadline Monotonic time to give up at.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+cc_oci_vm_template_read (int fd, guint8 *buf, gsize len, gint64 deadline)
+{
+	gsize    done = 0;
+	ssize_t  bytes;
+
+	while (done < len) {
+		struct pollfd  pfd = { .fd = fd, .events = POLLIN };
+		gint64         remaining;
+
+		remaining = deadline - g_get_monotonic_time ();
+		if (remaining <= 0) {
+			g_critical ("timed out waiting for hyperstart");
+			return false;
+		}
+
+		if (poll (&pfd, 1, (int)((remaining + 999) / 1000)) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+
+			g_critical ("failed to poll: %s", strerror (errno));
+			return false;
+		}
+
+		if (! pfd.revents) {
+			continue;
+		}
+
+		bytes = read (fd, buf + done, len - done);
+		if (bytes < 0 && errno == EINTR) {
+			continue;
+		} else if (bytes <= 0) {
+			g_critical ("failed to read from hyperstart: %s",
+					bytes < 0 ? strerror (errno)
+					: "connection closed");
+			return false;
+		}
+
+		done += (gsize)bytes;
+	}
+
+	return true;
+}
+
+/*!
+ * Wait for hyperstart to send its "ready" message on the control
+ * channel.
+ *
+ * \param socket_path Path to \ref CC_OCI_AGENT_CTL_SOCKET.
+ * \param timeout Milliseconds to wait for.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+cc_oci_vm_template_wait_ready (const gchar *socket_path, gint timeout)
+{
+	struct sockaddr_un  addr = { .sun_family = AF_UNIX };
+	guint8              header[CC_OCI_VM_TEMPLATE_HYPER_HEADER_SIZE];
+	guint8              payload[512];
+	guint32             code;
+	guint32             len;
+	gint64              deadline;
+	int                 fd = -1;
+	gboolean            ret = false;
+
+	if (strlen (socket_path) >= sizeof (addr.sun_path)) {
+		g_critical ("socket path too long: %s", socket_path);
+		return false;
+	}
+
+	g_strlcpy (addr.sun_path, socket_path, sizeof (addr.sun_path));
+
+	deadline = g_get_monotonic_time () + (gint64)timeout * 1000;
+
+	fd = socket (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0) {
+		g_critical ("failed to create socket: %s", strerror (errno));
+		return false;
+	}
+
+	/* hyperstart only writes once the host side is connected */
+	if (connect (fd, (struct sockaddr *)&addr, sizeof (addr)) < 0) {
+		g_critical ("failed to connect to %s: %s",
+				socket_path, strerror (errno));
+		goto out;
+	}
+
+	while (true) {
+		if (! cc_oci_vm_template_read (fd, header, sizeof (header),
+					deadline)) {
+			goto out;
+		}
+
+		code = cc_oci_get_big_endian_32 (header);
+		len = cc_oci_get_big_endian_32 (header + 4);
+
+		if (len < sizeof (header)) {
+			g_critical ("invalid hyperstart message length %u",
+					len);
+			goto out;
+		}
+
+		/* discard the payload */
+		for (len -= (guint32)sizeof (header); len; ) {
+			gsize chunk = MIN (len, sizeof (payload));
+
+			if (! cc_oci_vm_template_read (fd, payload, chunk,
+						deadline)) {
+				goto out;
+			}
+
+			len -= (guint32)chunk;
+		}
+
+		if (code == CC_OCI_VM_TEMPLATE_HYPER_READY) {
+			break;
+		}
+
+		g_debug ("ignoring hyperstart message %u", code);
+	}
+
+	ret = true;
+
+out:
+	close (fd);
+
+	return ret;
+}
+
+/*!
+ * Boot a VM until hyperstart is ready and save it as a template.
+ *
+ * \note Caller must hold the template lock.
+ *
+ * \param config \ref cc_oci_config of the container (with the VM
+ *   configuration loaded).
+ * \param dir Template directory.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+cc_oci_vm_template_create (const struct cc_oci_config *config,
+		const gchar *dir)
+{
+	struct cc_oci_config  *vm_config = NULL;
+	struct cc_oci_spawn    spawn;
+	GPtrArray             *additional_args = NULL;
+	gchar                **args = NULL;
+	gchar                **argv = NULL;
+	g_autofree gchar      *joined = NULL;
+	g_autofree gchar      *path = NULL;
+	g_autofree gchar      *share = NULL;
+	g_autofree gchar      *image = NULL;
+	g_autofree gchar      *state = NULL;
+	g_autofree gchar      *state_tmp = NULL;
+	g_autofree gchar      *ctl_socket = NULL;
+	g_autofree gchar      *uri = NULL;
+	GPid                   pid = -1;
+	int                    null_fd = -1;
+	gboolean               ret = false;
+
+	cc_oci_vm_template_clean (dir);
+
+	share = g_build_path ("/", dir, CC_OCI_VM_TEMPLATE_SHARE_DIR, NULL);
+	image = g_build_path ("/", dir, CC_OCI_VM_TEMPLATE_IMAGE, NULL);
+	state = g_build_path ("/", dir, CC_OCI_VM_TEMPLATE_STATE, NULL);
+	state_tmp = g_strdup_printf ("%s.tmp", state);
+	ctl_socket = g_build_path ("/", dir, CC_OCI_AGENT_CTL_SOCKET, NULL);
+
+	if (g_mkdir_with_parents (share, CC_OCI_DIR_MODE) < 0) {
+		g_critical ("failed to create %s: %s", share, strerror (errno));
+		goto out;
+	}
+
+	/* The template VM writes to the image, so it gets its own */
+	if (! cc_oci_vm_template_copy (config->vm->image_path, image)) {
+		goto out;
+	}
+
+	/* Build a throw-away configuration for the template VM. The VM
+	 * configuration and bundle are borrowed from the container.
+	 */
+	vm_config = cc_oci_config_create ();
+	if (! vm_config) {
+		goto out;
+	}
+
+	vm_config->vm = config->vm;
+	vm_config->bundle_path = config->bundle_path;
+	vm_config->vm_template = g_strdup (dir);
+	vm_config->vm_template_save = true;
+
+	g_strlcpy (vm_config->state.runtime_path, dir,
+			sizeof (vm_config->state.runtime_path));
+	g_snprintf (vm_config->state.comms_path,
+			sizeof (vm_config->state.comms_path),
+			"%s/%s", dir, CC_OCI_HYPERVISOR_SOCKET);
+	g_snprintf (vm_config->state.procsock_path,
+			sizeof (vm_config->state.procsock_path),
+			"%s/%s", dir, CC_OCI_PROCESS_SOCKET);
+	g_strlcpy (vm_config->workload_dir, share,
+			sizeof (vm_config->workload_dir));
+
+	additional_args = g_ptr_array_new_with_free_func (g_free);
+
+	cc_oci_populate_extra_args (vm_config, additional_args);
+	if (! cc_oci_vm_args_get (vm_config, &args, additional_args)) {
+		goto out;
+	}
+
+	/* Expanded arguments may contain embedded newlines (for
+	 * example "-net\nnone"), each of which starts a new argument.
+	 */
+	joined = g_strjoinv ("\n", args);
+	argv = g_strsplit_set (joined, "\n", -1);
+	if (! (argv && argv[0])) {
+		g_critical ("failed to split hypervisor args");
+		goto out;
+	}
+
+	path = g_find_program_in_path (argv[0]);
+	if (! path) {
+		g_critical ("hypervisor %s not found", argv[0]);
+		goto out;
+	}
+
+	null_fd = open ("/dev/null", O_RDWR | O_CLOEXEC);
+	if (null_fd < 0) {
+		g_critical ("failed to open /dev/null: %s", strerror (errno));
+		goto out;
+	}
+
+	cc_oci_spawn_init (&spawn);
+
+	spawn.path = path;
+	spawn.argv = argv;
+	spawn.stdio[STDIN_FILENO] = null_fd;
+	spawn.stdio[STDOUT_FILENO] = null_fd;
+	spawn.stdio[STDERR_FILENO] = null_fd;
+	spawn.setsid = true;
+	spawn.close_fds = true;
+
+	pid = cc_oci_spawn (&spawn);
+	if (pid < 0) {
+		g_critical ("failed to launch hypervisor %s", path);
+		goto out;
+	}
+
+	g_debug ("booting template VM (pid %d)", (int)pid);
+
+	if (! cc_oci_wait_for_path (ctl_socket,
+				CC_OCI_VM_TEMPLATE_READY_TIMEOUT,
+				"vm-template-ctl-socket")) {
+		goto out;
+	}
+
+	if (! cc_oci_vm_template_wait_ready (ctl_socket,
+				CC_OCI_VM_TEMPLATE_READY_TIMEOUT)) {
+		goto out;
+	}
+
+	if (! cc_oci_vm_pause (vm_config->state.comms_path, pid)) {
+		g_critical ("failed to pause template VM");
+		goto out;
+	}
+
+	uri = cc_oci_checkpoint_uri (state_tmp, false);
+	if (! uri) {
+		goto out;
+	}
+
+	if (! cc_oci_vm_migrate (vm_config->state.comms_path, pid, uri,
+				true, CC_OCI_VM_TEMPLATE_READY_TIMEOUT)) {
+		g_critical ("failed to save state of template VM");
+		goto out;
+	}
+
+	/* Only a complete template can be cloned */
+	if (g_rename (state_tmp, state) < 0) {
+		g_critical ("failed to rename %s to %s: %s",
+				state_tmp, state, strerror (errno));
+		goto out;
+	}
+
+	g_debug ("created VM template in %s", dir);
+
+	ret = true;
+
+out:
+	/* The memory of the template VM is kept by the "memory" file */
+	if (pid > 0) {
+		(void)kill (pid, SIGKILL);
+		(void)waitpid (pid, NULL, 0);
+	}
+	if (null_fd != -1) {
+		close (null_fd);
+	}
+	if (vm_config) {
+		vm_config->vm = NULL;
+		vm_config->bundle_path = NULL;
+		cc_oci_config_free (vm_config);
+	}
+	if (additional_args) {
+		g_ptr_array_free (additional_args, TRUE);
+	}
+	g_strfreev (args);
+	g_strfreev (argv);
+
+	(void)g_rmdir (share);
+
+	if (! ret) {
+		cc_oci_vm_template_clean (dir);
+	}
+
+	return ret;
+}
+
+/*!
+ * Select the template to clone the VM of \p config from (if the
+ * bundle requests one), creating the template if necessary.
+ *
+ * On success, \c config->vm_template is set if the VM should be
+ * cloned. If the template cannot be created, the VM is booted.
+ *
+ * \param config \ref cc_oci_config.
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+cc_oci_vm_template_get (struct cc_oci_config *config)
+{
+	g_autofree gchar  *key = NULL;
+	g_autofree gchar  *dir = NULL;
+	g_autofree gchar  *link = NULL;
+	int                lock_fd = -1;
+	gboolean           ret = false;
+
+	if (! (config && config->vm)) {
+		return false;
+	}
+
+	if (! config->vm_template_wanted) {
+		return true;
+	}
+
+	/* As for the VM pool, pods add containers to the share after
+	 * the VM is launched and block devices cannot be hot-attached.
+	 */
+	if (config->restore_image || config->pod || config->device_name) {
+		g_debug ("VM template not usable for this container");
+		return true;
+	}
+
+	key = cc_oci_vm_args_template_hash (config);
+	if (! key) {
+		/* let the normal launch report the problem */
+		return true;
+	}
+
+	dir = g_build_path ("/", vm_template_dir, key, NULL);
+
+	if (g_mkdir_with_parents (dir, CC_OCI_DIR_MODE) < 0) {
+		g_critical ("failed to create %s: %s", dir, strerror (errno));
+		return false;
+	}
+
+	lock_fd = cc_oci_vm_template_lock (dir);
+	if (lock_fd < 0) {
+		return false;
+	}
+
+	if (! cc_oci_vm_template_ready (dir)
+			&& ! cc_oci_vm_template_create (config, dir)) {
+		g_warning ("failed to create VM template in %s, "
+				"booting VM", dir);
+		ret = true;
+		goto out;
+	}
+
+	link = g_build_path ("/", config->state.runtime_path,
+			CC_OCI_VM_TEMPLATE_LINK, NULL);
+
+	if (symlink (dir, link) < 0) {
+		g_critical ("failed to link %s to %s: %s",
+				link, dir, strerror (errno));
+		goto out;
+	}
+
+	config->vm_template = g_strdup (dir);
+
+	g_debug ("cloning VM from template %s", dir);
+
+	ret = true;
+
+out:
+	cc_oci_vm_template_unlock (lock_fd);
+
+	return ret;
+}
+
+/*!
+ * Load the template state into a cloned VM, hot-attach its network
+ * devices and let the guest run.
+ *
+ * \note Must be called after the container network has been created.
+ *
+ * \param config \ref cc_oci_config.
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+cc_oci_vm_template_load (struct cc_oci_config *config)
+{
+	g_autofree gchar  *state = NULL;
+	g_autofree gchar  *uri = NULL;
+
+	if (! (config && config->vm && config->vm_template)) {
+		return false;
+	}
+
+	state = g_build_path ("/", config->vm_template,
+			CC_OCI_VM_TEMPLATE_STATE, NULL);
+
+	uri = cc_oci_checkpoint_uri (state, true);
+	if (! uri) {
+		return false;
+	}
+
+	if (! cc_oci_wait_for_path (config->state.comms_path,
+				start_data.ready_timeout,
+				"hypervisor-socket-ready")) {
+		return false;
+	}
+
+	if (! cc_oci_vm_migrate_incoming (config->state.comms_path,
+				config->vm->pid, uri, start_data.ready_timeout)) {
+		g_critical ("failed to clone VM from template %s",
+				config->vm_template);
+		return false;
+	}
+
+	if (! cc_oci_vm_netdev_add (config->state.comms_path,
+				config->vm->pid, config)) {
+		g_critical ("failed to attach network to cloned VM");
+		return false;
+	}
+
+	if (! cc_oci_vm_resume (config->state.comms_path,
+				config->vm->pid)) {
+		g_critical ("failed to resume cloned VM");
+		return false;
+	}
+
+	return true;
+}
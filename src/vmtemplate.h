@@ -0,0 +1,59 @@
+/*
+ * This file is part of cc-oci-runtime.
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _CC_OCI_VMTEMPLATE_H
+#define _CC_OCI_VMTEMPLATE_H
+
+#include <glib.h>
+
+#include "oci.h"
+
+/** Directory below which VM templates are kept.
+ *
+ * Each template lives in a sub-directory named after the hash of the
+ * hypervisor arguments template (see cc_oci_vm_args_template_hash()).
+ * Since clones map the template files, this should be a tmpfs.
+ */
+#define CC_OCI_VM_TEMPLATE_DIR_PREFIX	LOCALSTATEDIR \
+					"/run/cc-oci-runtime-template"
+
+/** OCI annotation which, when set to "true", makes the VM of the
+ * container a clone of a VM template.
+ */
+#define CC_OCI_VM_TEMPLATE_ANNOTATION	"com.intel.cc.vm-template"
+
+/** Symbolic link created below the container runtime directory
+ * pointing to the template the VM was cloned from.
+ */
+#define CC_OCI_VM_TEMPLATE_LINK		"vm-template"
+
+/** Time (in milliseconds) a template VM is allowed to take to boot
+ * to the point where hyperstart is ready.
+ */
+#define CC_OCI_VM_TEMPLATE_READY_TIMEOUT	30000
+
+gboolean cc_oci_vm_template_handle_annotation (struct cc_oci_config *config,
+		const struct oci_cfg_annotation *annotation);
+gboolean cc_oci_vm_template_get (struct cc_oci_config *config);
+gboolean cc_oci_vm_template_args (const struct cc_oci_config *config,
+		gchar ***args);
+gboolean cc_oci_vm_template_load (struct cc_oci_config *config);
+
+#endif /* _CC_OCI_VMTEMPLATE_H */
@@ -0,0 +1,205 @@
+/*
+ * This file is part of cc-oci-runtime.
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+#include <check.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "test_common.h"
+#include "logging.h"
+#include "oci.h"
+#include "oci-config.h"
+#include "batch.h"
+
+START_TEST(test_cc_oci_batch_parse) {
+	GPtrArray                  *entries = NULL;
+	struct cc_oci_batch_entry  *entry;
+
+	ck_assert (! cc_oci_batch_parse (NULL, NULL));
+	ck_assert (! cc_oci_batch_parse ("", NULL));
+	ck_assert (! cc_oci_batch_parse (NULL, &entries));
+
+	/* no entries */
+	ck_assert (! cc_oci_batch_parse ("", &entries));
+	ck_assert (! cc_oci_batch_parse ("# comment\n\n", &entries));
+
+	/* missing bundle */
+	ck_assert (! cc_oci_batch_parse ("foo\n", &entries));
+
+	/* too many fields */
+	ck_assert (! cc_oci_batch_parse ("foo /b /p extra\n", &entries));
+
+	/* duplicate container */
+	ck_assert (! cc_oci_batch_parse ("foo /a\nfoo /b\n", &entries));
+
+	ck_assert (! entries);
+
+	ck_assert (cc_oci_batch_parse ("# id bundle [pid-file]\n"
+				"foo /bundles/foo\n"
+				"\n"
+				"  bar\t/bundles/bar   /run/bar.pid  \n",
+				&entries));
+	ck_assert (entries);
+	ck_assert (entries->len == 2);
+
+	entry = g_ptr_array_index (entries, 0);
+	ck_assert (! g_strcmp0 (entry->container_id, "foo"));
+	ck_assert (! g_strcmp0 (entry->bundle, "/bundles/foo"));
+	ck_assert (! entry->pid_file);
+	ck_assert (entry->pid == -1);
+	ck_assert (entry->fd == -1);
+
+	entry = g_ptr_array_index (entries, 1);
+	ck_assert (! g_strcmp0 (entry->container_id, "bar"));
+	ck_assert (! g_strcmp0 (entry->bundle, "/bundles/bar"));
+	ck_assert (! g_strcmp0 (entry->pid_file, "/run/bar.pid"));
+
+	g_ptr_array_free (entries, true);
+} END_TEST
+
+START_TEST(test_cc_oci_batch_read) {
+	GPtrArray  *entries = NULL;
+	gchar      *tmpdir;
+	gchar      *path;
+
+	tmpdir = g_dir_make_tmp (NULL, NULL);
+	ck_assert (tmpdir);
+
+	path = g_build_path ("/", tmpdir, "batch", NULL);
+
+	ck_assert (! cc_oci_batch_read (NULL, &entries));
+	ck_assert (! cc_oci_batch_read (path, NULL));
+
+	/* file does not exist */
+	ck_assert (! cc_oci_batch_read (path, &entries));
+
+	ck_assert (g_file_set_contents (path, "foo /a\nbar /b\n", -1, NULL));
+
+	ck_assert (cc_oci_batch_read (path, &entries));
+	ck_assert (entries);
+	ck_assert (entries->len == 2);
+
+	g_ptr_array_free (entries, true);
+
+	ck_assert (! g_remove (path));
+	ck_assert (! g_remove (tmpdir));
+
+	g_free (path);
+	g_free (tmpdir);
+} END_TEST
+
+START_TEST(test_cc_oci_batch_create) {
+	struct cc_oci_config       *config;
+	struct cc_oci_batch_entry  *entry;
+	GPtrArray                  *entries = NULL;
+	gchar                      *tmpdir;
+	gchar                      *contents;
+	gchar                      *json;
+
+	config = cc_oci_config_create ();
+	ck_assert (config);
+
+	ck_assert (! cc_oci_batch_create (NULL, NULL, 0));
+	ck_assert (! cc_oci_batch_create (config, NULL, 0));
+	ck_assert (! cc_oci_batch_to_json (NULL));
+
+	tmpdir = g_dir_make_tmp (NULL, NULL);
+	ck_assert (tmpdir);
+
+	/* no bundle is usable (the first does not exist, the others
+	 * have no config file), so every container fails and reports
+	 * why.
+	 */
+	contents = g_strdup_printf ("c1 %s/no-such-bundle\n"
+			"c2 %s\n"
+			"c3 %s\n",
+			tmpdir, tmpdir, tmpdir);
+
+	ck_assert (cc_oci_batch_parse (contents, &entries));
+
+	ck_assert (! cc_oci_batch_create (config, entries, 2));
+
+	for (guint i = 0; i < entries->len; i++) {
+		entry = g_ptr_array_index (entries, i);
+
+		ck_assert (! entry->success);
+		ck_assert (entry->error);
+		ck_assert (entry->pid == -1);
+		ck_assert (entry->fd == -1);
+	}
+
+	entry = g_ptr_array_index (entries, 0);
+	ck_assert (g_strrstr (entry->error, "invalid bundle path"));
+
+	json = cc_oci_batch_to_json (entries);
+	ck_assert (json);
+
+	ck_assert (g_strrstr (json, "\"c1\""));
+	ck_assert (g_strrstr (json, "\"c2\""));
+	ck_assert (g_strrstr (json, "\"c3\""));
+	ck_assert (g_strrstr (json, "\"success\" : false"));
+	ck_assert (g_strrstr (json, "\"error\""));
+
+	g_free (json);
+	g_ptr_array_free (entries, true);
+	g_free (contents);
+
+	ck_assert (! g_remove (tmpdir));
+	g_free (tmpdir);
+
+	cc_oci_config_free (config);
+} END_TEST
+
+Suite* make_batch_suite(void) {
+	Suite* s = suite_create(__FILE__);
+
+	ADD_TEST (test_cc_oci_batch_parse, s);
+	ADD_TEST (test_cc_oci_batch_read, s);
+	ADD_TEST (test_cc_oci_batch_create, s);
+
+	return s;
+}
+
+int main (void) {
+	int number_failed;
+	Suite* s;
+	SRunner* sr;
+	struct cc_log_options options = { 0 };
+
+	options.enable_debug = true;
+	options.use_json = false;
+	options.filename = g_strdup ("batch_test_debug.log");
+	(void)cc_oci_log_init(&options);
+
+	s = make_batch_suite();
+	sr = srunner_create(s);
+
+	srunner_run_all(sr, CK_VERBOSE);
+	number_failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+
+	cc_oci_log_free (&options);
+
+	return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,244 @@
+/*
+ * This file is part of cc-oci-runtime.
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+#include <check.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "test_common.h"
+#include "logging.h"
+#include "oci.h"
+#include "oci-config.h"
+#include "checkpoint.h"
+
+extern gchar *checkpoint_dir;
+
+START_TEST(test_cc_oci_checkpoint_dir) {
+	gchar  *saved = checkpoint_dir;
+	gchar  *cwd;
+	gchar  *dir;
+	gchar  *expected;
+
+	ck_assert (! cc_oci_checkpoint_dir (NULL, NULL));
+	ck_assert (! cc_oci_checkpoint_dir ("", NULL));
+
+	checkpoint_dir = "/checkpoints";
+
+	dir = cc_oci_checkpoint_dir ("foo", NULL);
+	ck_assert (! g_strcmp0 (dir, "/checkpoints/foo"));
+	g_free (dir);
+
+	/* an explicit directory need not exist */
+	dir = cc_oci_checkpoint_dir ("foo", "/does/not/exist");
+	ck_assert (! g_strcmp0 (dir, "/does/not/exist"));
+	g_free (dir);
+
+	dir = cc_oci_checkpoint_dir (NULL, "/does/not/exist");
+	ck_assert (! g_strcmp0 (dir, "/does/not/exist"));
+	g_free (dir);
+
+	/* relative directories are below the current directory */
+	cwd = g_get_current_dir ();
+	expected = g_build_path ("/", cwd, "image", NULL);
+
+	dir = cc_oci_checkpoint_dir ("foo", "image");
+	ck_assert (! g_strcmp0 (dir, expected));
+	g_free (dir);
+
+	g_free (expected);
+	g_free (cwd);
+
+	checkpoint_dir = saved;
+} END_TEST
+
+START_TEST(test_cc_oci_checkpoint_image_find) {
+	gchar  *tmpdir;
+	gchar  *image;
+	gchar  *image_gz;
+	gchar  *path;
+
+	ck_assert (! cc_oci_checkpoint_image_find (NULL));
+	ck_assert (! cc_oci_checkpoint_image_find ("/does/not/exist"));
+
+	tmpdir = g_dir_make_tmp (NULL, NULL);
+	ck_assert (tmpdir);
+
+	image = g_build_path ("/", tmpdir, CC_OCI_CHECKPOINT_IMAGE, NULL);
+	image_gz = g_build_path ("/", tmpdir, CC_OCI_CHECKPOINT_IMAGE_GZ,
+			NULL);
+
+	/* no image */
+	ck_assert (! cc_oci_checkpoint_image_find (tmpdir));
+
+	ck_assert (g_file_set_contents (image_gz, "", -1, NULL));
+
+	path = cc_oci_checkpoint_image_find (tmpdir);
+	ck_assert (! g_strcmp0 (path, image_gz));
+	g_free (path);
+
+	ck_assert (! g_remove (image_gz));
+
+	/* a directory is not an image */
+	ck_assert (! g_mkdir (image, 0700));
+	ck_assert (! cc_oci_checkpoint_image_find (tmpdir));
+	ck_assert (! g_remove (image));
+
+	ck_assert (g_file_set_contents (image, "", -1, NULL));
+
+	path = cc_oci_checkpoint_image_find (tmpdir);
+	ck_assert (! g_strcmp0 (path, image));
+	g_free (path);
+
+	ck_assert (! g_remove (image));
+	ck_assert (! g_remove (tmpdir));
+
+	g_free (image);
+	g_free (image_gz);
+	g_free (tmpdir);
+} END_TEST
+
+START_TEST(test_cc_oci_checkpoint_uri) {
+	gchar  *uri;
+
+	ck_assert (! cc_oci_checkpoint_uri (NULL, false));
+	ck_assert (! cc_oci_checkpoint_uri ("", true));
+
+	uri = cc_oci_checkpoint_uri ("/run/foo/vm.state", false);
+	ck_assert (! g_strcmp0 (uri, "exec:cat > '/run/foo/vm.state'"));
+	g_free (uri);
+
+	uri = cc_oci_checkpoint_uri ("/run/foo/vm.state", true);
+	ck_assert (! g_strcmp0 (uri, "exec:cat < '/run/foo/vm.state'"));
+	g_free (uri);
+
+	uri = cc_oci_checkpoint_uri ("/run/foo/vm.state.gz", false);
+	ck_assert (! g_strcmp0 (uri,
+				"exec:gzip -1 -c > '/run/foo/vm.state.gz'"));
+	g_free (uri);
+
+	uri = cc_oci_checkpoint_uri ("/run/foo/vm.state.gz", true);
+	ck_assert (! g_strcmp0 (uri,
+				"exec:gzip -d -c < '/run/foo/vm.state.gz'"));
+	g_free (uri);
+
+	/* the path is quoted for the shell */
+	uri = cc_oci_checkpoint_uri ("/run/it's here/vm.state", false);
+	ck_assert (! g_strcmp0 (uri,
+				"exec:cat > '/run/it'\\''s here/vm.state'"));
+	g_free (uri);
+} END_TEST
+
+START_TEST(test_cc_oci_checkpoint) {
+	struct cc_oci_config              *config;
+	struct oci_state                   state = { 0 };
+	struct cc_oci_vm_cfg               vm = { 0 };
+	struct cc_oci_checkpoint_options   options = { 0 };
+
+	config = cc_oci_config_create ();
+	ck_assert (config);
+
+	config->optarg_container_id = "foo";
+
+	ck_assert (! cc_oci_checkpoint (NULL, NULL, NULL));
+	ck_assert (! cc_oci_checkpoint (config, NULL, NULL));
+	ck_assert (! cc_oci_checkpoint (config, &state, NULL));
+
+	/* no hypervisor */
+	ck_assert (! cc_oci_checkpoint (config, &state, &options));
+
+	vm.pid = 1;
+	state.vm = &vm;
+
+	/* container not running */
+	state.status = OCI_STATUS_CREATED;
+	ck_assert (! cc_oci_checkpoint (config, &state, &options));
+
+	state.status = OCI_STATUS_STOPPED;
+	ck_assert (! cc_oci_checkpoint (config, &state, &options));
+
+	cc_oci_config_free (config);
+} END_TEST
+
+START_TEST(test_cc_oci_restore) {
+	struct cc_oci_config  *config;
+	gchar                 *tmpdir;
+
+	ck_assert (! cc_oci_restore (NULL, NULL));
+	ck_assert (! cc_oci_restore_resume (NULL));
+
+	config = cc_oci_config_create ();
+	ck_assert (config);
+
+	/* not restoring */
+	ck_assert (! cc_oci_restore_resume (config));
+
+	tmpdir = g_dir_make_tmp (NULL, NULL);
+	ck_assert (tmpdir);
+
+	config->optarg_container_id = "foo";
+
+	/* no image */
+	ck_assert (! cc_oci_restore (config, tmpdir));
+	ck_assert (! config->restore_image);
+
+	ck_assert (! g_remove (tmpdir));
+	g_free (tmpdir);
+
+	cc_oci_config_free (config);
+} END_TEST
+
+Suite* make_checkpoint_suite(void) {
+	Suite* s = suite_create(__FILE__);
+
+	ADD_TEST (test_cc_oci_checkpoint_dir, s);
+	ADD_TEST (test_cc_oci_checkpoint_image_find, s);
+	ADD_TEST (test_cc_oci_checkpoint_uri, s);
+	ADD_TEST (test_cc_oci_checkpoint, s);
+	ADD_TEST (test_cc_oci_restore, s);
+
+	return s;
+}
+
+int main (void) {
+	int number_failed;
+	Suite* s;
+	SRunner* sr;
+	struct cc_log_options options = { 0 };
+
+	options.enable_debug = true;
+	options.use_json = false;
+	options.filename = g_strdup ("checkpoint_test_debug.log");
+	(void)cc_oci_log_init(&options);
+
+	s = make_checkpoint_suite();
+	sr = srunner_create(s);
+
+	srunner_run_all(sr, CK_VERBOSE);
+	number_failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+
+	cc_oci_log_free (&options);
+
+	return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,250 @@
+/*
+ * This file is part of cc-oci-runtime.
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <check.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "test_common.h"
+#include "logging.h"
+#include "util.h"
+#include "daemon.h"
+
+/* Number of attempts to connect to a newly-started daemon */
+#define DAEMON_TEST_RETRIES	100
+
+static gboolean test_show_version;
+static gchar *test_root;
+
+static GOptionEntry test_options[] =
+{
+	{
+		"version", 'v', G_OPTION_FLAG_NONE,
+		G_OPTION_ARG_NONE, &test_show_version,
+		"", NULL
+	},
+	{
+		"root", 0, G_OPTION_FLAG_NONE,
+		G_OPTION_ARG_STRING, &test_root,
+		"", NULL
+	},
+	{ NULL }
+};
+
+/*!
+ * Request handler which displays the working directory and the
+ * arguments, failing if the last argument is "fail".
+ */
+static gboolean
+test_handler (int argc, char **argv)
+{
+	g_autofree gchar *cwd = g_get_current_dir ();
+	g_autofree gchar *args = g_strjoinv (" ", argv);
+
+	g_print ("%s:%s\n", cwd, args);
+
+	return g_strcmp0 (argv[argc-1], "fail");
+}
+
+START_TEST(test_cc_oci_daemon_command_supported) {
+	ck_assert (! cc_oci_daemon_command_supported (NULL));
+	ck_assert (! cc_oci_daemon_command_supported (""));
+	ck_assert (! cc_oci_daemon_command_supported ("daemon"));
+	ck_assert (! cc_oci_daemon_command_supported ("create"));
+	ck_assert (! cc_oci_daemon_command_supported ("start"));
+	ck_assert (! cc_oci_daemon_command_supported ("exec"));
+
+	ck_assert (cc_oci_daemon_command_supported ("state"));
+	ck_assert (cc_oci_daemon_command_supported ("list"));
+	ck_assert (cc_oci_daemon_command_supported ("kill"));
+	ck_assert (cc_oci_daemon_command_supported ("pause"));
+	ck_assert (cc_oci_daemon_command_supported ("resume"));
+} END_TEST
+
+START_TEST(test_cc_oci_daemon_command_name) {
+	char *argv_none[] = { "prog", NULL };
+	char *argv_cmd[] = { "prog", "state", "foo", NULL };
+	char *argv_opts[] = { "prog", "-v", "--root", "/dir", "list", NULL };
+	char *argv_inline[] = { "prog", "--root=/dir", "kill", "foo", NULL };
+	char *argv_value[] = { "prog", "--root", "state", NULL };
+	char *argv_unknown[] = { "prog", "--foo", "state", NULL };
+	char *argv_grouped[] = { "prog", "-vv", "state", NULL };
+	char *argv_end[] = { "prog", "-v", "--", "pause", NULL };
+
+	ck_assert (! cc_oci_daemon_command_name (NULL, 2, argv_cmd));
+	ck_assert (! cc_oci_daemon_command_name (test_options, 2, NULL));
+
+	ck_assert (! cc_oci_daemon_command_name (test_options, 1, argv_none));
+
+	ck_assert (! g_strcmp0 (cc_oci_daemon_command_name (test_options,
+					3, argv_cmd), "state"));
+	ck_assert (! g_strcmp0 (cc_oci_daemon_command_name (test_options,
+					5, argv_opts), "list"));
+	ck_assert (! g_strcmp0 (cc_oci_daemon_command_name (test_options,
+					4, argv_inline), "kill"));
+	ck_assert (! g_strcmp0 (cc_oci_daemon_command_name (test_options,
+					4, argv_end), "pause"));
+
+	/* "state" is the value of the option */
+	ck_assert (! cc_oci_daemon_command_name (test_options, 3, argv_value));
+
+	ck_assert (! cc_oci_daemon_command_name (test_options,
+				3, argv_unknown));
+	ck_assert (! cc_oci_daemon_command_name (test_options,
+				3, argv_grouped));
+} END_TEST
+
+START_TEST(test_cc_oci_daemon_forward) {
+	g_autofree gchar  *tmpdir = NULL;
+	g_autofree gchar  *path = NULL;
+	g_autofree gchar  *cwd = NULL;
+	g_autofree gchar  *expected = NULL;
+	gchar             *outfile = NULL;
+	gchar             *contents = NULL;
+	char              *argv_ok[] = { "prog", "state", "ok", NULL };
+	char              *argv_fail[] = { "prog", "state", "fail", NULL };
+	gboolean           result = false;
+	gboolean           forwarded = false;
+	int                status;
+	pid_t              pid;
+
+	tmpdir = g_dir_make_tmp (NULL, NULL);
+	ck_assert (tmpdir);
+
+	path = g_build_path ("/", tmpdir, "daemon", "daemon.sock", NULL);
+
+	ck_assert (! cc_oci_daemon_forward (NULL, 3, argv_ok, &result));
+	ck_assert (! cc_oci_daemon_forward (path, 0, argv_ok, &result));
+	ck_assert (! cc_oci_daemon_forward (path, 3, NULL, &result));
+	ck_assert (! cc_oci_daemon_forward (path, 3, argv_ok, NULL));
+
+	/* no handler */
+	ck_assert (! cc_oci_daemon_run (path));
+
+	/* daemon not running */
+	ck_assert (! cc_oci_daemon_forward (path, 3, argv_ok, &result));
+
+	cc_oci_daemon_handler_set (test_handler);
+
+	pid = fork ();
+	ck_assert (pid != -1);
+
+	if (! pid) {
+		_exit (cc_oci_daemon_run (path) ? EXIT_SUCCESS : EXIT_FAILURE);
+	}
+
+	for (int i = 0; i < DAEMON_TEST_RETRIES && ! forwarded; i++) {
+		SAVE_OUTPUT (outfile) {
+			forwarded = cc_oci_daemon_forward (path, 3,
+					argv_ok, &result);
+		}
+
+		if (! forwarded) {
+			ck_assert (! g_remove (outfile));
+			g_free (outfile);
+			outfile = NULL;
+			g_usleep (10 * 1000);
+		}
+	}
+
+	ck_assert (forwarded);
+	ck_assert (result);
+
+	/* output written by the daemon, from the callers directory */
+	cwd = g_get_current_dir ();
+	expected = g_strdup_printf ("%s:prog state ok\n", cwd);
+
+	ck_assert (g_file_get_contents (outfile, &contents, NULL, NULL));
+	ck_assert (! g_strcmp0 (contents, expected));
+
+	g_free (contents);
+	ck_assert (! g_remove (outfile));
+	g_free (outfile);
+
+	/* the outcome of the command is returned */
+	SAVE_OUTPUT (outfile) {
+		forwarded = cc_oci_daemon_forward (path, 3,
+				argv_fail, &result);
+	}
+
+	ck_assert (forwarded);
+	ck_assert (! result);
+
+	ck_assert (! g_remove (outfile));
+	g_free (outfile);
+
+	/* only one daemon may run */
+	ck_assert (! cc_oci_daemon_run (path));
+	ck_assert (g_file_test (path, G_FILE_TEST_EXISTS));
+
+	ck_assert (! kill (pid, SIGTERM));
+	ck_assert (waitpid (pid, &status, 0) == pid);
+	ck_assert (WIFEXITED (status));
+	ck_assert (WEXITSTATUS (status) == EXIT_SUCCESS);
+
+	/* socket removed on exit */
+	ck_assert (! g_file_test (path, G_FILE_TEST_EXISTS));
+	ck_assert (! cc_oci_daemon_forward (path, 3, argv_ok, &result));
+
+	cc_oci_daemon_handler_set (NULL);
+
+	ck_assert (cc_oci_rm_rf (tmpdir));
+} END_TEST
+
+Suite* make_daemon_suite(void) {
+	Suite* s = suite_create(__FILE__);
+
+	ADD_TEST (test_cc_oci_daemon_command_supported, s);
+	ADD_TEST (test_cc_oci_daemon_command_name, s);
+	ADD_TEST (test_cc_oci_daemon_forward, s);
+
+	return s;
+}
+
+int main (void) {
+	int number_failed;
+	Suite* s;
+	SRunner* sr;
+	struct cc_log_options options = { 0 };
+
+	options.enable_debug = true;
+	options.use_json = false;
+	options.filename = g_strdup ("daemon_test_debug.log");
+	(void)cc_oci_log_init(&options);
+
+	s = make_daemon_suite();
+	sr = srunner_create(s);
+
+	srunner_run_all(sr, CK_VERBOSE);
+	number_failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+
+	cc_oci_log_free (&options);
+
+	return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,341 @@
+/*
+ * This file is part of cc-oci-runtime.
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <time.h>
+#include <utime.h>
+#include <sys/stat.h>
+
+#include <check.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "test_common.h"
+#include "logging.h"
+#include "util.h"
+#include "hypervisor-args.h"
+
+extern gchar *vm_args_cache_dir;
+
+/*!
+ * Set the modification time of \p path to \p secs seconds ago so that
+ * the template is old enough to be cached.
+ */
+static void
+age_file (const gchar *path, time_t secs)
+{
+	struct utimbuf times;
+
+	times.actime = times.modtime = time (NULL) - secs;
+
+	ck_assert (! utime (path, &times));
+}
+
+/*!
+ * Count the cached templates.
+ */
+static guint
+cache_entries (void)
+{
+	GDir        *dir;
+	guint        count = 0;
+
+	dir = g_dir_open (vm_args_cache_dir, 0, NULL);
+	if (! dir) {
+		return 0;
+	}
+
+	while (g_dir_read_name (dir)) {
+		count++;
+	}
+
+	g_dir_close (dir);
+
+	return count;
+}
+
+START_TEST(test_cc_oci_vm_args_tag_name) {
+	ck_assert (! cc_oci_vm_args_tag_name (CC_OCI_VM_ARGS_TAG_COUNT));
+
+	ck_assert (! g_strcmp0 (cc_oci_vm_args_tag_name
+				(CC_OCI_VM_ARGS_TAG_KERNEL), "@KERNEL@"));
+	ck_assert (! g_strcmp0 (cc_oci_vm_args_tag_name
+				(CC_OCI_VM_ARGS_TAG_AGENT_TTY_SOCKET),
+				"@AGENT_TTY_SOCKET@"));
+} END_TEST
+
+START_TEST(test_cc_oci_vm_args_template_expand) {
+	struct cc_oci_vm_args_template *template;
+	const gchar *values[CC_OCI_VM_ARGS_TAG_COUNT] = { NULL };
+	gchar **args;
+	gchar *lines[] = {
+		"/bin/hypervisor",
+		"-kernel @KERNEL@",
+		"# a comment",
+		"-drive file=@IMAGE@,size=@SIZE@ # trailing comment",
+		"-append \"@KERNEL_PARAMS@ @KERNEL_PARAMS@\"",
+		"hello# not a comment",
+		"@UUID@@NAME@",
+		"@FOO@ @ @@",
+		NULL
+	};
+
+	ck_assert (! cc_oci_vm_args_template_compile (NULL));
+	ck_assert (! cc_oci_vm_args_template_expand (NULL, values));
+
+	template = cc_oci_vm_args_template_compile (lines);
+	ck_assert (template);
+
+	ck_assert (! cc_oci_vm_args_template_expand (template, NULL));
+
+	values[CC_OCI_VM_ARGS_TAG_KERNEL] = "/tmp/vmlinux";
+	values[CC_OCI_VM_ARGS_TAG_IMAGE] = "/tmp/image";
+	values[CC_OCI_VM_ARGS_TAG_SIZE] = "1024";
+	values[CC_OCI_VM_ARGS_TAG_KERNEL_PARAMS] = "quiet";
+	values[CC_OCI_VM_ARGS_TAG_UUID] = "1234";
+
+	/* values are not scanned for tags */
+	values[CC_OCI_VM_ARGS_TAG_NAME] = "@KERNEL@";
+
+	args = cc_oci_vm_args_template_expand (template, values);
+	ck_assert (args);
+
+	/* one entry per template line */
+	ck_assert (g_strv_length (args) == 8);
+
+	ck_assert (! g_strcmp0 (args[0], "/bin/hypervisor"));
+	ck_assert (! g_strcmp0 (args[1], "-kernel /tmp/vmlinux"));
+	ck_assert (! g_strcmp0 (args[2], ""));
+	ck_assert (! g_strcmp0 (args[3],
+				"-drive file=/tmp/image,size=1024 "));
+	ck_assert (! g_strcmp0 (args[4], "-append \"quiet quiet\""));
+	ck_assert (! g_strcmp0 (args[5], "hello# not a comment"));
+	ck_assert (! g_strcmp0 (args[6], "1234@KERNEL@"));
+	ck_assert (! g_strcmp0 (args[7], "@FOO@ @ @@"));
+
+	g_strfreev (args);
+
+	/* tags without a value are left as-is */
+	values[CC_OCI_VM_ARGS_TAG_KERNEL] = NULL;
+
+	args = cc_oci_vm_args_template_expand (template, values);
+	ck_assert (args);
+	ck_assert (! g_strcmp0 (args[1], "-kernel @KERNEL@"));
+	g_strfreev (args);
+
+	cc_oci_vm_args_template_free (template);
+
+	/* NOP */
+	cc_oci_vm_args_template_free (NULL);
+} END_TEST
+
+START_TEST(test_cc_oci_vm_args_template_get) {
+	struct cc_oci_vm_args_template *template;
+	const gchar *values[CC_OCI_VM_ARGS_TAG_COUNT] = { NULL };
+	gchar *tmpdir;
+	gchar *args_file;
+	gchar *cache_file;
+	gchar **args;
+	GDir *dir;
+
+	tmpdir = g_dir_make_tmp (NULL, NULL);
+	ck_assert (tmpdir);
+
+	vm_args_cache_dir = g_build_path ("/", tmpdir, "cache", NULL);
+	args_file = g_build_path ("/", tmpdir, "hypervisor.args", NULL);
+
+	values[CC_OCI_VM_ARGS_TAG_SIZE] = "2G";
+	values[CC_OCI_VM_ARGS_TAG_KERNEL] = "vmlinux";
+
+	ck_assert (! cc_oci_vm_args_template_get (NULL));
+
+	/* file does not exist */
+	ck_assert (! cc_oci_vm_args_template_get (args_file));
+
+	ck_assert (g_file_set_contents (args_file,
+				"/bin/true\n-m @SIZE@\n", -1, NULL));
+
+	/* recently modified templates are not cached */
+	template = cc_oci_vm_args_template_get (args_file);
+	ck_assert (template);
+	cc_oci_vm_args_template_free (template);
+	ck_assert (cache_entries () == 0);
+
+	age_file (args_file, 60);
+
+	template = cc_oci_vm_args_template_get (args_file);
+	ck_assert (template);
+	cc_oci_vm_args_template_free (template);
+	ck_assert (cache_entries () == 1);
+
+	/* served from the cache */
+	template = cc_oci_vm_args_template_get (args_file);
+	ck_assert (template);
+
+	args = cc_oci_vm_args_template_expand (template, values);
+	ck_assert (args);
+	ck_assert (! g_strcmp0 (args[0], "/bin/true"));
+	ck_assert (! g_strcmp0 (args[1], "-m 2G"));
+	ck_assert (! args[2]);
+	g_strfreev (args);
+	cc_oci_vm_args_template_free (template);
+
+	/* a modified template invalidates the cache */
+	ck_assert (g_file_set_contents (args_file,
+				"/bin/true\n-m @SIZE@ -k @KERNEL@\n", -1, NULL));
+	age_file (args_file, 30);
+
+	template = cc_oci_vm_args_template_get (args_file);
+	ck_assert (template);
+
+	args = cc_oci_vm_args_template_expand (template, values);
+	ck_assert (args);
+	ck_assert (! g_strcmp0 (args[1], "-m 2G -k vmlinux"));
+	g_strfreev (args);
+	cc_oci_vm_args_template_free (template);
+
+	ck_assert (cache_entries () == 1);
+
+	dir = g_dir_open (vm_args_cache_dir, 0, NULL);
+	ck_assert (dir);
+	cache_file = g_build_path ("/", vm_args_cache_dir,
+			g_dir_read_name (dir), NULL);
+	g_dir_close (dir);
+
+	/* a corrupt cache file is ignored and replaced */
+	ck_assert (g_file_set_contents (cache_file, "garbage", -1, NULL));
+
+	template = cc_oci_vm_args_template_get (args_file);
+	ck_assert (template);
+
+	args = cc_oci_vm_args_template_expand (template, values);
+	ck_assert (args);
+	ck_assert (! g_strcmp0 (args[1], "-m 2G -k vmlinux"));
+	g_strfreev (args);
+	cc_oci_vm_args_template_free (template);
+
+	ck_assert (! g_remove (cache_file));
+	ck_assert (! g_remove (vm_args_cache_dir));
+	ck_assert (! g_remove (args_file));
+	ck_assert (! g_remove (tmpdir));
+
+	g_free (cache_file);
+	g_free (args_file);
+	g_free (vm_args_cache_dir);
+	g_free (tmpdir);
+} END_TEST
+
+START_TEST(test_cc_oci_vm_args_template_preload) {
+	struct cc_oci_vm_args_template *template;
+	const gchar *values[CC_OCI_VM_ARGS_TAG_COUNT] = { NULL };
+	gchar *tmpdir;
+	gchar *args_file;
+	gchar **args;
+
+	tmpdir = g_dir_make_tmp (NULL, NULL);
+	ck_assert (tmpdir);
+
+	vm_args_cache_dir = g_build_path ("/", tmpdir, "cache", NULL);
+	args_file = g_build_path ("/", tmpdir, "hypervisor.args", NULL);
+
+	values[CC_OCI_VM_ARGS_TAG_SIZE] = "2G";
+
+	ck_assert (! cc_oci_vm_args_template_preload (NULL));
+
+	/* file does not exist */
+	ck_assert (! cc_oci_vm_args_template_preload (args_file));
+
+	ck_assert (g_file_set_contents (args_file,
+				"/bin/true\n-m @SIZE@\n", -1, NULL));
+	age_file (args_file, 60);
+
+	ck_assert (cc_oci_vm_args_template_preload (args_file));
+	ck_assert (cache_entries () == 1);
+
+	/* served from memory once the cache has gone */
+	ck_assert (cc_oci_rm_rf (vm_args_cache_dir));
+
+	template = cc_oci_vm_args_template_get (args_file);
+	ck_assert (template);
+
+	args = cc_oci_vm_args_template_expand (template, values);
+	ck_assert (args);
+	ck_assert (! g_strcmp0 (args[1], "-m 2G"));
+	g_strfreev (args);
+	cc_oci_vm_args_template_free (template);
+
+	ck_assert (! g_file_test (vm_args_cache_dir, G_FILE_TEST_EXISTS));
+
+	/* but a modified template is still detected */
+	ck_assert (g_file_set_contents (args_file,
+				"/bin/true\n-m @SIZE@ -smp 2\n", -1, NULL));
+	age_file (args_file, 30);
+
+	template = cc_oci_vm_args_template_get (args_file);
+	ck_assert (template);
+
+	args = cc_oci_vm_args_template_expand (template, values);
+	ck_assert (args);
+	ck_assert (! g_strcmp0 (args[1], "-m 2G -smp 2"));
+	g_strfreev (args);
+	cc_oci_vm_args_template_free (template);
+
+	ck_assert (cc_oci_rm_rf (tmpdir));
+
+	g_free (args_file);
+	g_free (vm_args_cache_dir);
+	g_free (tmpdir);
+} END_TEST
+
+Suite* make_hypervisor_args_suite(void) {
+	Suite* s = suite_create(__FILE__);
+
+	ADD_TEST (test_cc_oci_vm_args_tag_name, s);
+	ADD_TEST (test_cc_oci_vm_args_template_expand, s);
+	ADD_TEST (test_cc_oci_vm_args_template_get, s);
+	ADD_TEST (test_cc_oci_vm_args_template_preload, s);
+
+	return s;
+}
+
+int main (void) {
+	int number_failed;
+	Suite* s;
+	SRunner* sr;
+	struct cc_log_options options = { 0 };
+
+	options.enable_debug = true;
+	options.use_json = false;
+	options.filename = g_strdup ("hypervisor_args_test_debug.log");
+	(void)cc_oci_log_init(&options);
+
+	s = make_hypervisor_args_suite();
+	sr = srunner_create(s);
+
+	srunner_run_all(sr, CK_VERBOSE);
+	number_failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+
+	cc_oci_log_free (&options);
+
+	return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
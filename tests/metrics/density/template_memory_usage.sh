@@ -0,0 +1,148 @@
+#!/bin/bash
+
+#  This file is part of cc-oci-runtime.
+#
+#  Copyright (C) 2017 Intel Corporation
+#
+#  This program is free software; you can redistribute it and/or
+#  modify it under the terms of the GNU General Public License
+#  as published by the Free Software Foundation; either version 2
+#  of the License, or (at your option) any later version.
+#
+#  This program is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program; if not, write to the Free Software
+#  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#  Description of the test:
+#  This test runs a number of containers whose VMs are booted, then the
+#  same number of containers whose VMs are cloned from a VM template
+#  (com.intel.cc.vm-template annotation), and compares the average PSS
+#  of the hypervisors. This test uses smem tool to get the memory used.
+
+set -e
+
+[ $# -ne 3 ] && ( echo >&2 "Usage: $0 <bundle-path> <count> <wait_time>"; exit 1 )
+
+SCRIPT_PATH=$(dirname "$(readlink -f "$0")")
+source "${SCRIPT_PATH}/../../lib/test-common.bash"
+
+TEST_NAME="VM template memory usage"
+RUNTIME_BIN="${RUNTIME_BIN:-cc-oci-runtime}"
+QEMU_BIN="${QEMU_BIN:-$(command -v qemu-lite-system-x86_64 || true)}"
+SMEM_BIN=$(command -v smem || true)
+JQ_BIN=$(command -v jq || true)
+BUNDLE=$(readlink -f "$1")
+CC_NUMBER="$2"
+WAIT_TIME="$3"
+BUNDLE_DIR=$(mktemp -d)
+TEMPLATE_ANNOTATION="com.intel.cc.vm-template"
+
+containers=()
+
+function cleanup(){
+	for id in "${containers[@]}"; do
+		"$RUNTIME_BIN" kill "$id" SIGKILL > /dev/null 2>&1 || true
+		"$RUNTIME_BIN" delete "$id" > /dev/null 2>&1 || true
+	done
+	containers=()
+}
+
+trap 'cleanup; rm -rf "$BUNDLE_DIR"' EXIT
+
+function save_result(){
+	local name="$1"
+	local value="$2"
+	local result_file=$(echo "${RESULT_DIR}/${TEST_NAME}-${name}" | sed 's| |-|g')
+
+	backup_old_file "$result_file"
+	write_csv_header "$result_file"
+	write_result_to_file "$TEST_NAME" "${name} units=kb" \
+		"$value" "$result_file"
+}
+
+# This function measures the PSS average
+# memory of a process.
+function get_pss_memory(){
+	ps="$1"
+	mem_amount=0
+	count=0
+	avg=0
+
+	data=$("$SMEM_BIN" --no-header -P "^$ps" -c "pss")
+	for i in $data;do
+		if (( $i > 0 ));then
+			mem_amount=$(( $i + $mem_amount ))
+			count=$(( $count + 1 ))
+		fi
+	done
+
+	if (( $count > 0 ));then
+		avg=$(echo "scale=2; $mem_amount / $count" | bc -l)
+	fi
+
+	echo "$avg"
+}
+
+# Create a bundle sharing the rootfs of the original one, with the
+# template annotation set to the value given.
+function make_bundle(){
+	local dir="$1"
+	local template="$2"
+
+	mkdir -p "$dir"
+	ln -sf "$BUNDLE/rootfs" "$dir/rootfs"
+	"$JQ_BIN" --arg key "$TEMPLATE_ANNOTATION" --arg value "$template" \
+		'.annotations[$key] = $value' \
+		"$BUNDLE/config.json" > "$dir/config.json"
+}
+
+# Run the containers and print the average PSS of their hypervisors.
+function get_memory_usage(){
+	local bundle="$1"
+	local mem
+
+	for i in $(seq 1 "$CC_NUMBER"); do
+		containers+=($(random_name))
+		"$RUNTIME_BIN" create --bundle "$bundle" "${containers[-1]}" < /dev/null > /dev/null
+		"$RUNTIME_BIN" start "${containers[-1]}" < /dev/null > /dev/null
+	done
+
+	sleep "$WAIT_TIME"
+
+	mem="$(get_pss_memory "$QEMU_BIN")"
+
+	cleanup
+
+	if [ "$mem" == "0" ]; then
+		die "Failed to find PSS for $QEMU_BIN"
+	fi
+
+	echo "$mem"
+}
+
+echo "Executing Test: ${TEST_NAME}"
+
+[ -z "$SMEM_BIN" ] && die "smem is not installed in your system, skipping test"
+[ -z "$JQ_BIN" ] && die "jq is not installed in your system, skipping test"
+[ -z "$QEMU_BIN" ] && die "hypervisor not found, please set QEMU_BIN"
+
+make_bundle "$BUNDLE_DIR/boot" "false"
+make_bundle "$BUNDLE_DIR/template" "true"
+
+# Create the template before measuring (the first clone creates it)
+get_memory_usage "$BUNDLE_DIR/template" > /dev/null
+
+boot_mem=$(get_memory_usage "$BUNDLE_DIR/boot")
+template_mem=$(get_memory_usage "$BUNDLE_DIR/template")
+saving=$(echo "scale=2; $boot_mem - $template_mem" | bc -l)
+
+save_result "boot" "$boot_mem"
+save_result "template" "$template_mem"
+save_result "saving" "$saving"
+
+echo "average hypervisor PSS: boot ${boot_mem}KiB, template ${template_mem}KiB, saving per VM ${saving}KiB"
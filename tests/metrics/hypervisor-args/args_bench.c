@@ -0,0 +1,333 @@
+/*
+ * This file is part of cc-oci-runtime.
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Microbenchmark comparing the cost of producing the hypervisor
+ * command-line from \ref CC_OCI_HYPERVISOR_CMDLINE_FILE the way the
+ * runtime used to (read the file, strip comments, search-and-replace
+ * every tag in every line, resolve the command) with a cached,
+ * compiled template (see cc_oci_vm_args_template_get()).
+ *
+ * Both methods finish by removing empty lines, as
+ * cc_oci_vm_args_get() does.
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <utime.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "util.h"
+#include "hypervisor-args.h"
+
+/** Default number of command-lines to produce per method. */
+#define ARGS_BENCH_DEFAULT_ITERATIONS	10000
+
+/** Template used if none is specified (based on hypervisor.args.in,
+ * with a command that must be resolved using \c PATH).
+ */
+#define ARGS_BENCH_TEMPLATE \
+	"true\n" \
+	"-name\n@NAME@\n" \
+	"-machine\npc-lite,accel=kvm,kernel_irqchip,nvdimm\n" \
+	"-device\nnvdimm,memdev=mem0,id=nv0\n" \
+	"-object\nmemory-backend-file,id=mem0,mem-path=@IMAGE@,size=@SIZE@\n" \
+	"-m\n2G,slots=2,maxmem=3G\n" \
+	"-kernel\n@KERNEL@\n" \
+	"-append\n@KERNEL_PARAMS@ @KERNEL_NET_PARAMS@\n" \
+	"-smp\n2,sockets=1,cores=2,threads=1\n" \
+	"-cpu\nhost\n" \
+	"-rtc\nbase=utc,driftfix=slew\n" \
+	"-no-user-config\n-nodefaults\n" \
+	"-global\nkvm-pit.lost_tick_policy=discard\n" \
+	"-device\nvirtio-serial-pci,id=virtio-serial0\n" \
+	"-device\nvirtconsole,chardev=charconsole0,id=console0\n" \
+	"-chardev\n@CONSOLE_DEVICE@\n" \
+	"-chardev\n" \
+	"# used to determine when hypervisor has started running.\n" \
+	"@PROCESS_SOCKET@\n" \
+	"#hyperstart ctl serial port\n" \
+	"-chardev\nsocket,id=charch0,path=@AGENT_CTL_SOCKET@,server,nowait\n" \
+	"-device\nvirtserialport,bus=virtio-serial0.0,nr=1,chardev=charch0,id=channel0,name=sh.hyper.channel.0\n" \
+	"#hyperstart tty_serial port\n" \
+	"-chardev\nsocket,id=charch1,path=@AGENT_TTY_SOCKET@,server,nowait\n" \
+	"-device\nvirtserialport,bus=virtio-serial0.0,nr=2,chardev=charch1,id=channel1,name=sh.hyper.channel.1\n" \
+	"-uuid\n@UUID@\n" \
+	"-qmp\nunix:@COMMS_SOCKET@,server,nowait\n" \
+	"-nographic\n-vga\nnone\n"
+
+extern gchar *vm_args_cache_dir;
+
+/** Representative tag values, indexed by \ref cc_oci_vm_args_tag. */
+static const gchar *args_bench_values[CC_OCI_VM_ARGS_TAG_COUNT] = {
+	"/usr/share/clear-containers/vmlinux.container",
+	"root=/dev/pmem0p1 rootflags=dax,data=ordered,errors=remount-ro rw rootfstype=ext4 tsc=reliable no_timer_check rcupdate.rcu_expedited=1 i8042.direct=1 i8042.dumbkbd=1 i8042.nopnp=1 i8042.noaux=1 noreplace-smp reboot=k panic=1 console=hvc0 console=hvc1 initcall_debug iommu=off quiet",
+	"ip=::::::0123456789ab::off::",
+	"/usr/share/clear-containers/clear-containers.img",
+	"235929600",
+	"/run/cc-oci-runtime/0123456789ab/hypervisor.sock",
+	"socket,id=procsock,path=/run/cc-oci-runtime/0123456789ab/process.sock,server,nowait",
+	"socket,path=/run/cc-oci-runtime/0123456789ab/console.sock,server,nowait,id=charconsole0,signal=off",
+	"0123456789ab",
+	"01234567-89ab-cdef-0123-0123456789ab",
+	"/run/cc-oci-runtime/0123456789ab/ga-ctl.sock",
+	"/run/cc-oci-runtime/0123456789ab/ga-tty.sock",
+};
+
+static int
+args_bench_cmp (const void *a, const void *b)
+{
+	gint64 x = *(const gint64 *)a;
+	gint64 y = *(const gint64 *)b;
+
+	return (x > y) - (x < y);
+}
+
+/*!
+ * Remove empty lines (as cc_oci_vm_args_get() does).
+ *
+ * \param args Expanded lines (freed).
+ *
+ * \return Newly-allocated \c NULL-terminated array.
+ */
+static gchar **
+args_bench_filter (gchar **args)
+{
+	gchar  **new_args;
+	guint    count = 0;
+	guint    i = 0;
+
+	for (gchar **arg = args; *arg; arg++) {
+		if (**arg) {
+			count++;
+		}
+	}
+
+	new_args = g_new0 (gchar *, count + 1);
+
+	for (gchar **arg = args; *arg; arg++) {
+		if (**arg) {
+			new_args[i++] = g_strdup (*arg);
+		}
+	}
+
+	g_strfreev (args);
+
+	return new_args;
+}
+
+/*!
+ * Produce a command-line the way the runtime used to.
+ *
+ * \param path Template file.
+ *
+ * \return Newly-allocated \c NULL-terminated array on success,
+ * else \c NULL.
+ */
+static gchar **
+args_bench_legacy (const gchar *path)
+{
+	gchar **args = NULL;
+
+	if (! cc_oci_file_to_strv (path, &args)) {
+		return NULL;
+	}
+
+	for (guint i = 0; args[i]; i++) {
+		gchar *ptr;
+
+		if (! i && ! g_path_is_absolute (args[i])) {
+			gchar *cmd = g_find_program_in_path (args[i]);
+
+			if (cmd) {
+				g_free (args[i]);
+				args[i] = cmd;
+			}
+		}
+
+		if (*args[i] == '#') {
+			*args[i] = '\0';
+			continue;
+		}
+
+		for (ptr = strchr (args[i], '#'); ptr;
+				ptr = strchr (ptr+1, '#')) {
+			if (g_ascii_isspace (*(ptr-1))) {
+				*ptr = '\0';
+				break;
+			}
+		}
+
+		for (guint tag = 0; tag < CC_OCI_VM_ARGS_TAG_COUNT; tag++) {
+			if (! cc_oci_replace_string (&args[i],
+					cc_oci_vm_args_tag_name (tag),
+					args_bench_values[tag])) {
+				g_strfreev (args);
+				return NULL;
+			}
+		}
+	}
+
+	return args_bench_filter (args);
+}
+
+/*!
+ * Produce a command-line from the compiled template.
+ *
+ * \param path Template file.
+ *
+ * \return Newly-allocated \c NULL-terminated array on success,
+ * else \c NULL.
+ */
+static gchar **
+args_bench_compiled (const gchar *path)
+{
+	struct cc_oci_vm_args_template  *template;
+	gchar                          **args;
+
+	template = cc_oci_vm_args_template_get (path);
+	if (! template) {
+		return NULL;
+	}
+
+	args = cc_oci_vm_args_template_expand (template, args_bench_values);
+	cc_oci_vm_args_template_free (template);
+
+	return args ? args_bench_filter (args) : NULL;
+}
+
+static void
+args_bench_usage (const char *name)
+{
+	printf ("Usage: %s [-n iterations] [-f template]\n", name);
+	printf ("\n");
+	printf ("Compare expanding the hypervisor arguments template by\n");
+	printf ("search-and-replace with expanding a cached, compiled template.\n");
+	printf ("Results are printed as CSV (times in microseconds).\n");
+}
+
+int
+main (int argc, char *argv[])
+{
+	const gchar  *methods[] = { "legacy", "compiled" };
+	guint         iterations = ARGS_BENCH_DEFAULT_ITERATIONS;
+	gchar        *template_file = NULL;
+	gchar        *tmpdir;
+	gchar        *path;
+	gint64       *samples;
+	struct utimbuf times;
+	int           c;
+
+	while ((c = getopt (argc, argv, "n:f:h")) != -1) {
+		switch (c) {
+		case 'n':
+			iterations = (guint)atoi (optarg);
+			break;
+		case 'f':
+			template_file = optarg;
+			break;
+		case 'h':
+			args_bench_usage (argv[0]);
+			return EXIT_SUCCESS;
+		default:
+			args_bench_usage (argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (! iterations) {
+		args_bench_usage (argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	tmpdir = g_dir_make_tmp (NULL, NULL);
+	if (! tmpdir) {
+		fprintf (stderr, "failed to create directory\n");
+		return EXIT_FAILURE;
+	}
+
+	vm_args_cache_dir = g_build_path ("/", tmpdir, "cache", NULL);
+
+	if (template_file) {
+		path = g_strdup (template_file);
+	} else {
+		path = g_build_path ("/", tmpdir, "hypervisor.args", NULL);
+		if (! g_file_set_contents (path, ARGS_BENCH_TEMPLATE,
+					-1, NULL)) {
+			fprintf (stderr, "failed to create %s\n", path);
+			return EXIT_FAILURE;
+		}
+
+		/* recently modified templates are not cached */
+		times.actime = times.modtime = time (NULL) - 60;
+		(void)utime (path, &times);
+	}
+
+	samples = g_new0 (gint64, iterations);
+
+	printf ("method,iterations,median_us,p99_us\n");
+
+	for (guint method = 0; method < G_N_ELEMENTS (methods); method++) {
+		for (guint i = 0; i < iterations; i++) {
+			gchar  **args;
+			gint64   start;
+
+			start = g_get_monotonic_time ();
+
+			args = method
+				? args_bench_compiled (path)
+				: args_bench_legacy (path);
+
+			samples[i] = g_get_monotonic_time () - start;
+
+			if (! args) {
+				fprintf (stderr, "%s: failed to expand %s\n",
+						methods[method], path);
+				return EXIT_FAILURE;
+			}
+
+			g_strfreev (args);
+		}
+
+		qsort (samples, iterations, sizeof (gint64), args_bench_cmp);
+
+		printf ("%s,%u,%" G_GINT64_FORMAT ",%" G_GINT64_FORMAT "\n",
+				methods[method], iterations,
+				samples[iterations / 2],
+				samples[(iterations * 99) / 100]);
+	}
+
+	(void)cc_oci_rm_rf (tmpdir);
+
+	g_free (samples);
+	g_free (path);
+	g_free (vm_args_cache_dir);
+	g_free (tmpdir);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,529 @@
+/*
+ * This file is part of cc-oci-runtime.
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Throughput benchmark of cc-shim relaying the output of a workload,
+ * or its input.
+ *
+ * The benchmark plays the part of the proxy, sending stream frames
+ * on a socketpair given to the shim as its proxy I/O fd (or receiving
+ * them, for the input), and of containerd-shim, reading the shim stdout
+ * from a pipe (or writing to its stdin). Besides the throughput, it
+ * reports the number of read and write system calls (as accounted in
+ * /proc/<pid>/io) the shim made per MiB relayed and the CPU time it used
+ * per GiB.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <glib.h>
+
+/** Default amount of output to relay, in MiB. */
+#define SHIM_BENCH_DEFAULT_MIB		1024
+
+/** Stream frame header, see shim/shim.h. */
+#define SHIM_BENCH_HEADER_SIZE		12
+
+/** Largest frame hyperstart sends. */
+#define SHIM_BENCH_MAX_FRAME_SIZE	10240
+
+/** Frames written to the shim with each write(). */
+#define SHIM_BENCH_BATCH		16
+
+#define SHIM_BENCH_IO_SEQ		1
+
+#define SHIM_BENCH_TRAILER_SIZE		(2 * SHIM_BENCH_HEADER_SIZE + 1)
+
+#define MIB				(1024 * 1024)
+
+struct shim_bench {
+	const char *shim;
+	gboolean    input;
+	size_t      frame_size;
+	size_t      total;
+	int         ctl[2], io[2], in[2], out[2];
+	pid_t       pid;
+};
+
+static void
+shim_bench_frame_header (uint8_t *buf, uint32_t len)
+{
+	memset (buf, 0, SHIM_BENCH_HEADER_SIZE);
+	buf[7] = SHIM_BENCH_IO_SEQ;
+	buf[8] = (uint8_t)(len >> 24);
+	buf[9] = (uint8_t)(len >> 16);
+	buf[10] = (uint8_t)(len >> 8);
+	buf[11] = (uint8_t)len;
+}
+
+/*!
+ * Read the number of read and write system calls made by a process.
+ *
+ * \param pid Process, which may have exited but not been reaped.
+ * \param[out] syscalls Number of system calls.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+shim_bench_syscalls (pid_t pid, guint64 *syscalls)
+{
+	gchar    *path;
+	gchar    *contents = NULL;
+	gchar   **lines;
+	guint64   syscr = 0, syscw = 0;
+	gboolean  ret;
+
+	path = g_strdup_printf ("/proc/%d/io", (int)pid);
+	ret = g_file_get_contents (path, &contents, NULL, NULL);
+	g_free (path);
+
+	if (! ret) {
+		return false;
+	}
+
+	lines = g_strsplit (contents, "\n", -1);
+	for (gchar **line = lines; *line; line++) {
+		(void)sscanf (*line, "syscr: %" SCNu64, &syscr);
+		(void)sscanf (*line, "syscw: %" SCNu64, &syscw);
+	}
+	g_strfreev (lines);
+	g_free (contents);
+
+	*syscalls = syscr + syscw;
+
+	return true;
+}
+
+static pid_t
+shim_bench_spawn (const struct shim_bench *bench)
+{
+	pid_t  pid;
+	gchar *ctl = g_strdup_printf ("%d", bench->ctl[1]);
+	gchar *io = g_strdup_printf ("%d", bench->io[1]);
+
+	pid = fork ();
+	if (pid) {
+		g_free (ctl);
+		g_free (io);
+		return pid;
+	}
+
+	if (dup2 (bench->in[0], STDIN_FILENO) == -1 ||
+			dup2 (bench->out[1], STDOUT_FILENO) == -1 ||
+			fcntl (bench->ctl[1], F_SETFD, 0) == -1 ||
+			fcntl (bench->io[1], F_SETFD, 0) == -1) {
+		_exit (EXIT_FAILURE);
+	}
+
+	execl (bench->shim, bench->shim, "-c", "shim-bench", "-p", ctl,
+			"-o", io, "-s", "1", "-e", "2", NULL);
+	_exit (EXIT_FAILURE);
+}
+
+/*!
+ * Build the end of the stdout stream followed by the exit code, for
+ * the shim to exit.
+ */
+static void
+shim_bench_trailer (uint8_t trailer[SHIM_BENCH_TRAILER_SIZE])
+{
+	shim_bench_frame_header (trailer, SHIM_BENCH_HEADER_SIZE);
+	shim_bench_frame_header (trailer + SHIM_BENCH_HEADER_SIZE,
+			SHIM_BENCH_HEADER_SIZE + 1);
+	trailer[SHIM_BENCH_TRAILER_SIZE - 1] = 0;
+}
+
+static gboolean
+shim_bench_send_exit (int fd)
+{
+	uint8_t trailer[SHIM_BENCH_TRAILER_SIZE];
+	size_t  offset = 0;
+	ssize_t ret;
+
+	shim_bench_trailer (trailer);
+
+	while (offset < sizeof (trailer)) {
+		struct pollfd pfd = { .fd = fd, .events = POLLOUT };
+
+		(void)poll (&pfd, 1, -1);
+		ret = write (fd, trailer + offset, sizeof (trailer) - offset);
+		if (ret == -1 && errno != EAGAIN && errno != EINTR) {
+			return false;
+		} else if (ret > 0) {
+			offset += (size_t)ret;
+		}
+	}
+
+	return true;
+}
+
+/*!
+ * Relay the output: send frames to the shim, read its stdout.
+ */
+static gboolean
+shim_bench_output (struct shim_bench *bench)
+{
+	size_t          payload = bench->frame_size - SHIM_BENCH_HEADER_SIZE;
+	size_t          stream_len = bench->total / payload * bench->frame_size;
+	size_t          sent = 0, received = 0;
+	size_t          batch_len, len;
+	uint8_t        *batch;
+	uint8_t         trailer[SHIM_BENCH_TRAILER_SIZE];
+	size_t          trailer_offset = 0;
+	uint8_t         buf[64 * 1024];
+	struct pollfd   pfds[2];
+	ssize_t         ret;
+
+	batch_len = SHIM_BENCH_BATCH * bench->frame_size;
+	batch = g_malloc (batch_len);
+	for (int i = 0; i < SHIM_BENCH_BATCH; i++) {
+		uint8_t *frame = batch + (size_t)i * bench->frame_size;
+
+		shim_bench_frame_header (frame, (uint32_t)bench->frame_size);
+		memset (frame + SHIM_BENCH_HEADER_SIZE, 'x', payload);
+	}
+
+	shim_bench_trailer (trailer);
+
+	pfds[0].fd = bench->io[0];
+	pfds[1].fd = bench->out[0];
+	pfds[1].events = POLLIN;
+
+	while (received < bench->total) {
+		pfds[0].events = POLLIN;
+		if (trailer_offset < sizeof (trailer)) {
+			pfds[0].events |= POLLOUT;
+		}
+
+		if (poll (pfds, 2, -1) == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			fprintf (stderr, "poll: %s\n", strerror (errno));
+			return false;
+		}
+
+		if (pfds[0].revents & POLLOUT) {
+			if (sent < stream_len) {
+				/* the batch of frames is sent over and over */
+				len = batch_len - sent % batch_len;
+				if (len > stream_len - sent) {
+					len = stream_len - sent;
+				}
+				ret = write (bench->io[0], batch + sent % batch_len, len);
+				if (ret > 0) {
+					sent += (size_t)ret;
+				}
+			} else {
+				ret = write (bench->io[0], trailer + trailer_offset,
+						sizeof (trailer) - trailer_offset);
+				if (ret > 0) {
+					trailer_offset += (size_t)ret;
+				}
+			}
+		}
+
+		/* stdin EOF sent by the shim */
+		if (pfds[0].revents & POLLIN) {
+			(void)read (bench->io[0], buf, sizeof (buf));
+		}
+
+		if (pfds[1].revents) {
+			ret = read (bench->out[0], buf, sizeof (buf));
+			if (ret <= 0) {
+				fprintf (stderr, "shim exited early\n");
+				return false;
+			}
+			received += (size_t)ret;
+		}
+	}
+
+	g_free (batch);
+
+	return true;
+}
+
+/*!
+ * Relay the input: write to the shim stdin, read the frames it sends
+ * until the end of the stream.
+ */
+static gboolean
+shim_bench_input (struct shim_bench *bench)
+{
+	uint8_t        *chunk;
+	uint8_t         buf[64 * 1024];
+	uint8_t         header[SHIM_BENCH_HEADER_SIZE];
+	size_t          header_len = 0;
+	size_t          frame_left = 0;
+	size_t          sent = 0, received = 0;
+	size_t          len;
+	struct pollfd   pfds[2];
+	gboolean        eof = false;
+	ssize_t         ret;
+
+	chunk = g_malloc (bench->frame_size);
+	memset (chunk, 'x', bench->frame_size);
+
+	pfds[0].fd = bench->io[0];
+	pfds[0].events = POLLIN;
+	pfds[1].fd = bench->in[1];
+	pfds[1].events = POLLOUT;
+
+	while (! eof) {
+		if (poll (pfds, pfds[1].fd == -1 ? 1 : 2, -1) == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			fprintf (stderr, "poll: %s\n", strerror (errno));
+			return false;
+		}
+
+		if (pfds[1].fd != -1 && pfds[1].revents) {
+			len = bench->total - sent;
+			if (len > bench->frame_size) {
+				len = bench->frame_size;
+			}
+			ret = write (bench->in[1], chunk, len);
+			if (ret > 0) {
+				sent += (size_t)ret;
+			}
+			if (sent == bench->total) {
+				close (bench->in[1]);
+				bench->in[1] = -1;
+				pfds[1].fd = -1;
+			}
+		}
+
+		if (! pfds[0].revents) {
+			continue;
+		}
+
+		ret = read (bench->io[0], buf, sizeof (buf));
+		if (ret <= 0) {
+			if (ret == -1 && errno == EAGAIN) {
+				continue;
+			}
+			fprintf (stderr, "shim exited early\n");
+			return false;
+		}
+
+		/* Count the payloads, up to the empty frame marking the
+		 * end of the stream */
+		for (size_t i = 0; i < (size_t)ret; ) {
+			if (frame_left) {
+				len = MIN (frame_left, (size_t)ret - i);
+				frame_left -= len;
+				received += len;
+				i += len;
+				continue;
+			}
+
+			header[header_len++] = buf[i++];
+			if (header_len < SHIM_BENCH_HEADER_SIZE) {
+				continue;
+			}
+			header_len = 0;
+			frame_left = ((size_t)header[8] << 24 |
+				(size_t)header[9] << 16 |
+				(size_t)header[10] << 8 | header[11]) -
+				SHIM_BENCH_HEADER_SIZE;
+			if (! frame_left) {
+				eof = true;
+			}
+		}
+	}
+
+	g_free (chunk);
+
+	if (received != bench->total) {
+		fprintf (stderr, "received %zu bytes, expected %zu\n",
+				received, bench->total);
+		return false;
+	}
+
+	if (! shim_bench_send_exit (bench->io[0])) {
+		fprintf (stderr, "failed to send the exit code\n");
+		return false;
+	}
+
+	return true;
+}
+
+static void
+shim_bench_usage (const char *name)
+{
+	printf ("Usage: %s [-m MiB] [-f frame size] [-d out|in] [-p cc-shim path]\n",
+			name);
+	printf ("\n");
+	printf ("Measure the throughput of cc-shim relaying stream frames\n");
+	printf ("of the given size from the proxy to its stdout (-d out),\n");
+	printf ("or writes of the given size from its stdin to the proxy\n");
+	printf ("(-d in).\n");
+	printf ("Results are printed as CSV.\n");
+}
+
+int
+main (int argc, char *argv[])
+{
+	struct shim_bench bench = {
+		.shim = SHIM_PATH,
+		.frame_size = SHIM_BENCH_MAX_FRAME_SIZE,
+	};
+	guint64         mib = SHIM_BENCH_DEFAULT_MIB;
+	size_t          payload;
+	siginfo_t       info;
+	struct rusage   usage;
+	guint64         syscalls = 0;
+	gint64          start, elapsed;
+	double          seconds, cpu, mibs;
+	gboolean        ret;
+	int             status;
+	int             c;
+
+	while ((c = getopt (argc, argv, "m:f:d:p:h")) != -1) {
+		switch (c) {
+		case 'm':
+			mib = g_ascii_strtoull (optarg, NULL, 10);
+			break;
+		case 'f':
+			bench.frame_size = (size_t)atoi (optarg);
+			break;
+		case 'd':
+			if (! g_strcmp0 (optarg, "in")) {
+				bench.input = true;
+			} else if (g_strcmp0 (optarg, "out")) {
+				shim_bench_usage (argv[0]);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'p':
+			bench.shim = optarg;
+			break;
+		case 'h':
+			shim_bench_usage (argv[0]);
+			return EXIT_SUCCESS;
+		default:
+			shim_bench_usage (argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (! mib || bench.frame_size <= SHIM_BENCH_HEADER_SIZE ||
+			bench.frame_size > SHIM_BENCH_MAX_FRAME_SIZE) {
+		shim_bench_usage (argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	if (bench.input) {
+		/* the frame size is the size of the writes to stdin */
+		bench.total = (size_t)mib * MIB;
+	} else {
+		/* whole frames only */
+		payload = bench.frame_size - SHIM_BENCH_HEADER_SIZE;
+		bench.total = (size_t)((mib * MIB + payload - 1) / payload) * payload;
+	}
+
+	if (socketpair (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, bench.ctl) ||
+			socketpair (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, bench.io) ||
+			pipe2 (bench.in, O_CLOEXEC) ||
+			pipe2 (bench.out, O_CLOEXEC)) {
+		fprintf (stderr, "failed to create fds: %s\n", strerror (errno));
+		return EXIT_FAILURE;
+	}
+
+	start = g_get_monotonic_time ();
+
+	bench.pid = shim_bench_spawn (&bench);
+	if (bench.pid == -1) {
+		fprintf (stderr, "failed to fork: %s\n", strerror (errno));
+		return EXIT_FAILURE;
+	}
+
+	close (bench.ctl[1]);
+	close (bench.io[1]);
+	close (bench.in[0]);
+	close (bench.out[1]);
+
+	/* In the output benchmark, stdin is closed right away */
+	if (! bench.input) {
+		close (bench.in[1]);
+		bench.in[1] = -1;
+	}
+
+	if (fcntl (bench.io[0], F_SETFL, O_NONBLOCK) == -1 ||
+			(bench.input &&
+			 fcntl (bench.in[1], F_SETFL, O_NONBLOCK) == -1)) {
+		fprintf (stderr, "failed to set O_NONBLOCK: %s\n", strerror (errno));
+		return EXIT_FAILURE;
+	}
+
+	ret = bench.input ? shim_bench_input (&bench) :
+		shim_bench_output (&bench);
+	if (! ret) {
+		return EXIT_FAILURE;
+	}
+
+	elapsed = g_get_monotonic_time () - start;
+
+	/* The counters go with the process once reaped */
+	if (waitid (P_PID, (id_t)bench.pid, &info, WEXITED | WNOWAIT) == -1 ||
+			! shim_bench_syscalls (bench.pid, &syscalls)) {
+		fprintf (stderr, "failed to get the shim system calls\n");
+	}
+
+	if (wait4 (bench.pid, &status, 0, &usage) != bench.pid ||
+			! WIFEXITED (status) || WEXITSTATUS (status)) {
+		fprintf (stderr, "shim failed\n");
+		return EXIT_FAILURE;
+	}
+
+	seconds = (double)elapsed / G_USEC_PER_SEC;
+	cpu = (double)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) +
+		(double)(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+	mibs = (double)bench.total / MIB;
+
+	printf ("direction,frame_size,mib,seconds,mib_per_s,"
+			"syscalls_per_mib,cpu_seconds,cpu_seconds_per_gib\n");
+	printf ("%s,%zu,%.1f,%.3f,%.1f,%.1f,%.3f,%.3f\n",
+			bench.input ? "in" : "out",
+			bench.frame_size, mibs, seconds, mibs / seconds,
+			(double)syscalls / mibs, cpu, cpu / (mibs / 1024));
+
+	close (bench.ctl[0]);
+	close (bench.io[0]);
+	close (bench.out[0]);
+
+	return EXIT_SUCCESS;
+}
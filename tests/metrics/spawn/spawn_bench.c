@@ -0,0 +1,389 @@
+/*
+ * This file is part of cc-oci-runtime.
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Microbenchmark comparing the latency of creating the runtime's
+ * children (hypervisor, shim and hooks) with fork(2)+exec and with
+ * cc_oci_spawn().
+ *
+ * Each child runs \c /bin/true with the same setup the runtime
+ * performs for that child type. Latency is measured from just before
+ * the child is created until the parent knows the exec succeeded
+ * (for the shim, until the child has stopped at exec and been
+ * detached; for hooks, until the hook has exited).
+ *
+ * Since fork(2) copies the parents page tables, its cost grows with
+ * the parents resident memory: use \c -m to emulate a larger runtime.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/ptrace.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <glib.h>
+
+#include "spawn.h"
+
+/** Program all children run. */
+#define SPAWN_BENCH_PROGRAM	"/bin/true"
+
+/** Default number of children to create per child type and method. */
+#define SPAWN_BENCH_DEFAULT_ITERATIONS	500
+
+/** Default size (in MiB) of the heap the parent touches. */
+#define SPAWN_BENCH_DEFAULT_HEAP_MB	64
+
+/** Types of child the runtime creates. */
+enum spawn_bench_child {
+	SPAWN_BENCH_HYPERVISOR = 0,
+	SPAWN_BENCH_SHIM,
+	SPAWN_BENCH_HOOK,
+
+	SPAWN_BENCH_CHILD_COUNT
+};
+
+static const gchar *spawn_bench_child_names[SPAWN_BENCH_CHILD_COUNT] = {
+	"hypervisor",
+	"shim",
+	"hook",
+};
+
+/** Resources a child inherits. */
+struct spawn_bench_fds {
+	/** Standard streams of the hypervisor (/dev/null). */
+	int null_fd;
+
+	/** Child end of the shim socket. */
+	int shim_fd;
+
+	/** Shim lock file. */
+	int flock_fd;
+};
+
+/** Sample hook state (the size of a typical state file). */
+static gchar spawn_bench_state[2048];
+
+static int
+spawn_bench_cmp (const void *a, const void *b)
+{
+	gint64 x = *(const gint64 *)a;
+	gint64 y = *(const gint64 *)b;
+
+	return (x > y) - (x < y);
+}
+
+/*!
+ * Setup a fork(2)ed child the way the runtime used to, then exec.
+ *
+ * \param child \ref spawn_bench_child.
+ * \param fds \ref spawn_bench_fds.
+ * \param stdin_fd Hook stdin.
+ * \param err_fd Write end of the error pipe.
+ */
+static void
+spawn_bench_fork_child (enum spawn_bench_child child,
+		const struct spawn_bench_fds *fds,
+		int stdin_fd, int err_fd)
+{
+	char *argv[] = { SPAWN_BENCH_PROGRAM, NULL };
+
+	switch (child) {
+	case SPAWN_BENCH_HYPERVISOR:
+		(void)setsid ();
+		(void)dup2 (fds->null_fd, STDOUT_FILENO);
+		(void)dup2 (fds->null_fd, STDERR_FILENO);
+		for (int fd = 3; fd < 256; fd++) {
+			if (fd != err_fd) {
+				(void)close (fd);
+			}
+		}
+		break;
+	case SPAWN_BENCH_SHIM:
+		(void)setsid ();
+		(void)fcntl (fds->shim_fd, F_SETFD, 0);
+		(void)fcntl (fds->flock_fd, F_SETFD, 0);
+		(void)flock (fds->flock_fd, LOCK_EX);
+		(void)ptrace (PTRACE_TRACEME, 0, NULL, 0);
+		break;
+	case SPAWN_BENCH_HOOK:
+		(void)dup2 (stdin_fd, STDIN_FILENO);
+		break;
+	default:
+		break;
+	}
+
+	execv (argv[0], argv);
+
+	(void)write (err_fd, "E", 1);
+	_exit (EXIT_FAILURE);
+}
+
+/*!
+ * Create a child with fork(2)+exec.
+ *
+ * \return Child pid, or \c -1 on error.
+ */
+static GPid
+spawn_bench_fork (enum spawn_bench_child child,
+		const struct spawn_bench_fds *fds, int stdin_fd)
+{
+	int      err_pipe[2];
+	GPid     pid;
+	char     c;
+
+	if (pipe2 (err_pipe, O_CLOEXEC) < 0) {
+		return -1;
+	}
+
+	pid = fork ();
+	if (pid == 0) {
+		close (err_pipe[0]);
+		spawn_bench_fork_child (child, fds, stdin_fd, err_pipe[1]);
+	}
+
+	close (err_pipe[1]);
+
+	/* blocks until the exec succeeds (pipe closed) or fails */
+	if (pid > 0 && read (err_pipe[0], &c, 1) > 0) {
+		(void)waitpid (pid, NULL, 0);
+		pid = -1;
+	}
+
+	close (err_pipe[0]);
+
+	return pid;
+}
+
+/*!
+ * Create a child with cc_oci_spawn().
+ *
+ * \return Child pid, or \c -1 on error.
+ */
+static GPid
+spawn_bench_spawn (enum spawn_bench_child child,
+		const struct spawn_bench_fds *fds, int stdin_fd)
+{
+	struct cc_oci_spawn  spawn;
+	gchar               *argv[] = { SPAWN_BENCH_PROGRAM, NULL };
+
+	cc_oci_spawn_init (&spawn);
+
+	spawn.path = argv[0];
+	spawn.argv = argv;
+
+	switch (child) {
+	case SPAWN_BENCH_HYPERVISOR:
+		spawn.setsid = true;
+		spawn.close_fds = true;
+		spawn.stdio[STDOUT_FILENO] = fds->null_fd;
+		spawn.stdio[STDERR_FILENO] = fds->null_fd;
+		break;
+	case SPAWN_BENCH_SHIM:
+		spawn.setsid = true;
+		(void)cc_oci_spawn_add_fd (&spawn, fds->shim_fd);
+		(void)cc_oci_spawn_add_fd (&spawn, fds->flock_fd);
+		spawn.flock_fd = fds->flock_fd;
+		spawn.traceme = true;
+		break;
+	case SPAWN_BENCH_HOOK:
+		spawn.stdio[STDIN_FILENO] = stdin_fd;
+		break;
+	default:
+		break;
+	}
+
+	return cc_oci_spawn (&spawn);
+}
+
+/*!
+ * Create one child and wait until the runtime would consider it
+ * started.
+ *
+ * \param child \ref spawn_bench_child.
+ * \param use_spawn \c true to use cc_oci_spawn(), else fork(2).
+ * \param fds \ref spawn_bench_fds.
+ *
+ * \return Latency in microseconds, or \c -1 on error.
+ */
+static gint64
+spawn_bench_run (enum spawn_bench_child child, gboolean use_spawn,
+		const struct spawn_bench_fds *fds)
+{
+	int      stdin_pipe[2] = { -1, -1 };
+	GPid     pid;
+	int      status = 0;
+	gint64   start;
+	gint64   end = -1;
+
+	start = g_get_monotonic_time ();
+
+	if (child == SPAWN_BENCH_HOOK) {
+		if (pipe2 (stdin_pipe, O_CLOEXEC) < 0) {
+			return -1;
+		}
+
+		if (write (stdin_pipe[1], spawn_bench_state,
+				sizeof (spawn_bench_state)) < 0) {
+			goto out;
+		}
+
+		close (stdin_pipe[1]);
+		stdin_pipe[1] = -1;
+	}
+
+	pid = use_spawn
+		? spawn_bench_spawn (child, fds, stdin_pipe[0])
+		: spawn_bench_fork (child, fds, stdin_pipe[0]);
+	if (pid < 0) {
+		goto out;
+	}
+
+	if (child == SPAWN_BENCH_SHIM) {
+		/* wait for the stop at exec, then let it run */
+		if (waitpid (pid, &status, 0) != pid || ! WIFSTOPPED (status)) {
+			goto out;
+		}
+
+		(void)ptrace (PTRACE_DETACH, pid, NULL, 0);
+		end = g_get_monotonic_time ();
+		(void)waitpid (pid, &status, 0);
+	} else if (child == SPAWN_BENCH_HOOK) {
+		(void)waitpid (pid, &status, 0);
+		end = g_get_monotonic_time ();
+	} else {
+		end = g_get_monotonic_time ();
+		(void)waitpid (pid, &status, 0);
+	}
+
+out:
+	if (stdin_pipe[0] != -1) close (stdin_pipe[0]);
+	if (stdin_pipe[1] != -1) close (stdin_pipe[1]);
+
+	return end < 0 ? -1 : end - start;
+}
+
+static void
+spawn_bench_usage (const char *name)
+{
+	printf ("Usage: %s [-n iterations] [-m heap-MiB]\n", name);
+	printf ("\n");
+	printf ("Compare fork+exec and clone(CLONE_VM|CLONE_VFORK) latency\n");
+	printf ("for the hypervisor, shim and hook children of the runtime.\n");
+	printf ("Results are printed as CSV (times in microseconds).\n");
+}
+
+int
+main (int argc, char *argv[])
+{
+	struct spawn_bench_fds  fds = { -1, -1, -1 };
+	int                     shim_socket[2] = { -1, -1 };
+	char                    flock_path[] = "/tmp/spawn_bench.XXXXXX";
+	guint                   iterations = SPAWN_BENCH_DEFAULT_ITERATIONS;
+	gsize                   heap_mb = SPAWN_BENCH_DEFAULT_HEAP_MB;
+	gchar                  *heap;
+	gint64                 *samples;
+	int                     c;
+
+	while ((c = getopt (argc, argv, "n:m:h")) != -1) {
+		switch (c) {
+		case 'n':
+			iterations = (guint)atoi (optarg);
+			break;
+		case 'm':
+			heap_mb = (gsize)atol (optarg);
+			break;
+		case 'h':
+			spawn_bench_usage (argv[0]);
+			return EXIT_SUCCESS;
+		default:
+			spawn_bench_usage (argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (! iterations) {
+		spawn_bench_usage (argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	/* Touch every page so that fork has to copy the page tables */
+	heap = g_malloc (MAX (heap_mb, 1) * 1024 * 1024);
+	memset (heap, 'x', MAX (heap_mb, 1) * 1024 * 1024);
+
+	memset (spawn_bench_state, '{', sizeof (spawn_bench_state));
+
+	fds.null_fd = open ("/dev/null", O_WRONLY|O_CLOEXEC);
+	fds.flock_fd = mkostemp (flock_path, O_CLOEXEC);
+	if (fds.null_fd < 0 || fds.flock_fd < 0 ||
+			socketpair (PF_UNIX, SOCK_STREAM|SOCK_CLOEXEC,
+				0, shim_socket) < 0) {
+		fprintf (stderr, "setup failed: %s\n", strerror (errno));
+		return EXIT_FAILURE;
+	}
+	fds.shim_fd = shim_socket[0];
+	(void)unlink (flock_path);
+
+	samples = g_new0 (gint64, iterations);
+
+	printf ("child,method,iterations,heap_mb,median_us,p99_us\n");
+
+	for (int child = 0; child < SPAWN_BENCH_CHILD_COUNT; child++) {
+		for (int use_spawn = 0; use_spawn <= 1; use_spawn++) {
+			for (guint i = 0; i < iterations; i++) {
+				samples[i] = spawn_bench_run (child,
+						use_spawn, &fds);
+				if (samples[i] < 0) {
+					fprintf (stderr, "%s: failed to run child\n",
+						spawn_bench_child_names[child]);
+					return EXIT_FAILURE;
+				}
+			}
+
+			qsort (samples, iterations, sizeof (gint64),
+					spawn_bench_cmp);
+
+			printf ("%s,%s,%u,%zu,%" G_GINT64_FORMAT ",%" G_GINT64_FORMAT "\n",
+					spawn_bench_child_names[child],
+					use_spawn ? "clone-vfork" : "fork",
+					iterations, heap_mb,
+					samples[iterations / 2],
+					samples[(iterations * 99) / 100]);
+		}
+	}
+
+	g_free (samples);
+	g_free (heap);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,101 @@
+#!/bin/bash
+
+#  This file is part of cc-oci-runtime.
+#
+#  Copyright (C) 2017 Intel Corporation
+#
+#  This program is free software; you can redistribute it and/or
+#  modify it under the terms of the GNU General Public License
+#  as published by the Free Software Foundation; either version 2
+#  of the License, or (at your option) any later version.
+#
+#  This program is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program; if not, write to the Free Software
+#  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#  Description of the test:
+#  This test compares the time taken to bring a container up by booting
+#  its VM ("create" + "start") against restoring the VM from a
+#  checkpoint image ("restore"). The time taken by "checkpoint" and the
+#  size of the image are also recorded.
+
+set -e
+
+[ $# -ne 2 ] && ( echo >&2 "Usage: $0 <bundle-path> <times to run>"; exit 1 )
+
+SCRIPT_PATH=$(dirname "$(readlink -f "$0")")
+source "${SCRIPT_PATH}/../../lib/test-common.bash"
+
+TEST_NAME="restore time"
+RUNTIME_BIN="${RUNTIME_BIN:-cc-oci-runtime}"
+BUNDLE="$1"
+TIMES="$2"
+COMPRESS="${COMPRESS:-}"
+IMAGE_PATH=$(mktemp -d)
+CONTAINER_ID="restore-time-$$"
+
+trap 'rm -rf "$IMAGE_PATH"' EXIT
+
+# Milliseconds elapsed since the time (in nanoseconds) given
+function elapsed(){
+	echo "scale=4; ($(date +%s%N)-$1)/1000000" | bc
+}
+
+function save_result(){
+	local name="$1"
+	local units="$2"
+	local value="$3"
+	local result_file=$(echo "${RESULT_DIR}/${TEST_NAME}-${name}" | sed 's| |-|g')
+
+	backup_old_file "$result_file"
+	write_csv_header "$result_file"
+	write_result_to_file "$TEST_NAME" "${name} units=${units}" \
+		"$value" "$result_file"
+}
+
+function destroy(){
+	"$RUNTIME_BIN" kill "$CONTAINER_ID" SIGKILL > /dev/null 2>&1 || true
+	"$RUNTIME_BIN" delete "$CONTAINER_ID" > /dev/null
+}
+
+echo "Executing test: ${TEST_NAME}"
+
+boot_total=0
+checkpoint_total=0
+restore_total=0
+
+for i in $(seq 1 "$TIMES"); do
+	start=$(date +%s%N)
+	"$RUNTIME_BIN" create --bundle "$BUNDLE" "$CONTAINER_ID" < /dev/null > /dev/null
+	"$RUNTIME_BIN" start "$CONTAINER_ID" < /dev/null > /dev/null
+	boot_total=$(echo "$boot_total + $(elapsed $start)" | bc)
+
+	start=$(date +%s%N)
+	"$RUNTIME_BIN" checkpoint --image-path "$IMAGE_PATH" $COMPRESS "$CONTAINER_ID" > /dev/null
+	checkpoint_total=$(echo "$checkpoint_total + $(elapsed $start)" | bc)
+
+	destroy
+
+	start=$(date +%s%N)
+	"$RUNTIME_BIN" restore --bundle "$BUNDLE" --image-path "$IMAGE_PATH" "$CONTAINER_ID" < /dev/null > /dev/null
+	restore_total=$(echo "$restore_total + $(elapsed $start)" | bc)
+
+	destroy
+done
+
+boot=$(echo "scale=4; $boot_total/$TIMES" | bc)
+checkpoint=$(echo "scale=4; $checkpoint_total/$TIMES" | bc)
+restore=$(echo "scale=4; $restore_total/$TIMES" | bc)
+image_size=$(du -k "$IMAGE_PATH" | awk '{print $1}')
+
+save_result "boot" "ms" "$boot"
+save_result "checkpoint" "ms" "$checkpoint"
+save_result "restore" "ms" "$restore"
+save_result "image size" "KiB" "$image_size"
+
+echo "boot ${boot}ms, checkpoint ${checkpoint}ms, restore ${restore}ms, image ${image_size}KiB"
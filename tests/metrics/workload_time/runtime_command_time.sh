@@ -0,0 +1,141 @@
+#!/bin/bash
+
+#  This file is part of cc-oci-runtime.
+#
+#  Copyright (C) 2017 Intel Corporation
+#
+#  This program is free software; you can redistribute it and/or
+#  modify it under the terms of the GNU General Public License
+#  as published by the Free Software Foundation; either version 2
+#  of the License, or (at your option) any later version.
+#
+#  This program is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program; if not, write to the Free Software
+#  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#  Description of the test:
+#  This test measures the latency and the CPU time of the runtime
+#  commands which can be served by the runtime daemon, both when each
+#  command runs in its own process and when it is forwarded to
+#  "cc-oci-runtime daemon". The CPU time includes the time the daemon
+#  spends handling the command.
+
+set -e
+
+[ $# -ne 1 ] && ( echo >&2 "Usage: $0 <times to run>"; exit 1 )
+
+SCRIPT_PATH=$(dirname "$(readlink -f "$0")")
+source "${SCRIPT_PATH}/../../lib/test-common.bash"
+
+TEST_NAME="runtime command time"
+IMAGE='busybox'
+CMD='sh'
+RUNTIME='cor'
+RUNTIME_BIN="${RUNTIME_BIN:-cc-oci-runtime}"
+TIMES="$1"
+CLK_TCK=$(getconf CLK_TCK)
+DAEMON_PID=""
+
+# CPU time (in clock ticks) used by the waited-for children of this shell
+function children_ticks(){
+	awk '{print $16 + $17}' /proc/$$/stat
+}
+
+# CPU time (in clock ticks) used by the daemon
+function daemon_ticks(){
+	if [ -n "$DAEMON_PID" ]; then
+		awk '{print $14 + $15}' /proc/${DAEMON_PID}/stat
+	else
+		echo 0
+	fi
+}
+
+function start_daemon(){
+	local socket="${DAEMON_SOCKET:-/run/cc-oci-runtime-daemon/daemon.sock}"
+
+	"$RUNTIME_BIN" daemon &
+	DAEMON_PID=$!
+
+	for i in $(seq 1 100); do
+		[ -S "$socket" ] && return
+		sleep 0.1
+	done
+
+	die "daemon did not create ${socket}"
+}
+
+function stop_daemon(){
+	kill "$DAEMON_PID"
+	wait "$DAEMON_PID" || true
+	DAEMON_PID=""
+}
+
+# Run a command TIMES times and record its average latency and CPU time
+# (in milliseconds).
+function measure(){
+	local mode="$1"
+	local name="$2"
+	shift 2
+	local result_file=$(echo "${RESULT_DIR}/${TEST_NAME}-${name}-${mode}" | sed 's| |-|g')
+	local start_ticks=$(( $(children_ticks) + $(daemon_ticks) ))
+	local start=$(date +%s%N)
+
+	for i in $(seq 1 "$TIMES"); do
+		"$@" > /dev/null
+	done
+
+	local end=$(date +%s%N)
+	local end_ticks=$(( $(children_ticks) + $(daemon_ticks) ))
+
+	local latency=$(echo "scale=4; ($end-$start)/1000000/$TIMES" | bc)
+	local cpu=$(echo "scale=4; ($end_ticks-$start_ticks)*1000/$CLK_TCK/$TIMES" | bc)
+
+	backup_old_file "$result_file-latency"
+	write_csv_header "$result_file-latency"
+	write_result_to_file "$TEST_NAME" "command=${name} mode=${mode} units=ms" \
+		"$latency" "$result_file-latency"
+
+	backup_old_file "$result_file-cpu"
+	write_csv_header "$result_file-cpu"
+	write_result_to_file "$TEST_NAME CPU" "command=${name} mode=${mode} units=ms" \
+		"$cpu" "$result_file-cpu"
+
+	echo "${name} (${mode}): latency ${latency}ms, cpu ${cpu}ms"
+}
+
+# A container can only be resumed once paused, so both are measured
+# together.
+function pause_resume(){
+	"$RUNTIME_BIN" pause "$1"
+	"$RUNTIME_BIN" resume "$1"
+}
+
+function measure_all(){
+	local mode="$1"
+
+	measure "$mode" state "$RUNTIME_BIN" state "$container_id"
+	measure "$mode" list "$RUNTIME_BIN" list
+	measure "$mode" kill "$RUNTIME_BIN" kill "$container_id" SIGCONT
+	measure "$mode" pause-resume pause_resume "$container_id"
+}
+
+echo "Executing test: ${TEST_NAME}"
+
+contname=$(random_name)
+$DOCKER_EXE run --name ${contname} -tid --runtime "$RUNTIME" "$IMAGE" "$CMD" > /dev/null
+container_id=$($DOCKER_EXE inspect --format '{{.Id}}' ${contname})
+
+export CC_OCI_NO_DAEMON=1
+measure_all local
+unset CC_OCI_NO_DAEMON
+
+start_daemon
+measure_all daemon
+stop_daemon
+
+$DOCKER_EXE rm -f ${contname} > /dev/null
@@ -21,6 +21,8 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 
@@ -39,17 +41,12 @@ gboolean cc_oci_cmd_is_shell (const char *cmd);
 gboolean cc_run_hook (struct oci_cfg_hook* hook,
 		const gchar* state,
 		gsize state_length);
-gboolean cc_oci_setup_shim (struct cc_oci_config *config,
-		int proxy_fd,
-		int proxy_io_fd,
-		int shim_flock_fd);
 GSocketConnection *cc_oci_socket_connection_from_fd (int fd);
-gboolean cc_oci_setup_child (struct cc_oci_config *config);
 gboolean cc_oci_vm_netcfg_get (struct cc_oci_config *config,
 		struct netlink_handle *hndl);
 gboolean
-cc_shim_launch (struct cc_oci_config *config, int *child_err_fd,
-		int *shim_args_fd, int *shim_socket_fd, gboolean initial_workload);
+cc_shim_launch (struct cc_oci_config *config, int *shim_args_fd,
+		gboolean initial_workload);
 
 
 START_TEST(test_cc_run_hook) {
@@ -165,49 +162,78 @@ START_TEST(test_cc_run_hook) {
 
 } END_TEST
 
-START_TEST(test_cc_oci_setup_shim) {
-	struct cc_oci_config config = { { 0 } };
-	char tmpf1[] = "/tmp/.tmpXXXXXX";
-	char tmpf2[] = "/tmp/.tmpXXXXXX";
-	char tmpf3[] = "/tmp/.tmpXXXXXX";
-	int tmpf1_fd = -1;
-	int tmpf2_fd = -1;
-	int flock_fd = -1;
-
-	ck_assert (! cc_oci_setup_shim (NULL, -1, -1, -1));
-
-	tmpf1_fd = g_mkstemp (tmpf1);
-	ck_assert (tmpf1_fd >= 0);
-
-	ck_assert (! cc_oci_setup_shim (NULL, tmpf1_fd, -1, -1));
-
-	tmpf2_fd = g_mkstemp (tmpf2);
-	ck_assert (tmpf2_fd >= 0);
-
-	ck_assert (! cc_oci_setup_shim (NULL, tmpf1_fd, tmpf2_fd, -1));
-
-	flock_fd = g_mkstemp (tmpf3);
-	ck_assert (flock_fd >= 0);
-
-	ck_assert (! cc_oci_setup_shim (NULL, tmpf1_fd, tmpf2_fd, flock_fd));
-
-	config.oci.process.terminal = false;
-	ck_assert (cc_oci_setup_shim (&config, tmpf1_fd, tmpf2_fd, flock_fd));
-
-	config.oci.process.terminal = true;
-	config.console = g_strdup("/dev/ptmx");
-	ck_assert (! cc_oci_setup_shim (&config, tmpf1_fd, tmpf2_fd, flock_fd));
-
-	g_free (config.console);
-
-	if (tmpf1_fd > -1) { close (tmpf1_fd); }
-	if (tmpf2_fd > -1) { close (tmpf2_fd); }
-	if (flock_fd > -1) { close (flock_fd); }
-
-	cc_oci_rm_rf (tmpf1);
-	cc_oci_rm_rf (tmpf2);
-	cc_oci_rm_rf (tmpf3);
+/* Receive the message sent by cc_shim_args_send() */
+static gboolean
+recv_shim_args (int fd, struct cc_shim_args *args, int fds[2])
+{
+	struct msghdr    msg = { 0 };
+	struct iovec     iov = { args, sizeof (*args) };
+	struct cmsghdr  *cmsg;
+	char             buf[CMSG_SPACE (sizeof (int) * 2)];
+
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = buf;
+	msg.msg_controllen = sizeof (buf);
+
+	if (recvmsg (fd, &msg, 0) != (ssize_t)sizeof (*args)) {
+		return false;
+	}
+
+	cmsg = CMSG_FIRSTHDR (&msg);
+	if (! (cmsg && cmsg->cmsg_type == SCM_RIGHTS &&
+			cmsg->cmsg_len == CMSG_LEN (sizeof (int) * 2))) {
+		return false;
+	}
+
+	memcpy (fds, CMSG_DATA (cmsg), sizeof (int) * 2);
+
+	return true;
+}
 
+START_TEST(test_cc_shim_args_send) {
+	int sockets[2] = { -1, -1 };
+	int pipe_fds[2] = { -1, -1 };
+	int fds[2] = { -1, -1 };
+	struct cc_shim_args args = { 0 };
+	char c;
+
+	ck_assert (socketpair (PF_UNIX, SOCK_STREAM, 0, sockets) == 0);
+	ck_assert (pipe (pipe_fds) == 0);
+
+	ck_assert (! cc_shim_args_send (-1, pipe_fds[0], pipe_fds[1], 1, false));
+	ck_assert (! cc_shim_args_send (sockets[0], -1, pipe_fds[1], 1, false));
+	ck_assert (! cc_shim_args_send (sockets[0], pipe_fds[0], -1, 1, false));
+	ck_assert (! cc_shim_args_send (sockets[0], pipe_fds[0], pipe_fds[1], 0, false));
+
+	/* no terminal: separate stderr stream */
+	ck_assert (cc_shim_args_send (sockets[0], pipe_fds[0], pipe_fds[1],
+				5, false));
+	ck_assert (recv_shim_args (sockets[1], &args, fds));
+	ck_assert (args.io_seq_no == 5);
+	ck_assert (args.err_seq_no == 6);
+	ck_assert (fds[0] != pipe_fds[0] && fds[1] != pipe_fds[1]);
+
+	/* the received fds refer to the pipe */
+	ck_assert (write (fds[1], "x", 1) == 1);
+	ck_assert (read (pipe_fds[0], &c, 1) == 1);
+
+	close (fds[0]);
+	close (fds[1]);
+
+	/* terminal: stderr goes to stdout */
+	ck_assert (cc_shim_args_send (sockets[0], pipe_fds[0], pipe_fds[1],
+				7, true));
+	ck_assert (recv_shim_args (sockets[1], &args, fds));
+	ck_assert (args.io_seq_no == 7);
+	ck_assert (args.err_seq_no == 0);
+
+	close (fds[0]);
+	close (fds[1]);
+	close (pipe_fds[0]);
+	close (pipe_fds[1]);
+	close (sockets[0]);
+	close (sockets[1]);
 } END_TEST
 
 START_TEST(test_socket_connection_from_fd) {
@@ -224,22 +250,12 @@ START_TEST(test_socket_connection_from_fd) {
 	close(sockets[1]);
 } END_TEST
 
-START_TEST(test_cc_oci_setup_child) {
-	struct cc_oci_config config = { { 0 } };
-	ck_assert (! cc_oci_setup_child (NULL));
-	ck_assert (cc_oci_setup_child (&config));
-
-	config.detached_mode = true;
-	ck_assert (cc_oci_setup_child (&config));
-} END_TEST
-
 Suite* make_process_suite(void) {
 	Suite* s = suite_create(__FILE__);
 
 	ADD_TEST(test_cc_run_hook, s);
-	ADD_TEST(test_cc_oci_setup_shim, s);
+	ADD_TEST(test_cc_shim_args_send, s);
 	ADD_TEST(test_socket_connection_from_fd, s);
-	ADD_TEST(test_cc_oci_setup_child, s);
 
 	return s;
 }
@@ -28,6 +28,7 @@
 #include "../src/oci.h"
 #include "../src/logging.h"
 #include "../src/proxy.h"
+#include "../src/oci-config.h"
 
 gboolean cc_proxy_connect (struct cc_proxy *proxy);
 gboolean cc_proxy_disconnect (struct cc_proxy *proxy);
@@ -56,11 +57,56 @@ START_TEST(test_cc_proxy_disconnect) {
 
 } END_TEST
 
+START_TEST(test_cc_proxy_cmd_create) {
+	struct cc_oci_config *config = NULL;
+	int proxy_io_fd = -1;
+	int ioBase = -1;
+
+	ck_assert (! cc_proxy_cmd_create (NULL, &proxy_io_fd, &ioBase));
+
+	config = cc_oci_config_create ();
+	ck_assert (config);
+
+	/* not connected */
+	ck_assert (! cc_proxy_cmd_create (config, &proxy_io_fd, &ioBase));
+
+	/* pretend to have a valid socket */
+	config->proxy->socket = (GSocket *)1;
+
+	ck_assert (! cc_proxy_cmd_create (config, NULL, &ioBase));
+	ck_assert (! cc_proxy_cmd_create (config, &proxy_io_fd, NULL));
+
+	/* no hostname to create the pod with */
+	ck_assert (! cc_proxy_cmd_create (config, &proxy_io_fd, &ioBase));
+
+	config->proxy->socket = NULL;
+	cc_oci_config_free (config);
+
+} END_TEST
+
+START_TEST(test_cc_proxy_cmd_register) {
+	struct cc_oci_config *config = NULL;
+
+	ck_assert (! cc_proxy_cmd_register (NULL));
+
+	config = cc_oci_config_create ();
+	ck_assert (config);
+
+	/* not connected */
+	ck_assert (! cc_proxy_cmd_register (config));
+	ck_assert (! config->proxy->registered);
+
+	cc_oci_config_free (config);
+
+} END_TEST
+
 Suite* make_proxy_suite(void) {
 	Suite* s = suite_create(__FILE__);
 
 	ADD_TEST (test_cc_proxy_connect, s);
 	ADD_TEST (test_cc_proxy_disconnect, s);
+	ADD_TEST (test_cc_proxy_cmd_create, s);
+	ADD_TEST (test_cc_proxy_cmd_register, s);
 
 	return s;
 }
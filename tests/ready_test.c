@@ -0,0 +1,179 @@
+/*
+ * This file is part of cc-oci-runtime.
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <check.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "test_common.h"
+#include "logging.h"
+#include "ready.h"
+
+/* Time (in microseconds) to wait before creating a path */
+#define READY_TEST_DELAY	(100 * 1000)
+
+/*!
+ * Create a listening socket, as the hypervisor does.
+ */
+static gpointer
+create_socket (gpointer data)
+{
+	const gchar         *path = data;
+	struct sockaddr_un   addr = { .sun_family = AF_UNIX };
+	int                  fd;
+
+	g_usleep (READY_TEST_DELAY);
+
+	g_strlcpy (addr.sun_path, path, sizeof (addr.sun_path));
+
+	fd = socket (AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		return NULL;
+	}
+
+	if (bind (fd, (struct sockaddr *)&addr, sizeof (addr)) < 0
+			|| listen (fd, 1) < 0) {
+		close (fd);
+		return NULL;
+	}
+
+	return GINT_TO_POINTER (fd);
+}
+
+/*!
+ * Create a file by renaming it into place.
+ */
+static gpointer
+rename_file (gpointer data)
+{
+	const gchar       *path = data;
+	g_autofree gchar  *tmp = g_strconcat (path, ".tmp", NULL);
+
+	g_usleep (READY_TEST_DELAY);
+
+	if (! g_file_set_contents (tmp, "", -1, NULL)) {
+		return GINT_TO_POINTER (false);
+	}
+
+	return GINT_TO_POINTER (g_rename (tmp, path) == 0);
+}
+
+START_TEST(test_cc_oci_wait_for_path) {
+	gchar    *tmpdir;
+	gchar    *path;
+	gchar    *invalid;
+	GThread  *thread;
+	gint64    start;
+	gint64    elapsed;
+	gint      fd;
+
+	tmpdir = g_dir_make_tmp (NULL, NULL);
+	ck_assert (tmpdir);
+
+	path = g_build_path ("/", tmpdir, "ctl.sock", NULL);
+	invalid = g_build_path ("/", tmpdir, "no-such-dir", "ctl.sock", NULL);
+
+	ck_assert (! cc_oci_wait_for_path (NULL, 0, NULL));
+	ck_assert (! cc_oci_wait_for_path (path, -1, NULL));
+
+	/* times out */
+	start = g_get_monotonic_time ();
+	ck_assert (! cc_oci_wait_for_path (path, 200, NULL));
+	elapsed = g_get_monotonic_time () - start;
+	ck_assert (elapsed >= 200 * 1000);
+	ck_assert (elapsed < 2 * G_USEC_PER_SEC);
+
+	/* times out when the directory cannot be watched */
+	start = g_get_monotonic_time ();
+	ck_assert (! cc_oci_wait_for_path (invalid, 200, NULL));
+	elapsed = g_get_monotonic_time () - start;
+	ck_assert (elapsed >= 200 * 1000);
+	ck_assert (elapsed < 2 * G_USEC_PER_SEC);
+
+	/* socket created whilst waiting */
+	thread = g_thread_new ("create-socket", create_socket, path);
+	ck_assert (thread);
+
+	start = g_get_monotonic_time ();
+	ck_assert (cc_oci_wait_for_path (path, 10000, "test-wait"));
+	elapsed = g_get_monotonic_time () - start;
+
+	fd = GPOINTER_TO_INT (g_thread_join (thread));
+	ck_assert (fd > 0);
+	close (fd);
+
+	/* woken by the creation rather than the timeout */
+	ck_assert (elapsed < 5 * G_USEC_PER_SEC);
+
+	/* path already exists */
+	ck_assert (cc_oci_wait_for_path (path, 10000, NULL));
+	ck_assert (! g_remove (path));
+
+	/* path renamed into place */
+	thread = g_thread_new ("rename-file", rename_file, path);
+	ck_assert (thread);
+
+	ck_assert (cc_oci_wait_for_path (path, 10000, NULL));
+	ck_assert (GPOINTER_TO_INT (g_thread_join (thread)));
+
+	ck_assert (! g_remove (path));
+	ck_assert (! g_remove (tmpdir));
+
+	g_free (invalid);
+	g_free (path);
+	g_free (tmpdir);
+} END_TEST
+
+Suite* make_ready_suite(void) {
+	Suite* s = suite_create(__FILE__);
+
+	ADD_TEST (test_cc_oci_wait_for_path, s);
+
+	return s;
+}
+
+int main (void) {
+	int number_failed;
+	Suite* s;
+	SRunner* sr;
+	struct cc_log_options options = { 0 };
+
+	options.enable_debug = true;
+	options.use_json = false;
+	options.filename = g_strdup ("ready_test_debug.log");
+	(void)cc_oci_log_init(&options);
+
+	s = make_ready_suite();
+	sr = srunner_create(s);
+
+	srunner_run_all(sr, CK_VERBOSE);
+	number_failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+
+	cc_oci_log_free (&options);
+
+	return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,255 @@
+/*
+ * This file is part of cc-oci-runtime.
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include <check.h>
+#include <glib.h>
+
+#include "test_common.h"
+
+/* Time (in milliseconds) to wait for the shim to forward data */
+#define SHIM_TEST_TIMEOUT	(10 * 1000)
+
+#define SHIM_TEST_IO_SEQ	1
+#define SHIM_TEST_FRAME_SIZE	1024
+#define SHIM_TEST_FRAMES	32
+#define SHIM_TEST_EXIT_CODE	3
+
+/* stream frames, as exchanged between the shim and the proxy */
+#define STREAM_HEADER_SIZE	12
+
+static void
+set_be32 (uint8_t *buf, uint32_t val)
+{
+	buf[0] = (uint8_t)(val >> 24);
+	buf[1] = (uint8_t)(val >> 16);
+	buf[2] = (uint8_t)(val >> 8);
+	buf[3] = (uint8_t)val;
+}
+
+static uint32_t
+get_be32 (const uint8_t *buf)
+{
+	return (uint32_t)buf[0] << 24 | (uint32_t)buf[1] << 16 |
+		(uint32_t)buf[2] << 8 | buf[3];
+}
+
+static void
+write_frame (int fd, uint64_t seq, const void *data, size_t len)
+{
+	uint8_t frame[STREAM_HEADER_SIZE + SHIM_TEST_FRAME_SIZE];
+
+	ck_assert (len <= SHIM_TEST_FRAME_SIZE);
+
+	set_be32 (frame, (uint32_t)(seq >> 32));
+	set_be32 (frame + 4, (uint32_t)seq);
+	set_be32 (frame + 8, (uint32_t)(STREAM_HEADER_SIZE + len));
+	memcpy (frame + STREAM_HEADER_SIZE, data, len);
+
+	ck_assert (write (fd, frame, STREAM_HEADER_SIZE + len) ==
+			(ssize_t)(STREAM_HEADER_SIZE + len));
+}
+
+/*!
+ * Read exactly len bytes from fd, failing if they don't come in time.
+ */
+static void
+read_full (int fd, void *buf, size_t len)
+{
+	struct pollfd  pfd = { .fd = fd, .events = POLLIN };
+	size_t         offset = 0;
+	ssize_t        ret;
+
+	while (offset < len) {
+		ck_assert (poll (&pfd, 1, SHIM_TEST_TIMEOUT) == 1);
+		ret = read (fd, (uint8_t *)buf + offset, len - offset);
+		ck_assert (ret > 0);
+		offset += (size_t)ret;
+	}
+}
+
+/*!
+ * Fill a pipe until writing to it would block, returning the number
+ * of bytes written.
+ */
+static size_t
+fill_pipe (int fd)
+{
+	char    buf[4096] = { 0 };
+	size_t  total = 0;
+	ssize_t ret;
+	int     flags;
+
+	flags = fcntl (fd, F_GETFL);
+	ck_assert (fcntl (fd, F_SETFL, flags | O_NONBLOCK) == 0);
+
+	while ((ret = write (fd, buf, sizeof (buf))) > 0) {
+		total += (size_t)ret;
+	}
+	ck_assert (errno == EAGAIN);
+
+	ck_assert (fcntl (fd, F_SETFL, flags) == 0);
+
+	return total;
+}
+
+/*
+ * While stdout can't be written to, the shim keeps forwarding stdin and
+ * signals to the proxy, and exits with the workload exit code once the
+ * output has been written out.
+ */
+START_TEST(test_shim_stdout_blocked) {
+	int      ctl[2], io[2], in[2], out[2];
+	pid_t    pid;
+	int      status;
+	size_t   prefilled;
+	size_t   expected, received = 0;
+	uint8_t  frame[SHIM_TEST_FRAME_SIZE] = { 0 };
+	uint8_t  buf[4096];
+	uint8_t  header[STREAM_HEADER_SIZE];
+	uint8_t  code = SHIM_TEST_EXIT_CODE;
+	uint32_t len;
+	char    *msg;
+	ssize_t  ret;
+	g_autofree gchar *expected_signal =
+		g_strdup_printf ("\"signal\":%d", SIGUSR1);
+
+	ck_assert (! socketpair (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, ctl));
+	ck_assert (! socketpair (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, io));
+	ck_assert (! pipe2 (in, O_CLOEXEC));
+	ck_assert (! pipe2 (out, O_CLOEXEC));
+
+	prefilled = fill_pipe (out[1]);
+
+	pid = fork ();
+	ck_assert (pid != -1);
+
+	if (! pid) {
+		g_autofree gchar *ctl_fd = g_strdup_printf ("%d", ctl[1]);
+		g_autofree gchar *io_fd = g_strdup_printf ("%d", io[1]);
+
+		if (dup2 (in[0], STDIN_FILENO) == -1 ||
+				dup2 (out[1], STDOUT_FILENO) == -1) {
+			_exit (EXIT_FAILURE);
+		}
+
+		/* the shim inherits its proxy fds */
+		fcntl (ctl[1], F_SETFD, 0);
+		fcntl (io[1], F_SETFD, 0);
+
+		execl (SHIM_PATH, SHIM_PATH, "-c", "shim-test",
+				"-p", ctl_fd, "-o", io_fd,
+				"-s", "1", "-e", "2", NULL);
+		_exit (EXIT_FAILURE);
+	}
+
+	close (ctl[1]);
+	close (io[1]);
+	close (in[0]);
+	close (out[1]);
+
+	/* More output than stdout can take, followed by the end of the
+	 * stream and the exit code
+	 */
+	for (int i = 0; i < SHIM_TEST_FRAMES; i++) {
+		memset (frame, 'a' + i % 26, sizeof (frame));
+		write_frame (io[0], SHIM_TEST_IO_SEQ, frame, sizeof (frame));
+	}
+	write_frame (io[0], SHIM_TEST_IO_SEQ, NULL, 0);
+	write_frame (io[0], SHIM_TEST_IO_SEQ, &code, 1);
+
+	/* stdin is still forwarded */
+	ck_assert (write (in[1], "hello", 5) == 5);
+
+	read_full (io[0], header, sizeof (header));
+	ck_assert (get_be32 (header) == 0);
+	ck_assert (get_be32 (header + 4) == SHIM_TEST_IO_SEQ);
+	ck_assert (get_be32 (header + 8) == STREAM_HEADER_SIZE + 5);
+	read_full (io[0], buf, 5);
+	ck_assert (! memcmp (buf, "hello", 5));
+
+	/* so are signals */
+	ck_assert (! kill (pid, SIGUSR1));
+
+	read_full (ctl[0], header, 8);
+	len = get_be32 (header);
+	ck_assert (len < sizeof (buf));
+	read_full (ctl[0], buf, len);
+	buf[len] = '\0';
+
+	msg = (char *)buf;
+	ck_assert (strstr (msg, "\"hyperName\":\"killcontainer\""));
+	ck_assert (strstr (msg, "\"container\":\"shim-test\""));
+	ck_assert (strstr (msg, expected_signal));
+
+	/* the shim waits for the output to be written out to exit */
+	ck_assert (waitpid (pid, &status, WNOHANG) == 0);
+
+	expected = prefilled + SHIM_TEST_FRAMES * SHIM_TEST_FRAME_SIZE;
+	while ((ret = read (out[0], buf, sizeof (buf))) > 0) {
+		received += (size_t)ret;
+	}
+	ck_assert (ret == 0);
+	ck_assert (received == expected);
+
+	ck_assert (waitpid (pid, &status, 0) == pid);
+	ck_assert (WIFEXITED (status));
+	ck_assert (WEXITSTATUS (status) == SHIM_TEST_EXIT_CODE);
+
+	close (ctl[0]);
+	close (io[0]);
+	close (in[1]);
+	close (out[0]);
+} END_TEST
+
+Suite* make_shim_suite(void) {
+	Suite* s = suite_create(__FILE__);
+
+	ADD_TEST_TIMEOUT (test_shim_stdout_blocked, s, 30);
+
+	return s;
+}
+
+int main (void) {
+	int number_failed;
+	Suite* s;
+	SRunner* sr;
+
+	s = make_shim_suite();
+	sr = srunner_create(s);
+
+	srunner_run_all(sr, CK_VERBOSE);
+	number_failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+
+	return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
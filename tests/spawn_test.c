@@ -0,0 +1,222 @@
+/*
+ * This file is part of cc-oci-runtime.
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/ptrace.h>
+
+#include <check.h>
+#include <glib.h>
+
+#include "test_common.h"
+#include "logging.h"
+#include "spawn.h"
+
+/* Spawn /bin/sh running \p cmd and return its exit status */
+static int
+spawn_shell (struct cc_oci_spawn *spawn, const gchar *cmd)
+{
+	gchar  *argv[] = { "sh", "-c", (gchar *)cmd, NULL };
+	GPid    pid;
+	int     status = -1;
+
+	spawn->path = "/bin/sh";
+	spawn->argv = argv;
+
+	pid = cc_oci_spawn (spawn);
+	if (pid < 0) {
+		return -1;
+	}
+
+	if (waitpid (pid, &status, 0) != pid) {
+		return -1;
+	}
+
+	return WIFEXITED (status) ? WEXITSTATUS (status) : -1;
+}
+
+START_TEST(test_cc_oci_spawn_add_fd) {
+	struct cc_oci_spawn spawn;
+	guint i;
+
+	cc_oci_spawn_init (&spawn);
+
+	ck_assert (spawn.stdio[0] == -1);
+	ck_assert (spawn.stdio[1] == -1);
+	ck_assert (spawn.stdio[2] == -1);
+	ck_assert (spawn.flock_fd == -1);
+	ck_assert (spawn.fds_len == 0);
+
+	ck_assert (! cc_oci_spawn_add_fd (NULL, 3));
+	ck_assert (! cc_oci_spawn_add_fd (&spawn, -1));
+	ck_assert (! cc_oci_spawn_add_fd (&spawn, STDERR_FILENO));
+
+	for (i = 0; i < CC_OCI_SPAWN_MAX_FDS; i++) {
+		ck_assert (cc_oci_spawn_add_fd (&spawn, (int)i+3));
+	}
+
+	ck_assert (! cc_oci_spawn_add_fd (&spawn, 100));
+	ck_assert (spawn.fds_len == CC_OCI_SPAWN_MAX_FDS);
+} END_TEST
+
+START_TEST(test_cc_oci_spawn) {
+	struct cc_oci_spawn spawn;
+	gchar *argv[] = { "/does/not/exist", NULL };
+	gchar *empty_env[] = { NULL };
+	gchar *env[] = { "CC_OCI_SPAWN_TEST=1", NULL };
+
+	ck_assert (cc_oci_spawn (NULL) < 0);
+
+	/* exec failure is reported to the parent */
+	cc_oci_spawn_init (&spawn);
+	spawn.path = argv[0];
+	spawn.argv = argv;
+	ck_assert (cc_oci_spawn (&spawn) < 0);
+
+	/* relative paths are rejected */
+	argv[0] = "sh";
+	spawn.path = argv[0];
+	ck_assert (cc_oci_spawn (&spawn) < 0);
+
+	cc_oci_spawn_init (&spawn);
+	ck_assert (spawn_shell (&spawn, "exit 3") == 3);
+
+	/* environment */
+	spawn.envp = empty_env;
+	ck_assert (spawn_shell (&spawn, "test -z \"$CC_OCI_SPAWN_TEST\"") == 0);
+	spawn.envp = env;
+	ck_assert (spawn_shell (&spawn, "test \"$CC_OCI_SPAWN_TEST\" = 1") == 0);
+
+	/* session */
+	cc_oci_spawn_init (&spawn);
+	spawn.setsid = true;
+	ck_assert (spawn_shell (&spawn,
+				"test \"$(ps -o sid= -p $$)\" -eq $$") == 0);
+} END_TEST
+
+START_TEST(test_cc_oci_spawn_fds) {
+	struct cc_oci_spawn spawn;
+	int pipe_fds[2] = { -1, -1 };
+	int keep_fd;
+	int close_fd;
+	gchar *cmd;
+	char buffer[8] = { 0 };
+
+	ck_assert (pipe2 (pipe_fds, O_CLOEXEC) == 0);
+	keep_fd = open ("/dev/null", O_RDONLY);
+	close_fd = open ("/dev/null", O_RDONLY);
+	ck_assert (keep_fd > 2 && close_fd > 2);
+
+	/* stdout redirected to the pipe */
+	cc_oci_spawn_init (&spawn);
+	spawn.stdio[STDOUT_FILENO] = pipe_fds[1];
+	ck_assert (spawn_shell (&spawn, "echo hello") == 0);
+	ck_assert (read (pipe_fds[0], buffer, sizeof (buffer)) == 6);
+	ck_assert (! g_strcmp0 (buffer, "hello\n"));
+
+	/* close-on-exec fds are not inherited */
+	cc_oci_spawn_init (&spawn);
+	cmd = g_strdup_printf ("test ! -e /proc/self/fd/%d", pipe_fds[0]);
+	ck_assert (spawn_shell (&spawn, cmd) == 0);
+	g_free (cmd);
+
+	/* other fds are only closed on request */
+	cmd = g_strdup_printf ("test -e /proc/self/fd/%d"
+			" && test -e /proc/self/fd/%d", keep_fd, close_fd);
+	ck_assert (spawn_shell (&spawn, cmd) == 0);
+	g_free (cmd);
+
+	spawn.close_fds = true;
+	ck_assert (cc_oci_spawn_add_fd (&spawn, keep_fd));
+	cmd = g_strdup_printf ("test -e /proc/self/fd/%d"
+			" && test ! -e /proc/self/fd/%d", keep_fd, close_fd);
+	ck_assert (spawn_shell (&spawn, cmd) == 0);
+	g_free (cmd);
+
+	close (pipe_fds[0]);
+	close (pipe_fds[1]);
+	close (keep_fd);
+	close (close_fd);
+} END_TEST
+
+START_TEST(test_cc_oci_spawn_traceme) {
+	struct cc_oci_spawn spawn;
+	gchar *argv[] = { "/bin/true", NULL };
+	GPid pid;
+	int status = 0;
+
+	cc_oci_spawn_init (&spawn);
+	spawn.path = argv[0];
+	spawn.argv = argv;
+	spawn.traceme = true;
+
+	pid = cc_oci_spawn (&spawn);
+	ck_assert (pid > 0);
+
+	/* child stops when it calls exec */
+	ck_assert (waitpid (pid, &status, 0) == pid);
+	ck_assert (WIFSTOPPED (status));
+	ck_assert (WSTOPSIG (status) == SIGTRAP);
+
+	ck_assert (ptrace (PTRACE_DETACH, pid, NULL, 0) == 0);
+	ck_assert (waitpid (pid, &status, 0) == pid);
+	ck_assert (WIFEXITED (status));
+	ck_assert (WEXITSTATUS (status) == 0);
+} END_TEST
+
+Suite* make_spawn_suite(void) {
+	Suite* s = suite_create(__FILE__);
+
+	ADD_TEST (test_cc_oci_spawn_add_fd, s);
+	ADD_TEST (test_cc_oci_spawn, s);
+	ADD_TEST (test_cc_oci_spawn_fds, s);
+	ADD_TEST (test_cc_oci_spawn_traceme, s);
+
+	return s;
+}
+
+int main (void) {
+	int number_failed;
+	Suite* s;
+	SRunner* sr;
+	struct cc_log_options options = { 0 };
+
+	options.enable_debug = true;
+	options.use_json = false;
+	options.filename = g_strdup ("spawn_test_debug.log");
+	(void)cc_oci_log_init(&options);
+
+	s = make_spawn_suite();
+	sr = srunner_create(s);
+
+	srunner_run_all(sr, CK_VERBOSE);
+	number_failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+
+	cc_oci_log_free (&options);
+
+	return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
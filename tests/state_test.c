@@ -143,6 +143,59 @@ START_TEST(test_cc_oci_state_file_read) {
 
 } END_TEST
 
+START_TEST(test_cc_oci_state_cache) {
+	struct oci_state  *state = NULL;
+	gchar             *tmpdir;
+	gchar             *path;
+	gchar             *contents;
+	gchar             *invalid;
+
+	cc_oci_state_cache_enable ();
+
+	tmpdir = g_dir_make_tmp (NULL, NULL);
+	ck_assert (tmpdir);
+
+	path = g_build_path ("/", tmpdir, "state.json", NULL);
+
+	ck_assert (g_file_get_contents (TEST_DATA_DIR "/state.json",
+				&contents, NULL, NULL));
+	ck_assert (g_file_get_contents (TEST_DATA_DIR "/state-no-id.json",
+				&invalid, NULL, NULL));
+
+	ck_assert (! cc_oci_state_file_read (path));
+
+	ck_assert (g_file_set_contents (path, contents, -1, NULL));
+
+	/* parsed, then from the cache */
+	for (int i = 0; i < 2; i++) {
+		state = cc_oci_state_file_read (path);
+		ck_assert (state);
+		ck_assert (state->id);
+		ck_assert (state->bundle_path);
+		cc_oci_state_free (state);
+	}
+
+	/* replaced */
+	ck_assert (g_file_set_contents (path, invalid, -1, NULL));
+	ck_assert (! cc_oci_state_file_read (path));
+
+	ck_assert (g_file_set_contents (path, contents, -1, NULL));
+	state = cc_oci_state_file_read (path);
+	ck_assert (state);
+	cc_oci_state_free (state);
+
+	/* removed */
+	ck_assert (! g_remove (path));
+	ck_assert (! cc_oci_state_file_read (path));
+
+	ck_assert (! g_remove (tmpdir));
+
+	g_free (contents);
+	g_free (invalid);
+	g_free (path);
+	g_free (tmpdir);
+} END_TEST
+
 START_TEST(test_cc_oci_state_free) {
 	struct oci_state *state = g_new0 (struct oci_state, 1);
 	ck_assert(state);
@@ -384,6 +437,7 @@ Suite* make_state_suite(void) {
 	Suite* s = suite_create(__FILE__);
 	ADD_TEST(test_cc_oci_state_file_get, s);
 	ADD_TEST(test_cc_oci_state_file_read, s);
+	ADD_TEST(test_cc_oci_state_cache, s);
 	ADD_TEST(test_cc_oci_state_free, s);
 	ADD_TEST(test_cc_oci_state_file_create, s);
 	ADD_TEST(test_cc_oci_state_file_delete, s);
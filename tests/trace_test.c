@@ -0,0 +1,169 @@
+/*
+ * This file is part of cc-oci-runtime.
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+#include <check.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <json-glib/json-glib.h>
+
+#include "test_common.h"
+#include "logging.h"
+#include "oci.h"
+#include "oci-config.h"
+#include "trace.h"
+
+START_TEST(test_cc_oci_trace_disabled) {
+	struct cc_oci_config *config;
+
+	ck_assert (! cc_oci_trace_enabled ());
+	ck_assert (cc_oci_trace_now () == 0);
+
+	config = cc_oci_config_create ();
+	ck_assert (config);
+
+	/* recording and writing are no-ops */
+	cc_oci_trace_end (CC_OCI_TRACE_PHASE, "foo", 0);
+	ck_assert (! cc_oci_trace_file_path (config));
+	ck_assert (cc_oci_trace_write (config));
+
+	cc_oci_config_free (config);
+} END_TEST
+
+START_TEST(test_cc_oci_trace_write) {
+	struct cc_oci_config *config;
+	gchar                *tmpdir;
+	gchar                *path;
+	gchar                *expected;
+	gint64                start;
+	JsonParser           *parser;
+	JsonObject           *obj;
+	JsonArray            *events;
+	JsonObject           *event;
+
+	tmpdir = g_dir_make_tmp (NULL, NULL);
+	ck_assert (tmpdir);
+
+	config = cc_oci_config_create ();
+	ck_assert (config);
+
+	cc_oci_trace_init ("create");
+	ck_assert (cc_oci_trace_enabled ());
+
+	/* no runtime path */
+	ck_assert (! cc_oci_trace_file_path (config));
+	ck_assert (cc_oci_trace_write (config));
+
+	g_snprintf (config->state.runtime_path,
+			sizeof (config->state.runtime_path),
+			"%s/container", tmpdir);
+
+	start = cc_oci_trace_now ();
+	ck_assert (start > 0);
+
+	/* invalid */
+	cc_oci_trace_add (NULL, "foo", start, start);
+	cc_oci_trace_add (CC_OCI_TRACE_PHASE, NULL, start, start);
+	cc_oci_trace_add (CC_OCI_TRACE_PHASE, "foo", 0, start);
+
+	cc_oci_trace_add (CC_OCI_TRACE_LAUNCH, "fork", start, start + 10);
+	cc_oci_trace_end (CC_OCI_TRACE_PROXY, "hello", start);
+
+	path = cc_oci_trace_file_path (config);
+	ck_assert (path);
+
+	expected = g_strdup_printf ("%s/container.create.%d.trace.json",
+			tmpdir, (int)getpid ());
+	ck_assert_str_eq (path, expected);
+
+	ck_assert (cc_oci_trace_write (config));
+	ck_assert (g_file_test (path, G_FILE_TEST_EXISTS));
+
+	parser = json_parser_new ();
+	ck_assert (json_parser_load_from_file (parser, path, NULL));
+
+	obj = json_node_get_object (json_parser_get_root (parser));
+	ck_assert (obj);
+
+	events = json_object_get_array_member (obj, "traceEvents");
+	ck_assert (events);
+	ck_assert (json_array_get_length (events) == 2);
+
+	event = json_array_get_object_element (events, 0);
+	ck_assert_str_eq (json_object_get_string_member (event, "name"),
+			"fork");
+	ck_assert_str_eq (json_object_get_string_member (event, "cat"),
+			CC_OCI_TRACE_LAUNCH);
+	ck_assert_str_eq (json_object_get_string_member (event, "ph"), "X");
+	ck_assert (json_object_get_int_member (event, "ts") == start);
+	ck_assert (json_object_get_int_member (event, "dur") == 10);
+
+	event = json_array_get_object_element (events, 1);
+	ck_assert_str_eq (json_object_get_string_member (event, "name"),
+			"hello");
+	ck_assert (json_object_get_int_member (event, "dur") >= 0);
+
+	/* clean up */
+	cc_oci_trace_free ();
+	ck_assert (! cc_oci_trace_enabled ());
+
+	g_object_unref (parser);
+	ck_assert (! g_remove (path));
+	ck_assert (! g_remove (tmpdir));
+	g_free (expected);
+	g_free (path);
+	g_free (tmpdir);
+	cc_oci_config_free (config);
+} END_TEST
+
+Suite* make_trace_suite(void) {
+	Suite* s = suite_create(__FILE__);
+
+	ADD_TEST (test_cc_oci_trace_disabled, s);
+	ADD_TEST (test_cc_oci_trace_write, s);
+
+	return s;
+}
+
+int main (void) {
+	int number_failed;
+	Suite* s;
+	SRunner* sr;
+	struct cc_log_options options = { 0 };
+
+	options.enable_debug = true;
+	options.use_json = false;
+	options.filename = g_strdup ("trace_test_debug.log");
+	(void)cc_oci_log_init(&options);
+
+	s = make_trace_suite();
+	sr = srunner_create(s);
+
+	srunner_run_all(sr, CK_VERBOSE);
+	number_failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+
+	cc_oci_log_free (&options);
+
+	return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,155 @@
+/*
+ * This file is part of cc-oci-runtime.
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+#include <check.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "test_common.h"
+#include "logging.h"
+#include "oci.h"
+#include "oci-config.h"
+#include "vmpool.h"
+
+extern gchar *vm_pool_dir;
+
+gchar *cc_oci_vm_pool_key_dir (const struct cc_oci_config *config);
+
+START_TEST(test_cc_oci_vm_pool_key_dir) {
+	struct cc_oci_config *config;
+
+	ck_assert (! cc_oci_vm_pool_key_dir (NULL));
+
+	config = cc_oci_config_create ();
+	ck_assert (config);
+
+	/* no VM configuration */
+	ck_assert (! cc_oci_vm_pool_key_dir (config));
+
+	cc_oci_config_free (config);
+} END_TEST
+
+START_TEST(test_cc_oci_vm_pool_claim) {
+	struct cc_oci_config *config;
+	gboolean              claimed = true;
+	gchar                *tmpdir;
+	gchar                *dir;
+	gchar                *saved = vm_pool_dir;
+
+	ck_assert (! cc_oci_vm_pool_claim (NULL, NULL));
+
+	config = cc_oci_config_create ();
+	ck_assert (config);
+
+	/* no VM configuration */
+	ck_assert (! cc_oci_vm_pool_claim (config, &claimed));
+
+	config->vm = g_malloc0 (sizeof (struct cc_oci_vm_cfg));
+	ck_assert (config->vm);
+
+	ck_assert (! cc_oci_vm_pool_claim (config, NULL));
+
+	tmpdir = g_dir_make_tmp (NULL, NULL);
+	ck_assert (tmpdir);
+
+	/* pooling is disabled when the pool directory does not exist */
+	dir = g_build_path ("/", tmpdir, "pool", NULL);
+	vm_pool_dir = dir;
+
+	ck_assert (cc_oci_vm_pool_claim (config, &claimed));
+	ck_assert (! claimed);
+
+	/* pods are never given a pooled VM */
+	ck_assert (! g_mkdir (dir, 0750));
+	config->pod = g_malloc0 (sizeof (struct cc_pod));
+	ck_assert (config->pod);
+
+	claimed = true;
+	ck_assert (cc_oci_vm_pool_claim (config, &claimed));
+	ck_assert (! claimed);
+
+	/* clean up */
+	vm_pool_dir = saved;
+	ck_assert (! g_rmdir (dir));
+	ck_assert (! g_remove (tmpdir));
+	g_free (dir);
+	g_free (tmpdir);
+	cc_oci_config_free (config);
+} END_TEST
+
+START_TEST(test_cc_oci_vm_pool_release) {
+	struct cc_oci_config *config;
+	gchar                *tmpdir;
+
+	ck_assert (! cc_oci_vm_pool_release (NULL));
+
+	config = cc_oci_config_create ();
+	ck_assert (config);
+
+	tmpdir = g_dir_make_tmp (NULL, NULL);
+	ck_assert (tmpdir);
+
+	/* container did not use a pooled VM */
+	g_strlcpy (config->state.runtime_path, tmpdir,
+			sizeof (config->state.runtime_path));
+	ck_assert (cc_oci_vm_pool_release (config));
+
+	/* clean up */
+	ck_assert (! g_remove (tmpdir));
+	g_free (tmpdir);
+	cc_oci_config_free (config);
+} END_TEST
+
+Suite* make_vmpool_suite(void) {
+	Suite* s = suite_create(__FILE__);
+
+	ADD_TEST (test_cc_oci_vm_pool_key_dir, s);
+	ADD_TEST (test_cc_oci_vm_pool_claim, s);
+	ADD_TEST (test_cc_oci_vm_pool_release, s);
+
+	return s;
+}
+
+int main (void) {
+	int number_failed;
+	Suite* s;
+	SRunner* sr;
+	struct cc_log_options options = { 0 };
+
+	options.enable_debug = true;
+	options.use_json = false;
+	options.filename = g_strdup ("vmpool_test_debug.log");
+	(void)cc_oci_log_init(&options);
+
+	s = make_vmpool_suite();
+	sr = srunner_create(s);
+
+	srunner_run_all(sr, CK_VERBOSE);
+	number_failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+
+	cc_oci_log_free (&options);
+
+	return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,289 @@
+/*
+ * This file is part of cc-oci-runtime.
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+#include <check.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "test_common.h"
+#include "logging.h"
+#include "oci.h"
+#include "oci-config.h"
+#include "vmtemplate.h"
+
+gchar *cc_oci_vm_template_mem_size (const gchar *value);
+gchar *cc_oci_vm_template_backend_update (const gchar *arg,
+		const gchar *from, const gchar *to, const gchar *share);
+gboolean cc_oci_vm_template_ready (const gchar *dir);
+
+START_TEST(test_cc_oci_vm_template_handle_annotation) {
+	struct cc_oci_config       *config;
+	struct oci_cfg_annotation   a = { 0 };
+
+	config = cc_oci_config_create ();
+	ck_assert (config);
+
+	ck_assert (! cc_oci_vm_template_handle_annotation (NULL, NULL));
+	ck_assert (! cc_oci_vm_template_handle_annotation (config, NULL));
+	ck_assert (! cc_oci_vm_template_handle_annotation (config, &a));
+
+	a.key = "foo";
+	a.value = "true";
+	ck_assert (! cc_oci_vm_template_handle_annotation (config, &a));
+	ck_assert (! config->vm_template_wanted);
+
+	a.key = CC_OCI_VM_TEMPLATE_ANNOTATION;
+	ck_assert (cc_oci_vm_template_handle_annotation (config, &a));
+	ck_assert (config->vm_template_wanted);
+
+	a.value = "false";
+	ck_assert (cc_oci_vm_template_handle_annotation (config, &a));
+	ck_assert (! config->vm_template_wanted);
+
+	a.value = NULL;
+	ck_assert (cc_oci_vm_template_handle_annotation (config, &a));
+	ck_assert (! config->vm_template_wanted);
+
+	cc_oci_config_free (config);
+} END_TEST
+
+START_TEST(test_cc_oci_vm_template_mem_size) {
+	gchar *size;
+
+	ck_assert (! cc_oci_vm_template_mem_size (NULL));
+	ck_assert (! cc_oci_vm_template_mem_size (""));
+	ck_assert (! cc_oci_vm_template_mem_size ("size="));
+
+	size = cc_oci_vm_template_mem_size ("2G,slots=2,maxmem=3G");
+	ck_assert (! g_strcmp0 (size, "2G"));
+	g_free (size);
+
+	size = cc_oci_vm_template_mem_size ("size=512M");
+	ck_assert (! g_strcmp0 (size, "512M"));
+	g_free (size);
+
+	/* "-m" defaults to MiB */
+	size = cc_oci_vm_template_mem_size ("1024");
+	ck_assert (! g_strcmp0 (size, "1024M"));
+	g_free (size);
+} END_TEST
+
+START_TEST(test_cc_oci_vm_template_backend_update) {
+	gchar *arg;
+
+	ck_assert (! cc_oci_vm_template_backend_update (NULL, NULL,
+				NULL, NULL));
+
+	/* not a file backend */
+	ck_assert (! cc_oci_vm_template_backend_update
+			("memory-backend-ram,id=mem0,size=1G",
+			 "/image", "/t/image", "on"));
+
+	/* backend for another file */
+	ck_assert (! cc_oci_vm_template_backend_update
+			("memory-backend-file,id=mem0,mem-path=/other",
+			 "/image", "/t/image", "on"));
+
+	/* only a complete option matches */
+	ck_assert (! cc_oci_vm_template_backend_update
+			("memory-backend-file,id=mem0,mem-path=/image.old",
+			 "/image", "/t/image", "on"));
+
+	arg = cc_oci_vm_template_backend_update
+		("memory-backend-file,id=mem0,mem-path=/image,size=42",
+		 "/image", "/t/image", "on");
+	ck_assert (! g_strcmp0 (arg, "memory-backend-file,id=mem0,"
+				"mem-path=/t/image,size=42,share=on"));
+	g_free (arg);
+
+	/* an existing share property is replaced */
+	arg = cc_oci_vm_template_backend_update
+		("memory-backend-file,share=on,id=mem0,mem-path=/image",
+		 "/image", "/t/image", "off");
+	ck_assert (! g_strcmp0 (arg, "memory-backend-file,id=mem0,"
+				"mem-path=/t/image,share=off"));
+	g_free (arg);
+} END_TEST
+
+START_TEST(test_cc_oci_vm_template_args) {
+	struct cc_oci_config  *config;
+	gchar                **args;
+	gchar                 *expected;
+
+	config = cc_oci_config_create ();
+	ck_assert (config);
+
+	config->vm = g_malloc0 (sizeof (struct cc_oci_vm_cfg));
+	ck_assert (config->vm);
+	g_strlcpy (config->vm->image_path, "/image",
+			sizeof (config->vm->image_path));
+
+	args = g_new0 (gchar *, 8);
+	args[0] = g_strdup ("qemu");
+	args[1] = g_strdup ("-object");
+	args[2] = g_strdup ("memory-backend-file,id=mem0,"
+			"mem-path=/image,size=42");
+	args[3] = g_strdup ("-m");
+	args[4] = g_strdup ("2G,slots=2,maxmem=3G");
+
+	ck_assert (! cc_oci_vm_template_args (NULL, NULL));
+
+	/* no template */
+	ck_assert (! cc_oci_vm_template_args (config, &args));
+
+	config->vm_template = g_strdup ("/t");
+
+	ck_assert (! cc_oci_vm_template_args (config, NULL));
+
+	/* clone */
+	ck_assert (cc_oci_vm_template_args (config, &args));
+	ck_assert (g_strv_length (args) == 9);
+	ck_assert (! g_strcmp0 (args[0], "qemu"));
+	ck_assert (! g_strcmp0 (args[2], "memory-backend-file,id=mem0,"
+				"mem-path=/t/image,size=42,share=off"));
+	ck_assert (! g_strcmp0 (args[4], "2G,slots=2,maxmem=3G"));
+	ck_assert (! g_strcmp0 (args[5], "-object"));
+
+	expected = g_strdup ("memory-backend-file,id=template-ram,"
+			"mem-path=/t/memory,size=2G,share=off");
+	ck_assert (! g_strcmp0 (args[6], expected));
+	g_free (expected);
+
+	ck_assert (! g_strcmp0 (args[7], "-numa"));
+	ck_assert (! g_strcmp0 (args[8], "node,memdev=template-ram"));
+	g_strfreev (args);
+
+	/* template VM, which must have a memory size */
+	config->vm_template_save = true;
+
+	args = g_new0 (gchar *, 4);
+	args[0] = g_strdup ("qemu");
+	args[1] = g_strdup ("-object");
+	args[2] = g_strdup ("memory-backend-file,id=mem0,mem-path=/image");
+
+	ck_assert (! cc_oci_vm_template_args (config, &args));
+
+	/* the args are left untouched on failure */
+	ck_assert (! g_strcmp0 (args[2],
+				"memory-backend-file,id=mem0,mem-path=/image"));
+	g_strfreev (args);
+
+	cc_oci_config_free (config);
+} END_TEST
+
+START_TEST(test_cc_oci_vm_template_ready) {
+	gchar *tmpdir;
+	gchar *path;
+
+	ck_assert (! cc_oci_vm_template_ready (NULL));
+
+	tmpdir = g_dir_make_tmp (NULL, NULL);
+	ck_assert (tmpdir);
+
+	ck_assert (! cc_oci_vm_template_ready (tmpdir));
+
+	/* a template is only usable once all its files exist */
+	path = g_build_path ("/", tmpdir, "vm.state", NULL);
+	ck_assert (g_file_set_contents (path, "", -1, NULL));
+	ck_assert (! cc_oci_vm_template_ready (tmpdir));
+	g_free (path);
+
+	path = g_build_path ("/", tmpdir, "memory", NULL);
+	ck_assert (g_file_set_contents (path, "", -1, NULL));
+	ck_assert (! cc_oci_vm_template_ready (tmpdir));
+	g_free (path);
+
+	path = g_build_path ("/", tmpdir, "image", NULL);
+	ck_assert (g_file_set_contents (path, "", -1, NULL));
+	ck_assert (cc_oci_vm_template_ready (tmpdir));
+	g_free (path);
+
+	/* clean up */
+	ck_assert (cc_oci_rm_rf (tmpdir));
+	g_free (tmpdir);
+} END_TEST
+
+START_TEST(test_cc_oci_vm_template_get) {
+	struct cc_oci_config *config;
+
+	ck_assert (! cc_oci_vm_template_get (NULL));
+
+	config = cc_oci_config_create ();
+	ck_assert (config);
+
+	/* no VM configuration */
+	ck_assert (! cc_oci_vm_template_get (config));
+
+	config->vm = g_malloc0 (sizeof (struct cc_oci_vm_cfg));
+	ck_assert (config->vm);
+
+	/* not requested by the bundle */
+	ck_assert (cc_oci_vm_template_get (config));
+	ck_assert (! config->vm_template);
+
+	/* pods always boot their VM */
+	config->vm_template_wanted = true;
+	config->pod = g_malloc0 (sizeof (struct cc_pod));
+	ck_assert (config->pod);
+
+	ck_assert (cc_oci_vm_template_get (config));
+	ck_assert (! config->vm_template);
+
+	cc_oci_config_free (config);
+} END_TEST
+
+Suite* make_vmtemplate_suite(void) {
+	Suite* s = suite_create(__FILE__);
+
+	ADD_TEST (test_cc_oci_vm_template_handle_annotation, s);
+	ADD_TEST (test_cc_oci_vm_template_mem_size, s);
+	ADD_TEST (test_cc_oci_vm_template_backend_update, s);
+	ADD_TEST (test_cc_oci_vm_template_args, s);
+	ADD_TEST (test_cc_oci_vm_template_ready, s);
+	ADD_TEST (test_cc_oci_vm_template_get, s);
+
+	return s;
+}
+
+int main (void) {
+	int number_failed;
+	Suite* s;
+	SRunner* sr;
+	struct cc_log_options options = { 0 };
+
+	options.enable_debug = true;
+	options.use_json = false;
+	options.filename = g_strdup ("vmtemplate_test_debug.log");
+	(void)cc_oci_log_init(&options);
+
+	s = make_vmtemplate_suite();
+	sr = srunner_create(s);
+
+	srunner_run_all(sr, CK_VERBOSE);
+	number_failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+
+	cc_oci_log_free (&options);
+
+	return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}